@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "wfs.h"
+#include "bitmap.h"
+
+/*
+  Compares the bit-at-a-time scan wfs used to allocate blocks with the
+  word/summary allocator in bitmap.c.
+
+  usage: alloc-bench [image size in MB] [percent full] [allocations] [percent holes]
+
+  The bitmap is filled front to back up to the requested percentage, the way
+  a filesystem fills up, and then a random share of the used blocks (10% by
+  default) is freed to leave holes. Both allocators then hand out the same
+  number of blocks from identical copies of it.
+*/
+
+// The allocation loop wfs used before bitmap.c
+static long scan_alloc(char *data_bitmap, size_t num_data_blocks) {
+    for (int i = 0; i < num_data_blocks; i++) {
+        if (!(data_bitmap[i / 8] & (1 << (i % 8)))) {
+            data_bitmap[i / 8] |= (1 << (i % 8));
+            return i;
+        }
+    }
+    return -1;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+    size_t image_mb = argc > 1 ? atol(argv[1]) : 4096;
+    int percent = argc > 2 ? atoi(argv[2]) : 90;
+    size_t allocs = argc > 3 ? atol(argv[3]) : 2000;
+    int holes = argc > 4 ? atoi(argv[4]) : 10;
+
+    size_t nbits = image_mb * 1024 * 1024 / DEFAULT_BLOCK_SIZE;
+    size_t nbytes = nbits / 8;
+    size_t used = nbits / 100 * percent;
+    if (allocs > nbits - used) {
+        allocs = nbits - used;
+    }
+
+    unsigned char *reference = calloc(nbytes, 1);
+    unsigned char *old_bits = malloc(nbytes);
+    unsigned char *new_bits = malloc(nbytes);
+    if (!reference || !old_bits || !new_bits) {
+        printf("Failed to allocate %zu byte bitmaps\n", nbytes);
+        return FAIL;
+    }
+
+    memset(reference, 0xff, used / 8);
+    srand(1);
+    for (size_t i = 0; i < used / 100 * holes; i++) {
+        size_t bit = (size_t)rand() % used;
+        reference[bit / 8] &= ~(1 << (bit % 8));
+    }
+    memcpy(old_bits, reference, nbytes);
+    memcpy(new_bits, reference, nbytes);
+
+    double start = now_ns();
+    for (size_t i = 0; i < allocs; i++) {
+        if (scan_alloc((char *)old_bits, nbits) < 0) {
+            break;
+        }
+    }
+    double scan_ns = (now_ns() - start) / allocs;
+
+    struct bitmap bm;
+    start = now_ns();
+    if (bitmap_init(&bm, new_bits, nbits, BITMAP_NEXT_FIT) != SUCCESS) {
+        printf("Failed to build the bitmap summary\n");
+        return FAIL;
+    }
+    double init_ms = (now_ns() - start) / 1e6;
+
+    start = now_ns();
+    for (size_t i = 0; i < allocs; i++) {
+        if (bitmap_alloc(&bm) < 0) {
+            break;
+        }
+    }
+    double word_ns = (now_ns() - start) / allocs;
+
+    printf("image %zu MB, %zu blocks, %d%% full, %d%% holes, %zu allocations\n", image_mb, nbits, percent, holes, allocs);
+    printf("%-14s %12.1f ns/alloc\n", "bit scan", scan_ns);
+    printf("%-14s %12.1f ns/alloc (summary built in %.1f ms)\n", "word/summary", word_ns, init_ms);
+    printf("speedup        %12.1fx\n", scan_ns / word_ns);
+
+    bitmap_destroy(&bm);
+    free(reference);
+    free(old_bits);
+    free(new_bits);
+    return SUCCESS;
+}
@@ -0,0 +1,166 @@
+#include <endian.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wfs.h"
+#include "bitmap.h"
+
+// Reads word w of the bitmap. Bits past nbits and held bits read as used.
+static uint64_t load_word(const struct bitmap *bm, size_t w) {
+    uint64_t word = 0;
+    size_t offset = w * sizeof(uint64_t);
+    size_t nbytes = (bm->nbits + 7) / 8;
+    size_t len = MIN(nbytes - offset, sizeof(uint64_t));
+
+    memcpy(&word, bm->bits + offset, len);
+    word = le64toh(word);
+    if (bm->held) {
+        uint64_t held;
+        memcpy(&held, bm->held + offset, sizeof(held));
+        word |= le64toh(held);
+    }
+
+    size_t valid = bm->nbits - w * 64;
+    if (valid < 64) {
+        word |= ~0ull << valid;
+    }
+    return word;
+}
+
+int bitmap_init(struct bitmap *bm, void *bits, size_t nbits, int policy) {
+    memset(bm, 0, sizeof(struct bitmap));
+    bm->bits = bits;
+    bm->policy = policy;
+    bm->nbits = nbits;
+    bm->nwords = (nbits + 63) / 64;
+    bm->nchunks = (bm->nwords + BITMAP_CHUNK_WORDS - 1) / BITMAP_CHUNK_WORDS;
+
+    bm->chunk_free = calloc(bm->nchunks ? bm->nchunks : 1, sizeof(uint32_t));
+    if (!bm->chunk_free) {
+        return FAIL;
+    }
+
+    for (size_t w = 0; w < bm->nwords; w++) {
+        int free_bits = 64 - __builtin_popcountll(load_word(bm, w));
+        bm->chunk_free[w / BITMAP_CHUNK_WORDS] += free_bits;
+        bm->nfree += free_bits;
+    }
+    return SUCCESS;
+}
+
+void bitmap_destroy(struct bitmap *bm) {
+    free(bm->chunk_free);
+    free(bm->held);
+    memset(bm, 0, sizeof(struct bitmap));
+}
+
+// Whether bitmap_alloc may not hand out bit
+static int taken(const struct bitmap *bm, size_t bit) {
+    return bitmap_test(bm, bit) || (bm->held && (bm->held[bit / 8] >> (bit % 8)) & 1);
+}
+
+// Marks a free bit as used and updates the summary
+static void take_bit(struct bitmap *bm, size_t bit) {
+    bm->bits[bit / 8] |= 1 << (bit % 8);
+    bm->chunk_free[bit / 64 / BITMAP_CHUNK_WORDS]--;
+    bm->nfree--;
+}
+
+long bitmap_alloc(struct bitmap *bm) {
+    if (bm->nfree == 0) {
+        return -1;
+    }
+
+    // Every word is looked at most once, wrapping around to word 0 at the end
+    size_t w = bm->cursor;
+    size_t scanned = 0;
+    while (scanned < bm->nwords) {
+        size_t chunk = w / BITMAP_CHUNK_WORDS;
+
+        if (bm->chunk_free[chunk] == 0) {
+            size_t next = (chunk + 1) * BITMAP_CHUNK_WORDS;
+            scanned += next - w;
+            w = next < bm->nwords ? next : 0;
+            continue;
+        }
+
+        uint64_t word = load_word(bm, w);
+        if (~word != 0) {
+            size_t bit = w * 64 + __builtin_ctzll(~word);
+            take_bit(bm, bit);
+            bm->cursor = w;
+            return bit;
+        }
+
+        scanned++;
+        w = w + 1 < bm->nwords ? w + 1 : 0;
+    }
+
+    // nfree says otherwise, only reachable if the bitmap was changed behind our back
+    return -1;
+}
+
+long bitmap_alloc_run(struct bitmap *bm, long goal, size_t max_len, size_t *len) {
+    long start;
+    if (goal >= 0 && (size_t)goal < bm->nbits && !taken(bm, goal)) {
+        start = goal;
+        take_bit(bm, start);
+    } else {
+        start = bitmap_alloc(bm);
+        if (start < 0) {
+            return -1;
+        }
+    }
+
+    // Extend the run over the free bits that follow
+    size_t n = 1;
+    while (n < max_len && start + n < bm->nbits && !taken(bm, start + n)) {
+        take_bit(bm, start + n);
+        n++;
+    }
+
+    if (bm->policy == BITMAP_NEXT_FIT) {
+        bm->cursor = (start + n - 1) / 64;
+    }
+    *len = n;
+    return start;
+}
+
+// Counts a bit that was freed as free in the summary
+static void give_bit(struct bitmap *bm, size_t bit) {
+    bm->chunk_free[bit / 64 / BITMAP_CHUNK_WORDS]++;
+    bm->nfree++;
+
+    if (bm->policy == BITMAP_FIRST_FIT && bit / 64 < bm->cursor) {
+        bm->cursor = bit / 64;
+    }
+}
+
+void bitmap_free(struct bitmap *bm, size_t bit) {
+    if (bit >= bm->nbits || !bitmap_test(bm, bit)) {
+        return;
+    }
+    bm->bits[bit / 8] &= ~(1 << (bit % 8));
+    if (bm->held) {
+        bm->held[bit / 8] |= 1 << (bit % 8);
+        return;
+    }
+    give_bit(bm, bit);
+}
+
+int bitmap_hold_frees(struct bitmap *bm) {
+    // Whole words, load_word() reads them 8 bytes at a time
+    bm->held = calloc(bm->nwords ? bm->nwords : 1, sizeof(uint64_t));
+    return bm->held ? SUCCESS : FAIL;
+}
+
+void bitmap_release(struct bitmap *bm, size_t bit) {
+    if (!bm->held || bit >= bm->nbits || !((bm->held[bit / 8] >> (bit % 8)) & 1)) {
+        return;
+    }
+    bm->held[bit / 8] &= ~(1 << (bit % 8));
+    give_bit(bm, bit);
+}
+
+int bitmap_test(const struct bitmap *bm, size_t bit) {
+    return (bm->bits[bit / 8] >> (bit % 8)) & 1;
+}
@@ -0,0 +1,58 @@
+#ifndef WFS_BITMAP_H
+#define WFS_BITMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  Allocator over an on-disk bitmap (bit i is bit i % 8 of byte i / 8).
+
+  The bitmap is scanned a 64-bit word at a time with ctz, starting from a
+  cursor. With BITMAP_NEXT_FIT the cursor stays where the previous allocation
+  left it. With BITMAP_FIRST_FIT frees move it back, so the lowest free bit is
+  always handed out. A summary with the
+  number of free bits in every chunk of BITMAP_CHUNK_WORDS words is built at
+  mount, so full chunks are skipped without touching the bitmap.
+
+  The summary is only right if every change to the bitmap goes through
+  bitmap_alloc and bitmap_free.
+
+  After bitmap_hold_frees(), a freed bit is cleared in the bitmap but held
+  back from allocation until bitmap_release() hands it out again. The
+  journal needs that for blocks whose old contents it may still write.
+*/
+
+#define BITMAP_CHUNK_WORDS 64   // 4096 bits per summary entry
+
+#define BITMAP_NEXT_FIT  0
+#define BITMAP_FIRST_FIT 1
+
+struct bitmap {
+    unsigned char *bits;        // The bitmap itself, usually inside a disk mapping
+    size_t nbits;
+    size_t nwords;
+    size_t nchunks;
+    size_t cursor;              // Word the next search starts at
+    int policy;                 // BITMAP_NEXT_FIT or BITMAP_FIRST_FIT
+    size_t nfree;
+    uint32_t *chunk_free;       // Free bits per chunk, held ones not counted
+    unsigned char *held;        // Freed bits not to hand out yet, NULL unless bitmap_hold_frees()
+};
+
+int bitmap_init(struct bitmap *bm, void *bits, size_t nbits, int policy);
+void bitmap_destroy(struct bitmap *bm);
+
+// Marks the first free bit at or after the cursor as used and returns it, -1 if none is free
+long bitmap_alloc(struct bitmap *bm);
+// Allocates up to max_len consecutive bits, at goal if that bit is free and
+// otherwise wherever bitmap_alloc would. Returns the first bit and sets *len.
+long bitmap_alloc_run(struct bitmap *bm, long goal, size_t max_len, size_t *len);
+void bitmap_free(struct bitmap *bm, size_t bit);
+int bitmap_test(const struct bitmap *bm, size_t bit);
+
+// Holds back the bits bitmap_free() frees from now on, see above
+int bitmap_hold_frees(struct bitmap *bm);
+// Lets bitmap_alloc hand out the held bit again
+void bitmap_release(struct bitmap *bm, size_t bit);
+
+#endif
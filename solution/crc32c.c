@@ -0,0 +1,77 @@
+#include <string.h>
+#include "crc32c.h"
+
+#define CRC32C_POLY 0x82f63b78  // Castagnoli polynomial, bit-reflected
+
+static uint32_t table[8][256];
+static uint32_t (*crc32c_impl)(uint32_t crc, const unsigned char *p, size_t len);
+
+// Slicing-by-8: eight table lookups per 8 bytes
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t len) {
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = table[7][lo & 0xff] ^ table[6][(lo >> 8) & 0xff] ^
+              table[5][(lo >> 16) & 0xff] ^ table[4][lo >> 24] ^
+              table[3][hi & 0xff] ^ table[2][(hi >> 8) & 0xff] ^
+              table[1][(hi >> 16) & 0xff] ^ table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+// The target attribute lets this one function use SSE4.2 without building everything with -msse4.2
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *p, size_t len) {
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+    while (len-- > 0) {
+        crc = __builtin_ia32_crc32qi(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+void crc32c_init(void) {
+    for (int i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+        }
+        table[0][i] = crc;
+    }
+    for (int i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            table[t][i] = table[0][table[t - 1][i] & 0xff] ^ (table[t - 1][i] >> 8);
+        }
+    }
+
+    crc32c_impl = crc32c_sw;
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_impl = crc32c_sse42;
+    }
+#endif
+}
+
+uint32_t crc32c(const void *buf, size_t len) {
+    return ~crc32c_impl(~0u, buf, len);
+}
+
+int crc32c_hw(void) {
+    return crc32c_impl != crc32c_sw;
+}
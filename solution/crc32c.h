@@ -0,0 +1,23 @@
+#ifndef WFS_CRC32C_H
+#define WFS_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  CRC32C (Castagnoli), the checksum behind WFS_FEATURE_CHECKSUMS.
+
+  On x86-64 CPUs with SSE4.2 the crc32 instruction does 8 bytes per step,
+  everywhere else a slicing-by-8 table does. crc32c_init() picks one and must
+  run before the first crc32c() call.
+*/
+
+void crc32c_init(void);
+
+// CRC32C of len bytes at buf
+uint32_t crc32c(const void *buf, size_t len);
+
+// 1 if crc32c() uses the hardware instruction
+int crc32c_hw(void);
+
+#endif
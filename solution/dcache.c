@@ -0,0 +1,197 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wfs.h"
+#include "dcache.h"
+
+struct dcache_entry {
+    uint64_t hash;
+    int parent;
+    uint32_t parent_gen;        // 0 marks an empty slot, generations start at 1
+    int inode;                  // DCACHE_NEGATIVE for a name that does not exist
+    uint32_t inode_gen;
+    size_t len;
+    char name[MAX_NAME];
+};
+
+struct dcache_path_entry {
+    uint64_t hash;
+    uint32_t path_gen;          // 0 marks an empty slot
+    int inode;
+    uint32_t inode_gen;
+    size_t len;
+    char path[DCACHE_PATH_MAX];
+};
+
+// 64-bit FNV-1a
+static uint64_t fnv1a(uint64_t hash, const char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static uint64_t dentry_hash(int parent, const char *name, size_t len) {
+    uint64_t hash = fnv1a(0xcbf29ce484222325ull, (const char *)&parent, sizeof(parent));
+    return fnv1a(hash, name, len);
+}
+
+static int inode_in_range(struct dcache *dc, int inode_num) {
+    return inode_num >= 0 && inode_num < dc->num_inodes;
+}
+
+int dcache_init(struct dcache *dc, int num_inodes) {
+    pthread_mutex_init(&dc->lock, NULL);
+    dc->path_gen = 1;
+    dc->dentries = calloc(DCACHE_BUCKETS, sizeof(struct dcache_entry));
+    dc->path_entries = calloc(DCACHE_PATH_BUCKETS, sizeof(struct dcache_path_entry));
+    dc->inode_gens = malloc(num_inodes * sizeof(uint32_t));
+    if (!dc->dentries || !dc->path_entries || !dc->inode_gens) {
+        dcache_destroy(dc);
+        return FAIL;
+    }
+    for (int i = 0; i < num_inodes; i++) {
+        dc->inode_gens[i] = 1;
+    }
+    dc->num_inodes = num_inodes;
+    return SUCCESS;
+}
+
+void dcache_destroy(struct dcache *dc) {
+    free(dc->dentries);
+    free(dc->path_entries);
+    free(dc->inode_gens);
+    dc->dentries = NULL;
+    dc->path_entries = NULL;
+    dc->inode_gens = NULL;
+    dc->num_inodes = 0;
+    pthread_mutex_destroy(&dc->lock);
+}
+
+int dcache_lookup(struct dcache *dc, int parent, const char *name, size_t len, int *inode_num) {
+    if (!inode_in_range(dc, parent) || len >= MAX_NAME) {
+        return 0;
+    }
+
+    uint64_t hash = dentry_hash(parent, name, len);
+    struct dcache_entry *entry = &dc->dentries[hash & (DCACHE_BUCKETS - 1)];
+    pthread_mutex_lock(&dc->lock);
+    int hit = entry->hash == hash && entry->parent == parent && entry->parent_gen == dc->inode_gens[parent] &&
+              entry->len == len && memcmp(entry->name, name, len) == 0;
+
+    // A positive entry is stale once its target inode has been freed
+    if (hit && entry->inode != DCACHE_NEGATIVE && entry->inode_gen != dc->inode_gens[entry->inode]) {
+        hit = 0;
+    }
+    if (hit) {
+        *inode_num = entry->inode;
+    }
+    pthread_mutex_unlock(&dc->lock);
+    return hit;
+}
+
+void dcache_add(struct dcache *dc, int parent, const char *name, size_t len, int inode_num) {
+    if (!inode_in_range(dc, parent) || len >= MAX_NAME) {
+        return;
+    }
+    if (inode_num != DCACHE_NEGATIVE && !inode_in_range(dc, inode_num)) {
+        return;
+    }
+
+    uint64_t hash = dentry_hash(parent, name, len);
+    struct dcache_entry *entry = &dc->dentries[hash & (DCACHE_BUCKETS - 1)];
+    pthread_mutex_lock(&dc->lock);
+    entry->hash = hash;
+    entry->parent = parent;
+    entry->parent_gen = dc->inode_gens[parent];
+    entry->inode = inode_num;
+    entry->inode_gen = inode_num == DCACHE_NEGATIVE ? 0 : dc->inode_gens[inode_num];
+    entry->len = len;
+    memcpy(entry->name, name, len);
+    pthread_mutex_unlock(&dc->lock);
+}
+
+void dcache_invalidate(struct dcache *dc, int parent, const char *name) {
+    size_t len = strlen(name);
+    if (!inode_in_range(dc, parent) || len >= MAX_NAME) {
+        return;
+    }
+
+    uint64_t hash = dentry_hash(parent, name, len);
+    struct dcache_entry *entry = &dc->dentries[hash & (DCACHE_BUCKETS - 1)];
+    pthread_mutex_lock(&dc->lock);
+    if (entry->hash == hash && entry->parent == parent) {
+        entry->parent_gen = 0;
+    }
+    pthread_mutex_unlock(&dc->lock);
+}
+
+int dcache_path_lookup(struct dcache *dc, const char *path, int *inode_num) {
+    if (!dc->path_entries) {
+        return 0;
+    }
+    size_t len = strlen(path);
+    if (len >= DCACHE_PATH_MAX) {
+        return 0;
+    }
+
+    uint64_t hash = fnv1a(0xcbf29ce484222325ull, path, len);
+    struct dcache_path_entry *entry = &dc->path_entries[hash & (DCACHE_PATH_BUCKETS - 1)];
+    pthread_mutex_lock(&dc->lock);
+    int hit = entry->hash == hash && entry->path_gen == dc->path_gen && entry->len == len &&
+              entry->inode_gen == dc->inode_gens[entry->inode] && memcmp(entry->path, path, len) == 0;
+    if (hit) {
+        *inode_num = entry->inode;
+    }
+    pthread_mutex_unlock(&dc->lock);
+    return hit;
+}
+
+void dcache_path_add(struct dcache *dc, const char *path, int inode_num) {
+    size_t len = strlen(path);
+    if (!dc->path_entries || len >= DCACHE_PATH_MAX || !inode_in_range(dc, inode_num)) {
+        return;
+    }
+
+    uint64_t hash = fnv1a(0xcbf29ce484222325ull, path, len);
+    struct dcache_path_entry *entry = &dc->path_entries[hash & (DCACHE_PATH_BUCKETS - 1)];
+    pthread_mutex_lock(&dc->lock);
+    entry->hash = hash;
+    entry->path_gen = dc->path_gen;
+    entry->inode = inode_num;
+    entry->inode_gen = dc->inode_gens[inode_num];
+    entry->len = len;
+    memcpy(entry->path, path, len);
+    pthread_mutex_unlock(&dc->lock);
+}
+
+// Called with dcache_lock held
+static void path_invalidate_all_locked(struct dcache *dc) {
+    dc->path_gen++;
+    if (dc->path_gen == 0) {
+        // Wrapped around, old entries could match again
+        memset(dc->path_entries, 0, DCACHE_PATH_BUCKETS * sizeof(struct dcache_path_entry));
+        dc->path_gen = 1;
+    }
+}
+
+void dcache_path_invalidate_all(struct dcache *dc) {
+    pthread_mutex_lock(&dc->lock);
+    path_invalidate_all_locked(dc);
+    pthread_mutex_unlock(&dc->lock);
+}
+
+void dcache_forget_inode(struct dcache *dc, int inode_num) {
+    if (!inode_in_range(dc, inode_num)) {
+        return;
+    }
+    pthread_mutex_lock(&dc->lock);
+    dc->inode_gens[inode_num]++;
+    if (dc->inode_gens[inode_num] == 0) {
+        dc->inode_gens[inode_num] = 1;
+    }
+    path_invalidate_all_locked(dc);
+    pthread_mutex_unlock(&dc->lock);
+}
@@ -0,0 +1,52 @@
+#ifndef WFS_DCACHE_H
+#define WFS_DCACHE_H
+
+/*
+  Dentry cache for path lookups.
+
+  Two direct-mapped hash tables:
+    - (parent inode, name) -> inode, with negative entries (DCACHE_NEGATIVE)
+      for names known not to exist.
+    - full path -> inode, positive entries only.
+
+  Every inode has a generation number that free_inode() bumps through
+  dcache_forget_inode(), so cached entries whose parent or target was
+  freed stop matching without having to search the table. Removing an
+  entry also bumps the path generation, which drops every cached full path.
+
+  All calls are safe from several threads, one mutex covers both tables.
+  Every mounted filesystem has its own cache.
+*/
+
+#include <pthread.h>
+#include <stdint.h>
+
+#define DCACHE_NEGATIVE     (-1)
+#define DCACHE_BUCKETS      (1 << 12)   // (parent, name) slots, power of two
+#define DCACHE_PATH_BUCKETS (1 << 10)   // Full path slots, power of two
+#define DCACHE_PATH_MAX     (256)       // Longer paths are not cached
+
+struct dcache {
+    struct dcache_entry *dentries;           // DCACHE_BUCKETS (parent, name) slots
+    struct dcache_path_entry *path_entries;  // DCACHE_PATH_BUCKETS full path slots
+    uint32_t *inode_gens;                    // Generation of every inode
+    int num_inodes;
+    uint32_t path_gen;                       // Full paths cached before the last removal have an older one
+    pthread_mutex_t lock;
+};
+
+int dcache_init(struct dcache *dc, int num_inodes);
+void dcache_destroy(struct dcache *dc);
+
+// Returns 1 and sets *inode_num (possibly DCACHE_NEGATIVE) on a hit, 0 on a miss
+int dcache_lookup(struct dcache *dc, int parent, const char *name, size_t len, int *inode_num);
+void dcache_add(struct dcache *dc, int parent, const char *name, size_t len, int inode_num);
+void dcache_invalidate(struct dcache *dc, int parent, const char *name);
+
+int dcache_path_lookup(struct dcache *dc, const char *path, int *inode_num);
+void dcache_path_add(struct dcache *dc, const char *path, int inode_num);
+void dcache_path_invalidate_all(struct dcache *dc);
+
+void dcache_forget_inode(struct dcache *dc, int inode_num);
+
+#endif
@@ -0,0 +1,415 @@
+#include <pthread.h>
+#include "wfs.h"
+#include "trace.h"
+#include "crc32c.h"
+#include "writeback.h"
+#include "journal.h"
+
+#define ALIGN8(x) (((x) + 7) & ~(size_t)7)
+
+static struct wfs_journal_header *header(struct journal *jr, int disk) {
+    return (struct wfs_journal_header *)jr->region[disk];
+}
+
+// Copies len bytes to pos of every disk's journal and marks them for writeback
+static void put(struct journal *jr, size_t pos, const void *src, size_t len) {
+    for (int i = 0; i < jr->num_disks; i++) {
+        memcpy(jr->region[i] + pos, src, len);
+    }
+    writeback_mark_all(jr->wb, jr->offset + pos, len);
+}
+
+// Room for orphans in the header block
+static size_t max_orphans(struct journal *jr) {
+    return (jr->first - sizeof(struct wfs_journal_header)) / sizeof(uint32_t);
+}
+
+// Writes the records of the transactions in [pos, end) of disk's journal in place on every
+// disk. Returns the number of bytes, -1 if a record isn't a range of the images.
+static ssize_t write_in_place(struct journal *jr, int disk, size_t pos, size_t end) {
+    ssize_t bytes = 0;
+    while (pos < end) {
+        struct wfs_journal_txn *txn = (struct wfs_journal_txn *)(jr->region[disk] + pos);
+        char *rec = (char *)(txn + 1);
+        char *rec_end = rec + txn->len;
+        while (rec < rec_end) {
+            struct wfs_journal_rec *r = (struct wfs_journal_rec *)rec;
+            if (r->offset < 0 || r->len > (uint64_t)jr->offset || r->offset > jr->offset - (off_t)r->len) {
+                return -1;  // Not a range of this image, the journal is from something else
+            }
+            for (int i = 0; i < jr->num_disks; i++) {
+                memcpy(jr->region[i] - jr->offset + r->offset, r + 1, r->len);
+            }
+            writeback_mark_all(jr->wb, r->offset, r->len);
+            jr->applied_fn(jr->applied_arg, r->offset, r->len);
+            bytes += r->len;
+            rec += sizeof(struct wfs_journal_rec) + ALIGN8(r->len);
+        }
+        pos += sizeof(struct wfs_journal_txn) + txn->len;
+    }
+    return bytes;
+}
+
+// Seals the running transaction, callers hold jr->lock
+static void seal(struct journal *jr) {
+    if (!jr->txn_open) {
+        return;
+    }
+    struct wfs_journal_txn txn = {
+        .magic = JOURNAL_TXN_MAGIC,
+        .sequence = jr->sequence,
+        .len = jr->head - jr->txn - sizeof(struct wfs_journal_txn),
+    };
+
+    // The records are in place already, the CRC covers them and the header after the field
+    put(jr, jr->txn, &txn, sizeof(txn));
+    struct wfs_journal_txn *placed = (struct wfs_journal_txn *)(jr->region[0] + jr->txn);
+    size_t covered = sizeof(txn) - offsetof(struct wfs_journal_txn, sequence);
+    txn.crc = crc32c(&placed->sequence, covered + txn.len);
+    put(jr, jr->txn + offsetof(struct wfs_journal_txn, crc), &txn.crc, sizeof(txn.crc));
+
+    TRACE(JOURNAL_COMMIT, NULL, jr->sequence, txn.len);
+    jr->sequence++;
+    jr->txn = jr->head;
+    jr->txn_open = 0;
+}
+
+// Seals the running transaction as part of every sync, and remembers how far the sync
+// commits. See writeback_set_commit().
+static void commit_hook(void *arg) {
+    struct journal *jr = arg;
+    pthread_mutex_lock(&jr->lock);
+    seal(jr);
+    jr->durable = jr->txn;
+    pthread_mutex_unlock(&jr->lock);
+}
+
+// Writes what the sync committed in place. Records come from disk 0's journal, every disk
+// has the same.
+static void synced_hook(void *arg) {
+    struct journal *jr = arg;
+    pthread_mutex_lock(&jr->apply_lock);
+    pthread_mutex_lock(&jr->lock);
+    size_t from = jr->applied, to = jr->durable;
+    pthread_mutex_unlock(&jr->lock);
+
+    // Nothing moves the transactions while apply_lock is held, reset() takes it too
+    if (to > from) {
+        ssize_t bytes = write_in_place(jr, 0, from, to);
+        TRACE(JOURNAL_APPLY, NULL, to - from, bytes);
+        pthread_mutex_lock(&jr->lock);
+        jr->applied = to;
+        pthread_mutex_unlock(&jr->lock);
+    }
+    pthread_mutex_unlock(&jr->apply_lock);
+}
+
+int journal_open(struct journal *jr, struct writeback *wb, int num_disks, void *const *regions, off_t offset, size_t header_size,
+                 void (*applied)(void *, off_t, size_t), size_t (*orphans)(void *, uint32_t *, size_t), void *arg) {
+    memset(jr, 0, sizeof(struct journal));
+    jr->region = calloc(num_disks, sizeof(char *));
+    if (!jr->region) {
+        return FAIL;
+    }
+    pthread_mutex_init(&jr->apply_lock, NULL);
+    pthread_mutex_init(&jr->lock, NULL);
+    pthread_cond_init(&jr->idle, NULL);
+    jr->wb = wb;
+    jr->num_disks = num_disks;
+    jr->offset = offset;
+    jr->first = header_size;
+    jr->applied_fn = applied;
+    jr->orphans_fn = orphans;
+    jr->applied_arg = arg;
+    for (int i = 0; i < num_disks; i++) {
+        jr->region[i] = (char *)regions[i] + offset;
+    }
+
+    // Disks agree on the size, it comes from mkfs
+    for (int i = 0; i < num_disks; i++) {
+        if (header(jr, i)->magic == JOURNAL_MAGIC) {
+            jr->size = header(jr, i)->size;
+            jr->head = jr->txn = jr->applied = jr->durable = jr->first;
+            if (jr->size <= jr->first) {
+                return FAIL;
+            }
+            writeback_set_commit(wb, commit_hook, synced_hook, jr);
+            return SUCCESS;
+        }
+    }
+    return FAIL;
+}
+
+void journal_close(struct journal *jr) {
+    if (!jr->region) {
+        return;
+    }
+    writeback_set_commit(jr->wb, NULL, NULL, NULL);
+    free(jr->region);
+    jr->region = NULL;
+    jr->num_disks = 0;
+    pthread_mutex_destroy(&jr->apply_lock);
+    pthread_mutex_destroy(&jr->lock);
+    pthread_cond_destroy(&jr->idle);
+}
+
+// The transaction at pos of disk's journal if it is the valid one numbered sequence
+static struct wfs_journal_txn *valid_txn(struct journal *jr, int disk, size_t pos, uint64_t sequence) {
+    if (pos + sizeof(struct wfs_journal_txn) > jr->size) {
+        return NULL;
+    }
+    struct wfs_journal_txn *txn = (struct wfs_journal_txn *)(jr->region[disk] + pos);
+    if (txn->magic != JOURNAL_TXN_MAGIC || txn->sequence != sequence ||
+        txn->len > jr->size - pos - sizeof(struct wfs_journal_txn)) {
+        return NULL;
+    }
+    size_t covered = sizeof(struct wfs_journal_txn) - offsetof(struct wfs_journal_txn, sequence);
+    if (crc32c(&txn->sequence, covered + txn->len) != txn->crc) {
+        return NULL;
+    }
+    return txn;
+}
+
+// Number of committed transactions in disk's journal
+static int count_txns(struct journal *jr, int disk) {
+    if (header(jr, disk)->magic != JOURNAL_MAGIC) {
+        return -1;
+    }
+    int count = 0;
+    size_t pos = jr->first;
+    struct wfs_journal_txn *txn;
+    while ((txn = valid_txn(jr, disk, pos, header(jr, disk)->sequence + count)) != NULL) {
+        pos += sizeof(struct wfs_journal_txn) + txn->len;
+        count++;
+    }
+    return count;
+}
+
+// Points the header of every disk at the next transaction and starts over from the top.
+// Everything logged so far is in place, so the orphans freed since the last time can go from
+// the list. Callers hold apply_lock and jr->lock.
+static void reset(struct journal *jr) {
+    struct wfs_journal_header hdr = {
+        .magic = JOURNAL_MAGIC,
+        .size = jr->size,
+        .sequence = jr->sequence,
+    };
+    size_t max = max_orphans(jr);
+    uint32_t nums[max + 1];
+    size_t count = jr->orphans_fn(jr->applied_arg, nums, max);
+    hdr.num_orphans = count > max ? JOURNAL_ORPHANS_LOST : count;
+    if (count <= max) {
+        put(jr, sizeof(hdr), nums, count * sizeof(uint32_t));
+    }
+    put(jr, 0, &hdr, sizeof(hdr));
+    jr->head = jr->txn = jr->applied = jr->durable = jr->first;
+    jr->txn_open = 0;
+    jr->checkpoints++;
+}
+
+int journal_replay(struct journal *jr, size_t *bytes) {
+    // Mirrors may have been synced to different points before the crash, the one that got
+    // furthest has every transaction the others have
+    int best = -1, best_count = -1;
+    for (int i = 0; i < jr->num_disks; i++) {
+        int count = count_txns(jr, i);
+        if (count < 0) {
+            continue;
+        }
+        if (best < 0 || header(jr, i)->sequence + count > header(jr, best)->sequence + best_count) {
+            best = i;
+            best_count = count;
+        }
+    }
+    if (best < 0) {
+        return -1;
+    }
+
+    size_t pos = jr->first;
+    for (int n = 0; n < best_count; n++) {
+        pos += sizeof(struct wfs_journal_txn) + ((struct wfs_journal_txn *)(jr->region[best] + pos))->len;
+    }
+    ssize_t written = write_in_place(jr, best, jr->first, pos);
+    if (written < 0) {
+        return -1;
+    }
+    *bytes = written;
+    jr->sequence = header(jr, best)->sequence + best_count;
+    TRACE(JOURNAL_REPLAY, NULL, best_count, *bytes, best);
+
+    // Mirrors that didn't get as far take the journal of the one that did
+    for (int i = 0; i < jr->num_disks; i++) {
+        if (i != best) {
+            memcpy(jr->region[i] + jr->first, jr->region[best] + jr->first, pos - jr->first);
+            writeback_mark(jr->wb, i, jr->offset + jr->first, pos - jr->first);
+        }
+    }
+
+    // The replayed metadata has to be on disk before the transactions can go
+    if (best_count > 0 && writeback_sync(jr->wb) != 0) {
+        return -1;
+    }
+    reset(jr);
+    if (best_count > 0 && writeback_sync(jr->wb) != 0) {
+        return -1;
+    }
+    return best_count;
+}
+
+ssize_t journal_orphans(struct journal *jr, uint32_t **nums) {
+    // A mirror's header may have been synced without the others', none lists an orphan the
+    // images don't have
+    size_t max = max_orphans(jr);
+    *nums = malloc(jr->num_disks * max * sizeof(uint32_t) + 1);
+    if (!*nums) {
+        return -1;
+    }
+    size_t count = 0;
+    for (int i = 0; i < jr->num_disks; i++) {
+        struct wfs_journal_header *hdr = header(jr, i);
+        if (hdr->magic != JOURNAL_MAGIC) {
+            continue;
+        }
+        if (hdr->num_orphans > max) {
+            free(*nums);
+            *nums = NULL;
+            return -1;
+        }
+        for (uint32_t j = 0; j < hdr->num_orphans; j++) {
+            size_t k = 0;
+            while (k < count && (*nums)[k] != hdr->orphans[j]) {
+                k++;
+            }
+            if (k == count) {
+                (*nums)[count++] = hdr->orphans[j];
+            }
+        }
+    }
+    return count;
+}
+
+void journal_orphan(struct journal *jr, uint32_t num) {
+    if (jr->num_disks == 0) {
+        return;
+    }
+    pthread_mutex_lock(&jr->lock);
+    uint32_t count = header(jr, 0)->num_orphans;
+    if (count < max_orphans(jr)) {
+        put(jr, sizeof(struct wfs_journal_header) + count * sizeof(uint32_t), &num, sizeof(num));
+        count++;
+    } else {
+        count = JOURNAL_ORPHANS_LOST;  // Until the next reset() lists them again
+    }
+    put(jr, offsetof(struct wfs_journal_header, num_orphans), &count, sizeof(count));
+    pthread_mutex_unlock(&jr->lock);
+}
+
+void journal_commit(struct journal *jr) {
+    if (jr->num_disks == 0) {
+        return;
+    }
+    pthread_mutex_lock(&jr->lock);
+    seal(jr);
+    pthread_mutex_unlock(&jr->lock);
+}
+
+// Syncs everything committed so far in place and empties the journal. Called holding jr->lock,
+// which it drops while syncing.
+static void checkpoint_locked(struct journal *jr) {
+    while (jr->checkpointing) {
+        pthread_cond_wait(&jr->idle, &jr->lock);
+    }
+    seal(jr);
+    jr->checkpointing = 1;
+    pthread_mutex_unlock(&jr->lock);
+
+    // The first sync commits what was just sealed and writes it in place, the second gets
+    // that to disk. Only then can the journal go, and until the emptied one is on disk too,
+    // a crash would replay it over whatever came after.
+    int err = writeback_sync(jr->wb);
+    if (err == 0) {
+        err = writeback_sync(jr->wb);
+    }
+    if (err == 0) {
+        pthread_mutex_lock(&jr->apply_lock);
+        pthread_mutex_lock(&jr->lock);
+        TRACE(JOURNAL_CHECKPOINT, NULL, jr->sequence);
+        reset(jr);
+        pthread_mutex_unlock(&jr->lock);
+        pthread_mutex_unlock(&jr->apply_lock);
+        writeback_sync(jr->wb);
+    }
+
+    pthread_mutex_lock(&jr->lock);
+    jr->checkpointing = 0;
+    pthread_cond_broadcast(&jr->idle);
+}
+
+void journal_checkpoint(struct journal *jr) {
+    if (jr->num_disks == 0) {
+        return;
+    }
+    pthread_mutex_lock(&jr->lock);
+    checkpoint_locked(jr);
+    pthread_mutex_unlock(&jr->lock);
+}
+
+unsigned long journal_checkpoints(struct journal *jr) {
+    pthread_mutex_lock(&jr->lock);
+    unsigned long n = jr->checkpoints;
+    pthread_mutex_unlock(&jr->lock);
+    return n;
+}
+
+void journal_hold(struct journal *jr) {
+    if (jr->num_disks > 0) {
+        pthread_mutex_lock(&jr->apply_lock);
+    }
+}
+
+void journal_release(struct journal *jr) {
+    if (jr->num_disks > 0) {
+        pthread_mutex_unlock(&jr->apply_lock);
+    }
+}
+
+int journal_start(struct journal *jr, int nranges, size_t bytes) {
+    size_t need = sizeof(struct wfs_journal_txn) + nranges * (sizeof(struct wfs_journal_rec) + 7) + bytes;
+    if (jr->num_disks == 0 || jr->first + need > jr->size) {
+        TRACE(JOURNAL_TOO_BIG, NULL, bytes);
+        return FAIL;
+    }
+
+    pthread_mutex_lock(&jr->lock);
+    while (jr->checkpointing) {
+        pthread_cond_wait(&jr->idle, &jr->lock);
+    }
+    if (jr->head + need > jr->size) {
+        checkpoint_locked(jr);
+        if (jr->head + need > jr->size) {
+            pthread_mutex_unlock(&jr->lock);
+            return FAIL;
+        }
+    }
+    if (!jr->txn_open) {
+        jr->head = jr->txn + sizeof(struct wfs_journal_txn);
+        jr->txn_open = 1;
+    }
+    return SUCCESS;
+}
+
+void journal_add(struct journal *jr, const char *image, off_t offset, size_t len) {
+    static const char zeros[8];
+    struct wfs_journal_rec rec = {
+        .offset = offset,
+        .len = len,
+    };
+    put(jr, jr->head, &rec, sizeof(rec));
+    put(jr, jr->head + sizeof(rec), image + offset, len);
+    put(jr, jr->head + sizeof(rec) + len, zeros, ALIGN8(len) - len);
+    jr->head += sizeof(rec) + ALIGN8(len);
+}
+
+void journal_stop(struct journal *jr) {
+    pthread_mutex_unlock(&jr->lock);
+}
@@ -0,0 +1,98 @@
+#ifndef WFS_JOURNAL_H
+#define WFS_JOURNAL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "writeback.h"
+
+/*
+  Metadata journal (WFS_FEATURE_JOURNAL), see wfs.h for the on-disk format.
+
+  The journal is write-ahead: metadata is changed in a private copy of the
+  images, and only reaches them in place once a transaction holding it is
+  on disk. An operation that changed metadata logs the new contents of the
+  ranges it changed as one unit, between journal_start() and journal_stop().
+  Units gather in the running transaction, which is sealed with a CRC32C when
+  the images are synced (the writeback commit hook), so one fsync or
+  background sync commits every operation since the last one. After the
+  sync, its transactions are written in place on every disk (the synced
+  hook), which the next sync gets to disk. When the journal fills up, a
+  checkpoint syncs the images and starts it over from the top.
+
+  At mount, journal_replay() writes the committed transactions in place on
+  every disk, so whatever part of the in-place writes a crash left undone,
+  the images end up as the last committed transaction has them.
+
+  The header block also lists the orphans, see wfs.h. journal_orphan() adds
+  one as soon as it is unlinked, and every time the journal is emptied the
+  list is written over with the ones the filesystem still has, which
+  orphans(arg, nums, max) of journal_open() hands over.
+*/
+
+struct journal {
+    struct writeback *wb;   // Of the images the journal is in
+    char **region;          // The journal of every disk, the same bytes on each
+    int num_disks;          // 0 while there is no journal
+    off_t offset;           // Of the journal in the images
+    size_t size;
+    size_t first;           // Where the first transaction goes, after the header block
+    void (*applied_fn)(void *, off_t, size_t); // Told of every range written in place
+    size_t (*orphans_fn)(void *, uint32_t *, size_t); // See journal_open()
+    void *applied_arg;      // Of both
+
+    pthread_mutex_t apply_lock; // Held while writing in place, see journal_hold()
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+    int checkpointing;      // Appends wait while a checkpoint syncs the images
+    size_t head;            // Where the next record goes
+    size_t txn;             // Start of the running transaction
+    int txn_open;           // Whether it has records
+    uint64_t sequence;      // Of the running transaction
+    size_t applied;         // End of the transactions written in place so far
+    size_t durable;         // End of those the running sync commits
+    unsigned long checkpoints; // Number of times the journal was emptied
+};
+
+// regions are the shared mappings of the images. applied(arg, offset, len) is called for every
+// range of them the journal writes. orphans(arg, nums, max) puts up to max of the orphans in
+// nums and returns how many there are, more than max if it lost track of them.
+int journal_open(struct journal *jr, struct writeback *wb, int num_disks, void *const *regions, off_t offset, size_t header_size,
+                 void (*applied)(void *, off_t, size_t), size_t (*orphans)(void *, uint32_t *, size_t), void *arg);
+void journal_close(struct journal *jr);
+
+// Applies the committed transactions to every disk and empties the journal. Returns the
+// number of transactions replayed, -1 if no disk has a valid journal.
+int journal_replay(struct journal *jr, size_t *bytes);
+
+// Reserves room for nranges records holding bytes in total and holds the journal until
+// journal_stop(). Returns FAIL, not holding it, if they can't fit even in an empty journal.
+// Units have to be added in the order their changes were made.
+int journal_start(struct journal *jr, int nranges, size_t bytes);
+// Logs [offset, offset + len) of image, the private copy
+void journal_add(struct journal *jr, const char *image, off_t offset, size_t len);
+void journal_stop(struct journal *jr);
+
+// The orphans the headers list, malloc'd in *nums, to call before journal_replay(). Returns
+// how many, -1 if the list was lost.
+ssize_t journal_orphans(struct journal *jr, uint32_t **nums);
+// Lists orphan num, before the transaction that removes its last link is committed
+void journal_orphan(struct journal *jr, uint32_t num);
+
+// Seals the running transaction
+void journal_commit(struct journal *jr);
+
+// Commits, syncs the images with everything committed written in place and empties the journal
+void journal_checkpoint(struct journal *jr);
+
+// Number of checkpoints so far. Once it has gone up, nothing logged before the call is
+// left to be written in place.
+unsigned long journal_checkpoints(struct journal *jr);
+
+// Keeps the journal from writing in place until journal_release(), for the scrubber, which
+// compares the copies on the disks
+void journal_hold(struct journal *jr);
+void journal_release(struct journal *jr);
+
+#endif
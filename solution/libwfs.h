@@ -0,0 +1,89 @@
+#ifndef LIBWFS_H
+#define LIBWFS_H
+
+/*
+  The filesystem as a library, libwfs.a. wfs is a FUSE front end over this
+  API. Other programs, such as tests and benchmarks, can link it and drive
+  the filesystem without FUSE or the kernel.
+
+  A process may mount any number of filesystems. The calls for one of them
+  may come from any number of threads at once, as they do from FUSE.
+  Paths are absolute within the filesystem. Calls return 0, or a byte
+  count for reads and writes, on success, and a negative errno on
+  failure, just as the FUSE callbacks do.
+
+  The functions that take a struct wfs_file use it in place of the path,
+  which may then be NULL. A file stays usable after it is unlinked, until
+  it is released.
+
+  /.wfs/stats is a read-only file that isn't on the disks, see
+  wfs_fs_stats(). /.wfs isn't listed in the root.
+*/
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+struct wfs_fs;
+struct wfs_file;
+
+struct wfs_options {
+    const char *read_policy;    // RAID 1 read policy, as for --read-policy=. NULL for stream.
+    int scrub_rate;             // MB/s for the background scrubber, 0 for none
+    double writeback_interval;  // Seconds between background syncs, <0 for the default
+};
+
+// Every option at its default
+void wfs_fs_options_init(struct wfs_options *opts);
+
+// Mounts the images made by mkfs. Disks can be in any order. Prints why on stdout and
+// returns NULL if it fails.
+struct wfs_fs *wfs_fs_mount(int num_disks, char *const disks[], const struct wfs_options *opts);
+
+// Starts the background threads the options ask for. Call it once, after any fork. Returns 0,
+// or 1 when a thread didn't start.
+int wfs_fs_start(struct wfs_fs *fs);
+
+// Stops the background threads and puts everything on disk. The filesystem must be idle.
+// Only wfs_fs_unmount() may follow.
+void wfs_fs_stop(struct wfs_fs *fs);
+
+// Stops the filesystem unless it is already stopped and frees it
+void wfs_fs_unmount(struct wfs_fs *fs);
+
+int wfs_fs_getattr(struct wfs_fs *fs, const char *path, struct wfs_file *file, struct stat *stbuf);
+int wfs_fs_mkdir(struct wfs_fs *fs, const char *path, mode_t mode);
+int wfs_fs_unlink(struct wfs_fs *fs, const char *path);
+int wfs_fs_rmdir(struct wfs_fs *fs, const char *path);
+
+// Opens the file, or the directory when want_dir is set, into *file
+int wfs_fs_open(struct wfs_fs *fs, const char *path, int want_dir, struct wfs_file **file);
+
+// Creates a regular file. It is also opened into *file unless file is NULL.
+int wfs_fs_create(struct wfs_fs *fs, const char *path, mode_t mode, struct wfs_file **file);
+
+void wfs_fs_release(struct wfs_fs *fs, struct wfs_file *file);
+
+int wfs_fs_read(struct wfs_fs *fs, const char *path, struct wfs_file *file, char *buf, size_t size, off_t offset);
+int wfs_fs_write(struct wfs_fs *fs, const char *path, struct wfs_file *file, const char *buf, size_t size, off_t offset);
+
+// Called for each entry with the offset to resume the listing after it. Returns non-zero when
+// it has no room for the entry, which ends the listing. Same as FUSE's fuse_fill_dir_t.
+typedef int (*wfs_fill_t)(void *ctx, const char *name, const struct stat *stbuf, off_t offset);
+
+// Lists the directory from offset on, 0 for the start
+int wfs_fs_readdir(struct wfs_fs *fs, const char *path, struct wfs_file *file, off_t offset, void *ctx, wfs_fill_t filler);
+
+// Puts everything written so far on stable storage. file may be NULL. A writeback that failed
+// since the file last synced or flushed is reported as -EIO.
+int wfs_fs_fsync(struct wfs_fs *fs, struct wfs_file *file);
+
+// For close, reports a failed writeback like wfs_fs_fsync() but doesn't sync
+int wfs_fs_flush(struct wfs_fs *fs, struct wfs_file *file);
+
+// The operation counts and latencies, path walks, allocations and mirror copies since the
+// mount, as the text of /.wfs/stats. Returns a malloc'd string, with its length in *len, or
+// NULL when out of memory.
+char *wfs_fs_stats(struct wfs_fs *fs, size_t *len);
+
+#endif
@@ -8,17 +8,68 @@
 #define FAIL 1
 #define SUCCESS 0
 
+size_t block_size = DEFAULT_BLOCK_SIZE;
+
 //rounds up to the nearest multiple of 32
 size_t round_32(size_t value) {
     return ((value + (32-1)) / 32) * 32;
 }
 
-//rounds up to the nearest multiple of 512
-size_t round_512(size_t value) {
+//rounds up to the nearest multiple of the block size
+size_t round_block(size_t value) {
     return ((value + (BLOCK_SIZE - 1)) / BLOCK_SIZE) * BLOCK_SIZE;
 }
 
-void initalize_disk(const char *disk_path, int disk_id, int raid_mode, int num_inodes, int num_data_blocks) {
+//parses a size in bytes, optionally followed by K or M, such as "4096", "64K" or "1M"
+size_t parse_size(const char *arg) {
+    char *end;
+    size_t size = strtoul(arg, &end, 10);
+    if (*end == 'K' || *end == 'k') {
+        size *= 1024;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        size *= 1024 * 1024;
+        end++;
+    }
+    return *end == '\0' ? size : 0;
+}
+
+//log2 of value, -1 if it isn't a power of two
+int log2_exact(size_t value) {
+    if (value == 0 || (value & (value - 1)) != 0) {
+        return -1;
+    }
+    return __builtin_ctzl(value);
+}
+
+//parses a comma separated feature list such as "dir_index,extents"
+int parse_features(const char *list, uint32_t *features) {
+    char *copy = strdup(list);
+    if (!copy) {
+        return FAIL;
+    }
+
+    int ret = SUCCESS;
+    for (char *name = strtok(copy, ","); name != NULL; name = strtok(NULL, ",")) {
+        if (strcmp(name, "dir_index") == 0) {
+            *features |= WFS_FEATURE_DIR_INDEX;
+        } else if (strcmp(name, "extents") == 0) {
+            *features |= WFS_FEATURE_EXTENTS;
+        } else if (strcmp(name, "checksums") == 0) {
+            *features |= WFS_FEATURE_CHECKSUMS;
+        } else if (strcmp(name, "dense_inodes") == 0) {
+            *features |= WFS_FEATURE_DENSE_INODES;
+        } else {
+            ret = FAIL;
+            break;
+        }
+    }
+
+    free(copy);
+    return ret;
+}
+
+void initalize_disk(const char *disk_path, int disk_id, int raid_mode, int num_inodes, int num_data_blocks, uint32_t features, int stripe_bits, size_t journal_size) {
     
     //open disk file, set user permissions
     int fd = open(disk_path, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
@@ -45,13 +96,34 @@ void initalize_disk(const char *disk_path, int disk_id, int raid_mode, int num_i
     size_t d_bitmap_size = num_data_blocks / 8;
 
     //where inode blocks begin (inode info stored starting here)
-    off_t i_blocks_ptr = round_512(d_bitmap_ptr + d_bitmap_size);
+    off_t i_blocks_ptr = round_block(d_bitmap_ptr + d_bitmap_size);
+
+    //bytes of inode table, each inode allocated fixed block size 
+    //unless they are packed INODES_PER_BLOCK to a block
+    size_t i_blocks_size = num_inodes * BLOCK_SIZE;
+    if (features & WFS_FEATURE_DENSE_INODES) {
+        i_blocks_size = (num_inodes + INODES_PER_BLOCK - 1) / INODES_PER_BLOCK * BLOCK_SIZE;
+    }
 
     //where data blocks begin (actual file content or directory entries stored here)
-    //each inode allocated fixed block size 
-    off_t d_blocks_ptr = round_512(i_blocks_ptr + (num_inodes * BLOCK_SIZE));
+    off_t d_blocks_ptr = round_block(i_blocks_ptr + i_blocks_size);
 
     size_t total_size = d_blocks_ptr + (num_inodes * sizeof(struct wfs_inode)) + (num_data_blocks * BLOCK_SIZE);
+
+    //checksum region, one per data block, right after the data blocks
+    off_t csum_end = d_blocks_ptr + num_data_blocks * BLOCK_SIZE;
+    if (features & WFS_FEATURE_CHECKSUMS) {
+        total_size += num_data_blocks * CSUM_SIZE;
+        csum_end += num_data_blocks * CSUM_SIZE;
+    }
+
+    //journal, from the next block boundary on
+    off_t journal_ptr = round_block(csum_end);
+    if (features & WFS_FEATURE_JOURNAL) {
+        if (journal_ptr + journal_size > total_size) {
+            total_size = journal_ptr + journal_size;
+        }
+    }
     
     //get the disk file size
     struct stat disk_stat;
@@ -78,7 +150,10 @@ void initalize_disk(const char *disk_path, int disk_id, int raid_mode, int num_i
         .i_blocks_ptr = i_blocks_ptr,
         .d_blocks_ptr = d_blocks_ptr,
         .raid_mode = raid_mode,
-        .disk_id = disk_id
+        .disk_id = disk_id,
+        .features = features,
+        .block_bits = log2_exact(block_size),
+        .stripe_bits = stripe_bits
     };
 
     //write to superblock
@@ -142,6 +217,33 @@ void initalize_disk(const char *disk_path, int disk_id, int raid_mode, int num_i
         exit(FAIL);
     }
 
+    //empty journal, the block after the header is cleared so nothing left there is replayed
+    if (features & WFS_FEATURE_JOURNAL) {
+        struct wfs_journal_header journal = {
+            .magic = JOURNAL_MAGIC,
+            .size = journal_size,
+            .sequence = 1
+        };
+        char *block = calloc(1, BLOCK_SIZE);
+        if (!block) {
+            close(fd);
+            exit(FAIL);
+        }
+        memcpy(block, &journal, sizeof(journal));
+        if (pwrite(fd, block, BLOCK_SIZE, journal_ptr) != BLOCK_SIZE) {
+            free(block);
+            close(fd);
+            exit(FAIL);
+        }
+        memset(block, 0, BLOCK_SIZE);
+        if (pwrite(fd, block, BLOCK_SIZE, journal_ptr + BLOCK_SIZE) != BLOCK_SIZE) {
+            free(block);
+            close(fd);
+            exit(FAIL);
+        }
+        free(block);
+    }
+
     close(fd);
 
 }
@@ -152,6 +254,9 @@ int main(int argc, char*argv []) {
     int num_inodes = 0;
     int num_data_blocks = 0;
     int num_disks = 0;
+    uint32_t features = 0;
+    size_t stripe_unit = 0;
+    size_t journal_size = 0;
 
     // Tokenize the command line arguments
     for (int i = 1; i < argc; i++) {
@@ -189,6 +294,39 @@ int main(int argc, char*argv []) {
             }
             num_data_blocks = atoi(argv[++i]);
         }
+        else if (strcmp(argv[i], "-B") == 0){
+            if (i+1 >= argc) {
+                exit(FAIL);
+            }
+            block_size = parse_size(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-S") == 0){
+            if (i+1 >= argc) {
+                exit(FAIL);
+            }
+            stripe_unit = parse_size(argv[++i]);
+            if (stripe_unit == 0) {
+                exit(FAIL);
+            }
+        }
+        else if (strcmp(argv[i], "-J") == 0){
+            if (i+1 >= argc) {
+                exit(FAIL);
+            }
+            journal_size = parse_size(argv[++i]);
+            if (journal_size == 0) {
+                exit(FAIL);
+            }
+            features |= WFS_FEATURE_JOURNAL;
+        }
+        else if (strcmp(argv[i], "-O") == 0){
+            if (i+1 >= argc) {
+                exit(FAIL);
+            }
+            if (parse_features(argv[++i], &features) != SUCCESS) {
+                exit(FAIL);
+            }
+        }
         else {
             exit(FAIL);
         }
@@ -203,11 +341,46 @@ int main(int argc, char*argv []) {
         exit(FAIL);
     }
 
+    //checksums are checked against the other mirrors, raid 0 has none
+    if ((features & WFS_FEATURE_CHECKSUMS) && raid_mode == 0) {
+        exit(FAIL);
+    }
+
+    //the journal is replayed onto every mirror, raid 0 has none
+    if ((features & WFS_FEATURE_JOURNAL) && (raid_mode == 0 || num_disks <= 1)) {
+        exit(FAIL);
+    }
+
+    //block size must be a power of two between 512 and 64K
+    if (block_size < MIN_BLOCK_SIZE || block_size > MAX_BLOCK_SIZE || log2_exact(block_size) < 0) {
+        exit(FAIL);
+    }
+
+    //stripe unit is a power of two number of blocks, raid 0 only
+    int stripe_bits = 0;
+    if (stripe_unit != 0) {
+        if (raid_mode != 0 || stripe_unit % block_size != 0) {
+            exit(FAIL);
+        }
+        stripe_bits = log2_exact(stripe_unit / block_size);
+        if (stripe_bits < 0) {
+            exit(FAIL);
+        }
+    }
+
+    //journal is whole blocks, a header and room for transactions
+    if (features & WFS_FEATURE_JOURNAL) {
+        journal_size = round_block(journal_size);
+        if (journal_size < MIN_JOURNAL_BLOCKS * BLOCK_SIZE) {
+            exit(FAIL);
+        }
+    }
+
     //should be multiple of nearest 32
     num_inodes = round_32(num_inodes);
 
     for (int i = 0; i < num_disks; i++) {
-        initalize_disk(disk_files[i], i, raid_mode, num_inodes, num_data_blocks);
+        initalize_disk(disk_files[i], i, raid_mode, num_inodes, num_data_blocks, features, stripe_bits, journal_size);
     }
 
     return SUCCESS;
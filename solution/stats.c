@@ -0,0 +1,187 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "wfs.h"
+#include "stats.h"
+
+#define STATS_MAX_SHARDS 128    // CPUs past this share shards
+
+static const char *const op_names[STATS_NUM_OPS] = {
+    "getattr", "lookup", "read", "write", "mknod", "mkdir", "readdir", "unlink", "rmdir",
+};
+
+static const char *const counter_names[STATS_NUM_COUNTERS] = {
+    "path_walks", "path_cached", "dentries_scanned", "blocks_allocated", "bytes_replicated",
+};
+
+struct stats_op_counts {
+    uint64_t count;
+    uint64_t errors;
+    uint64_t ns;
+    uint64_t buckets[STATS_BUCKETS];
+};
+
+// What the threads on one CPU count, on cache lines no other shard shares
+struct stats_shard {
+    struct stats_op_counts ops[STATS_NUM_OPS];
+    uint64_t counters[STATS_NUM_COUNTERS];
+    uint64_t depths[STATS_DEPTHS];
+} __attribute__((aligned(64)));
+
+int stats_init(struct stats *st) {
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    unsigned n = 1;
+    while (n < cpus && n < STATS_MAX_SHARDS) {
+        n *= 2;
+    }
+    if (posix_memalign((void **)&st->shards, 64, n * sizeof(struct stats_shard)) != 0) {
+        st->shards = NULL;
+        return FAIL;
+    }
+    memset(st->shards, 0, n * sizeof(struct stats_shard));
+    st->mask = n - 1;
+    clock_gettime(CLOCK_MONOTONIC, &st->since);
+    return SUCCESS;
+}
+
+void stats_destroy(struct stats *st) {
+    free(st->shards);
+    st->shards = NULL;
+}
+
+// The shard of the CPU the thread is on. It may move right after, which only costs sharing a
+// line for that one update.
+static struct stats_shard *my_shard(struct stats *st) {
+    int cpu = sched_getcpu();
+    return &st->shards[cpu < 0 ? 0 : (unsigned)cpu & st->mask];
+}
+
+static void count(uint64_t *counter, uint64_t n) {
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+void stats_op(struct stats *st, int op, uint64_t start, int failed) {
+    uint64_t ns = stats_start() - start;
+    int bucket = ns == 0 ? 0 : 63 - __builtin_clzll(ns);
+    if (bucket >= STATS_BUCKETS) {
+        bucket = STATS_BUCKETS - 1;
+    }
+
+    struct stats_op_counts *c = &my_shard(st)->ops[op];
+    count(&c->count, 1);
+    count(&c->ns, ns);
+    count(&c->buckets[bucket], 1);
+    if (failed) {
+        count(&c->errors, 1);
+    }
+}
+
+void stats_add(struct stats *st, int counter, uint64_t n) {
+    count(&my_shard(st)->counters[counter], n);
+}
+
+void stats_walk(struct stats *st, int depth) {
+    struct stats_shard *shard = my_shard(st);
+    if (depth < 0) {
+        count(&shard->counters[STATS_PATH_CACHED], 1);
+        return;
+    }
+    count(&shard->counters[STATS_PATH_WALKS], 1);
+    count(&shard->depths[depth < STATS_DEPTHS ? depth : STATS_DEPTHS - 1], 1);
+}
+
+static uint64_t load(const uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+// Microseconds by which the given fraction of the ops in c finished: the upper end of the
+// bucket it falls in
+static double percentile_us(const struct stats_op_counts *c, double fraction) {
+    uint64_t rank = (uint64_t)(c->count * fraction);
+    uint64_t seen = 0;
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        seen += c->buckets[i];
+        if (seen > rank) {
+            return (double)(2ull << i) / 1000;
+        }
+    }
+    return (double)(2ull << (STATS_BUCKETS - 1)) / 1000;
+}
+
+char *stats_format(struct stats *st, size_t *len) {
+    // Totals over the shards
+    struct stats_shard sum;
+    memset(&sum, 0, sizeof(sum));
+    for (unsigned s = 0; s <= st->mask; s++) {
+        struct stats_shard *shard = &st->shards[s];
+        for (int op = 0; op < STATS_NUM_OPS; op++) {
+            sum.ops[op].count += load(&shard->ops[op].count);
+            sum.ops[op].errors += load(&shard->ops[op].errors);
+            sum.ops[op].ns += load(&shard->ops[op].ns);
+            for (int i = 0; i < STATS_BUCKETS; i++) {
+                sum.ops[op].buckets[i] += load(&shard->ops[op].buckets[i]);
+            }
+        }
+        for (int i = 0; i < STATS_NUM_COUNTERS; i++) {
+            sum.counters[i] += load(&shard->counters[i]);
+        }
+        for (int i = 0; i < STATS_DEPTHS; i++) {
+            sum.depths[i] += load(&shard->depths[i]);
+        }
+    }
+
+    char *text = NULL;
+    FILE *out = open_memstream(&text, len);
+    if (!out) {
+        return NULL;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    fprintf(out, "uptime %.3f\n", (now.tv_sec - st->since.tv_sec) + (now.tv_nsec - st->since.tv_nsec) / 1e9);
+
+    // Ops. The percentiles are the upper ends of their buckets, so within a factor of 2.
+    fprintf(out, "\n%-8s %12s %10s %10s %10s %10s\n", "op", "count", "errors", "avg_us", "p50_us", "p99_us");
+    for (int op = 0; op < STATS_NUM_OPS; op++) {
+        const struct stats_op_counts *c = &sum.ops[op];
+        fprintf(out, "%-8s %12llu %10llu %10.1f %10.1f %10.1f\n", op_names[op],
+                (unsigned long long)c->count, (unsigned long long)c->errors,
+                c->count ? (double)c->ns / c->count / 1000 : 0.0,
+                c->count ? percentile_us(c, 0.5) : 0.0, c->count ? percentile_us(c, 0.99) : 0.0);
+    }
+
+    fprintf(out, "\n");
+    for (int i = 0; i < STATS_NUM_COUNTERS; i++) {
+        fprintf(out, "%-16s %llu\n", counter_names[i], (unsigned long long)sum.counters[i]);
+    }
+
+    // Histograms, as lower end:count for every bucket that isn't empty
+    fprintf(out, "\n# walk depth in components:walks\ndepth");
+    for (int i = 0; i < STATS_DEPTHS; i++) {
+        if (sum.depths[i] != 0) {
+            fprintf(out, " %d:%llu", i, (unsigned long long)sum.depths[i]);
+        }
+    }
+    fprintf(out, "\n\n# latency from ns:ops, each bucket up to twice its start\n");
+    for (int op = 0; op < STATS_NUM_OPS; op++) {
+        if (sum.ops[op].count == 0) {
+            continue;
+        }
+        fprintf(out, "%s", op_names[op]);
+        for (int i = 0; i < STATS_BUCKETS; i++) {
+            if (sum.ops[op].buckets[i] != 0) {
+                fprintf(out, " %llu:%llu", 1ull << i, (unsigned long long)sum.ops[op].buckets[i]);
+            }
+        }
+        fprintf(out, "\n");
+    }
+
+    if (fclose(out) != 0) {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
@@ -0,0 +1,79 @@
+#ifndef WFS_STATS_H
+#define WFS_STATS_H
+
+/*
+  Operation statistics, read through /.wfs/stats or printed on SIGUSR1.
+
+  The FUSE front ends count every request of the operations below, with
+  its errors and time, and put its latency in a histogram of power of two
+  buckets of nanoseconds. The core counts the work behind them: path
+  walks and how many components they took, directory entries compared,
+  data blocks allocated and bytes copied to the other disks by a sync.
+
+  Counters are kept per CPU, each set on cache lines of its own, and added
+  to with relaxed atomics, so threads on different CPUs never write the
+  same line and recording takes no lock. stats_format() adds the sets up,
+  which doesn't stop anyone, so the totals aren't all from one instant.
+
+  Every mounted filesystem has its own struct stats.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+enum stats_op {
+    STATS_GETATTR,
+    STATS_LOOKUP,       // --lowlevel only, the path API walks paths in the others
+    STATS_READ,
+    STATS_WRITE,
+    STATS_MKNOD,        // mknod and create
+    STATS_MKDIR,
+    STATS_READDIR,
+    STATS_UNLINK,
+    STATS_RMDIR,
+    STATS_NUM_OPS
+};
+
+enum stats_counter {
+    STATS_PATH_WALKS,       // Paths resolved a component at a time
+    STATS_PATH_CACHED,      // Paths the dentry cache had whole
+    STATS_DENTRIES_SCANNED,
+    STATS_BLOCKS_ALLOCATED,
+    STATS_BYTES_REPLICATED,
+    STATS_NUM_COUNTERS
+};
+
+#define STATS_BUCKETS 36    // Bucket i counts latencies in [2^i, 2^(i+1)) ns, the last one longer ones too
+#define STATS_DEPTHS  16    // Walks of 0 to 14 components, and longer ones in the last
+
+struct stats_shard;
+
+struct stats {
+    struct stats_shard *shards;
+    unsigned mask;              // Number of shards - 1, a power of two
+    struct timespec since;      // stats_init(), CLOCK_MONOTONIC
+};
+
+int stats_init(struct stats *st);
+void stats_destroy(struct stats *st);
+
+// Now in nanoseconds, to pass to stats_op() when the operation is done
+static inline uint64_t stats_start(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Counts one op that started at `start`, an error when failed is set
+void stats_op(struct stats *st, int op, uint64_t start, int failed);
+
+void stats_add(struct stats *st, int counter, uint64_t n);
+
+// Counts a path walk of depth components, or one the dentry cache answered when depth is -1
+void stats_walk(struct stats *st, int depth);
+
+// The totals as text in a malloc'd string, with its length in *len. NULL when out of memory.
+char *stats_format(struct stats *st, size_t *len);
+
+#endif
@@ -0,0 +1,132 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+// Event table shared with wfs-trace
+#define TRACE_EVENT(name, level, fmt) { #name, TRACE_##level, fmt },
+const struct trace_event_info trace_events[TRACE_NUM_EVENTS] = {
+#include "trace_events.h"
+};
+#undef TRACE_EVENT
+
+// Level recorded at runtime, stays TRACE_OFF unless the ring buffer is set up
+int trace_level = TRACE_OFF;
+
+static struct trace_header *trace_hdr;
+static struct trace_record *trace_ring;
+static size_t trace_map_size;
+static __thread uint32_t trace_tid;
+
+// Rounds up to the next power of two so the ring index is a mask
+static uint64_t round_pow2(uint64_t value) {
+    uint64_t n = 1;
+    while (n < value) {
+        n <<= 1;
+    }
+    return n;
+}
+
+// Maps the ring buffer file if WFS_TRACE is set. Returns 0 on success or when tracing is off.
+int trace_init(void) {
+    const char *level = getenv("WFS_TRACE");
+    if (level == NULL || atoi(level) <= TRACE_OFF) {
+        return 0;
+    }
+
+    char default_path[64];
+    const char *path = getenv("WFS_TRACE_FILE");
+    if (path == NULL) {
+        snprintf(default_path, sizeof(default_path), "/tmp/wfs-trace.%d", (int)getpid());
+        path = default_path;
+    }
+
+    uint64_t num_records = TRACE_DEFAULT_RECORDS;
+    const char *records = getenv("WFS_TRACE_RECORDS");
+    if (records != NULL && atol(records) > 0) {
+        num_records = round_pow2(atol(records));
+    }
+
+    int fd = open(path, O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+        return -1;
+    }
+
+    size_t map_size = sizeof(struct trace_header) + num_records * sizeof(struct trace_record);
+    if (ftruncate(fd, map_size) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    void *region = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        return -1;
+    }
+
+    trace_hdr = region;
+    trace_hdr->magic = TRACE_MAGIC;
+    trace_hdr->version = TRACE_VERSION;
+    trace_hdr->num_records = num_records;
+    atomic_store(&trace_hdr->head, 0);
+    trace_ring = (struct trace_record *)(trace_hdr + 1);
+    trace_map_size = map_size;
+
+    trace_level = atoi(level);
+    return 0;
+}
+
+void trace_shutdown(void) {
+    if (trace_hdr == NULL) {
+        return;
+    }
+    trace_level = TRACE_OFF;
+    munmap(trace_hdr, trace_map_size);
+    trace_hdr = NULL;
+    trace_ring = NULL;
+}
+
+// Claims the next slot and copies the event into it. Lock-free, slots are overwritten
+// once the ring wraps and readers use the seq field to skip records that are in flux.
+void trace_emit(int event, const char *str, int nargs, int64_t a0, int64_t a1, int64_t a2, int64_t a3) {
+    if (trace_hdr == NULL) {
+        return;
+    }
+
+    uint64_t seq = atomic_fetch_add_explicit(&trace_hdr->head, 1, memory_order_relaxed);
+    struct trace_record *rec = &trace_ring[seq & (trace_hdr->num_records - 1)];
+
+    atomic_store_explicit(&rec->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (trace_tid == 0) {
+        trace_tid = (uint32_t)syscall(SYS_gettid);
+    }
+
+    rec->time_ns = (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+    rec->event = event;
+    rec->tid = trace_tid;
+    rec->nargs = nargs;
+    rec->args[0] = a0;
+    rec->args[1] = a1;
+    rec->args[2] = a2;
+    rec->args[3] = a3;
+    if (str != NULL) {
+        size_t len = strnlen(str, TRACE_STR_LEN - 1);
+        memcpy(rec->str, str, len);
+        rec->str[len] = '\0';
+    } else {
+        rec->str[0] = '\0';
+    }
+
+    atomic_store_explicit(&rec->seq, seq + 1, memory_order_release);
+}
@@ -0,0 +1,108 @@
+#ifndef WFS_TRACE_H
+#define WFS_TRACE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+  Binary tracing for wfs.
+
+  Call sites log an event id plus up to one string and four integers:
+
+      TRACE(GET_INODE, NULL, inode_num);
+      TRACE(FIND_DENTRY, name, dir_inode->num);
+
+  The format string and level of every event live in trace_events.h. Nothing is
+  formatted at runtime, records are copied into a shared-memory ring buffer that
+  `wfs-trace` decodes.
+
+  WFS_TRACE_LEVEL picks which levels are compiled in (0 compiles every TRACE()
+  away). At runtime the WFS_TRACE environment variable sets the level that is
+  recorded and WFS_TRACE_FILE the ring buffer file (default /tmp/wfs-trace.<pid>).
+*/
+
+#define TRACE_OFF   0
+#define TRACE_ERROR 1
+#define TRACE_INFO  2
+#define TRACE_DEBUG 3
+
+#ifndef WFS_TRACE_LEVEL
+#define WFS_TRACE_LEVEL TRACE_DEBUG
+#endif
+
+#define TRACE_MAGIC     0x54534657  // "WFST"
+#define TRACE_VERSION   1
+#define TRACE_STR_LEN   64
+#define TRACE_MAX_ARGS  4
+#define TRACE_DEFAULT_RECORDS (1 << 16)
+
+// Event ids and their levels, generated from trace_events.h
+#define TRACE_EVENT(name, level, fmt) TRACE_EV_##name,
+enum trace_event_id {
+#include "trace_events.h"
+    TRACE_NUM_EVENTS
+};
+#undef TRACE_EVENT
+
+#define TRACE_EVENT(name, level, fmt) TRACE_LVL_##name = TRACE_##level,
+enum trace_event_level {
+#include "trace_events.h"
+};
+#undef TRACE_EVENT
+
+// Header at offset 0 of the ring buffer file
+struct trace_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t num_records;       // Always a power of two
+    _Atomic uint64_t head;      // Next sequence number to hand out
+};
+
+// Fixed-size record, the ring follows the header
+struct trace_record {
+    _Atomic uint64_t seq;       // Sequence number + 1 once the record is complete, 0 while writing
+    uint64_t time_ns;           // CLOCK_MONOTONIC
+    uint32_t event;
+    uint32_t tid;
+    int64_t args[TRACE_MAX_ARGS];
+    char str[TRACE_STR_LEN];
+    uint32_t nargs;
+    uint32_t pad;
+};
+
+struct trace_event_info {
+    const char *name;
+    int level;
+    const char *fmt;
+};
+
+extern const struct trace_event_info trace_events[TRACE_NUM_EVENTS];
+extern int trace_level;
+
+int trace_init(void);
+void trace_shutdown(void);
+void trace_emit(int event, const char *str, int nargs, int64_t a0, int64_t a1, int64_t a2, int64_t a3);
+
+// TRACE(event, str, [up to four integer args])
+#define TRACE_NARGS(...) TRACE_NARGS_(__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define TRACE_NARGS_(_1, _2, _3, _4, _5, _6, n, ...) n
+#define TRACE_CAT(a, b) TRACE_CAT_(a, b)
+#define TRACE_CAT_(a, b) a##b
+
+#define TRACE(...) TRACE_CAT(TRACE_, TRACE_NARGS(__VA_ARGS__))(__VA_ARGS__)
+#define TRACE_2(ev, s)                TRACE_IF(ev, s, 0, 0, 0, 0, 0)
+#define TRACE_3(ev, s, a0)            TRACE_IF(ev, s, 1, a0, 0, 0, 0)
+#define TRACE_4(ev, s, a0, a1)        TRACE_IF(ev, s, 2, a0, a1, 0, 0)
+#define TRACE_5(ev, s, a0, a1, a2)    TRACE_IF(ev, s, 3, a0, a1, a2, 0)
+#define TRACE_6(ev, s, a0, a1, a2, a3) TRACE_IF(ev, s, 4, a0, a1, a2, a3)
+
+// The first test is a constant, so disabled levels generate no code
+#define TRACE_IF(ev, s, n, a0, a1, a2, a3)                                          \
+    do {                                                                            \
+        if (TRACE_LVL_##ev <= WFS_TRACE_LEVEL && TRACE_LVL_##ev <= trace_level) {   \
+            trace_emit(TRACE_EV_##ev, (s), (n), (int64_t)(a0), (int64_t)(a1),       \
+                       (int64_t)(a2), (int64_t)(a3));                               \
+        }                                                                           \
+    } while (0)
+
+#endif
@@ -0,0 +1,164 @@
+// Trace events: TRACE_EVENT(name, level, format)
+//
+// Formats follow printf, but only one %s (the string argument of TRACE()) and up
+// to four integer conversions are allowed. Integers are stored as int64_t so
+// length modifiers are ignored when decoding. Append new events at the end of
+// a section, ids are only meaningful between a wfs binary and its wfs-trace.
+
+// Lookup and allocation helpers
+TRACE_EVENT(GET_INODE,             DEBUG, "get_inode: Accessing inode number %d")
+TRACE_EVENT(FIND_DISK,             DEBUG, "find_disk: Checking available space for inode %d")
+TRACE_EVENT(FIND_DISK_BLOCK,       DEBUG, "find_disk: Inspecting block %d")
+TRACE_EVENT(FIND_DISK_FOUND,       DEBUG, "find_disk: Found space in block %d on disk %d")
+TRACE_EVENT(FIND_DISK_NEW,         DEBUG, "find_disk: No free space, allocating on disk %d for new block")
+TRACE_EVENT(FIND_DISK_BAD_CALLER,  ERROR, "find_disk: calling type not defined")
+TRACE_EVENT(ALLOC_BLOCK,           DEBUG, "allocate_free_data_block: Searching for a free data block on disk %d")
+TRACE_EVENT(ALLOC_BLOCK_FOUND,     DEBUG, "allocate_free_data_block: Found free block at index %d")
+TRACE_EVENT(ALLOC_BLOCK_NOSPC,     ERROR, "allocate_free_data_block: No free data blocks available")
+TRACE_EVENT(ALLOC_INODE,           DEBUG, "allocate_free_inode: Allocated inode %d")
+TRACE_EVENT(ALLOC_INODE_NOSPC,     ERROR, "allocate_free_inode: No free inodes available")
+TRACE_EVENT(FREE_INODE,            DEBUG, "free_inode: Freeing inode number %d")
+TRACE_EVENT(FIND_DENTRY,           DEBUG, "find_dentry_in_directory: Searching for entry '%s' in directory inode %d")
+TRACE_EVENT(FIND_DENTRY_BLOCK,     DEBUG, "find_dentry_in_directory: Checking block %d on disk %d with block address %ld")
+TRACE_EVENT(FIND_DENTRY_FOUND,     DEBUG, "find_dentry_in_directory: Found matching entry '%s', inode num: %d")
+TRACE_EVENT(FIND_DENTRY_MISS,      DEBUG, "find_dentry_in_directory: Entry '%s' not found")
+TRACE_EVENT(LOOKUP,                DEBUG, "find_inode_by_path: Searching for path: %s")
+TRACE_EVENT(LOOKUP_BAD_PATH,       ERROR, "find_inode_by_path: Must start with '/': %s")
+TRACE_EVENT(LOOKUP_NO_ROOT,        ERROR, "find_inode_by_path: Failed to retrieve root inode")
+TRACE_EVENT(LOOKUP_CACHED,         DEBUG, "find_inode_by_path: Path cache hit, inode %d for path: %s")
+TRACE_EVENT(LOOKUP_DENTRY_CACHED,  DEBUG, "find_inode_by_path: Dentry cache hit for '%s', inode %d")
+TRACE_EVENT(LOOKUP_TOKEN,          DEBUG, "find_inode_by_path: Current token: %s")
+TRACE_EVENT(LOOKUP_NOTDIR,         DEBUG, "find_inode_by_path: Path component '%s' is not a directory")
+TRACE_EVENT(LOOKUP_NOENT,          DEBUG, "find_inode_by_path: Path component '%s' not found")
+TRACE_EVENT(LOOKUP_NO_INODE,       ERROR, "find_inode_by_path: Failed to retrieve inode for '%s'")
+TRACE_EVENT(LOOKUP_DONE,           DEBUG, "find_inode_by_path: Found inode %d for path: %s")
+TRACE_EVENT(ADD_DENTRY,            DEBUG, "add_dentry_to_directory: Adding '%s' to directory inode %d")
+TRACE_EVENT(ADD_DENTRY_DISK,       DEBUG, "add_dentry_to_directory: Target disk determined by find_disk is %d")
+TRACE_EVENT(ADD_DENTRY_NEW_BLOCK,  DEBUG, "add_dentry_to_directory: Allocated new block %d on disk %d for entry %d")
+TRACE_EVENT(ADD_DENTRY_TARGET,     DEBUG, "add_dentry_to_directory: Using target disk: %d")
+TRACE_EVENT(ADD_DENTRY_NOSPC,      ERROR, "add_dentry_to_directory: Failed to allocate data block for disk %d")
+TRACE_EVENT(ADD_DENTRY_ALLOC,      DEBUG, "add_dentry_to_directory: Allocated block %d on disk %d")
+TRACE_EVENT(ADD_DENTRY_DONE,       DEBUG, "add_dentry_to_directory: Added dentry '%s' in block %d, slot %d")
+TRACE_EVENT(ADD_DENTRY_FULL,       ERROR, "add_dentry_to_directory: No space left in directory inode %d")
+
+// Disk synchronization
+TRACE_EVENT(SYNC_RAID1,            DEBUG, "sync_disks_for_raid1: Synchronized %zu bytes from disk %d to other disks")
+TRACE_EVENT(SYNC_RAID0,            DEBUG, "sync_disks_for_raid0: Synchronized %zu bytes of metadata from disk %d to other disks")
+
+// Unlink and rmdir helpers
+TRACE_EVENT(RMDIR_NOT_EMPTY,       INFO,  "remove_directory_helper: Directory is not empty: %s")
+TRACE_EVENT(UNLINK_FREE_BLOCK,     DEBUG, "unlink_file_helper: Freeing block %d on disk %d")
+TRACE_EVENT(UNLINK_FREE_IND,       DEBUG, "unlink_file_helper: Freeing indirect block at %ld on disk %d")
+TRACE_EVENT(UNLINK_FREE_IND_ENTRY, DEBUG, "unlink_file_helper: Freeing indirect entry %d at %ld on disk %d")
+
+// readdir helper
+TRACE_EVENT(READDIR_NO_INODE,      ERROR, "wfs_readdir: Could not retrieve inode for entry: %s")
+TRACE_EVENT(READDIR_FULL,          DEBUG, "wfs_readdir: Buffer full, stopping directory reading")
+
+// FUSE callbacks
+TRACE_EVENT(GETATTR,               INFO,  "wfs_getattr: Getting attributes for path: %s")
+TRACE_EVENT(GETATTR_NOENT,         DEBUG, "wfs_getattr: File not found: %s")
+TRACE_EVENT(MKDIR,                 INFO,  "wfs_mkdir: Attempting to create directory at path: %s")
+TRACE_EVENT(MKDIR_BAD_PATH,        ERROR, "wfs_mkdir: Invalid path argument: %s")
+TRACE_EVENT(MKDIR_ROOT,            INFO,  "wfs_mkdir: Attempt to create root directory denied")
+TRACE_EVENT(MKDIR_NOMEM,           ERROR, "wfs_mkdir: Memory allocation failed for path copy")
+TRACE_EVENT(MKDIR_NAMETOOLONG,     INFO,  "wfs_mkdir: Name too long: %s")
+TRACE_EVENT(MKDIR_NO_PARENT,       INFO,  "wfs_mkdir: Parent directory not found: %s")
+TRACE_EVENT(MKDIR_PARENT_NOTDIR,   INFO,  "wfs_mkdir: Parent inode is not a directory: %s")
+TRACE_EVENT(MKDIR_EXISTS,          INFO,  "wfs_mkdir: Directory already exists with name: %s")
+TRACE_EVENT(MKDIR_NO_INODE,        ERROR, "wfs_mkdir: No free inodes available")
+TRACE_EVENT(MKDIR_BAD_INODE,       ERROR, "wfs_mkdir: Failed to retrieve allocated inode %d")
+TRACE_EVENT(MKDIR_INODE,           DEBUG, "wfs_mkdir: Initialized new inode: %d")
+TRACE_EVENT(MKDIR_NO_DENTRY,       ERROR, "wfs_mkdir: Failed to add new directory entry to parent")
+TRACE_EVENT(MKDIR_DONE,            INFO,  "wfs_mkdir: Successfully created directory: %s")
+TRACE_EVENT(MKNOD,                 INFO,  "wfs_mknod: Attempting to create file at path: %s")
+TRACE_EVENT(MKNOD_BAD_PATH,        ERROR, "wfs_mknod: Invalid path argument: %s")
+TRACE_EVENT(MKNOD_ROOT,            INFO,  "wfs_mknod: Attempt to create root directory denied")
+TRACE_EVENT(MKNOD_NOMEM,           ERROR, "wfs_mknod: Memory allocation failed for path copy")
+TRACE_EVENT(MKNOD_NAMETOOLONG,     INFO,  "wfs_mknod: File name '%s' is too long (max: %d)")
+TRACE_EVENT(MKNOD_NO_PARENT,       INFO,  "wfs_mknod: Parent directory not found: %s")
+TRACE_EVENT(MKNOD_PARENT_NOTDIR,   INFO,  "wfs_mknod: Parent inode is not a directory: %s")
+TRACE_EVENT(MKNOD_EXISTS,          INFO,  "wfs_mknod: File already exists with name: %s")
+TRACE_EVENT(MKNOD_NO_INODE,        ERROR, "wfs_mknod: No free inodes available")
+TRACE_EVENT(MKNOD_BAD_INODE,       ERROR, "wfs_mknod: Failed to retrieve allocated inode %d")
+TRACE_EVENT(MKNOD_INODE,           DEBUG, "wfs_mknod: Initialized new inode: %d")
+TRACE_EVENT(MKNOD_NO_DENTRY,       ERROR, "wfs_mknod: Failed to add new file entry to parent")
+TRACE_EVENT(MKNOD_DONE,            INFO,  "wfs_mknod: Successfully created file: %s")
+TRACE_EVENT(WRITE,                 INFO,  "wfs_write: Writing %zu bytes to file at path: %s, offset: %jd")
+TRACE_EVENT(WRITE_BAD_PATH,        ERROR, "wfs_write: Invalid path argument: %s")
+TRACE_EVENT(WRITE_NOENT,           INFO,  "wfs_write: File not found: %s")
+TRACE_EVENT(WRITE_NOTREG,          INFO,  "wfs_write: Path is not a regular file: %s")
+TRACE_EVENT(WRITE_BLOCK,           DEBUG, "wfs_write: Block index %d, block offset %d")
+TRACE_EVENT(WRITE_IND_ALLOC,       DEBUG, "wfs_write: Allocating indirect block")
+TRACE_EVENT(WRITE_IND_NOSPC,       ERROR, "wfs_write: Failed to allocate indirect block")
+TRACE_EVENT(WRITE_NOSPC,           ERROR, "wfs_write: No free data blocks available")
+TRACE_EVENT(WRITE_ALLOC,           DEBUG, "wfs_write: Allocated new data block at index %d on disk %d")
+TRACE_EVENT(WRITE_DONE,            INFO,  "wfs_write: Successfully wrote %zu bytes to file: %s")
+TRACE_EVENT(READDIR,               INFO,  "wfs_readdir: Reading directory entries for path: %s")
+TRACE_EVENT(READDIR_BAD_PATH,      ERROR, "wfs_readdir: Invalid path argument: %s")
+TRACE_EVENT(READDIR_NOENT,         INFO,  "wfs_readdir: Directory not found: %s")
+TRACE_EVENT(READDIR_NOTDIR,        INFO,  "wfs_readdir: Path is not a directory: %s")
+TRACE_EVENT(READ,                  INFO,  "wfs_read: Reading %zu bytes from file at path: %s, offset: %jd")
+TRACE_EVENT(READ_BAD_PATH,         ERROR, "wfs_read: Invalid path argument: %s")
+TRACE_EVENT(READ_NOENT,            INFO,  "wfs_read: File not found: %s")
+TRACE_EVENT(READ_NOTREG,           INFO,  "wfs_read: Path is not a regular file: %s")
+TRACE_EVENT(READ_HOLE,             INFO,  "wfs_read: Tried to read from an unallocated block %d")
+TRACE_EVENT(READ_BAD_CSUM,         ERROR, "wfs_read: Checksum mismatch for block %d on disk %d")
+TRACE_EVENT(READ_DONE,             INFO,  "wfs_read: Read %zu bytes from file: %s")
+TRACE_EVENT(UNLINK,                INFO,  "wfs_unlink: trying to unlink file: %s")
+TRACE_EVENT(UNLINK_NOMEM,          ERROR, "wfs_unlink: mem alloc failed for file path")
+TRACE_EVENT(UNLINK_NO_PARENT,      INFO,  "wfs_unlink: parent directory not found or not directory: %s")
+TRACE_EVENT(UNLINK_NOENT,          INFO,  "wfs_unlink: file not found: %s")
+TRACE_EVENT(UNLINK_NOTREG,         INFO,  "wfs_unlink: can't unlink %s, not a regular file")
+TRACE_EVENT(RMDIR,                 INFO,  "wfs_rmdir: trying to remove directory: %s")
+TRACE_EVENT(RMDIR_ROOT,            INFO,  "wfs_rmdir: can't remove root directory")
+TRACE_EVENT(RMDIR_NOMEM,           ERROR, "wfs_rmdir: mem alloc failed for directory path")
+TRACE_EVENT(RMDIR_NO_PARENT,       INFO,  "wfs_rmdir: parent directory not found or not directory: %s")
+TRACE_EVENT(RMDIR_NOENT,           INFO,  "wfs_rmdir: directory not found: %s")
+TRACE_EVENT(RMDIR_NOTDIR,          INFO,  "wfs_rmdir: can't remove %s, not a directory")
+
+// Hashed directory index
+TRACE_EVENT(DX_SPLIT,              DEBUG, "dx: Split level %d node of directory inode %d")
+TRACE_EVENT(DX_GROW,               INFO,  "dx: Directory inode %d grew to %d levels")
+TRACE_EVENT(DX_SHRINK,             DEBUG, "dx: Directory inode %d shrank to %d levels")
+TRACE_EVENT(DX_NOSPC,              ERROR, "dx: No free blocks to grow directory inode %d")
+TRACE_EVENT(DX_COLLIDE,            ERROR, "dx: Leaf of directory inode %d is full of one hash")
+TRACE_EVENT(DX_BAD_NODE,           ERROR, "dx: Bad index node at block %d of directory inode %d")
+
+// File block mapping
+TRACE_EVENT(EXT_ALLOC,             DEBUG, "extents: Inode %d got blocks %d..+%d on disk %d")
+TRACE_EVENT(EXT_BAD_BLOCK,         ERROR, "extents: Bad extent block at %d")
+
+// Background scrubber
+TRACE_EVENT(SCRUB_START,           INFO,  "scrub: Started, at most %d MB/s")
+TRACE_EVENT(SCRUB_REPAIR,          ERROR, "scrub: Rewrote the copy of block %d on disk %d from disk %d")
+TRACE_EVENT(SCRUB_UNVERIFIED,      ERROR, "scrub: No copy of block %d matches its checksum, kept the majority")
+TRACE_EVENT(SCRUB_PROGRESS,        DEBUG, "scrub: Pass %d is %d%% done")
+TRACE_EVENT(SCRUB_PASS,            INFO,  "scrub: Pass %d checked %zu blocks, repaired %zu, %zu had no good copy")
+
+// Low-level API and unlinked inodes still in use
+TRACE_EVENT(LL_LOOKUP,             DEBUG, "ll_lookup: Looking up '%s' in directory inode %d")
+TRACE_EVENT(LL_STALE,              ERROR, "ll: Request for inode %d, which isn't allocated")
+TRACE_EVENT(ORPHAN,                INFO,  "drop_inode: Inode %d has no links left but is in use, freeing it with its last reference")
+TRACE_EVENT(ORPHAN_FREE,           DEBUG, "Freeing unlinked inode %d")
+
+// Open files
+TRACE_EVENT(OPEN,                  INFO,  "wfs_open: Opening %s")
+TRACE_EVENT(OPEN_NOENT,            INFO,  "wfs_open: Not found: %s")
+TRACE_EVENT(OPEN_NOMEM,            ERROR, "open_file: No memory for a handle to inode %d")
+TRACE_EVENT(RELEASE,               DEBUG, "release_file: Closing inode %d")
+TRACE_EVENT(READAHEAD,             DEBUG, "file_readahead: Inode %d, bytes %jd..%jd")
+
+// Writeback
+TRACE_EVENT(WB_SYNC,               DEBUG, "writeback: Synced %zu ranges, %zu bytes")
+TRACE_EVENT(WB_JOIN,               DEBUG, "writeback: Waiting for sync %lu, one is running")
+TRACE_EVENT(WB_SYNC_FAIL,          ERROR, "writeback: Sync %lu failed, its chunks stay dirty")
+TRACE_EVENT(FSYNC,                 INFO,  "fsync_file: Syncing for inode %d")
+
+// Journal
+TRACE_EVENT(JOURNAL_COMMIT,        DEBUG, "journal: Committed transaction %lu, %lu bytes of records")
+TRACE_EVENT(JOURNAL_CHECKPOINT,    INFO,  "journal: Checkpoint, next transaction %lu")
+TRACE_EVENT(JOURNAL_TOO_BIG,       INFO,  "journal: %zu bytes don't fit, checkpointing and writing them in place")
+TRACE_EVENT(JOURNAL_REPLAY,        INFO,  "journal: Replayed %d transactions, %zu bytes, from disk %d")
+TRACE_EVENT(JOURNAL_LOST,          ERROR, "journal: Lost track of the data blocks an operation changed, out of memory")
+TRACE_EVENT(JOURNAL_APPLY,         DEBUG, "journal: Wrote %zu bytes of committed transactions in place, %zd bytes of records")
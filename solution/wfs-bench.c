@@ -0,0 +1,486 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "libwfs.h"
+
+#define FAIL 1
+#define SUCCESS 0
+
+/*
+  Drives the filesystem core through libwfs.h, without FUSE or the kernel, and
+  prints the results as JSON on stdout.
+
+  usage: wfs-bench [-r modes] [-d image dir] [-n ops] [-s data MB] [-B block size]
+                   [-O features] [-J journal size] [-m mkfs]
+
+  For every RAID mode in the comma separated list (0,1,1v by default) two
+  images are made with mkfs in the image directory (/dev/shm by default, so
+  the disks are in memory), mounted with wfs_fs_mount() and put through:
+  - lookup: stat of a file 1, 4 and 16 directories deep
+  - create, unlink: ops files, 64 to a directory
+  - seq_write, seq_read: a file of a quarter of the data region in 64K pieces
+  - rand_write, rand_read: ops 4K pieces at random places in that file
+  - alloc_4k: ops 4K appends to a new file with the data region filled to
+    0, 50 and 90% by files of 128 blocks, every 10th of them deleted again
+
+  Each result has the ops per second, from the whole run including the fsync
+  that ends the writes, and the p50 and p99 latency of a single call in
+  microseconds. The writes' fsync is where RAID 1 and 1v copy to the other
+  mirror, so it is the RAID overhead that shows up between the modes. -B, -O
+  (dir_index by default) and -J are passed to mkfs. -O "" formats without
+  features.
+  Build with make RELEASE=1 for numbers worth comparing.
+*/
+
+#define NUM_DISKS      2
+#define FILES_PER_DIR  64
+#define IO_SIZE        (64 * 1024)
+#define RAND_SIZE      4096
+#define FILL_BLOCKS    128
+
+static const char *image_dir = "/dev/shm";
+static const char *mkfs_path = "./mkfs";
+static const char *features = "dir_index";
+static const char *journal;
+static size_t block_size = 512;
+static size_t data_mb = 64;
+static size_t ops = 2000;
+
+static char disk_names[NUM_DISKS][256];
+static size_t data_blocks;
+
+// Latencies of one run of an operation
+struct series {
+    double *lat;    // ns
+    size_t n;
+    double start;
+};
+
+static int first_result = 1;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void die(const char *what, const char *path, int ret) {
+    fprintf(stderr, "wfs-bench: %s %s: %s\n", what, path ? path : "", ret < 0 ? strerror(-ret) : "failed");
+    for (int i = 0; i < NUM_DISKS; i++) {
+        if (disk_names[i][0]) {
+            unlink(disk_names[i]);
+        }
+    }
+    exit(FAIL);
+}
+
+// Same as mkfs -B and -J
+static size_t parse_size(const char *arg) {
+    char *end;
+    size_t size = strtoul(arg, &end, 10);
+    if (*end == 'K' || *end == 'k') {
+        size *= 1024;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        size *= 1024 * 1024;
+        end++;
+    }
+    return *end == '\0' ? size : 0;
+}
+
+static void series_start(struct series *s, size_t max) {
+    s->lat = realloc(s->lat, max * sizeof(double));
+    if (!s->lat) {
+        die("allocating", NULL, -ENOMEM);
+    }
+    s->n = 0;
+    s->start = now_ns();
+}
+
+static void series_add(struct series *s, double t0) {
+    s->lat[s->n++] = now_ns() - t0;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Prints one result. extra is more JSON members for it, such as "depth": 4, or "".
+static void report(const char *mode, const char *test, const char *extra, struct series *s, size_t bytes) {
+    double elapsed = now_ns() - s->start;
+    qsort(s->lat, s->n, sizeof(double), cmp_double);
+    double p50 = s->n ? s->lat[s->n / 2] : 0;
+    double p99 = s->n ? s->lat[s->n * 99 / 100] : 0;
+
+    printf("%s\n    {\"mode\": \"%s\", \"test\": \"%s\", %s%s\"ops\": %zu, \"ops_per_sec\": %.1f, ",
+           first_result ? "" : ",", mode, test, extra, *extra ? ", " : "", s->n, s->n / (elapsed / 1e9));
+    if (bytes) {
+        printf("\"mb_per_sec\": %.1f, ", bytes / (elapsed / 1e9) / (1024 * 1024));
+    }
+    printf("\"p50_us\": %.2f, \"p99_us\": %.2f}", p50 / 1e3, p99 / 1e3);
+    fflush(stdout);
+    first_result = 0;
+}
+
+// Makes fresh images for mode with mkfs
+static void make_images(const char *mode, size_t num_inodes) {
+    size_t bytes = data_blocks * (block_size + 4) + num_inodes * block_size + (journal ? parse_size(journal) : 0) +
+                   1024 * 1024;
+    // Written out rather than sparse, so the first write to a block doesn't also pay for
+    // tmpfs finding a page for it
+    static char zeros[1024 * 1024];
+    for (int i = 0; i < NUM_DISKS; i++) {
+        snprintf(disk_names[i], sizeof(disk_names[i]), "%s/wfs-bench-disk%d", image_dir, i + 1);
+        int fd = open(disk_names[i], O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            die("creating", disk_names[i], -errno);
+        }
+        for (size_t done = 0; done < bytes; done += sizeof(zeros)) {
+            if (write(fd, zeros, sizeof(zeros)) != sizeof(zeros)) {
+                die("writing", disk_names[i], -errno);
+            }
+        }
+        close(fd);
+    }
+
+    char inodes_arg[32], blocks_arg[32], bsize_arg[32];
+    snprintf(inodes_arg, sizeof(inodes_arg), "%zu", num_inodes);
+    snprintf(blocks_arg, sizeof(blocks_arg), "%zu", data_blocks);
+    snprintf(bsize_arg, sizeof(bsize_arg), "%zu", block_size);
+    char *args[20];
+    int n = 0;
+    args[n++] = (char *)mkfs_path;
+    args[n++] = "-r";
+    args[n++] = (char *)mode;
+    for (int i = 0; i < NUM_DISKS; i++) {
+        args[n++] = "-d";
+        args[n++] = disk_names[i];
+    }
+    args[n++] = "-i";
+    args[n++] = inodes_arg;
+    args[n++] = "-b";
+    args[n++] = blocks_arg;
+    args[n++] = "-B";
+    args[n++] = bsize_arg;
+    if (*features) {
+        args[n++] = "-O";
+        args[n++] = (char *)features;
+    }
+    if (journal) {
+        args[n++] = "-J";
+        args[n++] = (char *)journal;
+    }
+    args[n] = NULL;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        execv(mkfs_path, args);
+        _exit(127);
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        die("running", mkfs_path, FAIL);
+    }
+}
+
+static void bench_lookup(struct wfs_fs *fs, const char *mode, struct series *s) {
+    static const int depths[] = {1, 4, 16};
+    char path[256] = "";
+    int depth = 1;
+    for (int i = 0; i < 3; i++) {
+        // depth - 1 directories, then the file
+        for (; depth < depths[i]; depth++) {
+            strcat(path, "/d");
+            int ret = wfs_fs_mkdir(fs, path, 0755);
+            if (ret != 0) {
+                die("mkdir", path, ret);
+            }
+        }
+        char file[sizeof(path) + 2];
+        snprintf(file, sizeof(file), "%s/f", path);
+        int ret = wfs_fs_create(fs, file, S_IFREG | 0644, NULL);
+        if (ret != 0) {
+            die("create", file, ret);
+        }
+
+        struct stat st;
+        series_start(s, ops * 10);
+        for (size_t n = 0; n < ops * 10; n++) {
+            double t0 = now_ns();
+            ret = wfs_fs_getattr(fs, file, NULL, &st);
+            series_add(s, t0);
+            if (ret != 0) {
+                die("stat", file, ret);
+            }
+        }
+        char extra[32];
+        snprintf(extra, sizeof(extra), "\"depth\": %d", depths[i]);
+        report(mode, "lookup", extra, s, 0);
+    }
+}
+
+static void bench_create_unlink(struct wfs_fs *fs, const char *mode, struct series *s) {
+    char path[64];
+    size_t dirs = (ops + FILES_PER_DIR - 1) / FILES_PER_DIR;
+    for (size_t d = 0; d < dirs; d++) {
+        snprintf(path, sizeof(path), "/c%zu", d);
+        int ret = wfs_fs_mkdir(fs, path, 0755);
+        if (ret != 0) {
+            die("mkdir", path, ret);
+        }
+    }
+
+    series_start(s, ops);
+    for (size_t n = 0; n < ops; n++) {
+        snprintf(path, sizeof(path), "/c%zu/f%zu", n / FILES_PER_DIR, n);
+        double t0 = now_ns();
+        int ret = wfs_fs_create(fs, path, S_IFREG | 0644, NULL);
+        series_add(s, t0);
+        if (ret != 0) {
+            die("create", path, ret);
+        }
+    }
+    report(mode, "create", "", s, 0);
+
+    series_start(s, ops);
+    for (size_t n = 0; n < ops; n++) {
+        snprintf(path, sizeof(path), "/c%zu/f%zu", n / FILES_PER_DIR, n);
+        double t0 = now_ns();
+        int ret = wfs_fs_unlink(fs, path);
+        series_add(s, t0);
+        if (ret != 0) {
+            die("unlink", path, ret);
+        }
+    }
+    report(mode, "unlink", "", s, 0);
+
+    for (size_t d = 0; d < dirs; d++) {
+        snprintf(path, sizeof(path), "/c%zu", d);
+        wfs_fs_rmdir(fs, path);
+    }
+}
+
+// Times count calls of size bytes on file, at offset i * size or at random whole sizes
+static void time_io(struct wfs_fs *fs, struct wfs_file *file, int write, int random, size_t size, size_t count,
+                    size_t file_size, struct series *s) {
+    char *buf = malloc(size);
+    if (!buf) {
+        die("allocating", NULL, -ENOMEM);
+    }
+    memset(buf, 'w', size);
+    unsigned int seed = 1;
+
+    series_start(s, count + 1);
+    for (size_t i = 0; i < count; i++) {
+        off_t offset = random ? (off_t)(rand_r(&seed) % (file_size / size)) * size : (off_t)(i * size);
+        double t0 = now_ns();
+        int ret = write ? wfs_fs_write(fs, NULL, file, buf, size, offset) : wfs_fs_read(fs, NULL, file, buf, size, offset);
+        series_add(s, t0);
+        if (ret != (int)size) {
+            die(write ? "write" : "read", "/seq", ret);
+        }
+    }
+    if (write) {
+        int ret = wfs_fs_fsync(fs, file);
+        if (ret != 0) {
+            die("fsync", "/seq", ret);
+        }
+    }
+    free(buf);
+}
+
+static void bench_io(struct wfs_fs *fs, const char *mode, struct series *s) {
+    size_t file_size = data_blocks * block_size / 4 / IO_SIZE * IO_SIZE;
+    size_t count = file_size / IO_SIZE;
+    struct wfs_file *file;
+
+    int ret = wfs_fs_create(fs, "/seq", S_IFREG | 0644, &file);
+    if (ret != 0) {
+        die("create", "/seq", ret);
+    }
+    time_io(fs, file, 1, 0, IO_SIZE, count, file_size, s);
+    report(mode, "seq_write", "", s, file_size);
+    wfs_fs_release(fs, file);
+
+    // A new handle, so reads start without readahead
+    ret = wfs_fs_open(fs, "/seq", 0, &file);
+    if (ret != 0) {
+        die("open", "/seq", ret);
+    }
+    time_io(fs, file, 0, 0, IO_SIZE, count, file_size, s);
+    report(mode, "seq_read", "", s, file_size);
+
+    time_io(fs, file, 1, 1, RAND_SIZE, ops, file_size, s);
+    report(mode, "rand_write", "", s, ops * RAND_SIZE);
+    time_io(fs, file, 0, 1, RAND_SIZE, ops, file_size, s);
+    report(mode, "rand_read", "", s, ops * RAND_SIZE);
+    wfs_fs_release(fs, file);
+
+    ret = wfs_fs_unlink(fs, "/seq");
+    if (ret != 0) {
+        die("unlink", "/seq", ret);
+    }
+}
+
+static void bench_alloc(struct wfs_fs *fs, const char *mode, struct series *s) {
+    static const int levels[] = {0, 50, 90};
+    size_t capacity = data_blocks * block_size * (strcmp(mode, "0") == 0 ? NUM_DISKS : 1);
+    size_t fill_size = FILL_BLOCKS * block_size;
+    char *buf = malloc(fill_size);
+    if (!buf) {
+        die("allocating", NULL, -ENOMEM);
+    }
+    memset(buf, 'f', fill_size);
+
+    size_t filled = 0, files = 0;
+    char path[64];
+    for (int i = 0; i < 3; i++) {
+        // Files of FILL_BLOCKS, every 10th of this round deleted again for holes, up to the
+        // file nearest the level once they are
+        size_t first = files;
+        size_t level = capacity / 100 * levels[i] + fill_size / 2;
+        while (levels[i] > 0 && filled + fill_size - (files - first + 10) / 10 * fill_size <= level) {
+            if (files % FILES_PER_DIR == 0) {
+                snprintf(path, sizeof(path), "/a%zu", files / FILES_PER_DIR);
+                int ret = wfs_fs_mkdir(fs, path, 0755);
+                if (ret != 0) {
+                    die("mkdir", path, ret);
+                }
+            }
+            snprintf(path, sizeof(path), "/a%zu/f%zu", files / FILES_PER_DIR, files);
+            struct wfs_file *file;
+            int ret = wfs_fs_create(fs, path, S_IFREG | 0644, &file);
+            if (ret != 0) {
+                die("create", path, ret);
+            }
+            ret = wfs_fs_write(fs, NULL, file, buf, fill_size, 0);
+            wfs_fs_release(fs, file);
+            if (ret == -ENOSPC) {
+                break;
+            }
+            if (ret != (int)fill_size) {
+                die("write", path, ret);
+            }
+            filled += fill_size;
+            files++;
+        }
+        for (size_t f = first; f < files; f += 10) {
+            snprintf(path, sizeof(path), "/a%zu/f%zu", f / FILES_PER_DIR, f);
+            int ret = wfs_fs_unlink(fs, path);
+            if (ret != 0) {
+                die("unlink", path, ret);
+            }
+            filled -= fill_size;
+        }
+
+        // Half of what is left at most, the directories and indirect blocks take some too
+        size_t count = (capacity - filled) / 2 / RAND_SIZE;
+        if (count > ops) {
+            count = ops;
+        }
+        struct wfs_file *file;
+        int ret = wfs_fs_create(fs, "/alloc", S_IFREG | 0644, &file);
+        if (ret != 0) {
+            die("create", "/alloc", ret);
+        }
+        series_start(s, count);
+        for (size_t n = 0; n < count; n++) {
+            double t0 = now_ns();
+            ret = wfs_fs_write(fs, NULL, file, buf, RAND_SIZE, n * RAND_SIZE);
+            series_add(s, t0);
+            if (ret != RAND_SIZE) {
+                die("write", "/alloc", ret);
+            }
+        }
+        char extra[32];
+        snprintf(extra, sizeof(extra), "\"fill_percent\": %zu", (filled * 100 + capacity / 2) / capacity);
+        report(mode, "alloc_4k", extra, s, count * RAND_SIZE);
+        wfs_fs_release(fs, file);
+        ret = wfs_fs_unlink(fs, "/alloc");
+        if (ret != 0) {
+            die("unlink", "/alloc", ret);
+        }
+    }
+    free(buf);
+}
+
+int main(int argc, char *argv[]) {
+    char *modes = "0,1,1v";
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            printf("Usage: %s [-r modes] [-d image dir] [-n ops] [-s data MB] [-B block size] [-O features] [-J journal size] [-m mkfs]\n", argv[0]);
+            return FAIL;
+        }
+        if (strcmp(argv[i], "-r") == 0) {
+            modes = argv[++i];
+        } else if (strcmp(argv[i], "-d") == 0) {
+            image_dir = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0) {
+            ops = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            data_mb = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-B") == 0) {
+            block_size = parse_size(argv[++i]);
+        } else if (strcmp(argv[i], "-O") == 0) {
+            features = argv[++i];
+        } else if (strcmp(argv[i], "-J") == 0) {
+            journal = argv[++i];
+        } else if (strcmp(argv[i], "-m") == 0) {
+            mkfs_path = argv[++i];
+        } else {
+            printf("Unknown option %s\n", argv[i]);
+            return FAIL;
+        }
+    }
+    if (ops == 0 || data_mb == 0 || block_size == 0) {
+        printf("ops, data MB and block size must be positive numbers\n");
+        return FAIL;
+    }
+    data_blocks = data_mb * 1024 * 1024 / block_size;
+
+    // The fill files at 90% and a directory for every 64 of them, the create files and theirs,
+    // and the lookup chain
+    size_t fill_files = data_blocks * NUM_DISKS / FILL_BLOCKS;
+    size_t num_inodes = fill_files + fill_files / FILES_PER_DIR + ops + ops / FILES_PER_DIR + 64;
+
+    printf("{\"block_size\": %zu, \"data_mb\": %zu, \"features\": \"%s\", \"journal\": \"%s\", \"ops\": %zu, \"results\": [",
+           block_size, data_mb, features, journal ? journal : "", ops);
+
+    struct series s = {0};
+    char *list = strdup(modes);
+    for (char *mode = strtok(list, ","); mode != NULL; mode = strtok(NULL, ",")) {
+        make_images(mode, num_inodes);
+
+        char *disks[NUM_DISKS];
+        for (int i = 0; i < NUM_DISKS; i++) {
+            disks[i] = disk_names[i];
+        }
+        struct wfs_options opts;
+        wfs_fs_options_init(&opts);
+        struct wfs_fs *fs = wfs_fs_mount(NUM_DISKS, disks, &opts);
+        if (!fs || wfs_fs_start(fs) != SUCCESS) {
+            die("mounting", mode, FAIL);
+        }
+
+        bench_lookup(fs, mode, &s);
+        bench_create_unlink(fs, mode, &s);
+        bench_io(fs, mode, &s);
+        bench_alloc(fs, mode, &s);
+
+        wfs_fs_unmount(fs);
+        for (int i = 0; i < NUM_DISKS; i++) {
+            unlink(disk_names[i]);
+        }
+    }
+    printf("\n]}\n");
+
+    free(list);
+    free(s.lat);
+    return SUCCESS;
+}
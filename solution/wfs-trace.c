@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+#define FAIL 1
+#define SUCCESS 0
+
+static const char *level_names[] = { "OFF", "ERROR", "INFO", "DEBUG" };
+
+// Prints one record using the format string of its event. Every integer
+// conversion is printed from the 64-bit argument, %s takes the record string.
+static void print_record(const struct trace_record *rec) {
+    const struct trace_event_info *info = &trace_events[rec->event];
+    printf("%llu.%06llu %5u %-5s ", (unsigned long long)(rec->time_ns / 1000000000ull),
+           (unsigned long long)(rec->time_ns % 1000000000ull / 1000), rec->tid, level_names[info->level]);
+
+    int arg = 0;
+    for (const char *p = info->fmt; *p != '\0'; p++) {
+        if (*p != '%') {
+            putchar(*p);
+            continue;
+        }
+        p++;
+        if (*p == '%') {
+            putchar('%');
+            continue;
+        }
+
+        // skip flags, width and length modifiers
+        while (*p != '\0' && strchr("-+ #0123456789.lhzjt", *p) != NULL) {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+
+        if (*p == 's') {
+            fputs(rec->str, stdout);
+        } else if (arg < (int)rec->nargs) {
+            long long value = rec->args[arg++];
+            if (*p == 'x') {
+                printf("%llx", value);
+            } else if (*p == 'X') {
+                printf("%llX", value);
+            } else if (*p == 'c') {
+                putchar((int)value);
+            } else if (*p == 'u') {
+                printf("%llu", (unsigned long long)value);
+            } else {
+                printf("%lld", value);
+            }
+        } else {
+            fputs("?", stdout);
+        }
+    }
+    putchar('\n');
+}
+
+// Prints records [start, end), skipping any that were overwritten or are still being written
+static uint64_t dump_records(const struct trace_header *hdr, const struct trace_record *ring,
+                             uint64_t start, uint64_t end, int max_level) {
+    for (uint64_t seq = start; seq < end; seq++) {
+        const struct trace_record *slot = &ring[seq & (hdr->num_records - 1)];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != seq + 1) {
+            continue;
+        }
+
+        struct trace_record rec;
+        memcpy((void *)&rec, (const void *)slot, sizeof(rec));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq + 1) {
+            continue;
+        }
+
+        rec.str[TRACE_STR_LEN - 1] = '\0';
+        if (rec.event >= TRACE_NUM_EVENTS || trace_events[rec.event].level > max_level) {
+            continue;
+        }
+        print_record(&rec);
+    }
+    return end;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: wfs-trace [-f] [-l level] <trace file>\n");
+    exit(FAIL);
+}
+
+int main(int argc, char *argv[]) {
+    int follow = 0;
+    int max_level = TRACE_DEBUG;
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0) {
+            follow = 1;
+        } else if (strcmp(argv[i], "-l") == 0) {
+            if (i + 1 >= argc) {
+                usage();
+            }
+            max_level = atoi(argv[++i]);
+        } else if (path == NULL) {
+            path = argv[i];
+        } else {
+            usage();
+        }
+    }
+    if (path == NULL) {
+        usage();
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return FAIL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(struct trace_header)) {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        close(fd);
+        return FAIL;
+    }
+
+    void *region = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        perror("mmap");
+        return FAIL;
+    }
+
+    const struct trace_header *hdr = region;
+    if (hdr->magic != TRACE_MAGIC || hdr->version != TRACE_VERSION ||
+        st.st_size < (off_t)(sizeof(*hdr) + hdr->num_records * sizeof(struct trace_record))) {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        munmap(region, st.st_size);
+        return FAIL;
+    }
+    const struct trace_record *ring = (const struct trace_record *)(hdr + 1);
+
+    // only the last num_records events are still in the ring
+    uint64_t head = atomic_load((_Atomic uint64_t *)&hdr->head);
+    uint64_t next = head > hdr->num_records ? head - hdr->num_records : 0;
+    next = dump_records(hdr, ring, next, head, max_level);
+
+    while (follow) {
+        fflush(stdout);
+        usleep(100000);
+        head = atomic_load((_Atomic uint64_t *)&hdr->head);
+        if (head - next > hdr->num_records) {
+            next = head - hdr->num_records;
+        }
+        next = dump_records(hdr, ring, next, head, max_level);
+    }
+
+    munmap(region, st.st_size);
+    return SUCCESS;
+}
@@ -6,23 +6,64 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdint.h>
 
 
 #define FAIL 1
 #define SUCCESS 0
 
-#define BLOCK_SIZE (512)
+// The block size is picked by mkfs -B and read from the superblock at mount, so BLOCK_SIZE
+// and everything derived from it are runtime values. Each program defines block_size, except
+// the filesystem core (WFS_CORE), which can have several filesystems mounted and uses the
+// block size of the one its functions are given as fs.
+#define DEFAULT_BLOCK_SIZE (512)
+#define MIN_BLOCK_SIZE     (512)
+#define MAX_BLOCK_SIZE     (64 * 1024)
+#ifdef WFS_CORE
+#define BLOCK_SIZE (fs->block_size)
+#else
+extern size_t block_size;
+#define BLOCK_SIZE (block_size)
+#endif
 #define MAX_NAME   (28)
 
 #define D_BLOCK    (6)
 #define IND_BLOCK  (D_BLOCK+1)
 #define N_BLOCKS   (IND_BLOCK+1)
+#define PTRS_PER_BLOCK (BLOCK_SIZE / sizeof(off_t))
+#define MAX_IND_LEVEL  (3)   // blocks[IND_BLOCK], dind_block, tind_block
 
 // Access memory-mapped regions
+#ifdef WFS_CORE
+#define DISK_MAP_PTR(disk, offset)       ((char *)(fs->disk_region[disk]) + (offset))
+#define DISK_FILE_PTR(disk, offset)      ((char *)(fs->disk_file[disk]) + (offset))  // File data, see disk_file
+#else
 #define DISK_MAP_PTR(disk, offset)       ((char *)(disk_region[disk]) + (offset))
+#endif
 #define MIN(x, y)                    ((x) < (y) ? (x) : (y))
 #define MK_DIR_AND_NODE 11
+#define LOCK_SHARED    0   // Modes for lock_inode()
+#define LOCK_EXCLUSIVE 1
+
+// RAID 1 read policies (--read-policy=)
+#define READ_POLICY_FIRST             0   // Always disk 0
+#define READ_POLICY_ROUND_ROBIN       1   // Block b from mirror b % num_disks
+#define READ_POLICY_LEAST_OUTSTANDING 2   // Mirror with the fewest reads in progress
+#define READ_POLICY_STREAM            3   // Runs of READ_STREAM_BLOCKS blocks per mirror
+#define READ_STREAM_BLOCKS            64
+
+// Readahead for sequential readers of an open file, see file_readahead()
+#define READAHEAD_MIN_BLOCKS 8
+#define READAHEAD_MAX_BLOCKS 256
+
+// Background scrubber (--scrub-rate=)
+#define SCRUB_BATCH_BLOCKS   64   // Allocated blocks checked per hold of scrub_lock
+#define SCRUB_PASS_INTERVAL  60   // Seconds between the end of one pass and the next
+#define SCRUB_CLEAN          0    // scrub_block() results
+#define SCRUB_REPAIRED       1
+#define SCRUB_NO_GOOD_COPY   2
 #define MAX_DISKS 10
+#define MAX_DIRTY_RANGES 256
 
 /*
   The fields in the superblock should reflect the structure of the filesystem.
@@ -50,8 +91,75 @@ struct wfs_sb {
     // Extend after this line
     int raid_mode;
     int disk_id;
+    uint32_t features;  // WFS_FEATURE_* flags set by mkfs -O
+    uint8_t block_bits;  // log2 of the block size (mkfs -B), 0 for DEFAULT_BLOCK_SIZE
+    uint8_t stripe_bits; // log2 of the RAID 0 stripe unit in blocks (mkfs -S)
+    uint16_t reserved;   // These three use what was padding, the superblock stays 64 bytes
 };
 
+// Optional on-disk features. Images from before the features field have
+// i_bitmap_ptr < sizeof(struct wfs_sb) and are treated as having none.
+#define WFS_FEATURE_DIR_INDEX (1 << 0)  // Directories are hashed B+trees
+#define WFS_FEATURE_EXTENTS   (1 << 1)  // Regular files map their data with extents
+#define WFS_FEATURE_CHECKSUMS (1 << 2)  // Every data block has a CRC32C, mirrored modes only
+#define WFS_FEATURE_DENSE_INODES (1 << 3)  // Inodes are packed INODES_PER_BLOCK to a block
+#define WFS_FEATURE_JOURNAL   (1 << 4)  // Metadata changes are journaled, mirrored modes only
+
+/*
+  Block checksums (WFS_FEATURE_CHECKSUMS).
+
+  The checksum region follows the data blocks: one uint32_t CRC32C per data
+  block, at d_blocks_ptr + num_data_blocks * BLOCK_SIZE. Every mirror keeps
+  its own copy, so a bad block can be told apart from a bad checksum.
+*/
+#define CSUM_SIZE sizeof(uint32_t)
+
+/*
+  Metadata journal (WFS_FEATURE_JOURNAL).
+
+  mkfs -J reserves the journal at the first block boundary after the data
+  blocks and the checksums. It starts with a block holding a
+  wfs_journal_header, transactions follow from the next block on, back to
+  back. A transaction is a wfs_journal_txn and `len` bytes of records, each a
+  wfs_journal_rec and the new contents of that range of the image, padded to
+  8 bytes. A record applies to every mirror. Replay takes transactions
+  numbered on from the header's sequence while their CRC32C matches, and
+  every mirror keeps the same copy of the journal.
+
+  The rest of the header block lists the orphans, inodes unlinked while
+  still in use, so the next mount can free those a crash left behind
+  without going through every inode. An inode is listed before the
+  transaction that removes its last link commits, and stays listed until
+  the journal is emptied after the one that frees it. num_orphans is
+  JOURNAL_ORPHANS_LOST when they didn't fit.
+*/
+#define JOURNAL_MAGIC     0x4a534657  // "WFSJ"
+#define JOURNAL_TXN_MAGIC 0x54534657  // "WFST"
+#define MIN_JOURNAL_BLOCKS 16
+#define JOURNAL_COMMIT_INTERVAL 5   // Default --writeback-interval= with a journal, in seconds
+#define JOURNAL_ORPHANS_LOST UINT32_MAX
+
+struct wfs_journal_header {
+    uint32_t magic;
+    uint32_t num_orphans;
+    uint64_t size;      // Bytes of the journal, the header block included
+    uint64_t sequence;  // Of the transaction in the block after the header
+    uint32_t orphans[]; // Inode numbers, to the end of the header block
+};
+
+struct wfs_journal_txn {
+    uint32_t magic;
+    uint32_t crc;       // CRC32C from sequence to the end of the records
+    uint64_t sequence;
+    uint64_t len;       // Bytes of records after this header
+};
+
+struct wfs_journal_rec {
+    off_t offset;       // In the image
+    uint64_t len;
+};
+
+
 // Inode
 struct wfs_inode {
     int     num;      /* Inode number */
@@ -68,10 +176,90 @@ struct wfs_inode {
     off_t blocks[N_BLOCKS];
     // off_num / num_disks --> get index within disk
     // off_num % num_disks --> disk
+
+    // Inodes take a whole block on disk, these live in the space after blocks[]
+    off_t dind_block; /* Double indirect block */
+    off_t tind_block; /* Triple indirect block */
 };
 
+// With WFS_FEATURE_DENSE_INODES, inode i is slot i % INODES_PER_BLOCK of block
+// i / INODES_PER_BLOCK of the inode table. Inodes never straddle two blocks.
+#define INODES_PER_BLOCK (BLOCK_SIZE / sizeof(struct wfs_inode))
+
 // Directory entry
 struct wfs_dentry {
-    char name[MAX_NAME];
+    char name[MAX_NAME];  // Names shorter than MAX_NAME - 1 keep the DT_* type in the last byte
     int num;
 };
+
+#define READDIR_FIRST 3   // Readdir offset of the first entry, "." and ".." are 1 and 2
+
+/*
+  Hashed directory index (WFS_FEATURE_DIR_INDEX).
+
+  blocks[0] of a directory points at the root node of a B+tree keyed by a
+  32-bit hash of the name. Every node is one data block that starts with a
+  wfs_dx_header. Leaves (level 0) hold dentries sorted by hash, index nodes
+  hold (lowest hash, child block) pairs sorted by hash. Entries with equal
+  hashes are never split across two leaves, so a lookup reads one leaf.
+*/
+#define DX_MAGIC 0x58444657  // "WFDX"
+#define DX_MAX_DEPTH 8
+
+struct wfs_dx_header {
+    uint32_t magic;
+    uint16_t level;     // 0 for leaves
+    uint16_t count;     // Entries in use
+};
+
+struct wfs_dx_entry {
+    uint32_t hash;
+    struct wfs_dentry dentry;
+};
+
+struct wfs_dx_index {
+    uint32_t hash;      // Lowest hash stored under this child
+    uint32_t pad;
+    off_t block;
+};
+
+#define DX_LEAF_ENTRIES  ((BLOCK_SIZE - sizeof(struct wfs_dx_header)) / sizeof(struct wfs_dx_entry))
+#define DX_INDEX_ENTRIES ((BLOCK_SIZE - sizeof(struct wfs_dx_header)) / sizeof(struct wfs_dx_index))
+
+/*
+  Extent-mapped regular files (WFS_FEATURE_EXTENTS).
+
+  blocks[] of a regular file holds a wfs_extent_root instead of block
+  pointers. An extent maps len blocks stored back to back on one disk. For
+  RAID 0, file blocks are striped over the disks in units of 2^stripe_bits
+  blocks, and `local` is the index of a block within its disk's share of the
+  file. For the other modes `local` is the file block itself and disk is
+  always 0.
+  Extents that don't fit in the inode go to a chain of wfs_extent_blocks.
+*/
+#define EXT_MAGIC 0x45534657  // "WFSE"
+#define EXT_MAX_LEN UINT16_MAX
+
+struct wfs_extent {
+    uint32_t local;     // First block index covered, see above
+    uint16_t len;       // Number of blocks, 0 for an unused slot
+    uint16_t disk;
+    off_t start;        // Address of the first block on disk
+};
+
+#define EXT_ROOT_ENTRIES 3
+struct wfs_extent_root {
+    uint32_t count;
+    uint32_t pad;
+    off_t next;         // First wfs_extent_block on disk 0, 0 if none
+    struct wfs_extent ext[EXT_ROOT_ENTRIES];
+};
+
+struct wfs_extent_block {
+    uint32_t magic;
+    uint32_t count;
+    off_t next;
+    struct wfs_extent ext[];    // EXT_BLOCK_ENTRIES of them, up to the end of the block
+};
+
+#define EXT_BLOCK_ENTRIES ((BLOCK_SIZE - sizeof(struct wfs_extent_block)) / sizeof(struct wfs_extent))
@@ -0,0 +1,4277 @@
+#define WFS_CORE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include "wfs.h"
+#include "trace.h"
+#include "dcache.h"
+#include "bitmap.h"
+#include "crc32c.h"
+#include "writeback.h"
+#include "journal.h"
+#include "stats.h"
+#include "wfs_core.h"
+#include <libgen.h>
+#include <dirent.h>
+
+// The filesystem itself, behind the in-process API of libwfs.h. Everything a mount needs is in
+// its struct wfs_fs, which every function here takes as fs, so one process can have several
+// filesystems mounted. See wfs_core.h for the struct.
+
+// Byte ranges of the images changed since the last mirror sync. Each thread keeps its own
+// list and syncs what its operation touched. What an operation leaves behind without a sync,
+// the atime of a read say, goes with the thread's next sync, when it exits, or when
+// wfs_fs_stop() syncs the lists of every thread, which are on dirty_lists for that.
+struct dirty_range {
+    off_t start;
+    off_t end;
+};
+
+// Runs of data blocks freed on one disk. With a journal, the blocks an operation frees are
+// listed here until it has logged its changes, see hold_freed_blocks().
+struct freed_run {
+    int disk;
+    size_t first;
+    size_t len;
+    unsigned long checkpoint;   // journal_checkpoints() once logged
+};
+
+struct dirty_list {
+    struct dirty_range buf[MAX_DIRTY_RANGES];
+    struct dirty_range *ranges; // buf until an operation outgrows it
+    int num;
+    int max;
+    int overflow;               // Set when the list can't grow, forces a full copy on next sync
+    struct wfs_fs *fs;          // The filesystem the ranges are of
+    struct freed_run *freed_runs;
+    size_t num_freed_runs;
+    size_t max_freed_runs;
+    pthread_mutex_t lock;       // Held by the thread while it changes or syncs the list, and by wfs_fs_stop()
+    int registered;
+    struct dirty_list *next;
+};
+static __thread struct dirty_list dirty;
+static struct dirty_list *dirty_lists;
+static pthread_mutex_t dirty_lists_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t dirty_key;
+static pthread_once_t dirty_key_once = PTHREAD_ONCE_INIT;
+
+// Inode locks this thread holds, see lock_inode(). Operations don't nest across filesystems.
+static __thread int inode_locks_held = 0;
+
+
+/////////////////////////////////////////////////// HELPER FUNCTIONS ///////////////////////////////////////////////////////////
+
+// Gets the superblock (get it from disk 0 since the superblock will be the same for all the disks)
+struct wfs_sb *get_superblock(struct wfs_fs *fs) {
+    return (struct wfs_sb *)DISK_MAP_PTR(0, 0);
+}
+
+// Returns the WFS_FEATURE_* flags the filesystem was made with
+uint32_t get_features(struct wfs_fs *fs) {
+    struct wfs_sb *sb = get_superblock(fs);
+
+    // Images made before the features field existed have their inode bitmap where it would be
+    if (sb->i_bitmap_ptr < sizeof(struct wfs_sb)) {
+        return 0;
+    }
+    return sb->features;
+}
+
+// Getter functions for 
+int get_disk(struct wfs_fs *fs, int i) {
+    return i % fs->num_disks;
+}
+
+// 1 when metadata is changed in a private copy of the images until the journal commits it
+static int staged(struct wfs_fs *fs) {
+    return fs->disk_region[0] != fs->disk_file[0];
+}
+
+// -----------------------Dirty-range tracking for disk synchronization----------------------------
+// Every helper that changes metadata on the source disk records the bytes it touched here, so the
+// sync helpers only have to copy those ranges to the other disks instead of whole regions.
+
+static void clear_dirty_ranges(struct dirty_list *list) {
+    if (list->ranges != list->buf) {
+        free(list->ranges);
+    }
+    list->ranges = list->buf;
+    list->max = MAX_DIRTY_RANGES;
+    list->num = 0;
+    list->overflow = 0;
+    free(list->freed_runs);
+    list->freed_runs = NULL;
+    list->num_freed_runs = list->max_freed_runs = 0;
+}
+
+// Makes room for one more range, on the heap once there are more than MAX_DIRTY_RANGES
+static int grow_dirty_ranges(struct dirty_list *list) {
+    if (list->num < list->max) {
+        return SUCCESS;
+    }
+    size_t size = 2 * list->max * sizeof(struct dirty_range);
+    struct dirty_range *bigger = list->ranges == list->buf ? malloc(size) : realloc(list->ranges, size);
+    if (!bigger) {
+        return FAIL;
+    }
+    if (list->ranges == list->buf) {
+        memcpy(bigger, list->buf, sizeof(list->buf));
+    }
+    list->ranges = bigger;
+    list->max *= 2;
+    return SUCCESS;
+}
+
+static void sync_disks(struct wfs_fs *fs);
+
+// Syncs what the exiting thread left behind, while its filesystem is still mounted
+static void drop_dirty_list(void *arg) {
+    struct dirty_list *list = arg;
+    pthread_mutex_lock(&dirty_lists_lock);
+    if (list->fs) {
+        sync_disks(list->fs);
+    }
+    struct dirty_list **prev = &dirty_lists;
+    while (*prev != list) {
+        prev = &(*prev)->next;
+    }
+    *prev = list->next;
+    pthread_mutex_unlock(&dirty_lists_lock);
+    clear_dirty_ranges(list);
+    pthread_mutex_destroy(&list->lock);
+}
+
+static void make_dirty_key(void) {
+    pthread_key_create(&dirty_key, drop_dirty_list);
+}
+
+// Takes this thread's list for fs, which holds the ranges of one filesystem at a time. What
+// another one left in it is synced before it changes hands. Returns with dirty.lock held.
+static void lock_dirty_list(struct wfs_fs *fs) {
+    if (!dirty.registered) {
+        pthread_once(&dirty_key_once, make_dirty_key);
+        pthread_mutex_init(&dirty.lock, NULL);
+        clear_dirty_ranges(&dirty);
+        pthread_setspecific(dirty_key, &dirty);
+        pthread_mutex_lock(&dirty_lists_lock);
+        dirty.next = dirty_lists;
+        dirty_lists = &dirty;
+        pthread_mutex_unlock(&dirty_lists_lock);
+        dirty.registered = 1;
+    }
+    pthread_mutex_lock(&dirty.lock);
+    if (dirty.fs != fs) {
+        if (dirty.fs) {
+            struct wfs_fs *other = dirty.fs;
+            pthread_mutex_unlock(&dirty.lock);
+            sync_disks(other);
+            pthread_mutex_lock(&dirty.lock);
+        }
+        clear_dirty_ranges(&dirty);
+        dirty.fs = fs;
+    }
+}
+
+// Record [offset, offset + len) as modified. Offsets are the same on every disk.
+void mark_dirty_range(struct wfs_fs *fs, off_t offset, size_t len) {
+    if (fs->num_disks <= 1 || len == 0) {
+        return;
+    }
+    lock_dirty_list(fs);
+    off_t end = offset + len;
+
+    // Merge with a range we already have if they overlap or touch
+    for (int i = 0; i < dirty.num && !dirty.overflow; i++) {
+        if (offset <= dirty.ranges[i].end && dirty.ranges[i].start <= end) {
+            dirty.ranges[i].start = MIN(dirty.ranges[i].start, offset);
+            dirty.ranges[i].end = dirty.ranges[i].end > end ? dirty.ranges[i].end : end;
+            pthread_mutex_unlock(&dirty.lock);
+            return;
+        }
+    }
+
+    if (dirty.overflow || grow_dirty_ranges(&dirty) != SUCCESS) {
+        dirty.overflow = 1;
+    } else {
+        dirty.ranges[dirty.num].start = offset;
+        dirty.ranges[dirty.num].end = end;
+        dirty.num++;
+    }
+    pthread_mutex_unlock(&dirty.lock);
+}
+
+// Record a modified object given a pointer into any of the mapped disks. Changes to the
+// private copy of a journaled filesystem reach the images through the journal instead.
+void mark_dirty(struct wfs_fs *fs, const void *ptr, size_t len) {
+    for (int disk = 0; disk < fs->num_disks; disk++) {
+        const char *base = fs->disk_region[disk];
+        if ((const char *)ptr >= base && (const char *)ptr < base + fs->disk_sizes[disk]) {
+            mark_dirty_range(fs, (const char *)ptr - base, len);
+            if (!staged(fs)) {
+                writeback_mark(&fs->wb, disk, (const char *)ptr - base, len);
+            }
+            return;
+        }
+    }
+}
+
+void mark_inode_dirty(struct wfs_fs *fs, struct wfs_inode *inode) {
+    mark_dirty(fs, inode, sizeof(struct wfs_inode));
+}
+
+// -----------------------------------------------------------------------------------------------------
+
+// Offset of inode inode_num on every disk. Each inode takes a whole block unless the
+// filesystem has WFS_FEATURE_DENSE_INODES.
+off_t inode_offset(struct wfs_fs *fs, int inode_num) {
+    struct wfs_sb *sb = get_superblock(fs);
+    if (get_features(fs) & WFS_FEATURE_DENSE_INODES) {
+        return sb->i_blocks_ptr + (off_t)(inode_num / INODES_PER_BLOCK) * BLOCK_SIZE +
+               (inode_num % INODES_PER_BLOCK) * sizeof(struct wfs_inode);
+    }
+    return sb->i_blocks_ptr + (off_t)inode_num * BLOCK_SIZE;
+}
+
+// Gets the inode given an inode_num
+struct wfs_inode *get_inode(struct wfs_fs *fs, int inode_num) {
+    TRACE(GET_INODE, NULL, inode_num);
+    struct wfs_sb *sb = get_superblock(fs);
+
+    return (struct wfs_inode *)DISK_MAP_PTR(sb->disk_id, inode_offset(fs, inode_num));
+}
+
+int find_disk(struct wfs_fs *fs, struct wfs_inode *dir_inode, int calling_function) {
+    if (calling_function == MK_DIR_AND_NODE) {
+   
+        TRACE(FIND_DISK, NULL, dir_inode->num);
+
+        // Iterate through existing blocks to check for free space
+        for (int i = 0; i < D_BLOCK + 1; i++) {
+            if (dir_inode->blocks[i] != 0) {
+                char *data_block = DISK_MAP_PTR(0, dir_inode->blocks[i]);
+                TRACE(FIND_DISK_BLOCK, NULL, i);
+
+                for (int j = 0; j < fs->NUM_DENTRIES_PER_BLOCK; j++) {
+                    struct wfs_dentry *dentry = (struct wfs_dentry *)(data_block + j * sizeof(struct wfs_dentry));
+                    if (dentry->name[0] == '\0' || dentry->num == 0) {
+                        // Free space found in an existing block
+                        int disk_to_use = get_disk(fs, i);
+                        TRACE(FIND_DISK_FOUND, NULL, i, disk_to_use);
+                        return disk_to_use;
+                    }
+                }
+            }
+        }
+
+        // No space found in existing blocks, find next disk for new block
+        int used_blks = 0;
+        for (int i = 0; i < N_BLOCKS - 1; i++) {
+            if (dir_inode->blocks[i] != 0) {
+                used_blks++;
+            }
+        }
+        int disk_to_use = get_disk(fs, used_blks);
+        TRACE(FIND_DISK_NEW, NULL, disk_to_use);
+
+        return disk_to_use;
+    }
+
+    TRACE(FIND_DISK_BAD_CALLER, NULL);
+    return -1;
+}
+
+
+// ----------------------------------------Held data blocks----------------------------------------
+// The journal may still write a block's old contents in place after the block was freed, when
+// the transaction that last changed it as metadata is applied or replayed. If it had become file
+// data by then, which is written in place straight away, that would overwrite the file. So with a
+// journal, freed data blocks are held back from allocation (bitmap_hold_frees()) until a
+// checkpoint after the operation that freed them has logged its changes.
+
+// Notes that this thread's operation freed data block `bit` of disk
+static void note_freed(struct wfs_fs *fs, int disk, size_t bit) {
+    lock_dirty_list(fs);
+    struct freed_run *last = dirty.num_freed_runs > 0 ? &dirty.freed_runs[dirty.num_freed_runs - 1] : NULL;
+    if (last && last->disk == disk && (last->first + last->len == bit || bit + 1 == last->first)) {
+        last->first = MIN(last->first, bit);
+        last->len++;
+    } else if (dirty.num_freed_runs < dirty.max_freed_runs) {
+        dirty.freed_runs[dirty.num_freed_runs++] = (struct freed_run){.disk = disk, .first = bit, .len = 1};
+    } else {
+        size_t max = dirty.max_freed_runs ? 2 * dirty.max_freed_runs : 16;
+        struct freed_run *bigger = realloc(dirty.freed_runs, max * sizeof(struct freed_run));
+        // Without room the block stays held until the next mount
+        if (bigger) {
+            dirty.freed_runs = bigger;
+            dirty.max_freed_runs = max;
+            dirty.freed_runs[dirty.num_freed_runs++] = (struct freed_run){.disk = disk, .first = bit, .len = 1};
+        }
+    }
+    pthread_mutex_unlock(&dirty.lock);
+}
+
+// Lets the held blocks logged before checkpoint number `checkpoint` be allocated again.
+// Returns 1 if there were any.
+static int release_held_blocks(struct wfs_fs *fs, unsigned long checkpoint) {
+    pthread_mutex_lock(&fs->held_lock);
+    size_t n = 0;
+    while (n < fs->num_held && fs->held[n].checkpoint < checkpoint) {
+        struct freed_run *run = &fs->held[n++];
+        pthread_mutex_lock(&fs->data_bitmap_locks[run->disk]);
+        for (size_t i = 0; i < run->len; i++) {
+            bitmap_release(&fs->data_bitmaps[run->disk], run->first + i);
+        }
+        pthread_mutex_unlock(&fs->data_bitmap_locks[run->disk]);
+    }
+    fs->num_held -= n;
+    if (fs->num_held) {
+        memmove(fs->held, fs->held + n, fs->num_held * sizeof(struct freed_run));
+    }
+    pthread_mutex_unlock(&fs->held_lock);
+    return n > 0;
+}
+
+// Holds the blocks the operations of list freed, which have just been logged, until the next
+// checkpoint, and releases those held since before the last one. Callers hold sync_lock, so
+// the list stays in checkpoint order.
+static void hold_freed_blocks(struct wfs_fs *fs, struct dirty_list *list) {
+    unsigned long checkpoint = journal_checkpoints(&fs->journal);
+    pthread_mutex_lock(&fs->held_lock);
+    if (fs->num_held + list->num_freed_runs > fs->max_held) {
+        size_t max = 2 * fs->max_held > fs->num_held + list->num_freed_runs ? 2 * fs->max_held : fs->num_held + list->num_freed_runs;
+        struct freed_run *bigger = realloc(fs->held, max * sizeof(struct freed_run));
+        if (bigger) {
+            fs->held = bigger;
+            fs->max_held = max;
+        }
+    }
+
+    // Runs there's no room for stay held until the next mount
+    for (size_t i = 0; i < list->num_freed_runs && fs->num_held < fs->max_held; i++) {
+        fs->held[fs->num_held] = list->freed_runs[i];
+        fs->held[fs->num_held++].checkpoint = checkpoint;
+    }
+    pthread_mutex_unlock(&fs->held_lock);
+    list->num_freed_runs = 0;
+    release_held_blocks(fs, checkpoint);
+}
+
+// Out of data blocks. With a journal, a checkpoint may let held ones go, returns 1 if it did.
+static int reclaim_held_blocks(struct wfs_fs *fs) {
+    if (!staged(fs)) {
+        return 0;
+    }
+    pthread_mutex_lock(&fs->held_lock);
+    size_t held = fs->num_held;
+    pthread_mutex_unlock(&fs->held_lock);
+    if (held == 0) {
+        return 0;
+    }
+    journal_checkpoint(&fs->journal);
+    return release_held_blocks(fs, journal_checkpoints(&fs->journal));
+}
+// -----------------------------------------------------------------------------------------------------
+
+off_t allocate_free_data_block(struct wfs_fs *fs, int disk_id) {
+    TRACE(ALLOC_BLOCK, NULL, disk_id);
+   
+    struct wfs_sb *sb = get_superblock(fs);
+    char *data_bitmap = DISK_MAP_PTR(disk_id, sb->d_bitmap_ptr);
+
+    // Take the next free block after the last one handed out on this disk
+    pthread_mutex_lock(&fs->data_bitmap_locks[disk_id]);
+    long i = bitmap_alloc(&fs->data_bitmaps[disk_id]);
+    pthread_mutex_unlock(&fs->data_bitmap_locks[disk_id]);
+    if (i < 0 && reclaim_held_blocks(fs)) {
+        pthread_mutex_lock(&fs->data_bitmap_locks[disk_id]);
+        i = bitmap_alloc(&fs->data_bitmaps[disk_id]);
+        pthread_mutex_unlock(&fs->data_bitmap_locks[disk_id]);
+    }
+    if (i < 0) {
+        TRACE(ALLOC_BLOCK_NOSPC, NULL);
+        return 0;
+    }
+
+    TRACE(ALLOC_BLOCK_FOUND, NULL, i);
+    stats_add(&fs->stats, STATS_BLOCKS_ALLOCATED, 1);
+    mark_dirty(fs, &data_bitmap[i / 8], 1);
+    return sb->d_blocks_ptr + (off_t)i * BLOCK_SIZE; // Return the block address
+}
+
+// Marks the data block at blk_addr on disk_id as free in that disk's data bitmap
+void free_data_block(struct wfs_fs *fs, int disk_id, off_t blk_addr) {
+    struct wfs_sb *sb = get_superblock(fs);
+    char *data_bitmap = DISK_MAP_PTR(disk_id, sb->d_bitmap_ptr);
+
+    size_t blk_idx = (blk_addr - sb->d_blocks_ptr) / BLOCK_SIZE;
+    pthread_mutex_lock(&fs->data_bitmap_locks[disk_id]);
+    bitmap_free(&fs->data_bitmaps[disk_id], blk_idx);
+    pthread_mutex_unlock(&fs->data_bitmap_locks[disk_id]);
+    mark_dirty(fs, &data_bitmap[blk_idx / 8], 1);
+    if (staged(fs)) {
+        note_freed(fs, disk_id, blk_idx);
+    }
+}
+
+int allocate_free_inode(struct wfs_fs *fs) {
+    struct wfs_sb *sb = get_superblock(fs);
+    char *i_bitmap = DISK_MAP_PTR(sb->disk_id, sb->i_bitmap_ptr);
+
+    // Lowest free inode, the inode allocator is first-fit
+    pthread_mutex_lock(&fs->inode_bitmap_lock);
+    long i = bitmap_alloc(&fs->inode_bitmap);
+    pthread_mutex_unlock(&fs->inode_bitmap_lock);
+    if (i < 0) {
+        TRACE(ALLOC_INODE_NOSPC, NULL);
+        return -1;
+    }
+
+    TRACE(ALLOC_INODE, NULL, i);
+    mark_dirty(fs, &i_bitmap[i / 8], 1);
+    return i;
+}
+
+void free_inode(struct wfs_fs *fs, int i_num) {
+    TRACE(FREE_INODE, NULL, i_num);
+    struct wfs_sb *sb = get_superblock(fs);
+    char *i_bitmap = DISK_MAP_PTR(sb->disk_id, sb->i_bitmap_ptr);
+    pthread_mutex_lock(&fs->inode_bitmap_lock);
+    bitmap_free(&fs->inode_bitmap, i_num); // Mark as free
+    pthread_mutex_unlock(&fs->inode_bitmap_lock);
+    mark_dirty(fs, &i_bitmap[i_num / 8], 1);
+
+    // Cached entries for or under this inode are stale now
+    dcache_forget_inode(&fs->dcache, i_num);
+}
+
+
+// ------------------------------------------------Locking------------------------------------------------
+// FUSE may call in from several threads. Path walks lock each directory before the entry they
+// look up in it and keep that lock until the child is locked, so an inode can't be freed while
+// another thread is on its way to it: removing an entry takes the parent and the child
+// exclusively. Locks are only ever taken parent before child. The bitmap, sync and dentry cache
+// locks are taken last and never held across another lock.
+
+int init_inode_locks(struct wfs_fs *fs, int num_inodes) {
+    fs->inode_locks = malloc(num_inodes * sizeof(pthread_rwlock_t));
+    if (!fs->inode_locks) {
+        return FAIL;
+    }
+    for (int i = 0; i < num_inodes; i++) {
+        pthread_rwlock_init(&fs->inode_locks[i], NULL);
+    }
+    return SUCCESS;
+}
+
+void lock_inode(struct wfs_fs *fs, int inode_num, int mode) {
+    // An operation keeps the scrubber out from its first inode lock until its last unlock, by
+    // which point its changes have reached every mirror. Taken before any inode lock, so a
+    // waiting scrubber can't deadlock with threads that already hold one.
+    if (fs->scrub_rate > 0 && inode_locks_held++ == 0) {
+        pthread_rwlock_rdlock(&fs->scrub_lock);
+    }
+    if (mode == LOCK_EXCLUSIVE) {
+        pthread_rwlock_wrlock(&fs->inode_locks[inode_num]);
+    } else {
+        pthread_rwlock_rdlock(&fs->inode_locks[inode_num]);
+    }
+}
+
+// Takes the number rather than the inode, which may have been freed and reused by now
+void unlock_inode(struct wfs_fs *fs, int inode_num) {
+    pthread_rwlock_unlock(&fs->inode_locks[inode_num]);
+    if (fs->scrub_rate > 0 && --inode_locks_held == 0) {
+        pthread_rwlock_unlock(&fs->scrub_lock);
+    }
+}
+
+
+// -----------------------------------------Directory entries-----------------------------------------
+//
+// A dentry keeps the file type (DT_*) of its inode in name[MAX_NAME - 1] whenever the name
+// is short enough to leave that byte free, so listing a directory doesn't read every inode.
+// Dentries written before this, and names of MAX_NAME - 1 characters, read as DT_UNKNOWN.
+
+void set_dentry(struct wfs_dentry *dentry, const char *name, int num, mode_t mode) {
+    memset(dentry, 0, sizeof(struct wfs_dentry));
+    strncpy(dentry->name, name, MAX_NAME - 1);
+    dentry->num = num;
+    if (strlen(dentry->name) < MAX_NAME - 1) {
+        dentry->name[MAX_NAME - 1] = IFTODT(mode);
+    }
+}
+
+static int dentry_type(struct wfs_dentry *dentry) {
+    return strnlen(dentry->name, MAX_NAME) < MAX_NAME - 1 ? (unsigned char)dentry->name[MAX_NAME - 1] : DT_UNKNOWN;
+}
+
+// Passes one dentry to the filler along with the offset to resume after it, and remembers
+// the name in the dcache for the getattr that usually follows. Returns 1 once the buffer is full
+static int readdir_emit(struct wfs_fs *fs, struct wfs_inode *dir_inode, struct wfs_dentry *dentry, off_t offset, void *output_buffer, wfs_fill_t entry_to_buffer) {
+    struct stat entry_stat;
+    memset(&entry_stat, 0, sizeof(struct stat));
+    entry_stat.st_ino = dentry->num;
+
+    int type = dentry_type(dentry);
+    if (type != DT_UNKNOWN) {
+        entry_stat.st_mode = DTTOIF(type);
+    } else {
+        struct wfs_inode *entry_inode = get_inode(fs, dentry->num);
+        if (!entry_inode) {
+            TRACE(READDIR_NO_INODE, dentry->name);
+            return 0;
+        }
+        entry_stat.st_mode = entry_inode->mode;
+    }
+
+    dcache_add(&fs->dcache, dir_inode->num, dentry->name, strnlen(dentry->name, MAX_NAME), dentry->num);
+
+    if (entry_to_buffer(output_buffer, dentry->name, &entry_stat, offset) != 0) {
+        TRACE(READDIR_FULL, NULL);
+        return 1;
+    }
+    return 0;
+}
+
+
+// ---------------------------------------Hashed directory index---------------------------------------
+
+int is_indexed_dir(struct wfs_fs *fs, struct wfs_inode *inode) {
+    return S_ISDIR(inode->mode) && (get_features(fs) & WFS_FEATURE_DIR_INDEX);
+}
+
+// 32-bit FNV-1a of a dentry name
+static uint32_t dx_hash(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < MAX_NAME && name[i] != '\0'; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Index nodes always live on disk 0, for RAID 1 they are mirrored like any other block
+static struct wfs_dx_header *dx_node(struct wfs_fs *fs, off_t block) {
+    return (struct wfs_dx_header *)DISK_MAP_PTR(0, block);
+}
+
+static struct wfs_dx_entry *dx_entries(struct wfs_dx_header *node) {
+    return (struct wfs_dx_entry *)(node + 1);
+}
+
+static struct wfs_dx_index *dx_indexes(struct wfs_dx_header *node) {
+    return (struct wfs_dx_index *)(node + 1);
+}
+
+static void dx_init_node(struct wfs_fs *fs, off_t block, int level) {
+    struct wfs_dx_header *node = dx_node(fs, block);
+    memset(node, 0, BLOCK_SIZE);
+    node->magic = DX_MAGIC;
+    node->level = level;
+    mark_dirty(fs, node, BLOCK_SIZE);
+}
+
+// Position of the child whose subtree holds hash, idx[0] also covers everything below idx[1]
+static int dx_child_pos(struct wfs_dx_header *node, uint32_t hash) {
+    struct wfs_dx_index *idx = dx_indexes(node);
+    int lo = 1;
+    int hi = node->count - 1;
+    int pos = 0;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (idx[mid].hash <= hash) {
+            pos = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return pos;
+}
+
+// Position of the first leaf entry with a hash >= hash
+static int dx_leaf_pos(struct wfs_dx_header *leaf, uint32_t hash) {
+    struct wfs_dx_entry *ent = dx_entries(leaf);
+    int lo = 0;
+    int hi = leaf->count;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ent[mid].hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Walks from the root to the leaf for hash. path[d] is the node at depth d and pos[d] the
+// child taken there. Returns the depth of the leaf or -1 if the tree is damaged.
+static int dx_descend(struct wfs_fs *fs, struct wfs_inode *dir_inode, uint32_t hash, off_t *path, int *pos) {
+    off_t block = dir_inode->blocks[0];
+
+    for (int depth = 0; depth < DX_MAX_DEPTH; depth++) {
+        struct wfs_dx_header *node = dx_node(fs, block);
+        if (node->magic != DX_MAGIC || (node->level > 0 && node->count == 0)) {
+            TRACE(DX_BAD_NODE, NULL, block, dir_inode->num);
+            return -1;
+        }
+
+        path[depth] = block;
+        if (node->level == 0) {
+            return depth;
+        }
+        pos[depth] = dx_child_pos(node, hash);
+        block = dx_indexes(node)[pos[depth]].block;
+    }
+
+    TRACE(DX_BAD_NODE, NULL, block, dir_inode->num);
+    return -1;
+}
+
+struct wfs_dentry *dx_find_dentry(struct wfs_fs *fs, struct wfs_inode *dir_inode, const char *name) {
+    if (dir_inode->blocks[0] == 0) {
+        return NULL; // Nothing added yet
+    }
+
+    uint32_t hash = dx_hash(name);
+    off_t path[DX_MAX_DEPTH];
+    int pos[DX_MAX_DEPTH];
+    int depth = dx_descend(fs, dir_inode, hash, path, pos);
+    if (depth < 0) {
+        return NULL;
+    }
+
+    struct wfs_dx_header *leaf = dx_node(fs, path[depth]);
+    struct wfs_dx_entry *ent = dx_entries(leaf);
+    struct wfs_dentry *found = NULL;
+    int scanned = 0;
+    for (int i = dx_leaf_pos(leaf, hash); !found && i < leaf->count && ent[i].hash == hash; i++) {
+        scanned++;
+        if (strncmp(ent[i].dentry.name, name, MAX_NAME) == 0) {
+            found = &ent[i].dentry;
+        }
+    }
+    stats_add(&fs->stats, STATS_DENTRIES_SCANNED, scanned);
+    return found;
+}
+
+static void dx_leaf_insert(struct wfs_fs *fs, struct wfs_dx_header *leaf, uint32_t hash, struct wfs_dentry *entry) {
+    struct wfs_dx_entry *ent = dx_entries(leaf);
+    int i = dx_leaf_pos(leaf, hash);
+
+    memmove(&ent[i + 1], &ent[i], (leaf->count - i) * sizeof(struct wfs_dx_entry));
+    ent[i].hash = hash;
+    ent[i].dentry = *entry;
+    leaf->count++;
+    mark_dirty(fs, leaf, BLOCK_SIZE);
+}
+
+static void dx_index_insert(struct wfs_fs *fs, struct wfs_dx_header *node, int i, uint32_t hash, off_t block) {
+    struct wfs_dx_index *idx = dx_indexes(node);
+
+    memmove(&idx[i + 1], &idx[i], (node->count - i) * sizeof(struct wfs_dx_index));
+    idx[i].hash = hash;
+    idx[i].pad = 0;
+    idx[i].block = block;
+    node->count++;
+    mark_dirty(fs, node, BLOCK_SIZE);
+}
+
+// Adds a dentry, splitting full nodes on the way back up. All blocks a split can need are
+// allocated before anything is changed so running out of space leaves the tree untouched.
+int dx_add_dentry(struct wfs_fs *fs, struct wfs_inode *dir_inode, struct wfs_dentry *entry) {
+    if (dir_inode->blocks[0] == 0) {
+        off_t root = allocate_free_data_block(fs, 0);
+        if (root == 0) {
+            TRACE(DX_NOSPC, NULL, dir_inode->num);
+            return -1;
+        }
+        dx_init_node(fs, root, 0);
+        dir_inode->blocks[0] = root;
+        mark_inode_dirty(fs, dir_inode);
+    }
+
+    uint32_t hash = dx_hash(entry->name);
+    off_t path[DX_MAX_DEPTH];
+    int pos[DX_MAX_DEPTH];
+    int depth = dx_descend(fs, dir_inode, hash, path, pos);
+    if (depth < 0) {
+        return -1;
+    }
+
+    struct wfs_dx_header *leaf = dx_node(fs, path[depth]);
+    if (leaf->count < DX_LEAF_ENTRIES) {
+        dx_leaf_insert(fs, leaf, hash, entry);
+        return 0;
+    }
+
+    // Split point for the leaf, moved off the middle so no run of equal hashes is cut
+    struct wfs_dx_entry *ent = dx_entries(leaf);
+    int split = leaf->count / 2;
+    while (split < leaf->count && ent[split].hash == ent[split - 1].hash) {
+        split++;
+    }
+    if (split == leaf->count) {
+        split = leaf->count / 2;
+        while (split > 0 && ent[split].hash == ent[split - 1].hash) {
+            split--;
+        }
+    }
+    if (split == 0) {
+        TRACE(DX_COLLIDE, NULL, dir_inode->num);
+        return -1;
+    }
+
+    // One block per full node from the leaf up, plus one to grow the tree if the root is full too
+    int needed = 1;
+    int top = depth - 1;
+    while (top >= 0 && dx_node(fs, path[top])->count == DX_INDEX_ENTRIES) {
+        needed++;
+        top--;
+    }
+    if (top < 0) {
+        if (dx_node(fs, dir_inode->blocks[0])->level + 1 >= DX_MAX_DEPTH) {
+            TRACE(DX_NOSPC, NULL, dir_inode->num);
+            return -1;
+        }
+        needed++;
+    }
+
+    off_t spare[DX_MAX_DEPTH + 1];
+    for (int i = 0; i < needed; i++) {
+        spare[i] = allocate_free_data_block(fs, 0);
+        if (spare[i] == 0) {
+            TRACE(DX_NOSPC, NULL, dir_inode->num);
+            for (int j = 0; j < i; j++) {
+                free_data_block(fs, 0, spare[j]);
+            }
+            return -1;
+        }
+    }
+    int next_spare = 0;
+
+    // Move the upper half of the leaf to a new leaf and add the entry to whichever half it sorts into
+    TRACE(DX_SPLIT, NULL, 0, dir_inode->num);
+    off_t sibling = spare[next_spare++];
+    dx_init_node(fs, sibling, 0);
+    struct wfs_dx_header *right = dx_node(fs, sibling);
+    right->count = leaf->count - split;
+    memcpy(dx_entries(right), &ent[split], right->count * sizeof(struct wfs_dx_entry));
+    leaf->count = split;
+    mark_dirty(fs, leaf, BLOCK_SIZE);
+
+    uint32_t split_hash = dx_entries(right)[0].hash;
+    dx_leaf_insert(fs, hash >= split_hash ? right : leaf, hash, entry);
+
+    // Hook the new node into its parent, splitting index nodes that are full
+    for (depth = depth - 1; depth >= 0; depth--) {
+        struct wfs_dx_header *node = dx_node(fs, path[depth]);
+        int insert_at = pos[depth] + 1;
+
+        if (node->count < DX_INDEX_ENTRIES) {
+            dx_index_insert(fs, node, insert_at, split_hash, sibling);
+            return 0;
+        }
+
+        TRACE(DX_SPLIT, NULL, node->level, dir_inode->num);
+        off_t new_block = spare[next_spare++];
+        dx_init_node(fs, new_block, node->level);
+        struct wfs_dx_header *new_node = dx_node(fs, new_block);
+        int half = node->count / 2;
+        new_node->count = node->count - half;
+        memcpy(dx_indexes(new_node), &dx_indexes(node)[half], new_node->count * sizeof(struct wfs_dx_index));
+        node->count = half;
+        mark_dirty(fs, node, BLOCK_SIZE);
+
+        if (insert_at >= half) {
+            dx_index_insert(fs, new_node, insert_at - half, split_hash, sibling);
+        } else {
+            dx_index_insert(fs, node, insert_at, split_hash, sibling);
+        }
+        split_hash = dx_indexes(new_node)[0].hash;
+        sibling = new_block;
+    }
+
+    // The root split: move its lower half out so the root stays at blocks[0], then point it at both halves
+    struct wfs_dx_header *root = dx_node(fs, dir_inode->blocks[0]);
+    off_t lower = spare[next_spare++];
+    memcpy(dx_node(fs, lower), root, BLOCK_SIZE);
+    mark_dirty(fs, dx_node(fs, lower), BLOCK_SIZE);
+
+    int level = root->level + 1;
+    dx_init_node(fs, dir_inode->blocks[0], level);
+    dx_index_insert(fs, root, 0, 0, lower);
+    dx_index_insert(fs, root, 1, split_hash, sibling);
+    TRACE(DX_GROW, NULL, dir_inode->num, level + 1);
+    return 0;
+}
+
+// Removes a dentry, freeing nodes that become empty and collapsing a root left with one child
+int dx_remove_dentry(struct wfs_fs *fs, struct wfs_inode *dir_inode, const char *name) {
+    if (dir_inode->blocks[0] == 0) {
+        return -ENOENT;
+    }
+
+    uint32_t hash = dx_hash(name);
+    off_t path[DX_MAX_DEPTH];
+    int pos[DX_MAX_DEPTH];
+    int depth = dx_descend(fs, dir_inode, hash, path, pos);
+    if (depth < 0) {
+        return -ENOENT;
+    }
+
+    struct wfs_dx_header *leaf = dx_node(fs, path[depth]);
+    struct wfs_dx_entry *ent = dx_entries(leaf);
+    int i = dx_leaf_pos(leaf, hash);
+    while (i < leaf->count && ent[i].hash == hash && strncmp(ent[i].dentry.name, name, MAX_NAME) != 0) {
+        i++;
+    }
+    if (i == leaf->count || ent[i].hash != hash) {
+        return -ENOENT;
+    }
+
+    memmove(&ent[i], &ent[i + 1], (leaf->count - i - 1) * sizeof(struct wfs_dx_entry));
+    leaf->count--;
+    memset(&ent[leaf->count], 0, sizeof(struct wfs_dx_entry));
+    mark_dirty(fs, leaf, BLOCK_SIZE);
+
+    // Unlink empty nodes below the root from their parents
+    while (depth > 0 && dx_node(fs, path[depth])->count == 0) {
+        free_data_block(fs, 0, path[depth]);
+        depth--;
+
+        struct wfs_dx_header *node = dx_node(fs, path[depth]);
+        struct wfs_dx_index *idx = dx_indexes(node);
+        memmove(&idx[pos[depth]], &idx[pos[depth] + 1], (node->count - pos[depth] - 1) * sizeof(struct wfs_dx_index));
+        node->count--;
+        mark_dirty(fs, node, BLOCK_SIZE);
+    }
+
+    struct wfs_dx_header *root = dx_node(fs, dir_inode->blocks[0]);
+    if (root->level > 0 && root->count == 0) {
+        dx_init_node(fs, dir_inode->blocks[0], 0);
+    }
+    while (root->level > 0 && root->count == 1) {
+        off_t child = dx_indexes(root)[0].block;
+        memcpy(root, dx_node(fs, child), BLOCK_SIZE);
+        mark_dirty(fs, root, BLOCK_SIZE);
+        free_data_block(fs, 0, child);
+        TRACE(DX_SHRINK, NULL, dir_inode->num, root->level + 1);
+    }
+    return 0;
+}
+
+int dx_is_empty(struct wfs_fs *fs, struct wfs_inode *dir_inode) {
+    return dir_inode->blocks[0] == 0 || dx_node(fs, dir_inode->blocks[0])->count == 0;
+}
+
+// Readdir offsets of an indexed directory are (hash << 16 | n) + READDIR_FIRST for the n-th
+// entry with that hash, so a listing picks up where it stopped however the tree was split
+// in between. Entries with equal hashes share a leaf, which keeps n stable.
+static off_t dx_readdir_offset(uint32_t hash, int n) {
+    return ((off_t)hash << 16 | MIN(n, UINT16_MAX)) + READDIR_FIRST;
+}
+
+// Passes every entry under block past offset to the filler, returns 1 once the buffer is full
+static int dx_readdir(struct wfs_fs *fs, struct wfs_inode *dir_inode, off_t block, off_t offset, void *output_buffer, wfs_fill_t entry_to_buffer) {
+    struct wfs_dx_header *node = dx_node(fs, block);
+    if (node->magic != DX_MAGIC) {
+        TRACE(DX_BAD_NODE, NULL, block, -1);
+        return 0;
+    }
+
+    uint32_t after = offset >= READDIR_FIRST ? (offset - READDIR_FIRST) >> 16 : 0;
+    if (node->level > 0) {
+        struct wfs_dx_index *idx = dx_indexes(node);
+        for (int i = 0; i < node->count; i++) {
+            // Everything under this child hashes below the next one, skip it if that's all done
+            if (offset >= READDIR_FIRST && i + 1 < node->count && idx[i + 1].hash <= after) {
+                continue;
+            }
+            if (dx_readdir(fs, dir_inode, idx[i].block, offset, output_buffer, entry_to_buffer)) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    struct wfs_dx_entry *ent = dx_entries(node);
+    int n = 0;
+    for (int i = 0; i < node->count; i++) {
+        n = (i > 0 && ent[i].hash == ent[i - 1].hash) ? n + 1 : 0;
+        off_t entry_offset = dx_readdir_offset(ent[i].hash, n);
+        if (entry_offset <= offset) {
+            continue;
+        }
+        if (readdir_emit(fs, dir_inode, &ent[i].dentry, entry_offset, output_buffer, entry_to_buffer)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+// -----------------------------------------File block mapping-----------------------------------------
+//
+// Every read, write and unlink goes through these helpers so all of them agree on where a
+// file block lives. In RAID 0 file blocks go round the disks in stripe units of
+// stripe_blocks blocks (one unless mkfs -S said otherwise), indirect and extent blocks
+// always live on disk 0. The other modes keep everything on disk 0 and
+// mirror it.
+
+_Static_assert(sizeof(struct wfs_extent_root) <= sizeof(((struct wfs_inode *)0)->blocks),
+               "extent root must fit in the inode block pointers");
+
+int is_extent_file(struct wfs_fs *fs, struct wfs_inode *inode) {
+    return S_ISREG(inode->mode) && (get_features(fs) & WFS_FEATURE_EXTENTS);
+}
+
+// Disk that holds file block `block`
+static int file_block_disk(struct wfs_fs *fs, size_t block) {
+    return fs->raid_mode == 0 ? (block / fs->stripe_blocks) % fs->num_disks : 0;
+}
+
+// Index of file block `block` within its disk's share of the file
+static size_t file_block_local(struct wfs_fs *fs, size_t block) {
+    if (fs->raid_mode != 0) {
+        return block;
+    }
+    return block / (fs->stripe_blocks * fs->num_disks) * fs->stripe_blocks + block % fs->stripe_blocks;
+}
+
+// How many of the `count` file blocks from `block` on follow it on the same disk, before
+// the stripe unit ends
+static size_t file_stripe_left(struct wfs_fs *fs, size_t block, size_t count) {
+    return fs->raid_mode == 0 ? MIN(count, fs->stripe_blocks - block % fs->stripe_blocks) : count;
+}
+
+// How many of the `count` file blocks from `block` on live on the same disk as `block`
+static size_t file_blocks_on_disk(struct wfs_fs *fs, size_t block, size_t count) {
+    if (fs->raid_mode != 0) {
+        return count;
+    }
+    size_t on_disk = 0;
+    while (count > 0) {
+        size_t unit = file_stripe_left(fs, block, count);
+        on_disk += unit;
+
+        // The next unit on this disk comes after one unit on each of the other disks
+        size_t skip = unit + fs->stripe_blocks * (fs->num_disks - 1);
+        if (count <= skip) {
+            break;
+        }
+        count -= skip;
+        block += skip;
+    }
+    return on_disk;
+}
+
+// Last indirect block that resolved a data block pointer, per inode. Sequential I/O
+// hits the same leaf PTRS_PER_BLOCK times in a row, so it skips the walk from the inode.
+// Every thread has its own table. Freeing a file's blocks bumps bmap_epoch, which
+// drops the entries of every thread at once. The epoch is shared by every filesystem, an
+// unmount bumps it too so a filesystem mounted at the same address can't hit old entries.
+#define BMAP_CACHE_SLOTS 64
+static __thread struct bmap_cache_entry {
+    struct wfs_fs *fs;
+    int inode_num;
+    size_t first;   // File block mapped by the leaf's first entry
+    off_t leaf;     // Leaf indirect block on disk 0, 0 for an empty slot
+    unsigned long epoch;
+} bmap_cache[BMAP_CACHE_SLOTS];
+static unsigned long bmap_epoch;
+
+static void bmap_cache_forget() {
+    __atomic_add_fetch(&bmap_epoch, 1, __ATOMIC_RELEASE);
+}
+
+// Allocates and clears an indirect block on disk 0
+static off_t alloc_indirect_block(struct wfs_fs *fs) {
+    TRACE(WRITE_IND_ALLOC, NULL);
+    off_t block = allocate_free_data_block(fs, 0);
+    if (block == 0) {
+        TRACE(WRITE_IND_NOSPC, NULL);
+        return 0;
+    }
+    memset(DISK_MAP_PTR(0, block), 0, BLOCK_SIZE);
+    mark_dirty(fs, DISK_MAP_PTR(0, block), BLOCK_SIZE);
+    return block;
+}
+
+// Root of the indirect tree that maps file block `block`, with its depth. Past the direct
+// blocks, blocks[IND_BLOCK] maps the next PTRS_PER_BLOCK blocks, dind_block the
+// PTRS_PER_BLOCK^2 after those and tind_block the PTRS_PER_BLOCK^3 after that.
+// *index is set to the position of `block` within that tree.
+static off_t *indirect_root(struct wfs_fs *fs, struct wfs_inode *inode, size_t block, int *levels, size_t *index) {
+    off_t *roots[MAX_IND_LEVEL] = {&inode->blocks[IND_BLOCK], &inode->dind_block, &inode->tind_block};
+    size_t span = PTRS_PER_BLOCK;
+
+    block -= IND_BLOCK;
+    for (int level = 1; level <= MAX_IND_LEVEL; level++) {
+        if (block < span) {
+            *levels = level;
+            *index = block;
+            return roots[level - 1];
+        }
+        block -= span;
+        span *= PTRS_PER_BLOCK;
+    }
+    return NULL;
+}
+
+// Block pointer slot for file block `block` in the direct/indirect layout, allocating
+// missing indirect blocks if asked to. Returns NULL for a hole in the indirect range.
+static off_t *legacy_block_slot(struct wfs_fs *fs, struct wfs_inode *inode, size_t block, int alloc, int *err) {
+    if (block < IND_BLOCK) {
+        return &inode->blocks[block];
+    }
+
+    struct bmap_cache_entry *cached = &bmap_cache[inode->num % BMAP_CACHE_SLOTS];
+    unsigned long epoch = __atomic_load_n(&bmap_epoch, __ATOMIC_ACQUIRE);
+    if (cached->leaf != 0 && cached->fs == fs && cached->inode_num == inode->num && cached->epoch == epoch &&
+        block >= cached->first && block - cached->first < PTRS_PER_BLOCK) {
+        return (off_t *)DISK_MAP_PTR(0, cached->leaf) + (block - cached->first);
+    }
+
+    int levels;
+    size_t index;
+    off_t *slot = indirect_root(fs, inode, block, &levels, &index);
+    if (!slot) {
+        *err = -EFBIG;
+        return NULL;
+    }
+
+    size_t span = 1;
+    for (int i = 1; i < levels; i++) {
+        span *= PTRS_PER_BLOCK;
+    }
+
+    // Walk down one indirect block per level; span is what one entry at this level maps
+    for (int level = levels; level > 0; level--) {
+        if (*slot == 0) {
+            if (!alloc) {
+                return NULL;
+            }
+            *slot = alloc_indirect_block(fs);
+            if (*slot == 0) {
+                *err = -ENOSPC;
+                return NULL;
+            }
+            mark_dirty(fs, slot, sizeof(off_t));
+        }
+        off_t node = *slot;
+        slot = (off_t *)DISK_MAP_PTR(0, node) + index / span;
+        index %= span;
+        if (level == 1) {
+            cached->fs = fs;
+            cached->inode_num = inode->num;
+            cached->first = block - (block - IND_BLOCK) % PTRS_PER_BLOCK;
+            cached->leaf = node;
+            cached->epoch = epoch;
+        }
+        span /= PTRS_PER_BLOCK;
+    }
+    return slot;
+}
+
+// Extent slots of a file, *count of them, starting with the ones in the inode
+struct extent_cursor {
+    struct wfs_extent *ext;
+    uint32_t count;
+    off_t next;
+    void *owner;    // Inode or extent block the slots live in, for dirty tracking
+};
+
+static void extent_first(struct wfs_inode *inode, struct extent_cursor *cur) {
+    struct wfs_extent_root *root = (struct wfs_extent_root *)inode->blocks;
+    cur->ext = root->ext;
+    cur->count = root->count;
+    cur->next = root->next;
+    cur->owner = inode;
+}
+
+static int extent_next(struct wfs_fs *fs, struct extent_cursor *cur) {
+    if (cur->next == 0) {
+        return 0;
+    }
+    struct wfs_extent_block *eb = (struct wfs_extent_block *)DISK_MAP_PTR(0, cur->next);
+    if (eb->magic != EXT_MAGIC) {
+        TRACE(EXT_BAD_BLOCK, NULL, cur->next);
+        return 0;
+    }
+    cur->ext = eb->ext;
+    cur->count = eb->count;
+    cur->next = eb->next;
+    cur->owner = eb;
+    return 1;
+}
+
+// Finds the extent holding `local` on `disk`. *limit is lowered to the first local index
+// above `local` that is mapped on that disk, so a new run can't overlap it.
+static struct wfs_extent *extent_find(struct wfs_fs *fs, struct wfs_inode *inode, int disk, size_t local, size_t *limit) {
+    struct extent_cursor cur;
+    extent_first(inode, &cur);
+    do {
+        for (uint32_t i = 0; i < cur.count; i++) {
+            struct wfs_extent *e = &cur.ext[i];
+            if (e->disk != disk) {
+                continue;
+            }
+            if (local >= e->local && local < (size_t)e->local + e->len) {
+                return e;
+            }
+            if (e->local > local && e->local < *limit) {
+                *limit = e->local;
+            }
+        }
+    } while (extent_next(fs, &cur));
+    return NULL;
+}
+
+// Records a newly allocated run, growing the extent it continues when there is one
+static int extent_add(struct wfs_fs *fs, struct wfs_inode *inode, int disk, size_t local, off_t start, size_t len) {
+    struct extent_cursor cur;
+    struct extent_cursor last;
+    extent_first(inode, &cur);
+    do {
+        for (uint32_t i = 0; i < cur.count; i++) {
+            struct wfs_extent *e = &cur.ext[i];
+            if (e->disk == disk && (size_t)e->local + e->len == local &&
+                e->start + (off_t)e->len * BLOCK_SIZE == start && e->len + len <= EXT_MAX_LEN) {
+                e->len += len;
+                mark_dirty(fs, e, sizeof(struct wfs_extent));
+                return SUCCESS;
+            }
+        }
+        last = cur;
+    } while (extent_next(fs, &cur));
+
+    // Append to the last extent list, chaining a new extent block if that one is full
+    uint32_t capacity = last.owner == (void *)inode ? EXT_ROOT_ENTRIES : EXT_BLOCK_ENTRIES;
+    if (last.count == capacity) {
+        off_t block = allocate_free_data_block(fs, 0);
+        if (block == 0) {
+            return -ENOSPC;
+        }
+        struct wfs_extent_block *eb = (struct wfs_extent_block *)DISK_MAP_PTR(0, block);
+        memset(eb, 0, BLOCK_SIZE);
+        eb->magic = EXT_MAGIC;
+        mark_dirty(fs, eb, BLOCK_SIZE);
+
+        if (last.owner == (void *)inode) {
+            ((struct wfs_extent_root *)inode->blocks)->next = block;
+        } else {
+            ((struct wfs_extent_block *)last.owner)->next = block;
+        }
+        mark_dirty(fs, last.owner, last.owner == (void *)inode ? sizeof(struct wfs_inode) : BLOCK_SIZE);
+
+        last.ext = eb->ext;
+        last.count = 0;
+        last.owner = eb;
+    }
+
+    struct wfs_extent *e = &last.ext[last.count];
+    e->local = local;
+    e->len = len;
+    e->disk = disk;
+    e->start = start;
+    if (last.owner == (void *)inode) {
+        ((struct wfs_extent_root *)inode->blocks)->count++;
+        mark_inode_dirty(fs, inode);
+    } else {
+        ((struct wfs_extent_block *)last.owner)->count++;
+        mark_dirty(fs, last.owner, BLOCK_SIZE);
+    }
+    return SUCCESS;
+}
+
+// Allocates up to `want` blocks on `disk` for `local` and records them as an extent.
+// The run starts right after the previous run of the file when those blocks are free.
+static off_t extent_alloc(struct wfs_fs *fs, struct wfs_inode *inode, int disk, size_t local, size_t want, size_t *len) {
+    struct wfs_sb *sb = get_superblock(fs);
+
+    long goal = -1;
+    size_t limit = SIZE_MAX;
+    if (local > 0) {
+        struct wfs_extent *prev = extent_find(fs, inode, disk, local - 1, &limit);
+        if (prev) {
+            goal = (prev->start - sb->d_blocks_ptr) / BLOCK_SIZE + (local - prev->local);
+        }
+    }
+    limit = SIZE_MAX;
+    extent_find(fs, inode, disk, local, &limit);
+    want = MIN(want, MIN(limit - local, EXT_MAX_LEN));
+
+    pthread_mutex_lock(&fs->data_bitmap_locks[disk]);
+    long bit = bitmap_alloc_run(&fs->data_bitmaps[disk], goal, want, len);
+    pthread_mutex_unlock(&fs->data_bitmap_locks[disk]);
+    if (bit < 0 && reclaim_held_blocks(fs)) {
+        pthread_mutex_lock(&fs->data_bitmap_locks[disk]);
+        bit = bitmap_alloc_run(&fs->data_bitmaps[disk], goal, want, len);
+        pthread_mutex_unlock(&fs->data_bitmap_locks[disk]);
+    }
+    if (bit < 0) {
+        TRACE(ALLOC_BLOCK_NOSPC, NULL);
+        return -ENOSPC;
+    }
+    stats_add(&fs->stats, STATS_BLOCKS_ALLOCATED, *len);
+    char *data_bitmap = DISK_MAP_PTR(disk, sb->d_bitmap_ptr);
+    mark_dirty(fs, &data_bitmap[bit / 8], (bit + *len - 1) / 8 - bit / 8 + 1);
+
+    off_t start = sb->d_blocks_ptr + (off_t)bit * BLOCK_SIZE;
+    if (extent_add(fs, inode, disk, local, start, *len) != SUCCESS) {
+        for (size_t i = 0; i < *len; i++) {
+            free_data_block(fs, disk, start + (off_t)i * BLOCK_SIZE);
+        }
+        return -ENOSPC;
+    }
+    TRACE(EXT_ALLOC, NULL, inode->num, local, *len, disk);
+    return start;
+}
+
+// How many file blocks from `block`, whose pointer is *slot, lie back to back on disk. Only the
+// pointers next to it, in the inode or in the same indirect block, are looked at.
+static size_t legacy_run(struct wfs_fs *fs, const off_t *slot, size_t block) {
+    size_t left = block < IND_BLOCK ? IND_BLOCK - block : PTRS_PER_BLOCK - (block - IND_BLOCK) % PTRS_PER_BLOCK;
+    left = file_stripe_left(fs, block, left);
+
+    size_t run = 1;
+    while (run < left && slot[run] == slot[0] + (off_t)run * BLOCK_SIZE) {
+        run++;
+    }
+    return run;
+}
+
+// Finds file block `block`. Returns its address on *disk, 0 for a hole or a negative errno.
+// When `want` is non-zero a hole is filled, and for extent files the run allocated covers up
+// to `want` file blocks. *run is set to the number of file blocks from `block` on that are
+// stored back to back, so they can be copied with one memcpy.
+off_t map_file_block(struct wfs_fs *fs, struct wfs_inode *inode, size_t block, size_t want, int *disk, size_t *run) {
+    *disk = file_block_disk(fs, block);
+    *run = 1;
+
+    if (is_extent_file(fs, inode)) {
+        size_t local = file_block_local(fs, block);
+        size_t limit = SIZE_MAX;
+        struct wfs_extent *e = extent_find(fs, inode, *disk, local, &limit);
+        if (e) {
+            *run = file_stripe_left(fs, block, e->local + e->len - local);
+            return e->start + (off_t)(local - e->local) * BLOCK_SIZE;
+        }
+        if (want == 0) {
+            return 0;
+        }
+
+        // The blocks of this write that land on the same disk
+        size_t len;
+        off_t start = extent_alloc(fs, inode, *disk, local, file_blocks_on_disk(fs, block, want), &len);
+        if (start > 0) {
+            *run = file_stripe_left(fs, block, len);
+        }
+        return start;
+    }
+
+    int err = 0;
+    off_t *slot = legacy_block_slot(fs, inode, block, want != 0, &err);
+    if (!slot) {
+        return err;
+    }
+    if (*slot == 0 && want != 0) {
+        *slot = allocate_free_data_block(fs, *disk);
+        if (*slot == 0) {
+            TRACE(WRITE_NOSPC, NULL);
+            return -ENOSPC;
+        }
+        mark_dirty(fs, slot, sizeof(off_t));
+        TRACE(WRITE_ALLOC, NULL, block, *disk);
+    }
+    if (*slot > 0) {
+        *run = legacy_run(fs, slot, block);
+    }
+    return *slot;
+}
+
+// Frees an indirect block `level` levels above the data blocks, everything under it and
+// the data blocks it maps, the first of which is file block `first`
+static void free_indirect_tree(struct wfs_fs *fs, off_t block, int level, size_t first) {
+    if (block == 0) {
+        return;
+    }
+    TRACE(UNLINK_FREE_IND, NULL, block, 0);
+    off_t *ptrs = (off_t *)DISK_MAP_PTR(0, block);
+
+    size_t span = 1;
+    for (int i = 1; i < level; i++) {
+        span *= PTRS_PER_BLOCK;
+    }
+    for (size_t i = 0; i < PTRS_PER_BLOCK; i++) {
+        if (ptrs[i] == 0) {
+            continue;
+        }
+        if (level > 1) {
+            free_indirect_tree(fs, ptrs[i], level - 1, first + i * span);
+            continue;
+        }
+        int disk = file_block_disk(fs, first + i);
+        TRACE(UNLINK_FREE_IND_ENTRY, NULL, (int)i, ptrs[i], disk);
+        free_data_block(fs, disk, ptrs[i]);
+    }
+    free_data_block(fs, 0, block);
+}
+
+// Frees every data block of a file along with its indirect or extent blocks
+void free_file_blocks(struct wfs_fs *fs, struct wfs_inode *inode) {
+    if (is_extent_file(fs, inode)) {
+        struct extent_cursor cur;
+        extent_first(inode, &cur);
+        do {
+            for (uint32_t i = 0; i < cur.count; i++) {
+                for (uint32_t j = 0; j < cur.ext[i].len; j++) {
+                    free_data_block(fs, cur.ext[i].disk, cur.ext[i].start + (off_t)j * BLOCK_SIZE);
+                }
+            }
+            if (cur.owner != (void *)inode) {
+                free_data_block(fs, 0, (char *)cur.owner - DISK_MAP_PTR(0, 0));
+            }
+        } while (extent_next(fs, &cur));
+        return;
+    }
+
+    for (int i = 0; i < IND_BLOCK; i++) {
+        if (inode->blocks[i] != 0) {
+            TRACE(UNLINK_FREE_BLOCK, NULL, i, file_block_disk(fs, i));
+            free_data_block(fs, file_block_disk(fs, i), inode->blocks[i]);
+        }
+    }
+
+    off_t roots[MAX_IND_LEVEL] = {inode->blocks[IND_BLOCK], inode->dind_block, inode->tind_block};
+    size_t first = IND_BLOCK;
+    size_t span = PTRS_PER_BLOCK;
+    for (int level = 1; level <= MAX_IND_LEVEL; level++) {
+        free_indirect_tree(fs, roots[level - 1], level, first);
+        first += span;
+        span *= PTRS_PER_BLOCK;
+    }
+    bmap_cache_forget();
+}
+
+// ---------------------------------------Block checksums---------------------------------------
+
+int has_checksums(struct wfs_fs *fs) {
+    return fs->raid_mode != 0 && (get_features(fs) & WFS_FEATURE_CHECKSUMS);
+}
+
+int has_journal(struct wfs_fs *fs) {
+    return fs->raid_mode != 0 && (get_features(fs) & WFS_FEATURE_JOURNAL);
+}
+
+// Where the journal starts, the first block boundary after the data blocks and their checksums
+static off_t journal_offset(struct wfs_fs *fs) {
+    struct wfs_sb *sb = get_superblock(fs);
+    off_t end = sb->d_blocks_ptr + sb->num_data_blocks * BLOCK_SIZE;
+    if (has_checksums(fs)) {
+        end += sb->num_data_blocks * CSUM_SIZE;
+    }
+    return (end + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+}
+
+// Checksum of the data block at addr, in the table on `disk`
+static uint32_t *csum_slot(struct wfs_fs *fs, int disk, off_t addr) {
+    struct wfs_sb *sb = get_superblock(fs);
+    off_t table = sb->d_blocks_ptr + sb->num_data_blocks * BLOCK_SIZE;
+    return (uint32_t *)DISK_FILE_PTR(disk, table) + (addr - sb->d_blocks_ptr) / BLOCK_SIZE;
+}
+
+// Recomputes the checksums of the data blocks overlapping [start, end) from their copy
+// on s_disk, and stores them on every mirror. Callers hold sync_lock, or are the journal
+// writing metadata blocks in place, whose checksums nothing else updates meanwhile.
+static void update_csums(struct wfs_fs *fs, int s_disk, off_t start, off_t end) {
+    struct wfs_sb *sb = get_superblock(fs);
+    off_t data_end = sb->d_blocks_ptr + sb->num_data_blocks * BLOCK_SIZE;
+
+    start = start < sb->d_blocks_ptr ? sb->d_blocks_ptr : start;
+    end = MIN(end, data_end);
+    if (start >= end) {
+        return;
+    }
+    off_t first = start - start % BLOCK_SIZE;
+    for (off_t block = first; block < end; block += BLOCK_SIZE) {
+        uint32_t crc = crc32c(DISK_FILE_PTR(s_disk, block), BLOCK_SIZE);
+        for (int i = 0; i < fs->num_disks; i++) {
+            *csum_slot(fs, i, block) = crc;
+        }
+    }
+
+    // The slots are at the same place on every mirror
+    char *slots = (char *)csum_slot(fs, 0, first);
+    writeback_mark_all(&fs->wb, slots - DISK_FILE_PTR(0, 0), (char *)(csum_slot(fs, 0, end - 1) + 1) - slots);
+}
+
+// Brings the checksums of the data blocks in list's ranges up to date
+static void update_dirty_csums(struct wfs_fs *fs, struct dirty_list *list, int s_disk) {
+    struct wfs_sb *sb = get_superblock(fs);
+    if (list->overflow) {
+        update_csums(fs, s_disk, sb->d_blocks_ptr, sb->d_blocks_ptr + sb->num_data_blocks * BLOCK_SIZE);
+        return;
+    }
+    for (int i = 0; i < list->num; i++) {
+        update_csums(fs, s_disk, list->ranges[i].start, list->ranges[i].end);
+    }
+}
+
+// 1 if the copy of the data block at addr on `disk` matches that disk's checksum of it
+static int block_csum_ok(struct wfs_fs *fs, int disk, off_t block) {
+    return crc32c(DISK_FILE_PTR(disk, block), BLOCK_SIZE) == *csum_slot(fs, disk, block);
+}
+// -----------------------------------------------------------------------------------------------------
+
+// Copies the next len bytes of src to addr, on `disk` for RAID 0 and on every mirror
+// otherwise. src is memory or, when FUSE splices requests, a pipe that is read straight
+// into the image. Returns the number of bytes copied or -errno.
+static ssize_t write_file_data(struct wfs_fs *fs, int disk, off_t addr, struct wfs_source *src, size_t len) {
+    ssize_t copied = src->read(src->ctx, DISK_FILE_PTR(fs->raid_mode == 0 ? disk : 0, addr), len);
+    if (copied <= 0) {
+        return copied;
+    }
+    if (fs->raid_mode == 0) {
+        writeback_mark(&fs->wb, disk, addr, copied);
+        return copied;
+    }
+
+    for (int i = 1; i < fs->num_disks; i++) {
+        memcpy(DISK_FILE_PTR(i, addr), DISK_FILE_PTR(0, addr), copied);
+    }
+    writeback_mark_all(&fs->wb, addr, copied);
+    if (has_checksums(fs)) {
+        pthread_mutex_lock(&fs->sync_lock);
+        update_csums(fs, 0, addr, addr + copied);
+        pthread_mutex_unlock(&fs->sync_lock);
+    }
+    return copied;
+}
+
+// Mirror that serves a RAID 1 read of [addr, addr + *len), see read_policy. *len is cut
+// down to the part that disk should serve.
+static int pick_mirror(struct wfs_fs *fs, off_t addr, size_t *len) {
+    switch (fs->read_policy) {
+    case READ_POLICY_ROUND_ROBIN:
+        // Consecutive blocks alternate between the mirrors
+        *len = MIN(*len, BLOCK_SIZE - addr % BLOCK_SIZE);
+        return (addr / BLOCK_SIZE) % fs->num_disks;
+    case READ_POLICY_LEAST_OUTSTANDING: {
+        int best = 0;
+        for (int i = 1; i < fs->num_disks; i++) {
+            if (__atomic_load_n(&fs->outstanding_reads[i], __ATOMIC_RELAXED) <
+                __atomic_load_n(&fs->outstanding_reads[best], __ATOMIC_RELAXED)) {
+                best = i;
+            }
+        }
+        return best;
+    }
+    case READ_POLICY_STREAM:
+        // A sequential stream stays on one mirror for READ_STREAM_BLOCKS blocks at a time
+        *len = MIN(*len, READ_STREAM_BLOCKS * BLOCK_SIZE - addr % (READ_STREAM_BLOCKS * BLOCK_SIZE));
+        return (addr / (READ_STREAM_BLOCKS * BLOCK_SIZE)) % fs->num_disks;
+    default:
+        return 0;
+    }
+}
+
+// Mirror whose copy of [addr, addr + *len) most mirrors agree on. A range every mirror
+// agrees on comes from disk 0 in one go, otherwise *len is cut to the end of the first
+// block and that block is put to the vote.
+static int vote_source(struct wfs_fs *fs, off_t addr, size_t *len) {
+    int agree = 1;
+    for (int i = 1; i < fs->num_disks && agree; i++) {
+        agree = memcmp(DISK_FILE_PTR(0, addr), DISK_FILE_PTR(i, addr), *len) == 0;
+    }
+    if (agree) {
+        return 0;
+    }
+
+    *len = MIN(*len, BLOCK_SIZE - addr % BLOCK_SIZE);
+    int majority_votes[fs->num_disks];
+    int majority_disk_idx = 0;
+
+    for (int i = 0; i < fs->num_disks; i++) {
+        majority_votes[i] = 1;
+        for (int j = i + 1; j < fs->num_disks; j++) {
+            if (memcmp(DISK_FILE_PTR(i, addr), DISK_FILE_PTR(j, addr), *len) == 0) {
+                majority_votes[i]++;
+            }
+        }
+        if (majority_votes[i] > majority_votes[majority_disk_idx]) {
+            majority_disk_idx = i;
+        }
+    }
+    return majority_disk_idx;
+}
+
+// First mirror whose copy of the block holding addr matches its checksum, starting with
+// the one read_policy picks. *len is cut to the end of that block. A block with no good
+// copy (a stale checksum, say) falls back to voting.
+static int checked_source(struct wfs_fs *fs, off_t addr, size_t *len) {
+    *len = MIN(*len, BLOCK_SIZE - addr % BLOCK_SIZE);
+    off_t block = addr - addr % BLOCK_SIZE;
+    size_t span = *len;
+    int first = pick_mirror(fs, addr, &span);
+
+    for (int i = 0; i < fs->num_disks; i++) {
+        int disk = (first + i) % fs->num_disks;
+        if (block_csum_ok(fs, disk, block)) {
+            return disk;
+        }
+        TRACE(READ_BAD_CSUM, NULL, block, disk);
+    }
+    return vote_source(fs, addr, len);
+}
+
+// Disk to read file data at [addr, addr + *len) from, *len cut down to the part it serves.
+// RAID 1 spreads reads over the mirrors as read_policy says. RAID 1v checks one copy
+// against its checksum when the filesystem has them and otherwise takes the copy most
+// mirrors agree on.
+static int read_source(struct wfs_fs *fs, int disk, off_t addr, size_t *len) {
+    if (fs->raid_mode == 1 && fs->num_disks > 1) {
+        return pick_mirror(fs, addr, len);
+    }
+    if (fs->raid_mode != 2 || fs->num_disks == 1) {
+        return disk;
+    }
+    if (has_checksums(fs)) {
+        return checked_source(fs, addr, len);
+    }
+    return vote_source(fs, addr, len);
+}
+
+// Copies len bytes of file data at addr into dst, each part from the disk read_source() picks
+static void read_file_data(struct wfs_fs *fs, int disk, off_t addr, char *dst, size_t len) {
+    while (len > 0) {
+        size_t chunk = len;
+        int source = read_source(fs, disk, addr, &chunk);
+        if (fs->raid_mode == 1) {
+            __atomic_add_fetch(&fs->outstanding_reads[source], 1, __ATOMIC_RELAXED);
+        }
+        memcpy(dst, DISK_FILE_PTR(source, addr), chunk);
+        if (fs->raid_mode == 1) {
+            __atomic_sub_fetch(&fs->outstanding_reads[source], 1, __ATOMIC_RELAXED);
+        }
+        dst += chunk;
+        addr += chunk;
+        len -= chunk;
+    }
+}
+
+// Appends piece to map, growing it as needed
+static int map_push(struct wfs_map *map, struct wfs_piece piece) {
+    if (map->count == map->cap) {
+        size_t cap = map->cap ? 2 * map->cap : 4;
+        struct wfs_piece *pieces = realloc(map->pieces, cap * sizeof(struct wfs_piece));
+        if (!pieces) {
+            return FAIL;
+        }
+        map->pieces = pieces;
+        map->cap = cap;
+    }
+    map->pieces[map->count++] = piece;
+    return SUCCESS;
+}
+
+// Appends len bytes at addr on disk to map. Extends the last piece when the two are adjacent.
+static int map_add(struct wfs_fs *fs, struct wfs_map *map, int disk, off_t addr, size_t len) {
+    struct wfs_piece *last = map->count ? &map->pieces[map->count - 1] : NULL;
+    if (last && last->fd == fs->disk_fds[disk] && last->pos + (off_t)last->len == addr) {
+        last->len += len;
+        return SUCCESS;
+    }
+    return map_push(map, (struct wfs_piece){.fd = fs->disk_fds[disk], .pos = addr, .len = len});
+}
+
+size_t map_size(const struct wfs_map *map) {
+    size_t size = 0;
+    for (size_t i = 0; i < map->count; i++) {
+        size += map->pieces[i].len;
+    }
+    return size;
+}
+
+void free_map(struct wfs_map *map) {
+    for (size_t i = 0; i < map->count; i++) {
+        if (map->pieces[i].fd < 0) {
+            free(map->pieces[i].mem);
+        }
+    }
+    free(map->pieces);
+    *map = (struct wfs_map){0};
+}
+
+
+struct wfs_dentry *find_dentry_in_directory(struct wfs_fs *fs, struct wfs_inode *dir_inode, const char *name_to_add) {
+    TRACE(FIND_DENTRY, name_to_add, dir_inode->num);
+    if (is_indexed_dir(fs, dir_inode)) {
+        return dx_find_dentry(fs, dir_inode, name_to_add);
+    }
+
+    char *data_block;
+    struct wfs_dentry *dentry;
+    int scanned = 0;
+
+    for (int i = 0; i < D_BLOCK + 1; i++) {
+        if (dir_inode->blocks[i] == 0) {
+            continue; // Skip empty blocks
+        }
+               
+        // Iterate over all the disks to find the dentry
+        if (fs->raid_mode == 0){
+            for (int disk = 0; disk < fs->num_disks; disk++) {
+                TRACE(FIND_DENTRY_BLOCK, NULL, i, disk, dir_inode->blocks[i]);
+
+                data_block = DISK_MAP_PTR(disk, dir_inode->blocks[i]);
+                // Search over all dentries and see if we find the matching dentry
+                for (int j = 0; j < fs->NUM_DENTRIES_PER_BLOCK; j++) {
+                    dentry = (struct wfs_dentry *)(data_block + j * sizeof(struct wfs_dentry));
+                    scanned++;
+                    if (strncmp(dentry->name, name_to_add, MAX_NAME) == 0) {
+                        TRACE(FIND_DENTRY_FOUND, dentry->name, dentry->num);
+                        stats_add(&fs->stats, STATS_DENTRIES_SCANNED, scanned);
+                        return dentry;
+                    }
+                }
+            }
+            TRACE(FIND_DENTRY_MISS, name_to_add);
+            stats_add(&fs->stats, STATS_DENTRIES_SCANNED, scanned);
+            return NULL;
+        }
+        // RAID 1
+        else {
+            TRACE(FIND_DENTRY_BLOCK, NULL, i, 0, dir_inode->blocks[i]);
+
+            data_block = DISK_MAP_PTR(0, dir_inode->blocks[i]);
+
+            // Search over all dentries and see if we find the matching dentry
+            for (int j = 0; j < fs->NUM_DENTRIES_PER_BLOCK; j++) {
+                dentry = (struct wfs_dentry *)(data_block + j * sizeof(struct wfs_dentry));
+                scanned++;
+                if (strncmp(dentry->name, name_to_add, MAX_NAME) == 0) {
+                    TRACE(FIND_DENTRY_FOUND, dentry->name, dentry->num);
+                    stats_add(&fs->stats, STATS_DENTRIES_SCANNED, scanned);
+                    return dentry;
+                }
+            }
+        }
+    }
+
+    TRACE(FIND_DENTRY_MISS, name_to_add);
+    stats_add(&fs->stats, STATS_DENTRIES_SCANNED, scanned);
+    return NULL;
+}
+
+// Inode number of the entry `name` (len bytes, NUL terminated) in dir_inode, DCACHE_NEGATIVE
+// if there is none. The dentry cache is checked first and misses are remembered as negative
+// entries. The caller holds dir_inode locked.
+int lookup_child(struct wfs_fs *fs, struct wfs_inode *dir_inode, const char *name, size_t len) {
+    int child_num;
+    if (dcache_lookup(&fs->dcache, dir_inode->num, name, len, &child_num)) {
+        TRACE(LOOKUP_DENTRY_CACHED, name, child_num);
+        return child_num;
+    }
+
+    struct wfs_dentry *entry = find_dentry_in_directory(fs, dir_inode, name);
+    child_num = entry ? entry->num : DCACHE_NEGATIVE;
+    dcache_add(&fs->dcache, dir_inode->num, name, len, child_num);
+    return child_num;
+}
+
+// find_inode_by_path(), which counts the components it goes through in *depth. That is left
+// alone when the dentry cache has the whole path.
+static struct wfs_inode *walk_path(struct wfs_fs *fs, const char *path, int mode, int *depth) {
+    TRACE(LOOKUP, path);
+
+    if (path[0] != '/') {
+        TRACE(LOOKUP_BAD_PATH, path);
+        *depth = 0;
+        return NULL;
+    }
+
+    // Whole path resolved before and nothing has been removed since. The entry is checked again
+    // once the inode is locked, since removing it would have needed that lock.
+    int cached_num;
+    if (dcache_path_lookup(&fs->dcache, path, &cached_num)) {
+        lock_inode(fs, cached_num, mode);
+        int locked_num;
+        if (dcache_path_lookup(&fs->dcache, path, &locked_num) && locked_num == cached_num) {
+            TRACE(LOOKUP_CACHED, path, cached_num);
+            return get_inode(fs, cached_num);
+        }
+        unlock_inode(fs, cached_num);
+    }
+
+    // Only the last component is locked in the mode asked for, directories on the way are shared
+    *depth = 0;
+    const char *token = path + strspn(path, "/");
+    lock_inode(fs, 0, *token == '\0' ? mode : LOCK_SHARED);
+
+    // Get the root inode
+    struct wfs_inode *current_inode = get_inode(fs, 0);
+    if (!current_inode) {
+        TRACE(LOOKUP_NO_ROOT, NULL);
+        unlock_inode(fs, 0);
+        return NULL;
+    }
+
+    // Otherwise, walk the path one component at a time, checking the dentry cache before scanning the directory
+    while (*token != '\0') {
+        size_t len = strcspn(token, "/");
+        const char *next = token + len + strspn(token + len, "/");
+
+        // Make sure it is a directory
+        if (!S_ISDIR(current_inode->mode)) {
+            TRACE(LOOKUP_NOTDIR, NULL);
+            unlock_inode(fs, current_inode->num);
+            return NULL;
+        }
+
+        // Names that long can't be in a dentry
+        if (len >= MAX_NAME) {
+            TRACE(LOOKUP_NOENT, NULL);
+            unlock_inode(fs, current_inode->num);
+            return NULL;
+        }
+        char name[MAX_NAME];
+        memcpy(name, token, len);
+        name[len] = '\0';
+        TRACE(LOOKUP_TOKEN, name);
+        (*depth)++;
+
+        // Get the inode number for this component
+        int child_num = lookup_child(fs, current_inode, name, len);
+        if (child_num == DCACHE_NEGATIVE) {
+            TRACE(LOOKUP_NOENT, name);
+            unlock_inode(fs, current_inode->num);
+            return NULL;
+        }
+
+        // use the inode that the entry points to, locking it before letting go of its directory
+        lock_inode(fs, child_num, *next == '\0' ? mode : LOCK_SHARED);
+        unlock_inode(fs, current_inode->num);
+        current_inode = get_inode(fs, child_num);
+        if (!current_inode) {
+            TRACE(LOOKUP_NO_INODE, name);
+            unlock_inode(fs, child_num);
+            return NULL;
+        }
+
+        token = next; // go to the next component
+    }
+
+    dcache_path_add(&fs->dcache, path, current_inode->num);
+    TRACE(LOOKUP_DONE, path, current_inode->num);
+    return current_inode; // Return the inode we found after iterating the path
+}
+
+// Resolves path and returns its inode locked in `mode` (LOCK_SHARED or LOCK_EXCLUSIVE), NULL if
+// it doesn't exist. The caller releases it with unlock_inode().
+struct wfs_inode *find_inode_by_path(struct wfs_fs *fs, const char *path, int mode) {
+    int depth = -1;
+    struct wfs_inode *inode = walk_path(fs, path, mode, &depth);
+    stats_walk(&fs->stats, depth);
+    return inode;
+}
+
+int add_dentry_to_directory(struct wfs_fs *fs, struct wfs_inode *dir_inode, struct wfs_dentry *entry, const char *dir_name, int new_inode_num) {
+    TRACE(ADD_DENTRY, dir_name, dir_inode->num);
+    if (is_indexed_dir(fs, dir_inode)) {
+        return dx_add_dentry(fs, dir_inode, entry);
+    }
+
+    char *data_block;
+    struct wfs_dentry *dentry;
+    int target_disk = 0;
+
+    struct wfs_inode *inode;
+
+    if (fs->raid_mode == 0) {
+        // Use find_disk to determine the target disk
+        target_disk = find_disk(fs, dir_inode, MK_DIR_AND_NODE);
+        TRACE(ADD_DENTRY_DISK, NULL, target_disk);
+
+        int inode_num = dir_inode->num;
+        inode = (struct wfs_inode *)DISK_MAP_PTR(target_disk, inode_offset(fs, inode_num));
+
+        // For RAID-0, calculate which disk should hold the next block
+        int blk_num = (new_inode_num - 1) / fs->NUM_DENTRIES_PER_BLOCK;
+        target_disk = get_disk(fs, blk_num);
+
+        // The block follows from the inode number. Directories only have the direct blocks, past
+        // those it would land on blocks[IND_BLOCK], dind_block and tind_block, and past blocks[]
+        // in the next inode with dense inodes
+        if (blk_num >= IND_BLOCK) {
+            TRACE(ADD_DENTRY_FULL, NULL, dir_inode->num);
+            return -ENOSPC;
+        }
+
+        // Only allocate a new block if this is the first entry for this block on this disk
+        if (new_inode_num % fs->NUM_DENTRIES_PER_BLOCK == 1 && new_inode_num != 1) {
+            off_t blk_addr = allocate_free_data_block(fs, target_disk);
+            if (blk_addr >= 0) {
+                int blk_idx = blk_num;
+                dir_inode->blocks[blk_idx] = blk_addr;
+                mark_inode_dirty(fs, dir_inode);
+                TRACE(ADD_DENTRY_NEW_BLOCK, NULL, blk_idx, target_disk, new_inode_num);
+            }
+        }
+    } else {
+        // Default target_disk logic for non-RAID 0 modes
+        target_disk = 0; 
+        inode = dir_inode;
+    }
+
+    TRACE(ADD_DENTRY_TARGET, NULL, target_disk);
+    
+    // Look over each block in blocks array 
+    for (int i = 0; i < D_BLOCK + 1; i++) {
+        
+        if (inode->blocks[i] == 0) {
+            inode->blocks[i] = allocate_free_data_block(fs, target_disk);
+            mark_inode_dirty(fs, inode);
+            
+            if (inode->blocks[i] == 0) {
+                TRACE(ADD_DENTRY_NOSPC, NULL, target_disk);
+                return -1; 
+            }
+            // A freed block keeps its old contents, which would read as dentries
+            if (fs->raid_mode != 0) {
+                memset(DISK_MAP_PTR(target_disk, inode->blocks[i]), 0, BLOCK_SIZE);
+                mark_dirty(fs, DISK_MAP_PTR(target_disk, inode->blocks[i]), BLOCK_SIZE);
+            }
+            TRACE(ADD_DENTRY_ALLOC, NULL, i, target_disk);
+        }
+        
+        data_block = DISK_MAP_PTR(target_disk, inode->blocks[i]);        
+
+        // Loop over all the dentries and see if we can add to an empty slot
+        for (int j = 0; j < fs->NUM_DENTRIES_PER_BLOCK; j++) {
+            dentry = (struct wfs_dentry *)(data_block + j * sizeof(struct wfs_dentry));
+            if (dentry->name[0] == '\0') { // Empty slot
+                *dentry = *entry; // Copy entry
+                mark_dirty(fs, dentry, sizeof(struct wfs_dentry));
+                TRACE(ADD_DENTRY_DONE, dir_name, i, j);
+                return 0;
+            }
+        }
+    }
+
+    TRACE(ADD_DENTRY_FULL, NULL, inode->num);
+    return -1;
+}
+
+// Clears the dentry for name in dir_inode
+int remove_dentry_from_directory(struct wfs_fs *fs, struct wfs_inode *dir_inode, const char *name) {
+    if (is_indexed_dir(fs, dir_inode)) {
+        return dx_remove_dentry(fs, dir_inode, name);
+    }
+
+    struct wfs_dentry *dentry = find_dentry_in_directory(fs, dir_inode, name);
+    if (!dentry) {
+        return -ENOENT;
+    }
+    memset(dentry, 0, sizeof(struct wfs_dentry));
+    mark_dirty(fs, dentry, sizeof(struct wfs_dentry));
+    return 0;
+}
+
+// -----------------------Helper functions to synchronize disks--------------------------------------
+// The bitmaps change under their locks. A copy of any part of them takes those too, so an
+// allocation on another thread doesn't change a byte while it is read. Returns 1 if it locked.
+static int lock_bitmaps(struct wfs_fs *fs, int s_disk, off_t start, off_t end) {
+    struct wfs_sb *sb = get_superblock(fs);
+    if (end <= sb->i_bitmap_ptr || start >= sb->i_blocks_ptr) {
+        return 0;
+    }
+    pthread_mutex_lock(&fs->inode_bitmap_lock);
+    pthread_mutex_lock(&fs->data_bitmap_locks[s_disk]);
+    return 1;
+}
+
+static void unlock_bitmaps(struct wfs_fs *fs, int s_disk, int locked) {
+    if (locked) {
+        pthread_mutex_unlock(&fs->data_bitmap_locks[s_disk]);
+        pthread_mutex_unlock(&fs->inode_bitmap_lock);
+    }
+}
+
+// Copies [start, end) from the image of s_disk at src to the one at dst, the bitmaps in it
+// under their locks
+static void copy_image_range(struct wfs_fs *fs, int s_disk, char *dst, const char *src, off_t start, off_t end) {
+    struct wfs_sb *sb = get_superblock(fs);
+    off_t split[4] = {start, sb->i_bitmap_ptr, sb->i_blocks_ptr, end};
+    for (int i = 0; i < 3; i++) {
+        off_t from = split[i] < start ? start : split[i];
+        off_t to = MIN(split[i + 1], end);
+        if (from < to) {
+            int locked = lock_bitmaps(fs, s_disk, from, to);
+            memcpy(dst + from, src + from, to - from);
+            unlock_bitmaps(fs, s_disk, locked);
+        }
+    }
+}
+
+// Copies the dirty parts of [region_start, region_end) from s_disk to every other disk.
+// Returns the number of bytes copied per disk.
+static size_t copy_dirty_ranges(struct wfs_fs *fs, struct dirty_list *list, int s_disk, off_t region_start, off_t region_end) {
+    size_t bytes_copied = 0;
+
+    for (int i = 0; i < list->num || list->overflow; i++) {
+        off_t start = region_start;
+        off_t end = region_end;
+
+        // Lost track of what changed, copy the whole region
+        if (!list->overflow) {
+            start = list->ranges[i].start < region_start ? region_start : list->ranges[i].start;
+            end = MIN(list->ranges[i].end, region_end);
+            if (start >= end) {
+                continue;
+            }
+        }
+
+        for (int disk = 0; disk < fs->num_disks; disk++) {
+            if (disk != s_disk) {
+                copy_image_range(fs, s_disk, DISK_MAP_PTR(disk, 0), DISK_MAP_PTR(s_disk, 0), start, end);
+                if (!staged(fs)) {
+                    writeback_mark(&fs->wb, disk, start, end - start);
+                }
+            }
+        }
+        bytes_copied += end - start;
+
+        if (list->overflow) {
+            break;
+        }
+    }
+    return bytes_copied;
+}
+
+// Called by the journal for every range it writes in place, at replay and once the
+// transaction holding it is committed
+static void journal_applied(void *arg, off_t offset, size_t len) {
+    struct wfs_fs *fs = arg;
+    if (has_checksums(fs)) {
+        update_csums(fs, 0, offset, offset + len);
+    }
+}
+
+// Writes the dirty parts of [region_start, region_end) from s_disk's private copy in place on
+// every disk, for an operation the journal can't take. Callers hold sync_lock and have emptied
+// the journal, so nothing it logged before can land on top.
+static void write_dirty_in_place(struct wfs_fs *fs, struct dirty_list *list, int s_disk, off_t region_start, off_t region_end) {
+    struct wfs_sb *sb = get_superblock(fs);
+    journal_hold(&fs->journal);
+    for (int i = 0; i < list->num || list->overflow; i++) {
+        off_t start = region_start;
+        off_t end = region_end;
+
+        // Lost track of what changed. Only the bitmaps and inodes can be copied whole, the
+        // private copy of the data blocks is missing the file data written since the mount.
+        if (list->overflow) {
+            end = MIN(end, sb->d_blocks_ptr);
+            TRACE(JOURNAL_LOST, NULL);
+        } else {
+            start = list->ranges[i].start < region_start ? region_start : list->ranges[i].start;
+            end = MIN(list->ranges[i].end, region_end);
+            if (start >= end) {
+                continue;
+            }
+        }
+
+        for (int disk = 0; disk < fs->num_disks; disk++) {
+            copy_image_range(fs, s_disk, DISK_FILE_PTR(disk, 0), DISK_MAP_PTR(s_disk, 0), start, end);
+        }
+        writeback_mark_all(&fs->wb, start, end - start);
+        if (has_checksums(fs)) {
+            update_csums(fs, 0, start, end);
+        }
+
+        if (list->overflow) {
+            break;
+        }
+    }
+    journal_release(&fs->journal);
+}
+
+// Logs what the operation changed in [region_start, region_end) as one unit of the journal,
+// which writes it in place once committed. If that can't be done, because the ranges were
+// lost track of or don't fit, the journal is emptied and they are written in place right away,
+// which a crash can leave half done. Callers hold sync_lock.
+static void journal_dirty_ranges(struct wfs_fs *fs, struct dirty_list *list, int s_disk, off_t region_start, off_t region_end) {
+    int nranges = 0;
+    size_t bytes = 0;
+    for (int i = 0; i < list->num; i++) {
+        off_t start = list->ranges[i].start < region_start ? region_start : list->ranges[i].start;
+        off_t end = MIN(list->ranges[i].end, region_end);
+        if (start < end) {
+            nranges++;
+            bytes += end - start;
+        }
+    }
+    if (nranges == 0 && !list->overflow) {
+        return;
+    }
+
+    if (!list->overflow && journal_start(&fs->journal, nranges, bytes) == SUCCESS) {
+        for (int i = 0; i < list->num; i++) {
+            off_t start = list->ranges[i].start < region_start ? region_start : list->ranges[i].start;
+            off_t end = MIN(list->ranges[i].end, region_end);
+            if (start < end) {
+                int locked = lock_bitmaps(fs, s_disk, start, end);
+                journal_add(&fs->journal, DISK_MAP_PTR(s_disk, 0), start, end - start);
+                unlock_bitmaps(fs, s_disk, locked);
+            }
+        }
+        journal_stop(&fs->journal);
+    } else {
+        journal_checkpoint(&fs->journal);
+        write_dirty_in_place(fs, list, s_disk, region_start, region_end);
+    }
+    hold_freed_blocks(fs, list);
+}
+
+// Copies list's ranges to the mirrors, and logs them with a journal. Callers hold list->lock.
+static void sync_list_raid1(struct wfs_fs *fs, struct dirty_list *list, int s_disk) {
+    struct wfs_sb *sb = get_superblock(fs);  // Access superblock from disk 0
+
+    // Everything after the superblock is mirrored (inode bitmap, data bitmap, inodes, data blocks),
+    // the superblock itself is not since each disk keeps its own disk_id
+    pthread_mutex_lock(&fs->sync_lock);
+
+    // With a journal, metadata blocks get their checksums when it writes them in place
+    if (has_checksums(fs) && !staged(fs)) {
+        update_dirty_csums(fs, list, s_disk);
+    }
+    off_t region_end = sb->d_blocks_ptr + (sb->num_data_blocks * BLOCK_SIZE);
+    size_t bytes_copied = copy_dirty_ranges(fs, list, s_disk, sb->i_bitmap_ptr, region_end);
+    if (has_journal(fs)) {
+        journal_dirty_ranges(fs, list, s_disk, sb->i_bitmap_ptr, region_end);
+    }
+    pthread_mutex_unlock(&fs->sync_lock);
+    clear_dirty_ranges(list);
+    stats_add(&fs->stats, STATS_BYTES_REPLICATED, bytes_copied * (fs->num_disks - 1));
+    TRACE(SYNC_RAID1, NULL, bytes_copied, s_disk);
+}
+
+// Copies list's inode bitmap and inode ranges to the other disks. Callers hold list->lock.
+static void sync_list_raid0(struct wfs_fs *fs, struct dirty_list *list, int s_disk) {
+    struct wfs_sb *sb = get_superblock(fs);
+
+    // Only the inode bitmap and the inodes are replicated, data bitmaps and data blocks
+    // belong to the disk they live on
+    pthread_mutex_lock(&fs->sync_lock);
+    size_t bytes_copied = copy_dirty_ranges(fs, list, s_disk, sb->i_bitmap_ptr, sb->d_bitmap_ptr);
+    bytes_copied += copy_dirty_ranges(fs, list, s_disk, sb->i_blocks_ptr, sb->d_blocks_ptr);
+    pthread_mutex_unlock(&fs->sync_lock);
+    clear_dirty_ranges(list);
+    stats_add(&fs->stats, STATS_BYTES_REPLICATED, bytes_copied * (fs->num_disks - 1));
+    TRACE(SYNC_RAID0, NULL, bytes_copied, s_disk);
+}
+
+static void sync_disks_for_raid1(struct wfs_fs *fs, int s_disk) {
+    lock_dirty_list(fs);
+    sync_list_raid1(fs, &dirty, s_disk);
+    pthread_mutex_unlock(&dirty.lock);
+}
+
+static void sync_disks_for_raid0(struct wfs_fs *fs, int s_disk) {
+    lock_dirty_list(fs);
+    sync_list_raid0(fs, &dirty, s_disk);
+    pthread_mutex_unlock(&dirty.lock);
+}
+
+// Syncs what every thread has left in its list for fs, which is then no longer theirs
+static void sync_dirty_lists(struct wfs_fs *fs) {
+    pthread_mutex_lock(&dirty_lists_lock);
+    for (struct dirty_list *list = dirty_lists; list; list = list->next) {
+        pthread_mutex_lock(&list->lock);
+        if (list->fs == fs) {
+            if (fs->raid_mode != 0 && fs->num_disks > 1) {
+                sync_list_raid1(fs, list, 0);
+            } else if (fs->raid_mode == 0 && fs->num_disks > 1) {
+                sync_list_raid0(fs, list, 0);
+            }
+            list->fs = NULL;
+        }
+        pthread_mutex_unlock(&list->lock);
+    }
+    pthread_mutex_unlock(&dirty_lists_lock);
+}
+// -----------------------------------------------------------------------------------------------------
+
+
+// -------------------------------------------Dropping inodes-------------------------------------------
+// An inode may go on being used after its last name is gone, by an open file handle or, with
+// --lowlevel, by the kernel, which refers to inodes by number. inode_refs counts those
+// references (lookups replied minus those forgotten, plus open handles), and an inode removed
+// while that isn't 0 stays allocated with no links until forget_inode() drops the last one.
+
+static void free_dir_blocks(struct wfs_fs *fs, struct wfs_inode *inode) {
+    struct wfs_sb *sb = get_superblock(fs);
+    for (int i = 0; i < IND_BLOCK; i++) {
+        if (inode->blocks[i] != 0) {
+            int target_disk;
+
+            if (fs->raid_mode == 0) {
+                target_disk = i % fs->num_disks;
+            } else {
+                target_disk = sb->disk_id;
+            }
+            free_data_block(fs, target_disk, inode->blocks[i]);
+        }
+    }
+}
+
+// Frees the inode and its blocks
+static void destroy_inode(struct wfs_fs *fs, struct wfs_inode *inode) {
+    if (S_ISDIR(inode->mode)) {
+        free_dir_blocks(fs, inode);
+    } else {
+        free_file_blocks(fs, inode);
+    }
+    free_inode(fs, inode->num);
+}
+
+// Remembers orphan num, and lists it in the journal before the unlink is logged
+static void add_orphan(struct wfs_fs *fs, uint32_t num) {
+    pthread_mutex_lock(&fs->orphans_lock);
+    if (fs->num_orphans == fs->max_orphans) {
+        size_t max = fs->max_orphans ? 2 * fs->max_orphans : 16;
+        uint32_t *bigger = realloc(fs->orphans, max * sizeof(uint32_t));
+        if (bigger) {
+            fs->orphans = bigger;
+            fs->max_orphans = max;
+        }
+    }
+    // Without room it is found by going through every inode
+    if (fs->num_orphans < fs->max_orphans) {
+        fs->orphans[fs->num_orphans++] = num;
+    } else {
+        fs->orphans_lost = 1;
+    }
+    pthread_mutex_unlock(&fs->orphans_lock);
+    journal_orphan(&fs->journal, num);
+}
+
+// Forgets orphan num once the operation that freed it is logged
+static void remove_orphan(struct wfs_fs *fs, uint32_t num) {
+    pthread_mutex_lock(&fs->orphans_lock);
+    for (size_t i = 0; i < fs->num_orphans; i++) {
+        if (fs->orphans[i] == num) {
+            fs->orphans[i] = fs->orphans[--fs->num_orphans];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&fs->orphans_lock);
+}
+
+// The journal's orphans callback, see journal_open()
+static size_t list_orphans(void *arg, uint32_t *nums, size_t max) {
+    struct wfs_fs *fs = arg;
+    pthread_mutex_lock(&fs->orphans_lock);
+    size_t count = fs->orphans_lost ? max + 1 : fs->num_orphans;
+    if (count <= max) {
+        memcpy(nums, fs->orphans, count * sizeof(uint32_t));
+    }
+    pthread_mutex_unlock(&fs->orphans_lock);
+    return count;
+}
+
+// Called once no directory entry points at the inode, which the caller holds exclusive. The
+// caller syncs the disks.
+void drop_inode(struct wfs_fs *fs, struct wfs_inode *inode) {
+    if (__atomic_load_n(&fs->inode_refs[inode->num], __ATOMIC_ACQUIRE) > 0) {
+        TRACE(ORPHAN, NULL, inode->num);
+        inode->nlinks = 0;
+        mark_inode_dirty(fs, inode);
+        add_orphan(fs, inode->num);
+        return;
+    }
+    destroy_inode(fs, inode);
+}
+
+static void sync_disks(struct wfs_fs *fs) {
+    if (fs->raid_mode != 0 && fs->num_disks > 1) {
+        sync_disks_for_raid1(fs, 0);
+    } else if (fs->raid_mode == 0 && fs->num_disks > 1) {
+        sync_disks_for_raid0(fs, 0);
+    }
+}
+
+// Drops nlookup references to inode num, and the inode with them if it was removed and they
+// were the last
+void forget_inode(struct wfs_fs *fs, int num, unsigned long nlookup) {
+    if (__atomic_sub_fetch(&fs->inode_refs[num], nlookup, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+
+    // A lookup may have taken a new reference, or the inode been freed and reused, since
+    lock_inode(fs, num, LOCK_EXCLUSIVE);
+    pthread_mutex_lock(&fs->inode_bitmap_lock);
+    int allocated = bitmap_test(&fs->inode_bitmap, num);
+    pthread_mutex_unlock(&fs->inode_bitmap_lock);
+    struct wfs_inode *inode = get_inode(fs, num);
+    if (allocated && inode->nlinks == 0 && __atomic_load_n(&fs->inode_refs[num], __ATOMIC_ACQUIRE) == 0) {
+        TRACE(ORPHAN_FREE, NULL, num);
+        destroy_inode(fs, inode);
+        sync_disks(fs);
+        remove_orphan(fs, num);
+    }
+    unlock_inode(fs, num);
+}
+
+// Frees inode num if it is allocated and has no links
+static void reclaim_orphan(struct wfs_fs *fs, size_t num) {
+    lock_inode(fs, num, LOCK_EXCLUSIVE);
+    pthread_mutex_lock(&fs->inode_bitmap_lock);
+    int allocated = bitmap_test(&fs->inode_bitmap, num);
+    pthread_mutex_unlock(&fs->inode_bitmap_lock);
+    struct wfs_inode *inode = get_inode(fs, num);
+    if (allocated && inode->nlinks == 0) {
+        TRACE(ORPHAN_FREE, NULL, num);
+        destroy_inode(fs, inode);
+    }
+    unlock_inode(fs, num);
+}
+
+// Frees every inode left with no links. Those still in use when the filesystem was unmounted,
+// or when wfs stopped without unmounting, which are gone along with their references. The
+// orphans set has them all, as the journal had them at mount, unless it lost track of some or
+// there is no journal, and then every inode is checked. Nothing else runs meanwhile.
+void reclaim_orphans(struct wfs_fs *fs) {
+    struct wfs_sb *sb = get_superblock(fs);
+    if (fs->orphans_lost) {
+        for (size_t num = 1; num < sb->num_inodes; num++) {
+            reclaim_orphan(fs, num);
+        }
+    } else {
+        for (size_t i = 0; i < fs->num_orphans; i++) {
+            if (fs->orphans[i] > 0 && fs->orphans[i] < sb->num_inodes) {
+                reclaim_orphan(fs, fs->orphans[i]);
+            }
+        }
+    }
+    sync_disks(fs);
+
+    // Listed until the journal is emptied after the frees
+    pthread_mutex_lock(&fs->orphans_lock);
+    fs->num_orphans = 0;
+    fs->orphans_lost = 0;
+    pthread_mutex_unlock(&fs->orphans_lock);
+}
+
+
+// ---------------------------------------------Open files---------------------------------------------
+// wfs_fs_open() and wfs_fs_create() find the inode once and hand back a struct wfs_file, so
+// reads, writes and listings go straight to the inode without a path. See wfs_core.h.
+
+// Opens a handle to inode, which the caller holds locked so it can't be dropped meanwhile
+struct wfs_file *open_file(struct wfs_fs *fs, struct wfs_inode *inode) {
+    struct wfs_file *file = calloc(1, sizeof(struct wfs_file));
+    if (!file) {
+        TRACE(OPEN_NOMEM, NULL, inode->num);
+        return NULL;
+    }
+    file->num = inode->num;
+    file->wb_errors = writeback_errors(&fs->wb);
+    pthread_mutex_init(&file->lock, NULL);
+    __atomic_add_fetch(&fs->inode_refs[inode->num], 1, __ATOMIC_ACQ_REL);
+    return file;
+}
+
+// Closes a handle, freeing its inode if it was removed meanwhile and this was the last use
+void wfs_fs_release(struct wfs_fs *fs, struct wfs_file *file) {
+    TRACE(RELEASE, NULL, file->num);
+    if (!is_stats_num(fs, file->num)) {
+        forget_inode(fs, file->num, 1);
+    }
+    pthread_mutex_destroy(&file->lock);
+    free(file->stats_text);
+    free(file);
+}
+
+// Returns -EIO if a writeback failed since the handle last reported one, and notes it reported
+static int take_wb_error(struct wfs_fs *fs, struct wfs_file *file) {
+    unsigned long errors = writeback_errors(&fs->wb);
+    pthread_mutex_lock(&file->lock);
+    int failed = errors != file->wb_errors;
+    file->wb_errors = errors;
+    pthread_mutex_unlock(&file->lock);
+    return failed ? -EIO : 0;
+}
+
+// Puts everything written so far on stable storage, see writeback_sync(). Data and metadata
+// are tracked alike, so there is no cheaper datasync. file may be NULL.
+int wfs_fs_fsync(struct wfs_fs *fs, struct wfs_file *file) {
+    TRACE(FSYNC, NULL, file ? file->num : -1);
+    int ret = writeback_sync(&fs->wb);
+    if (file && take_wb_error(fs, file) != 0) {
+        ret = -EIO;
+    }
+    return ret;
+}
+
+// For close. Doesn't sync, that's fsync's job, but reports a writeback that failed since the
+// file was opened or last synced or flushed, the way close() reports write errors elsewhere.
+int wfs_fs_flush(struct wfs_fs *fs, struct wfs_file *file) {
+    return file ? take_wb_error(fs, file) : 0;
+}
+
+// Locks and returns the inode of an operation on an open file: the handle's when there is
+// one, or the one path leads to
+static struct wfs_inode *handle_inode(struct wfs_fs *fs, const char *path, struct wfs_file *file, int mode) {
+    if (!file) {
+        return find_inode_by_path(fs, path, mode);
+    }
+    lock_inode(fs, file->num, mode);
+    return get_inode(fs, file->num);
+}
+
+// map_file_block() for an open file, which starts from the run the last call found. I/O
+// that goes through a file in order asks for the blocks of one run again and again, and
+// gets them without walking from the inode. file may be NULL.
+static off_t file_map_block(struct wfs_fs *fs, struct wfs_file *file, struct wfs_inode *inode, size_t block, size_t want, int *disk, size_t *run) {
+    if (!file) {
+        return map_file_block(fs, inode, block, want, disk, run);
+    }
+
+    // Freeing blocks moves the epoch on, which is what makes a run stale
+    unsigned long epoch = __atomic_load_n(&bmap_epoch, __ATOMIC_ACQUIRE);
+    pthread_mutex_lock(&file->lock);
+    if (file->map_run > 0 && file->map_epoch == epoch &&
+        block >= file->map_block && block - file->map_block < file->map_run) {
+        size_t skip = block - file->map_block;
+        *disk = file->map_disk;
+        *run = file->map_run - skip;
+        off_t addr = file->map_addr + (off_t)skip * BLOCK_SIZE;
+        pthread_mutex_unlock(&file->lock);
+        return addr;
+    }
+    pthread_mutex_unlock(&file->lock);
+
+    off_t addr = map_file_block(fs, inode, block, want, disk, run);
+    if (addr > 0) {
+        pthread_mutex_lock(&file->lock);
+        file->map_block = block;
+        file->map_run = *run;
+        file->map_disk = *disk;
+        file->map_addr = addr;
+        file->map_epoch = epoch;
+        pthread_mutex_unlock(&file->lock);
+    }
+    return addr;
+}
+
+// Asks the kernel to read file data at [addr, addr + len) on disk into the page cache, from
+// the disks a read of it will go to
+static void readahead_data(struct wfs_fs *fs, int disk, off_t addr, size_t len) {
+    if (fs->raid_mode == 0 || fs->num_disks == 1) {
+        posix_fadvise(fs->disk_fds[disk], addr, len, POSIX_FADV_WILLNEED);
+    } else if (fs->raid_mode == 1 && fs->read_policy != READ_POLICY_ROUND_ROBIN) {
+        for (size_t done = 0; done < len;) {
+            size_t chunk = len - done;
+            int mirror = pick_mirror(fs, addr + done, &chunk);
+            posix_fadvise(fs->disk_fds[mirror], addr + done, chunk, POSIX_FADV_WILLNEED);
+            done += chunk;
+        }
+    } else {
+        // Round robin reads every mirror a block at a time, 1v compares them
+        for (int i = 0; i < fs->num_disks; i++) {
+            posix_fadvise(fs->disk_fds[i], addr, len, POSIX_FADV_WILLNEED);
+        }
+    }
+}
+
+// Reads ahead of a sequential reader of file, once a read at offset has returned `got` bytes.
+// The window starts at READAHEAD_MIN_BLOCKS, doubles with every read that picks up where the
+// last one ended, up to READAHEAD_MAX_BLOCKS, and closes on a seek. The next part is asked for
+// when the reader is half way through the last.
+static void file_readahead(struct wfs_fs *fs, struct wfs_file *file, struct wfs_inode *inode, off_t offset, size_t got) {
+    off_t end = offset + got;
+
+    pthread_mutex_lock(&file->lock);
+    if (offset != file->next_offset || got == 0) {
+        file->ra_blocks = 0;
+        file->ra_end = 0;
+    } else if (file->ra_blocks == 0) {
+        file->ra_blocks = READAHEAD_MIN_BLOCKS;
+    } else {
+        file->ra_blocks = MIN(2 * file->ra_blocks, READAHEAD_MAX_BLOCKS);
+    }
+    file->next_offset = end;
+
+    off_t window = (off_t)(file->ra_blocks * BLOCK_SIZE);
+    off_t from = file->ra_end > end ? file->ra_end : end;
+    off_t to = MIN(end + window, inode->size);
+    if (window == 0 || end + window / 2 < file->ra_end || from >= to) {
+        pthread_mutex_unlock(&file->lock);
+        return;
+    }
+    file->ra_end = to;
+    pthread_mutex_unlock(&file->lock);
+
+    // Straight from map_file_block(), the handle keeps the run the reader is in
+    TRACE(READAHEAD, NULL, file->num, from, to);
+    for (off_t pos = from; pos < to;) {
+        size_t blk_idx = pos / BLOCK_SIZE;
+        int disk;
+        size_t run;
+        off_t blk_addr = map_file_block(fs, inode, blk_idx, 0, &disk, &run);
+        if (blk_addr <= 0) {
+            pos = (off_t)(blk_idx + 1) * BLOCK_SIZE; // A hole
+            continue;
+        }
+        size_t len = MIN(run * BLOCK_SIZE - pos % BLOCK_SIZE, (size_t)(to - pos));
+        readahead_data(fs, disk, blk_addr + pos % BLOCK_SIZE, len);
+        pos += len;
+    }
+}
+
+
+// -------------------------------------------Statistics file-------------------------------------------
+// /.wfs/stats reads as wfs_fs_stats(). Neither it nor /.wfs is on disk: they take the inode
+// numbers just past the last inode, which no dentry can hold, and the operations check for
+// them before going to the inodes. Opening the file takes a snapshot into the handle, so a
+// reader gets one text however many reads it takes.
+
+#define STATS_DIR_NAME  ".wfs"
+#define STATS_FILE_NAME "stats"
+
+int stats_dir_num(struct wfs_fs *fs) {
+    return get_superblock(fs)->num_inodes;
+}
+
+int is_stats_num(struct wfs_fs *fs, int num) {
+    return num == stats_dir_num(fs) || num == stats_dir_num(fs) + 1;
+}
+
+int stats_child(struct wfs_fs *fs, int dir_num, const char *name) {
+    if (dir_num == 0 && strcmp(name, STATS_DIR_NAME) == 0) {
+        return stats_dir_num(fs);
+    }
+    if (dir_num == stats_dir_num(fs) && strcmp(name, STATS_FILE_NAME) == 0) {
+        return stats_dir_num(fs) + 1;
+    }
+    return -1;
+}
+
+// The inode number of the file an operation is on when that is /.wfs or /.wfs/stats, -1 if not
+static int stats_target(struct wfs_fs *fs, const char *path, struct wfs_file *file) {
+    if (file) {
+        return is_stats_num(fs, file->num) ? file->num : -1;
+    }
+    if (!path) {
+        return -1;
+    }
+    if (strcmp(path, "/" STATS_DIR_NAME) == 0) {
+        return stats_dir_num(fs);
+    }
+    if (strcmp(path, "/" STATS_DIR_NAME "/" STATS_FILE_NAME) == 0) {
+        return stats_dir_num(fs) + 1;
+    }
+    return -1;
+}
+
+char *wfs_fs_stats(struct wfs_fs *fs, size_t *len) {
+    return stats_format(&fs->stats, len);
+}
+
+// Attributes of /.wfs or /.wfs/stats, which belong to whoever mounted. The file is as long as
+// a snapshot taken now.
+void stats_stat(struct wfs_fs *fs, int num, struct stat *stbuf) {
+    memset(stbuf, 0, sizeof(struct stat));
+    stbuf->st_ino = num;
+    stbuf->st_uid = getuid();
+    stbuf->st_gid = getgid();
+    stbuf->st_atime = stbuf->st_mtime = time(NULL);
+    if (num == stats_dir_num(fs)) {
+        stbuf->st_mode = S_IFDIR | 0555;
+        stbuf->st_nlink = 2;
+        return;
+    }
+    size_t len = 0;
+    free(wfs_fs_stats(fs, &len));
+    stbuf->st_mode = S_IFREG | 0444;
+    stbuf->st_nlink = 1;
+    stbuf->st_size = len;
+}
+
+// Opens a handle to /.wfs or /.wfs/stats, see open_file()
+struct wfs_file *open_stats(struct wfs_fs *fs, int num) {
+    struct wfs_file *file = calloc(1, sizeof(struct wfs_file));
+    if (!file) {
+        return NULL;
+    }
+    if (num != stats_dir_num(fs) && !(file->stats_text = wfs_fs_stats(fs, &file->stats_len))) {
+        free(file);
+        return NULL;
+    }
+    file->num = num;
+    file->wb_errors = writeback_errors(&fs->wb);
+    pthread_mutex_init(&file->lock, NULL);
+    return file;
+}
+
+// Copies up to size bytes of the snapshot in file from offset on, returns how many
+static int read_stats(struct wfs_file *file, char *buf, size_t size, off_t offset) {
+    if (offset < 0 || (size_t)offset >= file->stats_len) {
+        return 0;
+    }
+    size = MIN(size, file->stats_len - offset);
+    memcpy(buf, file->stats_text + offset, size);
+    return size;
+}
+
+// Lists /.wfs, see readdir_at()
+static int readdir_stats(struct wfs_fs *fs, off_t offset, void *output_buffer, wfs_fill_t filler) {
+    struct stat entry_stat;
+    memset(&entry_stat, 0, sizeof(struct stat));
+    entry_stat.st_ino = stats_dir_num(fs) + 1;
+    entry_stat.st_mode = S_IFREG;
+    if ((offset < 1 && filler(output_buffer, ".", NULL, 1) != 0) ||
+        (offset < 2 && filler(output_buffer, "..", NULL, 2) != 0)) {
+        return SUCCESS;
+    }
+    if (offset < 3) {
+        filler(output_buffer, STATS_FILE_NAME, &entry_stat, 3);
+    }
+    return SUCCESS;
+}
+// -----------------------------------------------------------------------------------------------------
+
+
+int remove_directory_helper(struct wfs_fs *fs, struct wfs_inode *parent_inode, struct wfs_inode *target_inode, const char *target_dir) {
+    // Check if directory is empty
+    int is_directory_empty = 1;
+    if (is_indexed_dir(fs, target_inode)) {
+        is_directory_empty = dx_is_empty(fs, target_inode);
+    } else {
+        for (int block_idx = 0; block_idx < D_BLOCK; block_idx++) {
+            if (target_inode->blocks[block_idx] == 0) {
+                continue;
+            }
+            // Check correct disk for the block in RAID 0
+            int target_disk;
+            if (fs->raid_mode == 0) {
+                target_disk = block_idx % fs->num_disks;
+            } else {
+                target_disk = 0;
+            }
+
+            char *block_data = DISK_MAP_PTR(target_disk, target_inode->blocks[block_idx]);
+            for (int entry_idx = 0; entry_idx < fs->NUM_DENTRIES_PER_BLOCK; entry_idx++) {
+                struct wfs_dentry *current_entry = (struct wfs_dentry *)(block_data + entry_idx * sizeof(struct wfs_dentry));
+                // Skip '.' and '..'
+                if (current_entry->name[0] != '\0' &&
+                    strcmp(current_entry->name, ".") != 0 &&
+                    strcmp(current_entry->name, "..") != 0) {
+                    is_directory_empty = 0;
+                    break;
+                }
+            }
+            if (!is_directory_empty) {
+                break;
+            }
+        }
+    }
+
+    if (!is_directory_empty) {
+        TRACE(RMDIR_NOT_EMPTY, target_dir);
+        return -ENOTEMPTY;
+    }
+
+    struct wfs_sb *sb = get_superblock(fs);
+    char *parent_block_data;
+    struct wfs_dentry *curr_dentry;
+    int entry_found = 0;
+
+
+    // Remove directory entry from parent
+    if (is_indexed_dir(fs, parent_inode)) {
+        entry_found = dx_remove_dentry(fs, parent_inode, target_dir) == 0;
+    } else {
+        for (int i = 0; i < D_BLOCK; i++) {
+            if (parent_inode->blocks[i] == 0) {
+                continue;
+            }
+
+            int target_disk;
+            if (fs->raid_mode == 0) {
+                target_disk = get_disk(fs, i);
+            } else {
+                target_disk = sb->disk_id;
+            }
+            parent_block_data = DISK_MAP_PTR(target_disk, parent_inode->blocks[i]);
+            for (int j = 0; j < fs->NUM_DENTRIES_PER_BLOCK; j++) {
+                curr_dentry = (struct wfs_dentry *)(parent_block_data + j * sizeof(struct wfs_dentry));
+
+                if (strncmp(curr_dentry->name, target_dir, MAX_NAME) == 0) {
+                    // Clear directory entry
+                    memset(curr_dentry, 0, sizeof(struct wfs_dentry));
+                    mark_dirty(fs, curr_dentry, sizeof(struct wfs_dentry));
+                    entry_found = 1;
+                    break;
+                }
+            }
+            if (entry_found) {
+                break;
+            }
+        }
+    }
+
+    if (!entry_found) {
+        return -ENOENT;
+    }
+
+    drop_inode(fs, target_inode);
+
+    // Update parent metadata
+    parent_inode->nlinks--;
+    parent_inode->mtim = time(NULL);
+    mark_inode_dirty(fs, parent_inode);
+
+    if (fs->raid_mode != 0 && fs->num_disks > 1) {
+        sync_disks_for_raid1(fs, 0);
+    } else if (fs->raid_mode == 0 && fs->num_disks > 1) {
+        sync_disks_for_raid0(fs, 0);
+    }
+
+    return SUCCESS;
+}
+
+
+int unlink_file_helper(struct wfs_fs *fs, struct wfs_inode *parent_inode, struct wfs_inode *target_inode, const char *target_file) {
+    if (remove_dentry_from_directory(fs, parent_inode, target_file) != 0) {
+        return -ENOENT;
+    }
+
+    drop_inode(fs, target_inode);
+
+    return SUCCESS;
+}
+
+
+// Passes the entries of a directory past offset to the filler. Offsets of plain directories
+// are the slot of the entry, block_index * NUM_DENTRIES_PER_BLOCK + entry_index + READDIR_FIRST
+int process_directory_blocks(struct wfs_fs *fs, struct wfs_inode *dir_inode, off_t offset, void *output_buffer, wfs_fill_t entry_to_buffer) {
+    if (is_indexed_dir(fs, dir_inode)) {
+        if (dir_inode->blocks[0] != 0) {
+            dx_readdir(fs, dir_inode, dir_inode->blocks[0], offset, output_buffer, entry_to_buffer);
+        }
+        return SUCCESS;
+    }
+
+    int first_slot = offset >= READDIR_FIRST ? offset - READDIR_FIRST + 1 : 0;
+
+    // Go through all blocks in directory
+    for (int block_index = first_slot / fs->NUM_DENTRIES_PER_BLOCK; block_index < IND_BLOCK; block_index++) {
+        // Skip unallocated blocks
+        if (dir_inode->blocks[block_index] == 0) {
+            continue;
+        }
+
+        int disk = 0;
+        // Find exact disk for raid 0
+        if (fs->raid_mode == 0) {
+            disk = block_index % fs->num_disks;
+        }
+        // Get data block with offset
+        char *data_block_ptr = DISK_MAP_PTR(disk, dir_inode->blocks[block_index]);
+
+        // Go through all entries in block
+        for (int entry_index = 0; entry_index < BLOCK_SIZE / sizeof(struct wfs_dentry); entry_index++) {
+
+            struct wfs_dentry *dentry = (struct wfs_dentry *)(entry_index * sizeof(struct wfs_dentry) + data_block_ptr);
+
+            // Skip the slots of removed entries, there may be more after them
+            if (dentry->name[0] == '\0') {
+                continue;
+            }
+
+            // Skip what an earlier call already returned
+            int slot = block_index * fs->NUM_DENTRIES_PER_BLOCK + entry_index;
+            if (slot < first_slot) {
+                continue;
+            }
+
+            // Add entry to buffer
+            if (readdir_emit(fs, dir_inode, dentry, slot + READDIR_FIRST, output_buffer, entry_to_buffer)) {
+                return SUCCESS;
+            }
+        }
+    }
+    return SUCCESS;
+}
+
+static void sort_disks_for_raid0(struct wfs_fs *fs) {
+    struct wfs_sb *sb = get_superblock(fs);
+
+    // If not in RAID 0 mode, no sorting needed
+    if (sb->raid_mode != 0) {
+        return;
+    }
+
+    // // Print initial order
+    // printf("Initial Disk Order:\n");
+    // for (int i = 0; i < num_disks; i++) {
+    //     printf("Disk %d: %s\n", i, disk_names[i]);
+    // }
+
+    // Create temp arrays to store sorted information
+    char *sorted_disk_names[MAX_DISKS];
+    size_t sorted_disk_sizes[MAX_DISKS];
+    void *sorted_mmregion[MAX_DISKS];
+    int sorted_disk_fds[MAX_DISKS];
+
+    // Sort based on original disk order
+    for (int target_id = 0; target_id < fs->num_disks; target_id++) {
+        int found = 0;
+        // Find the disk with the matching original disk ID
+        for (int j = 0; j < fs->num_disks; j++) {
+            // Open the current disk to read its superblock
+            int fd = open(fs->disk_names[j], O_RDONLY);
+            if (fd == -1) {
+                printf("Failed to open disk for ID check");
+                continue;
+            }
+
+            // Read the superblock to get disk ID
+            struct wfs_sb current_sb;
+            if (read(fd, &current_sb, sizeof(struct wfs_sb)) != sizeof(struct wfs_sb)) {
+                close(fd);
+                printf("Failed to read superblock");
+                continue;
+            }
+            close(fd);
+
+            // // Print disk IDs
+            // printf("Checking disk %s with disk_id %d, looking for target_id %d\n",
+            //        disk_names[j], current_sb.disk_id, target_id);
+
+            // Check if this disk matches the target ID
+            if (current_sb.disk_id == target_id) {
+                // Store in sorted position
+                sorted_disk_names[target_id] = fs->disk_names[j];
+                sorted_disk_sizes[target_id] = fs->disk_sizes[j];
+                sorted_mmregion[target_id] = fs->disk_region[j];
+                sorted_disk_fds[target_id] = fs->disk_fds[j];
+                found = 1;
+                break;
+            }
+        }
+
+        // DEBUG: Check if we found the disk
+        if (!found) {
+            printf("Could not find disk with target_id %d\n", target_id);
+            return;
+        }
+    }
+
+    // Copy back to original arrays
+    for (int i = 0; i < fs->num_disks; i++) {
+        fs->disk_names[i] = sorted_disk_names[i];
+        fs->disk_sizes[i] = sorted_disk_sizes[i];
+        fs->disk_region[i] = sorted_mmregion[i];
+        fs->disk_file[i] = sorted_mmregion[i];
+        fs->disk_fds[i] = sorted_disk_fds[i];
+    }
+
+    // // Print final order
+    // printf("Final Disk Order:\n");
+    // for (int i = 0; i < num_disks; i++) {
+    //     printf("Disk %d: %s\n", i, disk_names[i]);
+    // }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/////////////////////////////////////////////// OPERATIONS /////////////////////////////////////////////////////////////////////////////////////
+// The wfs_fs_*() functions of libwfs.h take paths, the FUSE path callbacks in wfs.c just call
+// them. The *_at() functions do the work of an operation on inodes the caller has already found
+// and locked, for those and for the low-level callbacks in wfs_ll.c.
+
+// Populates the stat structure from the inode
+void fill_stat(struct wfs_inode *inode, struct stat *stbuf) {
+    stbuf->st_uid = inode->uid;         
+    stbuf->st_gid = inode->gid;         
+    stbuf->st_atime = __atomic_load_n(&inode->atim, __ATOMIC_RELAXED);
+    stbuf->st_mtime = inode->mtim;       
+    stbuf->st_mode = inode->mode;        
+    stbuf->st_size = inode->size;        
+}
+
+// Stats path, or the open file, which may have no path left, when there is one
+int wfs_fs_getattr(struct wfs_fs *fs, const char *path, struct wfs_file *file, struct stat *stbuf) {
+
+    TRACE(GETATTR, path);
+    memset(stbuf, 0, sizeof(struct stat)); // Clear the stat structure
+
+    int stats_num = stats_target(fs, path, file);
+    if (stats_num >= 0) {
+        stats_stat(fs, stats_num, stbuf);
+        return SUCCESS;
+    }
+
+    // Find the inode corresponding to the path
+    struct wfs_inode *inode = handle_inode(fs, path, file, LOCK_SHARED);
+    if (inode == NULL) {
+        TRACE(GETATTR_NOENT, path);
+        return -ENOENT; 
+    }
+
+    fill_stat(inode, stbuf);
+    unlock_inode(fs, inode->num);
+    return SUCCESS;
+}
+
+// Opens the file or directory at path into *filep. want_dir says which of the two it must be.
+int wfs_fs_open(struct wfs_fs *fs, const char *path, int want_dir, struct wfs_file **filep) {
+    TRACE(OPEN, path);
+
+    int stats_num = stats_target(fs, path, NULL);
+    if (stats_num >= 0) {
+        if ((stats_num == stats_dir_num(fs)) != want_dir) {
+            return want_dir ? -ENOTDIR : -EISDIR;
+        }
+        *filep = open_stats(fs, stats_num);
+        return *filep ? SUCCESS : -ENOMEM;
+    }
+
+    struct wfs_inode *inode = find_inode_by_path(fs, path, LOCK_SHARED);
+    if (!inode) {
+        TRACE(OPEN_NOENT, path);
+        return -ENOENT;
+    }
+    int is_dir = S_ISDIR(inode->mode) != 0;
+    if (is_dir != want_dir) {
+        unlock_inode(fs, inode->num);
+        return want_dir ? -ENOTDIR : -EISDIR;
+    }
+
+    struct wfs_file *file = open_file(fs, inode);
+    unlock_inode(fs, inode->num);
+    if (!file) {
+        return -ENOMEM;
+    }
+    *filep = file;
+    return SUCCESS;
+}
+
+
+// Creates the directory `name` in parent_inode, which the caller holds exclusive, and puts
+// its inode number in *new_num
+int mkdir_at(struct wfs_fs *fs, struct wfs_inode *parent_inode, const char *dir_name, mode_t mode, int *new_num) {
+    // Check if the directory already exists
+    struct wfs_dentry *existing_entry = find_dentry_in_directory(fs, parent_inode, dir_name);
+    if (existing_entry) {
+        TRACE(MKDIR_EXISTS, dir_name);
+        return -EEXIST; 
+    }
+
+
+    int new_inode_num = allocate_free_inode(fs); // Allocate from inode bitmap
+    if (new_inode_num < 0) {
+        TRACE(MKDIR_NO_INODE, NULL);
+        return -ENOSPC; 
+    }
+
+    struct wfs_inode *new_inode = get_inode(fs, new_inode_num);
+    if (!new_inode) {
+        TRACE(MKDIR_BAD_INODE, NULL, new_inode_num);
+        return -EIO;
+    }
+
+    // Initialize the inode
+    memset(new_inode, 0, sizeof(struct wfs_inode));
+    new_inode->num = new_inode_num;
+    new_inode->mode = S_IFDIR | mode; 
+    new_inode->uid = getuid();
+    new_inode->gid = getgid();
+    new_inode->size = 0; 
+    new_inode->nlinks = 2; // Self (.) and parent (..)
+    new_inode->atim = new_inode->mtim = new_inode->ctim = time(NULL);
+    mark_inode_dirty(fs, new_inode);
+
+    TRACE(MKDIR_INODE, NULL, new_inode_num);
+
+    // RAID 1 and 1v are both mirrored
+    if (fs->raid_mode != 0) {
+        // Adding a new entry in the parent directory
+        struct wfs_dentry new_entry;
+        set_dentry(&new_entry, dir_name, new_inode_num, new_inode->mode);
+
+        if (add_dentry_to_directory(fs, parent_inode, &new_entry, dir_name, new_inode_num) < 0) {
+            TRACE(MKDIR_NO_DENTRY, NULL);
+            free_inode(fs, new_inode_num);
+            return -ENOSPC; // No space in directory entries
+        }
+
+        // Update parent directory's metadata
+        parent_inode->nlinks++;
+        parent_inode->mtim = time(NULL);
+        mark_inode_dirty(fs, parent_inode);
+
+        if (fs->num_disks > 1) {
+            sync_disks_for_raid1(fs, 0);
+        }
+    }
+    else { // RAID MODE 0
+        if (fs->num_disks > 1) {
+
+            struct wfs_dentry new_entry;
+            set_dentry(&new_entry, dir_name, new_inode_num, new_inode->mode);
+
+            // Add the new dentry in the parent direcotry
+            if (add_dentry_to_directory(fs, parent_inode, &new_entry, dir_name, new_inode_num) < 0) {
+                TRACE(MKDIR_NO_DENTRY, NULL);
+                free_inode(fs, new_inode_num);
+                return -ENOSPC; 
+            }
+
+            // Update parent directory's metadata
+            parent_inode->nlinks++;
+            parent_inode->mtim = time(NULL);
+            mark_inode_dirty(fs, parent_inode);
+
+            // Propagate the new inode, its bitmap bit and the parent's changes
+            sync_disks_for_raid0(fs, 0);
+        }
+    }
+
+    // Drop any negative entry for the new name
+    dcache_invalidate(&fs->dcache, parent_inode->num, dir_name);
+
+    *new_num = new_inode_num;
+    return SUCCESS;
+}
+
+
+int wfs_fs_mkdir(struct wfs_fs *fs, const char *path, mode_t mode) {
+    TRACE(MKDIR, path);
+
+    // Check the path is valid or not
+    if (path == NULL || path[0] != '/') {
+        TRACE(MKDIR_BAD_PATH, path);
+        return -EINVAL;
+    }
+
+    // If root direcotry, cannot create it since it already exists
+    if (strcmp(path, "/") == 0) {
+        TRACE(MKDIR_ROOT, NULL);
+        return -EEXIST; 
+    }
+
+    // Nor /.wfs, which would be hidden behind the statistics
+    if (stats_target(fs, path, NULL) >= 0) {
+        return -EEXIST;
+    }
+
+    
+    char *cpy_path = strdup(path);
+    char *cpy_path_2 = strdup(path);
+    if (!cpy_path || !cpy_path_2) {
+        TRACE(MKDIR_NOMEM, NULL);
+        free(cpy_path);
+        free(cpy_path_2);
+        return -ENOMEM;
+    }
+    char *parent_path = dirname(cpy_path_2);   // Parent directory is everything before the last '/'
+
+    // Find the last '/' character to separate the parent path and directory name
+    char *last_slash = strrchr(cpy_path, '/');
+ 
+    // Null-terminate the parent path at the last slash --> get the dir name from that
+    *last_slash = '\0';  
+    char *dir_name = last_slash + 1; 
+
+    // Valudate length of name
+    if (strlen(dir_name) >= MAX_NAME) {
+        TRACE(MKDIR_NAMETOOLONG, dir_name);
+        free(cpy_path);
+        free(cpy_path_2);
+        return -ENAMETOOLONG;
+    }
+
+    struct wfs_inode *parent_inode = find_inode_by_path(fs, parent_path, LOCK_EXCLUSIVE);
+    if (!parent_inode) {
+        TRACE(MKDIR_NO_PARENT, parent_path);
+        free(cpy_path);
+        free(cpy_path_2);
+        return -ENOENT; // Parent does not exist
+    }
+
+    // Check if parent is a directory
+    if (!S_ISDIR(parent_inode->mode)) {
+        TRACE(MKDIR_PARENT_NOTDIR, parent_path);
+        free(cpy_path);
+        free(cpy_path_2);
+        unlock_inode(fs, parent_inode->num);
+        return -ENOTDIR;
+    }
+
+    int new_inode_num;
+    int ret = mkdir_at(fs, parent_inode, dir_name, mode, &new_inode_num);
+    free(cpy_path);
+    free(cpy_path_2);
+    unlock_inode(fs, parent_inode->num);
+    if (ret == SUCCESS) {
+        TRACE(MKDIR_DONE, path);
+    }
+    return ret;
+}
+
+
+// Creates the regular file `name` in parent_inode, which the caller holds exclusive, and
+// puts its inode number in *new_num
+int mknod_at(struct wfs_fs *fs, struct wfs_inode *parent_inode, const char *file_name, mode_t mode, int *new_num) {
+    // Check if the file already exists
+    struct wfs_dentry *existing_entry = find_dentry_in_directory(fs, parent_inode, file_name);
+    if (existing_entry) {
+        TRACE(MKNOD_EXISTS, file_name);
+        return -EEXIST; 
+    }
+
+    // Allocate a new inode for the file
+    int new_inode_num = allocate_free_inode(fs); // Allocate from inode bitmap
+    if (new_inode_num < 0) {
+        TRACE(MKNOD_NO_INODE, NULL);
+        return -ENOSPC; 
+    }
+
+    struct wfs_inode *new_inode = get_inode(fs, new_inode_num);
+    if (!new_inode) {
+        TRACE(MKNOD_BAD_INODE, NULL, new_inode_num);
+        return -EIO;
+    }
+
+    // Initialize the inode
+    memset(new_inode, 0, sizeof(struct wfs_inode));
+    new_inode->num = new_inode_num;
+    new_inode->mode = S_IFREG | mode; 
+    new_inode->uid = getuid();
+    new_inode->gid = getgid();
+    new_inode->size = 0; 
+    new_inode->nlinks = 1; // Regular files start with 1 link
+    new_inode->atim = new_inode->mtim = new_inode->ctim = time(NULL);
+    mark_inode_dirty(fs, new_inode);
+
+    TRACE(MKNOD_INODE, NULL, new_inode_num);
+    // RAID 1 and 1v are both mirrored
+    if (fs->raid_mode != 0) {
+        // Add a new entry in the parent directory
+        struct wfs_dentry new_entry;
+        set_dentry(&new_entry, file_name, new_inode_num, new_inode->mode);
+
+        if (add_dentry_to_directory(fs, parent_inode, &new_entry, file_name, new_inode_num) < 0) {
+            TRACE(MKNOD_NO_DENTRY, NULL);
+            free_inode(fs, new_inode_num); 
+            return -ENOSPC; 
+        }
+
+        // Update parent directory's metadata
+        parent_inode->nlinks++;
+        parent_inode->mtim = time(NULL);
+        mark_inode_dirty(fs, parent_inode);
+
+        if (fs->num_disks > 1) {
+            sync_disks_for_raid1(fs, 0);
+        }
+    } else {
+        if (fs->num_disks > 1) {
+
+             // Add a new entry in the parent directory
+            struct wfs_dentry new_entry;
+            set_dentry(&new_entry, file_name, new_inode_num, new_inode->mode);
+
+            if (add_dentry_to_directory(fs, parent_inode, &new_entry, file_name, new_inode_num) < 0) {
+                TRACE(MKNOD_NO_DENTRY, NULL);
+                free_inode(fs, new_inode_num);
+                return -ENOSPC; 
+            }
+
+            // Update parent directory's metadata
+            parent_inode->nlinks++;
+            parent_inode->mtim = time(NULL);
+            mark_inode_dirty(fs, parent_inode);
+
+            // Propagate the new inode, its bitmap bit and the parent's changes
+            sync_disks_for_raid0(fs, 0);
+        }
+    }
+
+    // Drop any negative entry for the new name
+    dcache_invalidate(&fs->dcache, parent_inode->num, file_name);
+
+    *new_num = new_inode_num;
+    return SUCCESS;
+}
+
+
+// Creates the file at path and, unless filep is NULL, opens it into *filep
+int wfs_fs_create(struct wfs_fs *fs, const char *path, mode_t mode, struct wfs_file **filep) {
+    TRACE(MKNOD, path);
+
+    // Check path
+    if (path == NULL || path[0] != '/') {
+        TRACE(MKNOD_BAD_PATH, path);
+        return -EINVAL;
+    }
+
+    // If root directory, cannot create it since it already exists
+    if (strcmp(path, "/") == 0) {
+        TRACE(MKNOD_ROOT, NULL);
+        return -EEXIST; 
+    }
+    if (stats_target(fs, path, NULL) >= 0) {
+        return -EEXIST;
+    }
+
+    char *path_copy = strdup(path);
+    char *path_copy2 = strdup(path);
+    if (!path_copy || !path_copy2) {
+        TRACE(MKNOD_NOMEM, NULL);
+        free(path_copy);
+        free(path_copy2);
+        return -ENOMEM;
+    }
+    char *parent_path = dirname(path_copy2);   // Parent directory is everything before the last '/'
+
+    char *last_slash = strrchr(path_copy, '/');
+    *last_slash = '\0';  // Null-terminate the parent path at the last slash
+    char *file_name = last_slash + 1; // File name is everything after the last '/'
+
+
+    if (strlen(file_name) >= MAX_NAME) {
+        TRACE(MKNOD_NAMETOOLONG, file_name, MAX_NAME);
+        free(path_copy);
+        free(path_copy2);
+        return -ENAMETOOLONG;
+    }
+
+    struct wfs_inode *parent_inode = find_inode_by_path(fs, parent_path, LOCK_EXCLUSIVE);
+    if (!parent_inode) {
+        TRACE(MKNOD_NO_PARENT, parent_path);
+        free(path_copy);
+        free(path_copy2);
+        return -ENOENT; 
+    }
+
+    // Check if parent is a directory
+    if (!S_ISDIR(parent_inode->mode)) {
+        TRACE(MKNOD_PARENT_NOTDIR, parent_path);
+        free(path_copy);
+        free(path_copy2);
+        unlock_inode(fs, parent_inode->num);
+        return -ENOTDIR;
+    }
+
+    int new_inode_num;
+    int ret = mknod_at(fs, parent_inode, file_name, mode, &new_inode_num);
+    free(path_copy);
+    free(path_copy2);
+
+    // Opened before the parent is unlocked, so nobody can unlink it first
+    if (ret == SUCCESS && filep) {
+        lock_inode(fs, new_inode_num, LOCK_SHARED);
+        struct wfs_file *file = open_file(fs, get_inode(fs, new_inode_num));
+        unlock_inode(fs, new_inode_num);
+        if (file) {
+            *filep = file;
+        } else {
+            ret = -ENOMEM; // The file stays, as it would if open() failed after mknod()
+        }
+    }
+    unlock_inode(fs, parent_inode->num);
+    if (ret == SUCCESS) {
+        TRACE(MKNOD_DONE, path);
+    }
+    return ret;
+}
+
+// Writes the data of src, which FUSE hands over as memory or, when it splices requests, as a
+// pipe. Either way it is copied once, straight into the disk images. The caller holds the
+// regular file inode exclusive. Returns the number of bytes written.
+int write_at(struct wfs_fs *fs, struct wfs_inode *inode, struct wfs_file *file, struct wfs_source *src, off_t offset) {
+    size_t size = src->size;
+    size_t total_bytes_written = 0;
+    size_t remaining_bytes = size;
+    off_t current_offset = offset;
+
+    // Write data run by run, a run being as many blocks as are back to back on disk
+    while (remaining_bytes > 0) {
+        // Calc block number and offset within block
+        size_t block_index = current_offset / BLOCK_SIZE;
+        int block_offset = current_offset % BLOCK_SIZE;
+        size_t blocks_left = (current_offset + remaining_bytes + BLOCK_SIZE - 1) / BLOCK_SIZE - block_index;
+
+        TRACE(WRITE_BLOCK, NULL, block_index, block_offset);
+
+        // Find the block, allocating it (and the rest of the write, for extent files) if needed
+        int disk;
+        size_t run;
+        off_t block_ptr = file_map_block(fs, file, inode, block_index, blocks_left, &disk, &run);
+        if (block_ptr <= 0) {
+            if (total_bytes_written > 0) {
+                break; // Report what made it to disk
+            }
+            return block_ptr < 0 ? block_ptr : -ENOSPC;
+        }
+
+        // Check how much to write in this run
+        size_t write_size = MIN(remaining_bytes, run * BLOCK_SIZE - block_offset);
+        ssize_t copied = write_file_data(fs, disk, block_ptr + block_offset, src, write_size);
+        if (copied <= 0) {
+            if (total_bytes_written > 0) {
+                break;
+            }
+            return copied < 0 ? copied : -EIO;
+        }
+
+        // Update pointers and counters
+        current_offset += copied;
+        remaining_bytes -= copied;
+        total_bytes_written += copied;
+        if ((size_t)copied < write_size) {
+            break; // The source ran dry
+        }
+    }
+
+    // Update inode metadata
+    if (current_offset > inode->size) {
+        //Update file size if wrote beyond current end
+        inode->size = current_offset;
+    }  
+    //Update modification time
+    inode->mtim = time(NULL);
+    mark_inode_dirty(fs, inode);
+
+    if ((fs->raid_mode != 0) && fs->num_disks > 1) {
+        //Synch file data and metadata
+        sync_disks_for_raid1(fs, 0);
+    } else if (fs->raid_mode == 0 && fs->num_disks > 1) {
+        // Only the inodes touched by this write (block pointers, size, mtime) get copied
+        sync_disks_for_raid0(fs, 0);
+    }
+
+    return total_bytes_written; // Return the number of bytes written
+}
+
+// Writes the data of src at offset of the open file, or of the one at path when file is NULL
+int wfs_fs_write_from(struct wfs_fs *fs, const char *path, struct wfs_file *file, struct wfs_source *src, off_t offset) {
+    TRACE(WRITE, path, src->size, offset);
+
+    // Check path, which is only used without a handle
+    if (!file && (path == NULL || path[0] != '/')) {
+        TRACE(WRITE_BAD_PATH, path);
+        return -EINVAL;
+    }
+    if (stats_target(fs, path, file) >= 0) {
+        return -EACCES;
+    }
+
+    //Find inode for file
+    struct wfs_inode *inode = handle_inode(fs, path, file, LOCK_EXCLUSIVE);
+    if (!inode) {
+        TRACE(WRITE_NOENT, path);
+        return -ENOENT;
+    }
+
+    // Check if file is regular
+    if (!S_ISREG(inode->mode)) {
+        TRACE(WRITE_NOTREG, path);
+        unlock_inode(fs, inode->num);
+        return -EISDIR;
+    }
+
+    int ret = write_at(fs, inode, file, src, offset);
+    unlock_inode(fs, inode->num);
+    if (ret >= 0) {
+        TRACE(WRITE_DONE, path, ret);
+    }
+    return ret;
+}
+
+// A wfs_source over memory, ctx points at the next byte and the source's size is what's left
+struct mem_source {
+    struct wfs_source src;
+    const char *next;
+};
+
+static ssize_t read_mem(void *ctx, char *dst, size_t len) {
+    struct mem_source *mem = ctx;
+    len = MIN(len, mem->src.size);
+    memcpy(dst, mem->next, len);
+    mem->next += len;
+    mem->src.size -= len;
+    return len;
+}
+
+int wfs_fs_write(struct wfs_fs *fs, const char *path, struct wfs_file *file, const char *buf, size_t size, off_t offset) {
+    struct mem_source mem = {{size, read_mem, &mem}, buf};
+    return wfs_fs_write_from(fs, path, file, &mem.src, offset);
+}
+
+
+
+// Lists the directory from offset on. The caller holds it locked.
+int readdir_at(struct wfs_fs *fs, struct wfs_inode *dir_inode, off_t offset, void *output_buffer, wfs_fill_t filler) {
+    // Add '.' and '..' first (current and parent directory), at offsets 1 and 2. Every
+    // entry goes out with its offset, so a listing that fills the buffer resumes from there
+    if ((offset < 1 && filler(output_buffer, ".", NULL, 1) != 0) ||
+        (offset < 2 && filler(output_buffer, "..", NULL, 2) != 0)) {
+        return SUCCESS;
+    }
+
+    // Call the helper function to process the directory blocks
+    return process_directory_blocks(fs, dir_inode, offset, output_buffer, filler);
+}
+
+int wfs_fs_readdir(struct wfs_fs *fs, const char *path, struct wfs_file *file, off_t offset, void *output_buffer, wfs_fill_t filler) {
+    TRACE(READDIR, path);
+
+    // Check path, which is only used without a handle
+    if (!file && (path == NULL || path[0] != '/')) {
+        TRACE(READDIR_BAD_PATH, path);
+        return -EINVAL;
+    }
+    int stats_num = stats_target(fs, path, file);
+    if (stats_num >= 0) {
+        return stats_num == stats_dir_num(fs) ? readdir_stats(fs, offset, output_buffer, filler) : -ENOTDIR;
+    }
+
+    // Find the inode for directory
+    struct wfs_inode *dir_inode = handle_inode(fs, path, file, LOCK_SHARED);
+    if (!dir_inode) {
+        TRACE(READDIR_NOENT, path);
+        return -ENOENT;
+    }
+
+    // Check if directory
+    if (!S_ISDIR(dir_inode->mode)) {
+        TRACE(READDIR_NOTDIR, path);
+        unlock_inode(fs, dir_inode->num);
+        return -ENOTDIR;
+    }
+
+    int ret = readdir_at(fs, dir_inode, offset, output_buffer, filler);
+    unlock_inode(fs, dir_inode->num);
+    return ret;
+}
+
+// Copies up to size bytes of the file at offset into buf, stopping at the end of the file
+// or at a hole. The caller holds the inode lock. Returns the number of bytes read.
+static int read_file(struct wfs_fs *fs, struct wfs_inode *file_inode, struct wfs_file *file, char *buf, size_t size, off_t offset) {
+    // Check if the read request is past the end of the file
+    if (file_inode->size <= offset) {
+        return 0; // No bytes to read
+    }
+
+    // Adjust the read size if it exceeds the remaining file size
+    if (offset + size > file_inode->size) {
+        size = file_inode->size - offset;
+    }
+
+    size_t total_bytes_read = 0;
+    size_t bytes_left = size;
+    off_t current_file_offset = offset;
+    char *buffer_pointer = buf;
+
+    // Read data run by run, a run being as many blocks as are back to back on disk
+    while (bytes_left > 0) {
+        // Calculate the block index and offset within the block
+        size_t blk_idx = current_file_offset / BLOCK_SIZE;
+        int block_internal_offset = current_file_offset % BLOCK_SIZE;
+
+        int target_disk_index;
+        size_t run;
+        off_t blk_addr = file_map_block(fs, file, file_inode, blk_idx, 0, &target_disk_index, &run);
+
+        // Check if the block is allocated
+        if (blk_addr <= 0) {
+            TRACE(READ_HOLE, NULL, blk_idx);
+            break;
+        }
+
+        // Determine how much to read from this run
+        size_t bytes_to_read = MIN(run * BLOCK_SIZE - block_internal_offset, bytes_left);
+        read_file_data(fs, target_disk_index, blk_addr + block_internal_offset, buffer_pointer, bytes_to_read);
+
+        buffer_pointer += bytes_to_read;
+        current_file_offset += bytes_to_read;
+        bytes_left -= bytes_to_read;
+        total_bytes_read += bytes_to_read;
+    }
+    return total_bytes_read;
+}
+
+// Sets the atime after a read at offset that got some data
+static void update_atime(struct wfs_fs *fs, struct wfs_inode *file_inode, off_t offset) {
+    // Readers share the lock, the store is atomic so concurrent ones don't tear it
+    if (offset < file_inode->size) {
+        __atomic_store_n(&file_inode->atim, time(NULL), __ATOMIC_RELAXED);
+        mark_inode_dirty(fs, file_inode);
+    }
+}
+
+int wfs_fs_read(struct wfs_fs *fs, const char *path, struct wfs_file *file, char *buf, size_t size, off_t offset) {
+    TRACE(READ, path, size, offset);
+    
+    // Check path, which is only used without a handle
+    if (!file && (path == NULL || path[0] != '/')) {
+        TRACE(READ_BAD_PATH, path);
+        return -EINVAL;
+    }
+
+    // /.wfs/stats is read from the snapshot open took, or a new one without a handle
+    int stats_num = stats_target(fs, path, file);
+    if (stats_num >= 0) {
+        if (stats_num == stats_dir_num(fs)) {
+            return -EISDIR;
+        }
+        struct wfs_file *snapshot = file ? file : open_stats(fs, stats_num);
+        if (!snapshot) {
+            return -ENOMEM;
+        }
+        int ret = read_stats(snapshot, buf, size, offset);
+        if (!file) {
+            wfs_fs_release(fs, snapshot);
+        }
+        return ret;
+    }
+
+    // Find the inode for the file
+    struct wfs_inode *file_inode = handle_inode(fs, path, file, LOCK_SHARED);
+    if (!file_inode) {
+        TRACE(READ_NOENT, path);
+        return -ENOENT;
+    }
+    
+    if (!S_ISREG(file_inode->mode)) {
+        TRACE(READ_NOTREG, path);
+        unlock_inode(fs, file_inode->num);
+        return -EISDIR;
+    }
+
+    int total_bytes_read = read_file(fs, file_inode, file, buf, size, offset);
+    update_atime(fs, file_inode, offset);
+    if (file) {
+        file_readahead(fs, file, file_inode, offset, total_bytes_read);
+    }
+    unlock_inode(fs, file_inode->num);
+
+    TRACE(READ_DONE, path, total_bytes_read);
+    return total_bytes_read;
+}
+
+// Returns the data of [offset, offset + size) as pieces of the disk images rather than a
+// copy, so with splice FUSE hands it from the page cache to the kernel without it passing
+// through user space. Runs on different RAID 0 disks are separate pieces, adjacent ones on
+// the same disk are merged. The caller holds the inode lock.
+int map_file_range(struct wfs_fs *fs, struct wfs_inode *file_inode, struct wfs_file *file, struct wfs_map *map, size_t size, off_t offset) {
+    // Nothing past the end of the file
+    size_t bytes_left = 0;
+    if (offset < file_inode->size) {
+        bytes_left = MIN(size, file_inode->size - offset);
+    }
+    off_t current_file_offset = offset;
+
+    // Map the data run by run, a run being as many blocks as are back to back on disk
+    while (bytes_left > 0) {
+        size_t blk_idx = current_file_offset / BLOCK_SIZE;
+        int block_internal_offset = current_file_offset % BLOCK_SIZE;
+
+        int target_disk_index;
+        size_t run;
+        off_t blk_addr = file_map_block(fs, file, file_inode, blk_idx, 0, &target_disk_index, &run);
+        if (blk_addr <= 0) {
+            TRACE(READ_HOLE, NULL, blk_idx);
+            break;
+        }
+
+        // Each part of the run comes from the disk read_source() picks for it
+        size_t bytes_to_read = MIN(run * BLOCK_SIZE - block_internal_offset, bytes_left);
+        off_t addr = blk_addr + block_internal_offset;
+        for (size_t done = 0; done < bytes_to_read;) {
+            size_t chunk = bytes_to_read - done;
+            int source = read_source(fs, target_disk_index, addr + done, &chunk);
+            if (map_add(fs, map, source, addr + done, chunk) != SUCCESS) {
+                free_map(map);
+                return -ENOMEM;
+            }
+            done += chunk;
+        }
+
+        current_file_offset += bytes_to_read;
+        bytes_left -= bytes_to_read;
+    }
+    return 0;
+}
+
+// Reads into a buffer of our own, for when the data has to be copied anyway
+int read_file_buf(struct wfs_fs *fs, struct wfs_inode *file_inode, struct wfs_file *file, struct wfs_map *map, size_t size, off_t offset) {
+    char *mem = malloc(size ? size : 1);
+    if (!mem) {
+        return -ENOMEM;
+    }
+
+    size_t len = read_file(fs, file_inode, file, mem, size, offset);
+    if (map_push(map, (struct wfs_piece){.fd = -1, .mem = mem, .len = len}) != SUCCESS) {
+        free(mem);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+// Fills map, which starts out empty, with the data of [offset, offset + size), see
+// map_file_range(). The pieces are read after the caller drops the inode lock, so they need a
+// reference to keep an unlink from freeing their blocks first. An open handle is one until it
+// is released, which FUSE doesn't do while a read on it is in flight. Without a handle nothing
+// holds the inode, so the data is copied into a buffer of its own under the lock, as it is
+// for least-outstanding, which has to see every read finish. The caller holds the inode lock.
+// free_map() frees the map.
+int read_at(struct wfs_fs *fs, struct wfs_inode *file_inode, struct wfs_file *file, struct wfs_map *map, size_t size, off_t offset) {
+    *map = (struct wfs_map){0};
+    int ret;
+    if (!file || (fs->raid_mode == 1 && fs->read_policy == READ_POLICY_LEAST_OUTSTANDING)) {
+        ret = read_file_buf(fs, file_inode, file, map, size, offset);
+    } else {
+        ret = map_file_range(fs, file_inode, file, map, size, offset);
+    }
+    if (ret == 0) {
+        update_atime(fs, file_inode, offset);
+        if (file) {
+            file_readahead(fs, file, file_inode, offset, map_size(map));
+        }
+    }
+    return ret;
+}
+
+// Like wfs_fs_read(), but returns the data as a map, see read_at(). The pieces are read
+// after the inode lock is dropped, so a read racing a write to the same range can return
+// part of that write.
+int wfs_fs_read_map(struct wfs_fs *fs, const char *path, struct wfs_file *file, struct wfs_map *map, size_t size, off_t offset) {
+    TRACE(READ, path, size, offset);
+    *map = (struct wfs_map){0};
+
+    // Check path, which is only used without a handle
+    if (!file && (path == NULL || path[0] != '/')) {
+        TRACE(READ_BAD_PATH, path);
+        return -EINVAL;
+    }
+
+    // /.wfs/stats isn't on disk, it goes out as a copy
+    if (stats_target(fs, path, file) >= 0) {
+        char *data = malloc(size ? size : 1);
+        int ret = data ? wfs_fs_read(fs, path, file, data, size, offset) : -ENOMEM;
+        if (ret >= 0 && map_push(map, (struct wfs_piece){.fd = -1, .mem = data, .len = ret}) != SUCCESS) {
+            ret = -ENOMEM;
+        }
+        if (ret < 0) {
+            free(data);
+            return ret;
+        }
+        return 0;
+    }
+
+    // Find the inode for the file
+    struct wfs_inode *file_inode = handle_inode(fs, path, file, LOCK_SHARED);
+    if (!file_inode) {
+        TRACE(READ_NOENT, path);
+        return -ENOENT;
+    }
+
+    if (!S_ISREG(file_inode->mode)) {
+        TRACE(READ_NOTREG, path);
+        unlock_inode(fs, file_inode->num);
+        return -EISDIR;
+    }
+
+    int ret = read_at(fs, file_inode, file, map, size, offset);
+    unlock_inode(fs, file_inode->num);
+    if (ret < 0) {
+        return ret;
+    }
+
+    TRACE(READ_DONE, path, map_size(map));
+    return 0;
+}
+
+
+// Removes the regular file `name` from parent_inode, which the caller holds exclusive
+int unlink_at(struct wfs_fs *fs, struct wfs_inode *parent_inode, const char *target_file) {
+    // Find directory entry
+    struct wfs_dentry *target_dentry = find_dentry_in_directory(fs, parent_inode, target_file);
+    if (!target_dentry) {
+        TRACE(UNLINK_NOENT, target_file);
+        return -ENOENT;
+    }
+
+    // Find file's inode, waiting for anyone still reading or writing it
+    int target_num = target_dentry->num;
+    lock_inode(fs, target_num, LOCK_EXCLUSIVE);
+    struct wfs_inode *target_inode = get_inode(fs, target_num);
+    if (!target_inode || !S_ISREG(target_inode->mode)) {
+        TRACE(UNLINK_NOTREG, target_file);
+        unlock_inode(fs, target_num);
+        return -EISDIR;
+    }
+
+    // Call the helper function to unlink the file
+    int result = unlink_file_helper(fs, parent_inode, target_inode, target_file);
+    unlock_inode(fs, target_num);
+   
+    // If unlink operation failed, return failure
+    if (result != SUCCESS) {
+        return result;
+    }
+
+
+    // Update parent metadata
+    parent_inode->nlinks--;
+    parent_inode->mtim = time(NULL);
+    mark_inode_dirty(fs, parent_inode);
+
+    if (fs->raid_mode != 0 && fs->num_disks > 1) {
+        sync_disks_for_raid1(fs, 0);
+    } else if (fs->raid_mode == 0 && fs->num_disks > 1) {
+        sync_disks_for_raid0(fs, 0);
+    }
+
+    dcache_add(&fs->dcache, parent_inode->num, target_file, strlen(target_file), DCACHE_NEGATIVE);
+    dcache_path_invalidate_all(&fs->dcache);
+    return SUCCESS;
+}
+
+int wfs_fs_unlink(struct wfs_fs *fs, const char *path) {
+    TRACE(UNLINK, path);
+    // Check if path is valid
+    if (path == NULL || path[0] != '/') {
+        return -EINVAL;
+    }
+    if (stats_target(fs, path, NULL) >= 0) {
+        return -EPERM;
+    }
+
+    // Create copies of path and extract parent path and file name
+    char *original_path = strdup(path);
+    char *duplicate_path = strdup(path);
+
+    if (!original_path || !duplicate_path) {
+        TRACE(UNLINK_NOMEM, NULL);
+        free(original_path);
+        free(duplicate_path);
+        return -ENOMEM;
+    }
+    char *parent = dirname(duplicate_path);
+
+    char *slash = strrchr(original_path, '/');
+    *slash = '\0';
+
+    char *target_file = slash + 1;
+
+    // Find parent inode and check if directory
+    struct wfs_inode *parent_inode = find_inode_by_path(fs, parent, LOCK_EXCLUSIVE);
+    if (!parent_inode || !S_ISDIR(parent_inode->mode)) {
+        TRACE(UNLINK_NO_PARENT, parent);
+        if (parent_inode) {
+            unlock_inode(fs, parent_inode->num);
+        }
+        free(original_path);
+        free(duplicate_path);
+        return -ENOENT;
+    }
+
+    int result = unlink_at(fs, parent_inode, target_file);
+    unlock_inode(fs, parent_inode->num);
+
+    free(original_path);
+    free(duplicate_path);
+
+    return result;
+}
+
+// Removes the empty directory `name` from parent_inode, which the caller holds exclusive
+int rmdir_at(struct wfs_fs *fs, struct wfs_inode *parent_inode, const char *target_dir) {
+    // Find directory entry
+    struct wfs_dentry *target_dentry = find_dentry_in_directory(fs, parent_inode, target_dir);
+    if (!target_dentry) {
+        TRACE(RMDIR_NOENT, target_dir);
+        return -ENOENT;
+    }
+
+    // Find directory's inode, the lock keeps entries from being added while we check it's empty
+    int target_num = target_dentry->num;
+    lock_inode(fs, target_num, LOCK_EXCLUSIVE);
+    struct wfs_inode *target_inode = get_inode(fs, target_num);
+    if (!target_inode || !S_ISDIR(target_inode->mode)) {
+        TRACE(RMDIR_NOTDIR, target_dir);
+        unlock_inode(fs, target_num);
+        return -ENOTDIR;
+    }
+
+    int result = remove_directory_helper(fs, parent_inode, target_inode, target_dir);
+    unlock_inode(fs, target_num);
+    if (result == SUCCESS) {
+        dcache_add(&fs->dcache, parent_inode->num, target_dir, strlen(target_dir), DCACHE_NEGATIVE);
+        dcache_path_invalidate_all(&fs->dcache);
+    }
+    return result;
+}
+
+int wfs_fs_rmdir(struct wfs_fs *fs, const char *directory_path) {
+    TRACE(RMDIR, directory_path);
+
+    // Check input
+    if (directory_path == NULL || directory_path[0] != '/') {
+        return -EINVAL;
+    }
+
+    // Root directory cannot be removed, and neither can /.wfs
+    if (strcmp(directory_path, "/") == 0) {
+        TRACE(RMDIR_ROOT, NULL);
+        return -EBUSY;
+    }
+    if (stats_target(fs, directory_path, NULL) >= 0) {
+        return -EPERM;
+    }
+
+    // Create copies of the path and extract parent path and directory name
+    char *original_path = strdup(directory_path);
+    char *duplicate_path = strdup(directory_path);
+    if (!original_path || !duplicate_path) {
+        TRACE(RMDIR_NOMEM, NULL);
+        free(original_path);
+        free(duplicate_path);
+        return -ENOMEM;
+    }
+
+    char *parent = dirname(duplicate_path);
+
+    char *slash = strrchr(original_path, '/');
+    *slash = '\0';
+
+    char *target_dir = slash + 1;
+
+    // Find parent inode and check if directory
+    struct wfs_inode *parent_inode = find_inode_by_path(fs, parent, LOCK_EXCLUSIVE);
+    if (!parent_inode || !S_ISDIR(parent_inode->mode)) {
+        TRACE(RMDIR_NO_PARENT, parent);
+        if (parent_inode) {
+            unlock_inode(fs, parent_inode->num);
+        }
+        free(original_path);
+        free(duplicate_path);
+        return -ENOENT;
+    }
+
+    int result = rmdir_at(fs, parent_inode, target_dir);
+    unlock_inode(fs, parent_inode->num);
+
+    free(original_path);
+    free(duplicate_path);
+    return result;
+}
+
+
+/*
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+*/
+
+
+
+
+// -----------------------------------------Background scrubber-----------------------------------------
+// With --scrub-rate=MB/s a thread walks the allocated data blocks in the data bitmap, checks
+// that every mirror has the same (and, with checksums, a correct) copy, and rewrites the bad
+// ones. It holds scrub_lock exclusive, and the journal from writing in place, for one batch of
+// blocks at a time and sleeps between batches to stay within its budget.
+
+// Checks every copy of the data block at addr and rewrites the bad ones from a good one. The
+// good copy is the first one matching its checksum, or without checksums (or when none
+// matches) the one most mirrors agree on, ties going to the lower disk as in vote_source().
+static int scrub_block(struct wfs_fs *fs, off_t addr) {
+    int csums = has_checksums(fs);
+    int source = -1;
+
+    if (csums) {
+        int clean = 1;
+        for (int i = 0; i < fs->num_disks; i++) {
+            int ok = block_csum_ok(fs, i, addr);
+            if (ok && source < 0) {
+                source = i;
+            }
+            clean = clean && ok && *csum_slot(fs, i, addr) == *csum_slot(fs, 0, addr);
+        }
+        if (clean) {
+            return SCRUB_CLEAN;
+        }
+    } else {
+        int clean = 1;
+        for (int i = 1; i < fs->num_disks && clean; i++) {
+            clean = memcmp(DISK_FILE_PTR(0, addr), DISK_FILE_PTR(i, addr), BLOCK_SIZE) == 0;
+        }
+        if (clean) {
+            return SCRUB_CLEAN;
+        }
+    }
+
+    int verified = source >= 0 || !csums;
+    if (source < 0) {
+        int best_votes = 0;
+        for (int i = 0; i < fs->num_disks; i++) {
+            int votes = 1;
+            for (int j = i + 1; j < fs->num_disks; j++) {
+                if (memcmp(DISK_FILE_PTR(i, addr), DISK_FILE_PTR(j, addr), BLOCK_SIZE) == 0) {
+                    votes++;
+                }
+            }
+            if (votes > best_votes) {
+                best_votes = votes;
+                source = i;
+            }
+        }
+        TRACE(SCRUB_UNVERIFIED, NULL, addr);
+    }
+
+    for (int i = 0; i < fs->num_disks; i++) {
+        if (i != source && memcmp(DISK_FILE_PTR(i, addr), DISK_FILE_PTR(source, addr), BLOCK_SIZE) != 0) {
+            memcpy(DISK_FILE_PTR(i, addr), DISK_FILE_PTR(source, addr), BLOCK_SIZE);
+            writeback_mark(&fs->wb, i, addr, BLOCK_SIZE);
+            TRACE(SCRUB_REPAIR, NULL, addr, i, source);
+        }
+    }
+    if (csums) {
+        update_csums(fs, source, addr, addr + BLOCK_SIZE);
+    }
+    return verified ? SCRUB_REPAIRED : SCRUB_NO_GOOD_COPY;
+}
+
+// Sleeps until `until` unless the scrubber is told to stop first. Returns 1 if it was.
+static int scrub_sleep(struct wfs_fs *fs, const struct timespec *until) {
+    pthread_mutex_lock(&fs->scrub_stop_lock);
+    while (!fs->scrub_stop && pthread_cond_timedwait(&fs->scrub_stop_cond, &fs->scrub_stop_lock, until) != ETIMEDOUT) {
+    }
+    int stop = fs->scrub_stop;
+    pthread_mutex_unlock(&fs->scrub_stop_lock);
+    return stop;
+}
+
+// Time `seconds` after `start`
+static struct timespec time_after(const struct timespec *start, double seconds) {
+    struct timespec t = *start;
+    t.tv_sec += (time_t)seconds;
+    t.tv_nsec += (long)((seconds - (time_t)seconds) * 1e9);
+    if (t.tv_nsec >= 1000000000) {
+        t.tv_sec++;
+        t.tv_nsec -= 1000000000;
+    }
+    return t;
+}
+
+static void *scrub_thread(void *arg) {
+    struct wfs_fs *fs = arg;
+    struct wfs_sb *sb = get_superblock(fs);
+    double bytes_per_sec = (double)fs->scrub_rate * 1024 * 1024;
+
+    TRACE(SCRUB_START, NULL, fs->scrub_rate);
+    for (int pass = 1; ; pass++) {
+        size_t checked = 0, repaired = 0, no_good_copy = 0;
+        int reported = 0;
+        struct timespec start;
+        clock_gettime(CLOCK_REALTIME, &start);
+
+        size_t block = 0;
+        while (block < sb->num_data_blocks) {
+            // Free blocks cost nothing but a bit test, still bound how many are skipped per batch
+            size_t batch = 0;
+            pthread_rwlock_wrlock(&fs->scrub_lock);
+            journal_hold(&fs->journal);
+            for (size_t seen = 0; block < sb->num_data_blocks && batch < SCRUB_BATCH_BLOCKS &&
+                                  seen < SCRUB_BATCH_BLOCKS * 64; block++, seen++) {
+                if (!bitmap_test(&fs->data_bitmaps[0], block)) {
+                    continue;
+                }
+                int ret = scrub_block(fs, sb->d_blocks_ptr + block * BLOCK_SIZE);
+                repaired += ret == SCRUB_REPAIRED;
+                no_good_copy += ret == SCRUB_NO_GOOD_COPY;
+                batch++;
+            }
+            journal_release(&fs->journal);
+            pthread_rwlock_unlock(&fs->scrub_lock);
+            checked += batch;
+
+            int percent = block * 100 / sb->num_data_blocks;
+            if (percent / 10 > reported) {
+                reported = percent / 10;
+                TRACE(SCRUB_PROGRESS, NULL, pass, percent);
+            }
+
+            // Every copy of every checked block was read
+            struct timespec until = time_after(&start, checked * BLOCK_SIZE * fs->num_disks / bytes_per_sec);
+            if (scrub_sleep(fs, &until)) {
+                return NULL;
+            }
+        }
+
+        TRACE(SCRUB_PASS, NULL, pass, checked, repaired, no_good_copy);
+        if (repaired > 0 || no_good_copy > 0) {
+            printf("scrub: pass %d checked %zu blocks, repaired %zu, %zu had no good copy\n",
+                   pass, checked, repaired, no_good_copy);
+            fflush(stdout);
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        struct timespec next = time_after(&now, SCRUB_PASS_INTERVAL);
+        if (scrub_sleep(fs, &next)) {
+            return NULL;
+        }
+    }
+}
+
+
+// Starts the scrubber and the writeback thread. wfs.c calls it once FUSE is up, a thread
+// started before fuse_main wouldn't survive daemonizing.
+int wfs_fs_start(struct wfs_fs *fs) {
+    int ret = SUCCESS;
+
+    // Left over from a wfs that stopped while unlinked inodes were still in use
+    reclaim_orphans(fs);
+
+    if (fs->scrub_rate > 0) {
+        if (pthread_create(&fs->scrub_tid, NULL, scrub_thread, fs) == 0) {
+            fs->scrub_started = 1;
+        } else {
+            printf("Failed to start the scrubber\n");
+            ret = FAIL;
+        }
+    }
+    if (fs->writeback_interval > 0 && writeback_start(&fs->wb, fs->writeback_interval) != SUCCESS) {
+        printf("Failed to start writeback\n");
+        ret = FAIL;
+    }
+    return ret;
+}
+
+void wfs_fs_stop(struct wfs_fs *fs) {
+    if (fs->stopped) {
+        return;
+    }
+    fs->stopped = 1;
+    if (fs->scrub_started) {
+        pthread_mutex_lock(&fs->scrub_stop_lock);
+        fs->scrub_stop = 1;
+        pthread_cond_broadcast(&fs->scrub_stop_cond);
+        pthread_mutex_unlock(&fs->scrub_stop_lock);
+        pthread_join(fs->scrub_tid, NULL);
+        fs->scrub_started = 0;
+    }
+    reclaim_orphans(fs);
+
+    // Whatever changed since the last sync goes out before the mount is gone, and a clean
+    // unmount leaves nothing to replay
+    sync_dirty_lists(fs);
+    writeback_stop(&fs->wb);
+    writeback_sync(&fs->wb);
+    journal_checkpoint(&fs->journal);
+}
+// -----------------------------------------------------------------------------------------------------
+
+
+// ------------------------------------------------Mounting------------------------------------------------
+
+// Sets read_policy from its --read-policy= name
+static int parse_read_policy(struct wfs_fs *fs, const char *name) {
+    if (strcmp(name, "first") == 0) {
+        fs->read_policy = READ_POLICY_FIRST;
+    } else if (strcmp(name, "round-robin") == 0) {
+        fs->read_policy = READ_POLICY_ROUND_ROBIN;
+    } else if (strcmp(name, "least-outstanding") == 0) {
+        fs->read_policy = READ_POLICY_LEAST_OUTSTANDING;
+    } else if (strcmp(name, "stream") == 0) {
+        fs->read_policy = READ_POLICY_STREAM;
+    } else {
+        return FAIL;
+    }
+    return SUCCESS;
+}
+
+void wfs_fs_options_init(struct wfs_options *opts) {
+    memset(opts, 0, sizeof(struct wfs_options));
+    opts->writeback_interval = -1;
+}
+
+// Maps the disks and builds everything the operations need. On failure it says why on stdout,
+// as wfs always has, and undoes what it did.
+struct wfs_fs *wfs_fs_mount(int num_disks, char *const disks[], const struct wfs_options *opts) {
+    if (num_disks == 0) {
+        printf("No disk paths provided\n");
+        return NULL;
+    }
+
+    if (num_disks > MAX_DISKS) {
+        printf("Too many disks provided. Max supported: %d\n", MAX_DISKS);
+        return NULL;
+    }
+
+    struct wfs_fs *fs = calloc(1, sizeof(struct wfs_fs));
+    if (!fs) {
+        printf("Failed to allocate the filesystem\n");
+        return NULL;
+    }
+    fs->block_size = DEFAULT_BLOCK_SIZE;
+    fs->stripe_blocks = 1;
+    fs->read_policy = READ_POLICY_STREAM;
+    pthread_mutex_init(&fs->sync_lock, NULL);
+    pthread_mutex_init(&fs->inode_bitmap_lock, NULL);
+    pthread_mutex_init(&fs->held_lock, NULL);
+    pthread_mutex_init(&fs->orphans_lock, NULL);
+    fs->orphans_lost = 1;  // Until the journal lists them
+    for (int i = 0; i < MAX_DISKS; i++) {
+        pthread_mutex_init(&fs->data_bitmap_locks[i], NULL);
+        fs->disk_fds[i] = -1;
+    }
+    pthread_mutex_init(&fs->scrub_stop_lock, NULL);
+    pthread_cond_init(&fs->scrub_stop_cond, NULL);
+
+    // Prefer the scrubber once it waits, or a steady stream of operations would starve it
+    pthread_rwlockattr_t scrub_lock_attr;
+    pthread_rwlockattr_init(&scrub_lock_attr);
+    pthread_rwlockattr_setkind_np(&scrub_lock_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&fs->scrub_lock, &scrub_lock_attr);
+    pthread_rwlockattr_destroy(&scrub_lock_attr);
+
+    // Counted from the start, mounting may already allocate and copy
+    if (stats_init(&fs->stats) != SUCCESS) {
+        printf("Failed to allocate the statistics\n");
+        wfs_fs_unmount(fs);
+        return NULL;
+    }
+
+    // Memory-map each disk
+    fs->num_disks = num_disks;
+    for (int i = 0; i < num_disks; i++) {
+        fs->disk_names[i] = disks[i]; // Store disk name
+
+        // Open the disk file
+        int fd = open(fs->disk_names[i], O_RDWR);
+        if (fd == -1) {
+            printf("Failed to open disk");
+            wfs_fs_unmount(fs);
+            return NULL;
+        }
+        fs->disk_fds[i] = fd; // Stays open for read_at()
+
+        // Get the disk file size
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            printf("Failed to stat disk");
+            wfs_fs_unmount(fs);
+            return NULL;
+        }
+
+        // Memory-map the disk
+        void *region = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (region == MAP_FAILED) {
+            printf("Failed to mmap disk");
+            wfs_fs_unmount(fs);
+            return NULL;
+        }
+        fs->disk_region[i] = region;
+        fs->disk_file[i] = region;
+        fs->disk_sizes[i] = st.st_size;
+    }
+
+    // Initalize raid mode
+    struct wfs_sb *sb = get_superblock(fs);
+    fs->raid_mode = sb->raid_mode;
+
+    // Block size and stripe unit, images from before mkfs -B and -S have 512-byte blocks
+    // striped one at a time
+    if (sb->i_bitmap_ptr >= sizeof(struct wfs_sb)) {
+        fs->block_size = sb->block_bits ? (size_t)1 << sb->block_bits : DEFAULT_BLOCK_SIZE;
+        fs->stripe_blocks = (size_t)1 << sb->stripe_bits;
+    }
+    if (fs->block_size < MIN_BLOCK_SIZE || fs->block_size > MAX_BLOCK_SIZE) {
+        printf("Unsupported block size %zu\n", fs->block_size);
+        wfs_fs_unmount(fs);
+        return NULL;
+    }
+    fs->NUM_DENTRIES_PER_BLOCK = BLOCK_SIZE / sizeof(struct wfs_dentry);
+
+    if (fs->raid_mode == 0) {
+        sort_disks_for_raid0(fs);
+    }
+    sb = get_superblock(fs);
+
+    if (opts->read_policy && parse_read_policy(fs, opts->read_policy) != SUCCESS) {
+        printf("Unknown read policy %s, expected first, round-robin, least-outstanding or stream\n",
+               opts->read_policy);
+        wfs_fs_unmount(fs);
+        return NULL;
+    }
+    fs->scrub_rate = opts->scrub_rate;
+    if (fs->scrub_rate > 0 && (fs->raid_mode == 0 || fs->num_disks == 1)) {
+        printf("Scrubbing needs RAID 1 or 1v with more than one disk\n");
+        wfs_fs_unmount(fs);
+        return NULL;
+    }
+    fs->writeback_interval = opts->writeback_interval;
+
+    // Build the allocators and the writeback map after the disks are in their final order
+    if (writeback_init(&fs->wb, fs->num_disks, fs->disk_file, fs->disk_sizes) != SUCCESS) {
+        printf("Failed to allocate the writeback map\n");
+        wfs_fs_unmount(fs);
+        return NULL;
+    }
+    static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+    pthread_once(&crc32c_once, crc32c_init);
+
+    // A crash leaves metadata as the last committed transactions have it once they are
+    // replayed, before anything reads it
+    if (has_journal(fs)) {
+        size_t replayed_bytes;
+        int replayed;
+        int opened = journal_open(&fs->journal, &fs->wb, fs->num_disks, fs->disk_file, journal_offset(fs), BLOCK_SIZE,
+                                  journal_applied, list_orphans, fs);
+
+        // Replay lists them again, as orphans hands them back
+        ssize_t orphans = opened == SUCCESS ? journal_orphans(&fs->journal, &fs->orphans) : -1;
+        if (orphans >= 0) {
+            fs->num_orphans = fs->max_orphans = orphans;
+            fs->orphans_lost = 0;
+        }
+        if (opened != SUCCESS || (replayed = journal_replay(&fs->journal, &replayed_bytes)) < 0) {
+            printf("The journal is damaged\n");
+            wfs_fs_unmount(fs);
+            return NULL;
+        }
+        if (replayed > 0) {
+            printf("Replayed %d journal transactions, %zu bytes\n", replayed, replayed_bytes);
+            fflush(stdout);  // FUSE drops stdout when it goes to the background
+        }
+
+        // Transactions only count once synced, so they are by default
+        if (fs->writeback_interval < 0) {
+            fs->writeback_interval = JOURNAL_COMMIT_INTERVAL;
+        }
+
+        // From here on metadata is changed in a private copy of the images, and the journal
+        // writes it in place once it has committed it
+        for (int i = 0; i < fs->num_disks; i++) {
+            void *copy = mmap(NULL, fs->disk_sizes[i], PROT_READ | PROT_WRITE, MAP_PRIVATE, fs->disk_fds[i], 0);
+            if (copy == MAP_FAILED) {
+                printf("Failed to mmap disk");
+                wfs_fs_unmount(fs);
+                return NULL;
+            }
+            fs->disk_region[i] = copy;
+        }
+        sb = get_superblock(fs);
+    }
+    if (fs->writeback_interval < 0) {
+        fs->writeback_interval = 0;
+    }
+    for (int i = 0; i < fs->num_disks; i++) {
+        if (bitmap_init(&fs->data_bitmaps[i], DISK_MAP_PTR(i, sb->d_bitmap_ptr), sb->num_data_blocks, BITMAP_NEXT_FIT) != SUCCESS ||
+            (staged(fs) && bitmap_hold_frees(&fs->data_bitmaps[i]) != SUCCESS)) {
+            printf("Failed to set up block allocator\n");
+            wfs_fs_unmount(fs);
+            return NULL;
+        }
+    }
+    if (bitmap_init(&fs->inode_bitmap, DISK_MAP_PTR(sb->disk_id, sb->i_bitmap_ptr), sb->num_inodes, BITMAP_FIRST_FIT) != SUCCESS) {
+        printf("Failed to set up inode allocator\n");
+        wfs_fs_unmount(fs);
+        return NULL;
+    }
+
+    if (dcache_init(&fs->dcache, sb->num_inodes) != SUCCESS) {
+        printf("Failed to allocate the dentry cache\n");
+        wfs_fs_unmount(fs);
+        return NULL;
+    }
+
+    if (init_inode_locks(fs, sb->num_inodes) != SUCCESS) {
+        printf("Failed to allocate inode locks\n");
+        wfs_fs_unmount(fs);
+        return NULL;
+    }
+
+    fs->inode_refs = calloc(sb->num_inodes, sizeof(unsigned long));
+    if (!fs->inode_refs) {
+        printf("Failed to allocate inode reference counts\n");
+        wfs_fs_unmount(fs);
+        return NULL;
+    }
+    fs->mounted = 1;
+    return fs;
+}
+
+// Also takes what a failed wfs_fs_mount() got through
+void wfs_fs_unmount(struct wfs_fs *fs) {
+    if (fs->mounted) {
+        wfs_fs_stop(fs);
+    }
+
+    // The block mapping cache may hold runs of this filesystem, and the next one could be
+    // allocated at the same address
+    bmap_cache_forget();
+
+    journal_close(&fs->journal);
+    if (fs->wb.disks) {
+        writeback_destroy(&fs->wb);
+    }
+    free(fs->inode_refs);
+    free(fs->inode_locks);
+    free(fs->held);
+    free(fs->orphans);
+    if (fs->dcache.dentries) {
+        dcache_destroy(&fs->dcache);
+    }
+    bitmap_destroy(&fs->inode_bitmap);
+    for (int i = 0; i < fs->num_disks; i++) {
+        bitmap_destroy(&fs->data_bitmaps[i]);
+    }
+    for (int i = 0; i < fs->num_disks; i++) {
+        if (fs->disk_region[i] != fs->disk_file[i]) {
+            munmap(fs->disk_region[i], fs->disk_sizes[i]);
+        }
+        if (fs->disk_file[i] != NULL) {
+            munmap(fs->disk_file[i], fs->disk_sizes[i]);
+        }
+        if (fs->disk_fds[i] >= 0) {
+            close(fs->disk_fds[i]);
+        }
+    }
+
+    pthread_mutex_destroy(&fs->sync_lock);
+    pthread_mutex_destroy(&fs->inode_bitmap_lock);
+    pthread_mutex_destroy(&fs->held_lock);
+    pthread_mutex_destroy(&fs->orphans_lock);
+    for (int i = 0; i < MAX_DISKS; i++) {
+        pthread_mutex_destroy(&fs->data_bitmap_locks[i]);
+    }
+    pthread_mutex_destroy(&fs->scrub_stop_lock);
+    pthread_cond_destroy(&fs->scrub_stop_cond);
+    pthread_rwlock_destroy(&fs->scrub_lock);
+    stats_destroy(&fs->stats);
+    free(fs);
+}
+// -----------------------------------------------------------------------------------------------------
@@ -0,0 +1,182 @@
+#ifndef WFS_CORE_H
+#define WFS_CORE_H
+
+/*
+  The filesystem behind libwfs.h (wfs_core.c), as the two FUSE front ends
+  over it see it: the path callbacks in wfs.c and the inode number ones in
+  wfs_ll.c (--lowlevel). Nothing here needs FUSE, wfs_fuse.h has what the
+  front ends share on top of it.
+
+  Functions taking a wfs_inode expect the caller to hold it with
+  lock_inode(), exclusive when they change it. Inode numbers are wfs's own,
+  wfs_ll.c maps them to FUSE node ids. Include after wfs.h.
+*/
+
+#include <pthread.h>
+#include "bitmap.h"
+#include "dcache.h"
+#include "writeback.h"
+#include "journal.h"
+#include "stats.h"
+#include "libwfs.h"
+
+// A mounted filesystem
+struct wfs_fs {
+    int num_disks;
+    int raid_mode;
+    size_t block_size;          // From the superblock, see BLOCK_SIZE
+    size_t stripe_blocks;       // RAID 0 stripe unit in blocks
+    int NUM_DENTRIES_PER_BLOCK;
+    void *disk_region[MAX_DISKS];
+    // The images as shared mappings, where file data is read and written. With a journal,
+    // disk_region is a private copy of them where metadata is changed until the journal has
+    // committed it, see journal.h. Without one the two are the same mapping.
+    void *disk_file[MAX_DISKS];
+    char *disk_names[MAX_DISKS];  // Only used while mounting
+    size_t disk_sizes[MAX_DISKS]; // To munmap
+    int disk_fds[MAX_DISKS];      // Kept open so read_buf can hand out file data by descriptor
+    pthread_mutex_t sync_lock;    // One copy at a time, so the last copy of a range has its newest bytes
+
+    // Allocators over the data bitmap of every disk and the inode bitmap
+    struct bitmap data_bitmaps[MAX_DISKS];
+    struct bitmap inode_bitmap;
+    pthread_mutex_t data_bitmap_locks[MAX_DISKS];
+    pthread_mutex_t inode_bitmap_lock;
+
+    // With a journal, data blocks freed by operations it has logged, held back from
+    // allocation until a checkpoint, see hold_freed_blocks()
+    struct freed_run *held;
+    size_t num_held;
+    size_t max_held;
+    pthread_mutex_t held_lock;
+
+    // Inodes unlinked while still in use, freed when the last reference goes, see drop_inode().
+    // orphans_lost when there may be others, as there may be when mounting without a journal.
+    uint32_t *orphans;
+    size_t num_orphans;
+    size_t max_orphans;
+    int orphans_lost;
+    pthread_mutex_t orphans_lock;
+
+    // One reader/writer lock per inode, see lock_inode()
+    pthread_rwlock_t *inode_locks;
+
+    // How RAID 1 spreads file reads over the mirrors
+    int read_policy;
+    int outstanding_reads[MAX_DISKS]; // memcpys in progress per disk, for least-outstanding
+
+    // Background scrubber, see scrub_thread()
+    int scrub_rate;             // MB/s, 0 when not scrubbing
+    pthread_rwlock_t scrub_lock; // Shared while an operation holds inode locks, exclusive while scrubbing
+    pthread_t scrub_tid;
+    int scrub_started;
+    int scrub_stop;
+    pthread_mutex_t scrub_stop_lock;
+    pthread_cond_t scrub_stop_cond;
+
+    // Seconds between background syncs of the changed parts of the images. 0 leaves it to
+    // the kernel, and to fsync.
+    double writeback_interval;
+
+    // Kernel lookups and open handles per inode. See drop_inode().
+    unsigned long *inode_refs;
+
+    struct dcache dcache;
+    struct writeback wb;
+    struct journal journal;
+    struct stats stats;         // See wfs_fs_stats()
+
+    int mounted;                // wfs_fs_mount() got all the way through
+    int stopped;                // By wfs_fs_stop()
+};
+
+struct wfs_sb *get_superblock(struct wfs_fs *fs);
+struct wfs_inode *get_inode(struct wfs_fs *fs, int inode_num);
+void lock_inode(struct wfs_fs *fs, int inode_num, int mode);
+void unlock_inode(struct wfs_fs *fs, int inode_num);
+
+// DCACHE_NEGATIVE if dir_inode has no entry called name
+int lookup_child(struct wfs_fs *fs, struct wfs_inode *dir_inode, const char *name, size_t len);
+
+void fill_stat(struct wfs_inode *inode, struct stat *stbuf);
+int mkdir_at(struct wfs_fs *fs, struct wfs_inode *parent_inode, const char *name, mode_t mode, int *new_num);
+int mknod_at(struct wfs_fs *fs, struct wfs_inode *parent_inode, const char *name, mode_t mode, int *new_num);
+int unlink_at(struct wfs_fs *fs, struct wfs_inode *parent_inode, const char *name);
+int rmdir_at(struct wfs_fs *fs, struct wfs_inode *parent_inode, const char *name);
+int readdir_at(struct wfs_fs *fs, struct wfs_inode *dir_inode, off_t offset, void *output_buffer, wfs_fill_t filler);
+
+// An open file or directory, from wfs_fs_open() or wfs_fs_create() until wfs_fs_release(). The
+// FUSE front ends keep it in fi->fh. It holds a reference to its inode, so num stays the same
+// file until then, unlinked or not. Threads may share a handle.
+struct wfs_file {
+    int num;
+    pthread_mutex_t lock;   // Guards the rest
+
+    // Last run of blocks file_map_block() found: file blocks map_block..+map_run lie back to
+    // back at map_addr on map_disk. Good while map_epoch is the block mapping epoch.
+    size_t map_block;
+    size_t map_run;         // 0 for none
+    int map_disk;
+    off_t map_addr;
+    unsigned long map_epoch;
+
+    // Sequential reads, see file_readahead()
+    off_t next_offset;      // Where the last read ended
+    size_t ra_blocks;       // Readahead window, 0 while reads jump around
+    off_t ra_end;           // File offset readahead has been asked for up to
+
+    unsigned long wb_errors; // writeback_errors() when last reported, see wfs_fs_flush()
+
+    // Snapshot of /.wfs/stats taken by open, when num is that file, see is_stats_num()
+    char *stats_text;
+    size_t stats_len;
+};
+
+struct wfs_file *open_file(struct wfs_fs *fs, struct wfs_inode *inode);
+
+// The data of a read, as pieces of the disk images where it can be, so it can go to the
+// kernel without a copy through wfs, and as memory of its own otherwise. See read_at().
+struct wfs_piece {
+    int fd;         // Image the piece is in, -1 for mem
+    off_t pos;      // In the image
+    char *mem;      // malloc'd, when fd is -1
+    size_t len;
+};
+
+struct wfs_map {
+    size_t count;
+    size_t cap;
+    struct wfs_piece *pieces;
+};
+
+size_t map_size(const struct wfs_map *map);
+void free_map(struct wfs_map *map);
+
+// Where write_at() takes the data from. read() copies the next len bytes of it to dst and
+// returns how many it copied, 0 once there are none left, or -errno.
+struct wfs_source {
+    size_t size;
+    ssize_t (*read)(void *ctx, char *dst, size_t len);
+    void *ctx;
+};
+
+// file may be NULL for an inode found without opening it
+int read_at(struct wfs_fs *fs, struct wfs_inode *file_inode, struct wfs_file *file, struct wfs_map *map, size_t size, off_t offset);
+int write_at(struct wfs_fs *fs, struct wfs_inode *inode, struct wfs_file *file, struct wfs_source *src, off_t offset);
+
+// wfs_fs_read() and wfs_fs_write() with the data as a map and a source
+int wfs_fs_read_map(struct wfs_fs *fs, const char *path, struct wfs_file *file, struct wfs_map *map, size_t size, off_t offset);
+int wfs_fs_write_from(struct wfs_fs *fs, const char *path, struct wfs_file *file, struct wfs_source *src, off_t offset);
+
+// /.wfs and /.wfs/stats, which aren't on disk, have the two inode numbers past the last inode
+int stats_dir_num(struct wfs_fs *fs);
+int is_stats_num(struct wfs_fs *fs, int num);
+// Inode number of name in the directory dir_num when it is one of those two, -1 otherwise
+int stats_child(struct wfs_fs *fs, int dir_num, const char *name);
+void stats_stat(struct wfs_fs *fs, int num, struct stat *stbuf);
+struct wfs_file *open_stats(struct wfs_fs *fs, int num);
+
+// Drops nlookup kernel lookups of inode num, see inode_refs
+void forget_inode(struct wfs_fs *fs, int num, unsigned long nlookup);
+
+#endif
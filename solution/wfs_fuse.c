@@ -0,0 +1,77 @@
+#define FUSE_USE_VERSION 30
+#include <stdlib.h>
+#include <errno.h>
+#include <stdint.h>
+#include <fuse.h>
+#include "wfs.h"
+#include "wfs_fuse.h"
+
+// The FUSE buffers of the front ends, over the maps and sources of wfs_core.c
+
+struct fuse_bufvec *map_to_bufvec(struct wfs_map *map) {
+    // An empty read is one empty memory buffer
+    size_t count = map->count ? map->count : 1;
+    struct fuse_bufvec *buf = malloc(sizeof(struct fuse_bufvec) + (count - 1) * sizeof(struct fuse_buf));
+    if (!buf) {
+        free_map(map);
+        return NULL;
+    }
+    *buf = FUSE_BUFVEC_INIT(0);
+
+    for (size_t i = 0; i < map->count; i++) {
+        struct wfs_piece *piece = &map->pieces[i];
+        struct fuse_buf *out = &buf->buf[i];
+        out->size = piece->len;
+        if (piece->fd < 0) {
+            out->flags = 0;
+            out->mem = piece->mem;
+            out->fd = -1;
+            out->pos = 0;
+        } else {
+            out->flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK | FUSE_BUF_FD_RETRY;
+            out->mem = NULL;
+            out->fd = piece->fd;
+            out->pos = piece->pos;
+        }
+    }
+    buf->count = count;
+
+    free(map->pieces);
+    *map = (struct wfs_map){0};
+    return buf;
+}
+
+void free_bufvec(struct fuse_bufvec *buf) {
+    for (size_t i = 0; i < buf->count; i++) {
+        if (!(buf->buf[i].flags & FUSE_BUF_IS_FD)) {
+            free(buf->buf[i].mem);
+        }
+    }
+    free(buf);
+}
+
+// Copies the next len bytes of the bufvec to dst, fuse_buf_copy() keeps track of where it is
+static ssize_t read_bufvec(void *ctx, char *dst, size_t len) {
+    struct fuse_bufvec to = FUSE_BUFVEC_INIT(len);
+    to.buf[0].mem = dst;
+    return fuse_buf_copy(&to, ctx, 0);
+}
+
+struct wfs_source bufvec_source(struct fuse_bufvec *buf) {
+    return (struct wfs_source){fuse_buf_size(buf), read_bufvec, buf};
+}
+
+int wfs_fs_read_buf(struct wfs_fs *fs, const char *path, struct wfs_file *file, struct fuse_bufvec **bufp, size_t size, off_t offset) {
+    struct wfs_map map;
+    int ret = wfs_fs_read_map(fs, path, file, &map, size, offset);
+    if (ret < 0) {
+        return ret;
+    }
+    *bufp = map_to_bufvec(&map);
+    return *bufp ? 0 : -ENOMEM;
+}
+
+int wfs_fs_write_buf(struct wfs_fs *fs, const char *path, struct wfs_file *file, struct fuse_bufvec *buf, off_t offset) {
+    struct wfs_source src = bufvec_source(buf);
+    return wfs_fs_write_from(fs, path, file, &src, offset);
+}
@@ -0,0 +1,38 @@
+#ifndef WFS_FUSE_H
+#define WFS_FUSE_H
+
+/*
+  What the two FUSE front ends, wfs.c and wfs_ll.c, share on top of
+  wfs_core.h: file handles in fuse_file_info, and the reads and writes of
+  wfs_core.h with their data as FUSE buffers. Only wfs is built with this,
+  libwfs.a doesn't need FUSE.
+*/
+
+#include <fuse.h>
+#include "wfs_core.h"
+
+// The handle in fi->fh, or NULL when there is none
+#define FILE_HANDLE(fi) ((fi) ? (struct wfs_file *)(uintptr_t)(fi)->fh : NULL)
+
+// A bufvec with the pieces of map, fds where the map has them. It takes over map's memory and
+// leaves map empty, out of memory it frees map and returns NULL. free_bufvec() frees it, as
+// FUSE does the ones read_buf returns.
+struct fuse_bufvec *map_to_bufvec(struct wfs_map *map);
+void free_bufvec(struct fuse_bufvec *buf);
+
+// A wfs_source of the data in buf, which may be a pipe when FUSE splices requests
+struct wfs_source bufvec_source(struct fuse_bufvec *buf);
+
+// wfs_fs_read_map() and wfs_fs_write_from() with the data as FUSE buffers
+int wfs_fs_read_buf(struct wfs_fs *fs, const char *path, struct wfs_file *file, struct fuse_bufvec **bufp, size_t size, off_t offset);
+int wfs_fs_write_buf(struct wfs_fs *fs, const char *path, struct wfs_file *file, struct fuse_bufvec *buf, off_t offset);
+
+// wfs_ll.c
+extern double entry_timeout;
+extern double attr_timeout;
+int wfs_ll_main(int argc, char *argv[], struct wfs_fs *fs);
+
+// wfs.c
+void stats_signal_start(struct wfs_fs *fs);
+
+#endif
@@ -0,0 +1,622 @@
+#define FUSE_USE_VERSION 30
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fuse_lowlevel.h>
+#include <pthread.h>
+#include "wfs.h"
+#include "trace.h"
+#include "dcache.h"
+#include "wfs_fuse.h"
+
+// FUSE low-level front end, used with --lowlevel. The kernel names inodes by node id rather
+// than by path, so every operation finds its inode directly and a path is resolved one
+// component at a time, by lookups the kernel caches for entry_timeout seconds. The requests
+// the statistics count (stats.h) are timed by a wrapper around the callback that serves them.
+
+// Seconds the kernel may keep names and attributes, --entry-timeout= and --attr-timeout=
+double entry_timeout = 1.0;
+double attr_timeout = 1.0;
+
+// FUSE reserves node id 1 for the root, which is wfs inode 0
+#define NODE_ID(num)   ((fuse_ino_t)(num) + 1)
+#define INODE_NUM(ino) ((int)((ino) - 1))
+
+// Whether the request this thread is serving failed, for the statistics
+static __thread int ll_failed;
+
+static void ll_reply_err(fuse_req_t req, int err) {
+    ll_failed = err != 0;
+    fuse_reply_err(req, err);
+}
+
+static uint64_t ll_start(void) {
+    ll_failed = 0;
+    return stats_start();
+}
+
+// Counts the request served since ll_start() as op. The reply is out and req gone by then, so
+// fs is taken from it before.
+static void ll_count(struct wfs_fs *fs, int op, uint64_t start) {
+    stats_op(&fs->stats, op, start, ll_failed);
+}
+
+// Locks the inode behind a node id in `mode`. If it isn't allocated the request is answered
+// with ESTALE and NULL returned.
+static struct wfs_inode *ll_inode(fuse_req_t req, fuse_ino_t ino, int mode) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    int num = INODE_NUM(ino);
+    if (ino == 0 || ino > get_superblock(fs)->num_inodes) {
+        TRACE(LL_STALE, NULL, num);
+        ll_reply_err(req, ESTALE);
+        return NULL;
+    }
+
+    lock_inode(fs, num, mode);
+    pthread_mutex_lock(&fs->inode_bitmap_lock);
+    int allocated = bitmap_test(&fs->inode_bitmap, num);
+    pthread_mutex_unlock(&fs->inode_bitmap_lock);
+    if (!allocated) {
+        TRACE(LL_STALE, NULL, num);
+        unlock_inode(fs, num);
+        ll_reply_err(req, ESTALE);
+        return NULL;
+    }
+    return get_inode(fs, num);
+}
+
+// Locks the inode of a request on an open file in `mode`: the handle's, or the node id's when
+// there is no handle, see ll_inode()
+static struct wfs_inode *ll_file_inode(fuse_req_t req, fuse_ino_t ino, struct wfs_file *file, int mode) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    if (!file) {
+        return ll_inode(req, ino, mode);
+    }
+    lock_inode(fs, file->num, mode);
+    return get_inode(fs, file->num);
+}
+
+static void ll_stat(struct wfs_inode *inode, struct stat *stbuf) {
+    memset(stbuf, 0, sizeof(struct stat));
+    fill_stat(inode, stbuf);
+    stbuf->st_ino = NODE_ID(inode->num);
+    stbuf->st_nlink = inode->nlinks;
+}
+
+// Fills in the reply to a lookup of inode, which takes a reference the kernel gives back with
+// forget. Once the reply is sent, see ll_reply_entry().
+static void ll_entry(struct wfs_fs *fs, struct wfs_inode *inode, struct fuse_entry_param *e) {
+    memset(e, 0, sizeof(struct fuse_entry_param));
+    e->ino = NODE_ID(inode->num);
+    e->attr_timeout = attr_timeout;
+    e->entry_timeout = entry_timeout;
+    ll_stat(inode, &e->attr);
+    __atomic_add_fetch(&fs->inode_refs[inode->num], 1, __ATOMIC_ACQ_REL);
+}
+
+// Sends an entry filled by ll_entry(), or a create reply with the handle in fi when fi is set.
+// When the request was interrupted the kernel never sees the reference or the handle, so they
+// are dropped here.
+static void ll_reply_entry(fuse_req_t req, struct fuse_entry_param *e, struct fuse_file_info *fi) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    int err = fi ? fuse_reply_create(req, e, fi) : fuse_reply_entry(req, e);
+    if (err != 0) {
+        if (fi) {
+            wfs_fs_release(fs, FILE_HANDLE(fi));
+        }
+        forget_inode(fs, INODE_NUM(e->ino), 1);
+    }
+}
+
+// Attributes of /.wfs or /.wfs/stats, see stats_stat()
+static void ll_stats_stat(struct wfs_fs *fs, int num, struct stat *stbuf) {
+    stats_stat(fs, num, stbuf);
+    stbuf->st_ino = NODE_ID(num);
+}
+
+static void serve_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+
+    // /.wfs and what is in it aren't on disk, and hold no references for forget to drop
+    int stats_num = stats_child(fs, INODE_NUM(parent), name);
+    if (stats_num >= 0 || INODE_NUM(parent) == stats_dir_num(fs)) {
+        struct fuse_entry_param e;
+        memset(&e, 0, sizeof(e));
+        e.entry_timeout = entry_timeout;
+        if (stats_num >= 0) {
+            e.ino = NODE_ID(stats_num);
+            e.attr_timeout = attr_timeout;
+            ll_stats_stat(fs, stats_num, &e.attr);
+        } else {
+            ll_failed = 1;
+        }
+        fuse_reply_entry(req, &e);
+        return;
+    }
+
+    struct wfs_inode *dir_inode = ll_inode(req, parent, LOCK_SHARED);
+    if (!dir_inode) {
+        return;
+    }
+    TRACE(LL_LOOKUP, name, dir_inode->num);
+
+    size_t len = strlen(name);
+    if (!S_ISDIR(dir_inode->mode) || len >= MAX_NAME) {
+        unlock_inode(fs, dir_inode->num);
+        ll_reply_err(req, S_ISDIR(dir_inode->mode) ? ENAMETOOLONG : ENOTDIR);
+        return;
+    }
+
+    int num = lookup_child(fs, dir_inode, name, len);
+    if (num == DCACHE_NEGATIVE) {
+        unlock_inode(fs, dir_inode->num);
+        ll_failed = 1;
+
+        // Every change goes through this mount, so the kernel can cache misses as well
+        struct fuse_entry_param e;
+        memset(&e, 0, sizeof(e));
+        e.entry_timeout = entry_timeout;
+        fuse_reply_entry(req, &e);
+        return;
+    }
+
+    // The directory lock keeps the entry from being removed until the child is locked
+    lock_inode(fs, num, LOCK_SHARED);
+    unlock_inode(fs, dir_inode->num);
+    struct fuse_entry_param e;
+    ll_entry(fs, get_inode(fs, num), &e);
+    unlock_inode(fs, num);
+    ll_reply_entry(req, &e, NULL);
+}
+
+static void ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    uint64_t start = ll_start();
+    serve_lookup(req, parent, name);
+    ll_count(fs, STATS_LOOKUP, start);
+}
+
+static void ll_forget(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    // The root is never looked up, so it has no references to give back
+    if (ino != FUSE_ROOT_ID && ino <= get_superblock(fs)->num_inodes) {
+        forget_inode(fs, INODE_NUM(ino), nlookup);
+    }
+    fuse_reply_none(req);
+}
+
+static void ll_forget_multi(fuse_req_t req, size_t count, struct fuse_forget_data *forgets) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    for (size_t i = 0; i < count; i++) {
+        if (forgets[i].ino != FUSE_ROOT_ID && forgets[i].ino <= get_superblock(fs)->num_inodes) {
+            forget_inode(fs, INODE_NUM(forgets[i].ino), forgets[i].nlookup);
+        }
+    }
+    fuse_reply_none(req);
+}
+
+static void serve_getattr(fuse_req_t req, fuse_ino_t ino) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    struct stat stbuf;
+    if (is_stats_num(fs, INODE_NUM(ino))) {
+        ll_stats_stat(fs, INODE_NUM(ino), &stbuf);
+        fuse_reply_attr(req, &stbuf, attr_timeout);
+        return;
+    }
+
+    struct wfs_inode *inode = ll_inode(req, ino, LOCK_SHARED);
+    if (!inode) {
+        return;
+    }
+
+    ll_stat(inode, &stbuf);
+    unlock_inode(fs, inode->num);
+    fuse_reply_attr(req, &stbuf, attr_timeout);
+}
+
+static void ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    uint64_t start = ll_start();
+    serve_getattr(req, ino);
+    ll_count(fs, STATS_GETATTR, start);
+}
+
+// Creates `name` in parent with make, mkdir_at() or mknod_at(), and replies with its entry
+static void serve_make(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode, struct fuse_file_info *fi,
+                       int (*make)(struct wfs_fs *, struct wfs_inode *, const char *, mode_t, int *)) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+
+    // Nothing can be made in /.wfs, or be called .wfs in the root
+    if (stats_child(fs, INODE_NUM(parent), name) >= 0) {
+        ll_reply_err(req, EEXIST);
+        return;
+    }
+    if (is_stats_num(fs, INODE_NUM(parent))) {
+        ll_reply_err(req, EACCES);
+        return;
+    }
+
+    struct wfs_inode *dir_inode = ll_inode(req, parent, LOCK_EXCLUSIVE);
+    if (!dir_inode) {
+        return;
+    }
+
+    int err = 0;
+    int num;
+    if (!S_ISDIR(dir_inode->mode)) {
+        err = ENOTDIR;
+    } else if (dir_inode->nlinks == 0) {
+        err = ENOENT; // Removed while the kernel still had it
+    } else if (strlen(name) >= MAX_NAME) {
+        err = ENAMETOOLONG;
+    } else {
+        int ret = make(fs, dir_inode, name, mode, &num);
+        if (ret != SUCCESS) {
+            err = -ret;
+        }
+    }
+    if (err != 0) {
+        unlock_inode(fs, dir_inode->num);
+        ll_reply_err(req, err);
+        return;
+    }
+
+    lock_inode(fs, num, LOCK_SHARED);
+    unlock_inode(fs, dir_inode->num);
+    struct fuse_entry_param e;
+    ll_entry(fs, get_inode(fs, num), &e);
+    struct wfs_file *file = fi ? open_file(fs, get_inode(fs, num)) : NULL;
+    unlock_inode(fs, num);
+    if (fi && !file) {
+        forget_inode(fs, num, 1);
+        ll_reply_err(req, ENOMEM);
+        return;
+    }
+    if (fi) {
+        fi->fh = (uintptr_t)file;
+    }
+    ll_reply_entry(req, &e, fi);
+}
+
+// serve_make() counted as op
+static void ll_make(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode, struct fuse_file_info *fi,
+                    int (*make)(struct wfs_fs *, struct wfs_inode *, const char *, mode_t, int *), int op) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    uint64_t start = ll_start();
+    serve_make(req, parent, name, mode, fi, make);
+    ll_count(fs, op, start);
+}
+
+static void ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode) {
+    ll_make(req, parent, name, mode, NULL, mkdir_at, STATS_MKDIR);
+}
+
+static void ll_mknod(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode, dev_t rdev) {
+    ll_make(req, parent, name, mode, NULL, mknod_at, STATS_MKNOD);
+}
+
+static void ll_create(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode, struct fuse_file_info *fi) {
+    ll_make(req, parent, name, mode, fi, mknod_at, STATS_MKNOD);
+}
+
+// Removes `name` from parent with remove, unlink_at() or rmdir_at(). The request is counted
+// as op.
+static void ll_remove(fuse_req_t req, fuse_ino_t parent, const char *name,
+                      int (*remove)(struct wfs_fs *, struct wfs_inode *, const char *), int op) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    uint64_t start = ll_start();
+    if (stats_child(fs, INODE_NUM(parent), name) >= 0 || is_stats_num(fs, INODE_NUM(parent))) {
+        ll_reply_err(req, EPERM);
+    } else {
+        struct wfs_inode *dir_inode = ll_inode(req, parent, LOCK_EXCLUSIVE);
+        if (dir_inode) {
+            int ret = S_ISDIR(dir_inode->mode) ? remove(fs, dir_inode, name) : -ENOTDIR;
+            unlock_inode(fs, dir_inode->num);
+            ll_reply_err(req, -ret);
+        }
+    }
+    ll_count(fs, op, start);
+}
+
+static void ll_unlink(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    ll_remove(req, parent, name, unlink_at, STATS_UNLINK);
+}
+
+static void ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    ll_remove(req, parent, name, rmdir_at, STATS_RMDIR);
+}
+
+// Opens the file or directory behind ino into fi->fh. want_dir says which of the two it must be.
+static void ll_open_handle(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi, int want_dir) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    struct wfs_file *file;
+    int num = INODE_NUM(ino);
+    if (is_stats_num(fs, num)) {
+        if ((num == stats_dir_num(fs)) != want_dir || (!want_dir && (fi->flags & O_ACCMODE) != O_RDONLY)) {
+            ll_reply_err(req, want_dir ? ENOTDIR : num == stats_dir_num(fs) ? EISDIR : EACCES);
+            return;
+        }
+
+        // Each open of /.wfs/stats reads a new snapshot, however long, not what the kernel cached
+        file = open_stats(fs, num);
+        fi->direct_io = !want_dir;
+    } else {
+        struct wfs_inode *inode = ll_inode(req, ino, LOCK_SHARED);
+        if (!inode) {
+            return;
+        }
+        int is_dir = S_ISDIR(inode->mode) != 0;
+        if (is_dir != want_dir) {
+            unlock_inode(fs, inode->num);
+            ll_reply_err(req, want_dir ? ENOTDIR : EISDIR);
+            return;
+        }
+
+        file = open_file(fs, inode);
+        unlock_inode(fs, inode->num);
+    }
+    if (!file) {
+        ll_reply_err(req, ENOMEM);
+        return;
+    }
+    fi->fh = (uintptr_t)file;
+    if (fuse_reply_open(req, fi) != 0) {
+        wfs_fs_release(fs, file); // Interrupted, the kernel never got the handle
+    }
+}
+
+static void ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    ll_open_handle(req, ino, fi, 0);
+}
+
+static void ll_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    ll_open_handle(req, ino, fi, 1);
+}
+
+// Closes a handle from open, create or opendir
+static void ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    struct wfs_file *file = FILE_HANDLE(fi);
+    if (file) {
+        wfs_fs_release(fs, file);
+    }
+    ll_reply_err(req, 0);
+}
+
+// fsync and fsyncdir
+static void ll_fsync(fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info *fi) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    ll_reply_err(req, -wfs_fs_fsync(fs, FILE_HANDLE(fi)));
+}
+
+static void ll_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    ll_reply_err(req, -wfs_fs_flush(fs, FILE_HANDLE(fi)));
+}
+
+// Reply buffer for readdir, filled by ll_fill()
+struct ll_dir_buf {
+    fuse_req_t req;
+    fuse_ino_t ino;
+    char *buf;
+    size_t size;
+    size_t used;
+};
+
+// wfs_fill_t for readdir_at(), returns 1 once the buffer is full
+static int ll_fill(void *output_buffer, const char *name, const struct stat *stbuf, off_t offset) {
+    struct ll_dir_buf *dir = output_buffer;
+
+    // "." and ".." come without a stat, readdir only cares that they are directories
+    struct stat entry_stat;
+    memset(&entry_stat, 0, sizeof(struct stat));
+    entry_stat.st_ino = stbuf ? NODE_ID(stbuf->st_ino) : dir->ino;
+    entry_stat.st_mode = stbuf ? stbuf->st_mode : S_IFDIR;
+
+    size_t len = fuse_add_direntry(dir->req, dir->buf + dir->used, dir->size - dir->used, name, &entry_stat, offset);
+    if (len > dir->size - dir->used) {
+        return 1;
+    }
+    dir->used += len;
+    return 0;
+}
+
+static void serve_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, struct fuse_file_info *fi) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    struct wfs_file *file = FILE_HANDLE(fi);
+
+    // /.wfs has no inode to lock, the core lists it
+    if (file && is_stats_num(fs, file->num)) {
+        struct ll_dir_buf dir = {req, ino, malloc(size), size, 0};
+        if (!dir.buf) {
+            ll_reply_err(req, ENOMEM);
+            return;
+        }
+        wfs_fs_readdir(fs, NULL, file, offset, &dir, ll_fill);
+        fuse_reply_buf(req, dir.buf, dir.used);
+        free(dir.buf);
+        return;
+    }
+
+    struct wfs_inode *dir_inode = ll_file_inode(req, ino, file, LOCK_SHARED);
+    if (!dir_inode) {
+        return;
+    }
+    if (!S_ISDIR(dir_inode->mode)) {
+        unlock_inode(fs, dir_inode->num);
+        ll_reply_err(req, ENOTDIR);
+        return;
+    }
+
+    struct ll_dir_buf dir = {req, ino, malloc(size), size, 0};
+    if (!dir.buf) {
+        unlock_inode(fs, dir_inode->num);
+        ll_reply_err(req, ENOMEM);
+        return;
+    }
+    readdir_at(fs, dir_inode, offset, &dir, ll_fill);
+    unlock_inode(fs, dir_inode->num);
+
+    fuse_reply_buf(req, dir.buf, dir.used);
+    free(dir.buf);
+}
+
+static void ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, struct fuse_file_info *fi) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    uint64_t start = ll_start();
+    serve_readdir(req, ino, size, offset, fi);
+    ll_count(fs, STATS_READDIR, start);
+}
+
+static void serve_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, struct fuse_file_info *fi) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    struct wfs_file *file = FILE_HANDLE(fi);
+    struct fuse_bufvec *buf;
+
+    // From the snapshot the handle to /.wfs/stats took
+    if (file && is_stats_num(fs, file->num)) {
+        int ret = wfs_fs_read_buf(fs, NULL, file, &buf, size, offset);
+        if (ret < 0) {
+            ll_reply_err(req, -ret);
+            return;
+        }
+        fuse_reply_data(req, buf, FUSE_BUF_SPLICE_MOVE);
+        free_bufvec(buf);
+        return;
+    }
+
+    struct wfs_inode *inode = ll_file_inode(req, ino, file, LOCK_SHARED);
+    if (!inode) {
+        return;
+    }
+    if (!S_ISREG(inode->mode)) {
+        unlock_inode(fs, inode->num);
+        ll_reply_err(req, EISDIR);
+        return;
+    }
+
+    struct wfs_map map;
+    int ret = read_at(fs, inode, file, &map, size, offset);
+    buf = ret < 0 ? NULL : map_to_bufvec(&map);
+    if (!buf) {
+        unlock_inode(fs, inode->num);
+        ll_reply_err(req, ret < 0 ? -ret : ENOMEM);
+        return;
+    }
+
+    // Unlike the path API, the reply goes out before the lock is dropped, so a write to the
+    // same range can't land in the middle of it
+    fuse_reply_data(req, buf, FUSE_BUF_SPLICE_MOVE);
+    unlock_inode(fs, inode->num);
+    free_bufvec(buf);
+}
+
+static void ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, struct fuse_file_info *fi) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    uint64_t start = ll_start();
+    serve_read(req, ino, size, offset, fi);
+    ll_count(fs, STATS_READ, start);
+}
+
+static void serve_write(fuse_req_t req, fuse_ino_t ino, struct fuse_bufvec *bufv, off_t offset, struct fuse_file_info *fi) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    struct wfs_file *file = FILE_HANDLE(fi);
+    if (file && is_stats_num(fs, file->num)) {
+        ll_reply_err(req, EACCES);
+        return;
+    }
+
+    struct wfs_inode *inode = ll_file_inode(req, ino, file, LOCK_EXCLUSIVE);
+    if (!inode) {
+        return;
+    }
+    if (!S_ISREG(inode->mode)) {
+        unlock_inode(fs, inode->num);
+        ll_reply_err(req, EISDIR);
+        return;
+    }
+
+    struct wfs_source src = bufvec_source(bufv);
+    int ret = write_at(fs, inode, file, &src, offset);
+    unlock_inode(fs, inode->num);
+    if (ret < 0) {
+        ll_reply_err(req, -ret);
+    } else {
+        fuse_reply_write(req, ret);
+    }
+}
+
+static void ll_write_buf(fuse_req_t req, fuse_ino_t ino, struct fuse_bufvec *bufv, off_t offset, struct fuse_file_info *fi) {
+    struct wfs_fs *fs = fuse_req_userdata(req);
+    uint64_t start = ll_start();
+    serve_write(req, ino, bufv, offset, fi);
+    ll_count(fs, STATS_WRITE, start);
+}
+
+// Starts the filesystem's threads once FUSE is up, as wfs_init() does for the path API
+static void ll_init(void *userdata, struct fuse_conn_info *conn) {
+    // Let FUSE splice file data between the kernel and the images, see ll_read()
+    conn->want |= conn->capable & (FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_READ);
+    wfs_fs_start(userdata);
+    stats_signal_start(userdata);
+}
+
+static void ll_destroy(void *userdata) {
+    wfs_fs_stop(userdata);
+}
+
+static struct fuse_lowlevel_ops ll_ops = {
+    .init = ll_init,
+    .destroy = ll_destroy,
+    .lookup = ll_lookup,
+    .forget = ll_forget,
+    .forget_multi = ll_forget_multi,
+    .getattr = ll_getattr,
+    .mkdir = ll_mkdir,
+    .mknod = ll_mknod,
+    .create = ll_create,
+    .open = ll_open,
+    .release = ll_release,
+    .opendir = ll_opendir,
+    .releasedir = ll_release,
+    .flush = ll_flush,
+    .fsync = ll_fsync,
+    .fsyncdir = ll_fsync,
+    .unlink = ll_unlink,
+    .rmdir = ll_rmdir,
+    .readdir = ll_readdir,
+    .read = ll_read,
+    .write_buf = ll_write_buf,
+};
+
+// Mounts and serves requests for fs until unmounted, like fuse_main() does for the path API
+int wfs_ll_main(int argc, char *argv[], struct wfs_fs *fs) {
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    char *mountpoint;
+    int multithreaded;
+    int foreground;
+    int err = -1;
+    if (fuse_parse_cmdline(&args, &mountpoint, &multithreaded, &foreground) != -1 && mountpoint) {
+        struct fuse_chan *ch = fuse_mount(mountpoint, &args);
+        if (ch) {
+            struct fuse_session *se = fuse_lowlevel_new(&args, &ll_ops, sizeof(ll_ops), fs);
+            if (se) {
+                if (fuse_set_signal_handlers(se) != -1) {
+                    fuse_session_add_chan(se, ch);
+                    if (fuse_daemonize(foreground) != -1) {
+                        err = multithreaded ? fuse_session_loop_mt(se) : fuse_session_loop(se);
+                    }
+                    fuse_remove_signal_handlers(se);
+                    fuse_session_remove_chan(ch);
+                }
+                fuse_session_destroy(se);
+            }
+            fuse_unmount(mountpoint, ch);
+        }
+        free(mountpoint);
+    }
+    fuse_opt_free_args(&args);
+    return err ? FAIL : SUCCESS;
+}
@@ -0,0 +1,847 @@
+#include <stdarg.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "wfs.h"
+#include "crc32c.h"
+
+/*
+  Offline checker for wfs images: ./wfsck [-y] [-j threads] <disk> [<disk> ...]
+
+  The disks are mapped whole and checked in passes, each spread over the
+  threads:
+  1. Entries: every directory's entries are counted per inode they name, so
+     link counts and unreachable inodes can be told without a walk from the
+     root.
+  2. Blocks: every allocated inode marks the data, directory, index, indirect
+     and extent blocks it uses in a bitmap per disk, which catches blocks used
+     twice.
+  3. Mirrors: the copies of the metadata are compared. RAID 1 and 1v mirror
+     the bitmaps, the inode table and the metadata blocks, RAID 0 the inode
+     bitmap and the inode table.
+  4. Bitmaps: the data bitmaps are compared with what pass 2 found in use.
+
+  With -y, leaked blocks are freed, blocks in use but free in the bitmap
+  are marked used, and inodes no entry names (orphans) are freed with their
+  blocks, on every copy. Nothing else is changed. Run it on unmounted images.
+*/
+
+size_t block_size = DEFAULT_BLOCK_SIZE;
+
+// Exit codes, as fsck(8) has them
+#define FSCK_OK        0
+#define FSCK_CORRECTED 1
+#define FSCK_ERRORS    4
+#define FSCK_FAILED    8
+
+#define MAX_REPORTS    50           // Problems printed per kind, the rest are only counted
+#define INODE_BATCH    256          // Inodes a thread takes from the pass at a time
+#define WORD_BATCH     1024         // Bitmap words, 64 blocks each
+#define COMPARE_CHUNK  (1 << 20)    // Bytes of the replicated regions
+#define MAX_THREADS    64
+
+enum problem {
+    BAD_INODE,          // Fields of an allocated inode that make no sense
+    BAD_POINTER,        // Block address outside the data region
+    BAD_BLOCK,          // Index or extent block without its magic or with a bad count
+    SHARED_BLOCK,       // Used twice
+    USED_FREE_BLOCK,    // Used, but free in the bitmap
+    LEAKED_BLOCK,       // Allocated in the bitmap, used by nothing
+    BAD_DENTRY,         // Names an inode that is out of range or free
+    LINK_COUNT,
+    ORPHAN,             // Allocated inode no entry names, or with no links
+    MIRROR,             // Copies of replicated metadata differ
+    JOURNAL,            // Damaged journal header
+    NUM_PROBLEMS
+};
+
+static const char *problem_names[NUM_PROBLEMS] = {
+    [BAD_INODE] = "bad inodes",
+    [BAD_POINTER] = "bad block pointers",
+    [BAD_BLOCK] = "bad index or extent blocks",
+    [SHARED_BLOCK] = "blocks used more than once",
+    [USED_FREE_BLOCK] = "used blocks marked free",
+    [LEAKED_BLOCK] = "leaked blocks",
+    [BAD_DENTRY] = "bad directory entries",
+    [LINK_COUNT] = "wrong link counts",
+    [ORPHAN] = "orphan inodes",
+    [MIRROR] = "mirror differences",
+    [JOURNAL] = "damaged journals",
+};
+
+static unsigned long problems[NUM_PROBLEMS];
+static unsigned long repaired[NUM_PROBLEMS];
+static pthread_mutex_t report_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int num_disks;
+static int raid_mode;
+static void *disk_region[MAX_DISKS];
+static char *disk_names[MAX_DISKS];
+static size_t disk_sizes[MAX_DISKS];
+static struct wfs_sb *sb;
+static uint32_t features;
+static size_t stripe_blocks = 1;
+static int num_dentries;            // Per legacy directory block
+static int repair;
+static int num_threads;
+
+// Filled in by the passes
+static uint32_t *links;             // Entries naming each inode
+static uint64_t *used[MAX_DISKS];   // Blocks found in use, per disk
+static uint64_t *meta;              // Metadata blocks of the mirrored modes, compared in pass 3
+static uint64_t *orphans;           // Inodes to free with -y, once pass 2 is done
+static size_t bitmap_words;         // Of used[] and meta
+static unsigned long dirs_seen, files_seen;
+
+static void report(enum problem kind, const char *fmt, ...) {
+    unsigned long n = __atomic_add_fetch(&problems[kind], 1, __ATOMIC_RELAXED);
+    if (n > MAX_REPORTS) {
+        return;
+    }
+    pthread_mutex_lock(&report_lock);
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    printf(n == MAX_REPORTS ? "\n(further %s not listed)\n" : "\n", problem_names[kind]);
+    pthread_mutex_unlock(&report_lock);
+}
+
+// ------------------------------------------Layout------------------------------------------------
+
+static int mirrored() {
+    return raid_mode != 0;
+}
+
+static int bit_test(const unsigned char *bits, size_t i) {
+    return (bits[i / 8] >> (i % 8)) & 1;
+}
+
+static void bit_set(unsigned char *bits, size_t i, int value) {
+    if (value) {
+        bits[i / 8] |= 1 << (i % 8);
+    } else {
+        bits[i / 8] &= ~(1 << (i % 8));
+    }
+}
+
+static unsigned char *inode_bitmap(int disk) {
+    return (unsigned char *)DISK_MAP_PTR(disk, sb->i_bitmap_ptr);
+}
+
+static unsigned char *data_bitmap(int disk) {
+    return (unsigned char *)DISK_MAP_PTR(disk, sb->d_bitmap_ptr);
+}
+
+static off_t inode_offset(size_t num) {
+    if (features & WFS_FEATURE_DENSE_INODES) {
+        return sb->i_blocks_ptr + (off_t)(num / INODES_PER_BLOCK) * BLOCK_SIZE +
+               (num % INODES_PER_BLOCK) * sizeof(struct wfs_inode);
+    }
+    return sb->i_blocks_ptr + (off_t)num * BLOCK_SIZE;
+}
+
+// Disk 0 holds the copy of the inode table wfs reads
+static struct wfs_inode *get_inode(size_t num) {
+    return (struct wfs_inode *)DISK_MAP_PTR(0, inode_offset(num));
+}
+
+static off_t data_end() {
+    return sb->d_blocks_ptr + (off_t)sb->num_data_blocks * BLOCK_SIZE;
+}
+
+// Index of the data block at addr, -1 if addr isn't the start of one
+static long block_index(off_t addr) {
+    if (addr < sb->d_blocks_ptr || addr >= data_end() || (addr - sb->d_blocks_ptr) % BLOCK_SIZE != 0) {
+        return -1;
+    }
+    return (addr - sb->d_blocks_ptr) / BLOCK_SIZE;
+}
+
+// Same as wfs.c: which disk holds file block `block` of a legacy file
+static int file_block_disk(size_t block) {
+    return raid_mode == 0 ? (block / stripe_blocks) % num_disks : 0;
+}
+
+// Disk of block i of a legacy directory
+static int dir_block_disk(int i) {
+    return raid_mode == 0 ? i % num_disks : 0;
+}
+
+// The block at addr on disk if it is one, NULL otherwise
+static char *block_ptr(int disk, off_t addr) {
+    if (disk < 0 || disk >= num_disks || block_index(addr) < 0) {
+        return NULL;
+    }
+    return DISK_MAP_PTR(disk, addr);
+}
+
+// Runs work over [0, total) in batches on every thread
+struct pass {
+    void (*work)(size_t first, size_t end);
+    size_t total;
+    size_t batch;
+    size_t next;
+};
+
+static void *pass_thread(void *arg) {
+    struct pass *p = arg;
+    for (;;) {
+        size_t first = __atomic_fetch_add(&p->next, p->batch, __ATOMIC_RELAXED);
+        if (first >= p->total) {
+            return NULL;
+        }
+        p->work(first, MIN(first + p->batch, p->total));
+    }
+}
+
+static void run_pass(void (*work)(size_t first, size_t end), size_t total, size_t batch) {
+    struct pass p = {.work = work, .total = total, .batch = batch};
+    pthread_t tids[MAX_THREADS];
+    int started = 0;
+    for (int i = 1; i < num_threads; i++) {
+        if (pthread_create(&tids[started], NULL, pass_thread, &p) == 0) {
+            started++;
+        }
+    }
+    pass_thread(&p);
+    for (int i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+}
+
+// ------------------------------------Pass 1: directory entries------------------------------------
+
+static void count_entry(struct wfs_inode *dir, struct wfs_dentry *dentry, unsigned long *entries) {
+    if (dentry->name[0] == '\0') {
+        return;
+    }
+    (*entries)++;
+    int num = dentry->num;
+    if (num <= 0 || (size_t)num >= sb->num_inodes || !bit_test(inode_bitmap(0), num)) {
+        report(BAD_DENTRY, "directory %d: entry \"%.*s\" names %s inode %d", dir->num,
+               MAX_NAME, dentry->name, num <= 0 || (size_t)num >= sb->num_inodes ? "invalid" : "free", num);
+        return;
+    }
+    __atomic_add_fetch(&links[num], 1, __ATOMIC_RELAXED);
+}
+
+// Counts the entries under dx node `block`, which should be `level` levels above the leaves.
+// Damaged nodes are skipped here and reported by pass 2.
+static void dx_count(struct wfs_inode *dir, off_t block, int level, unsigned long *entries) {
+    struct wfs_dx_header *node = (struct wfs_dx_header *)block_ptr(0, block);
+    if (!node || node->magic != DX_MAGIC || node->level != level) {
+        return;
+    }
+    if (level == 0) {
+        struct wfs_dx_entry *ent = (struct wfs_dx_entry *)(node + 1);
+        for (size_t i = 0; i < MIN(node->count, DX_LEAF_ENTRIES); i++) {
+            count_entry(dir, &ent[i].dentry, entries);
+        }
+        return;
+    }
+    struct wfs_dx_index *idx = (struct wfs_dx_index *)(node + 1);
+    for (size_t i = 0; i < MIN(node->count, DX_INDEX_ENTRIES); i++) {
+        dx_count(dir, idx[i].block, level - 1, entries);
+    }
+}
+
+static void count_dir(struct wfs_inode *dir) {
+    unsigned long entries = 0;
+    if (features & WFS_FEATURE_DIR_INDEX) {
+        struct wfs_dx_header *root = (struct wfs_dx_header *)block_ptr(0, dir->blocks[0]);
+        if (root && root->magic == DX_MAGIC && root->level < DX_MAX_DEPTH) {
+            dx_count(dir, dir->blocks[0], root->level, &entries);
+        }
+    } else {
+        for (int i = 0; i <= D_BLOCK; i++) {
+            char *block = block_ptr(dir_block_disk(i), dir->blocks[i]);
+            if (!block) {
+                continue;
+            }
+            for (int j = 0; j < num_dentries; j++) {
+                count_entry(dir, (struct wfs_dentry *)block + j, &entries);
+            }
+        }
+    }
+
+    // Directories count . and their parent's entry, and one more for every entry in them
+    if (dir->nlinks != 0 && (unsigned long)dir->nlinks != entries + 2) {
+        report(LINK_COUNT, "directory %d: %d links, %lu entries", dir->num, dir->nlinks, entries);
+    }
+}
+
+static void count_entries(size_t first, size_t end) {
+    for (size_t num = first; num < end; num++) {
+        if (!bit_test(inode_bitmap(0), num)) {
+            continue;
+        }
+        struct wfs_inode *inode = get_inode(num);
+        if (S_ISDIR(inode->mode)) {
+            count_dir(inode);
+        }
+    }
+}
+
+// ------------------------------------Pass 2: blocks in use------------------------------------
+
+// Marks the block at addr on disk as used by inode num. Returns 0 if it isn't a block or was
+// already used, in which case whatever it points to has been or can't be checked.
+static int use_block(int num, int disk, off_t addr, const char *what) {
+    long i = block_index(addr);
+    if (i < 0 || disk < 0 || disk >= num_disks) {
+        report(BAD_POINTER, "inode %d: %s block %ld on disk %d is not in the data region", num, what, (long)addr, disk);
+        return 0;
+    }
+    uint64_t bit = (uint64_t)1 << (i % 64);
+    if (__atomic_fetch_or(&used[disk][i / 64], bit, __ATOMIC_RELAXED) & bit) {
+        report(SHARED_BLOCK, "inode %d: %s block %ld on disk %d is used more than once", num, what, i, disk);
+        return 0;
+    }
+    return 1;
+}
+
+// Blocks holding metadata, the ones whose mirror copies are compared
+static int use_meta(int num, int disk, off_t addr, const char *what) {
+    if (!use_block(num, disk, addr, what)) {
+        return 0;
+    }
+    if (mirrored()) {
+        long i = block_index(addr);
+        __atomic_fetch_or(&meta[i / 64], (uint64_t)1 << (i % 64), __ATOMIC_RELAXED);
+    }
+    return 1;
+}
+
+static void use_dx(int num, off_t block, int level) {
+    if (!use_meta(num, 0, block, "index")) {
+        return;
+    }
+    struct wfs_dx_header *node = (struct wfs_dx_header *)DISK_MAP_PTR(0, block);
+    size_t max = level == 0 ? DX_LEAF_ENTRIES : DX_INDEX_ENTRIES;
+    if (node->magic != DX_MAGIC || node->level != level || node->count > max) {
+        report(BAD_BLOCK, "directory %d: index block %ld is not a level %d node", num,
+               block_index(block), level);
+        return;
+    }
+    if (level > 0) {
+        struct wfs_dx_index *idx = (struct wfs_dx_index *)(node + 1);
+        for (size_t i = 0; i < node->count; i++) {
+            use_dx(num, idx[i].block, level - 1);
+        }
+    }
+}
+
+static void use_dir_blocks(struct wfs_inode *dir) {
+    if (features & WFS_FEATURE_DIR_INDEX) {
+        if (dir->blocks[0] == 0) {
+            return;
+        }
+        struct wfs_dx_header *root = (struct wfs_dx_header *)block_ptr(0, dir->blocks[0]);
+        int level = root && root->level < DX_MAX_DEPTH ? root->level : 0;
+        use_dx(dir->num, dir->blocks[0], level);
+        return;
+    }
+    for (int i = 0; i <= D_BLOCK; i++) {
+        if (dir->blocks[i] != 0) {
+            use_meta(dir->num, dir_block_disk(i), dir->blocks[i], "directory");
+        }
+    }
+}
+
+// Indirect block `level` levels above the data blocks, the first of which is file block `first`
+static void use_indirect(int num, off_t block, int level, size_t first) {
+    if (!use_meta(num, 0, block, "indirect")) {
+        return;
+    }
+    off_t *ptrs = (off_t *)DISK_MAP_PTR(0, block);
+    size_t span = 1;
+    for (int i = 1; i < level; i++) {
+        span *= PTRS_PER_BLOCK;
+    }
+    for (size_t i = 0; i < PTRS_PER_BLOCK; i++) {
+        if (ptrs[i] == 0) {
+            continue;
+        }
+        if (level > 1) {
+            use_indirect(num, ptrs[i], level - 1, first + i * span);
+        } else {
+            use_block(num, file_block_disk(first + i), ptrs[i], "data");
+        }
+    }
+}
+
+static void use_extent_slots(int num, struct wfs_extent *ext, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (ext[i].len == 0) {
+            continue;
+        }
+        off_t last = ext[i].start + (off_t)(ext[i].len - 1) * BLOCK_SIZE;
+        if (ext[i].disk >= num_disks || (mirrored() && ext[i].disk != 0) ||
+            block_index(ext[i].start) < 0 || block_index(last) < 0) {
+            report(BAD_POINTER, "inode %d: extent of %u blocks at %ld on disk %u is not in the data region",
+                   num, ext[i].len, (long)ext[i].start, ext[i].disk);
+            continue;
+        }
+        for (uint32_t j = 0; j < ext[i].len; j++) {
+            use_block(num, ext[i].disk, ext[i].start + (off_t)j * BLOCK_SIZE, "data");
+        }
+    }
+}
+
+static void use_file_blocks(struct wfs_inode *inode) {
+    int num = inode->num;
+    if (features & WFS_FEATURE_EXTENTS) {
+        struct wfs_extent_root *root = (struct wfs_extent_root *)inode->blocks;
+        if (root->count > EXT_ROOT_ENTRIES) {
+            report(BAD_INODE, "inode %d: %u extents in the inode, room for %d", num, root->count, EXT_ROOT_ENTRIES);
+        }
+        use_extent_slots(num, root->ext, MIN(root->count, EXT_ROOT_ENTRIES));
+        for (off_t next = root->next; next != 0; ) {
+            if (!use_meta(num, 0, next, "extent")) {
+                return;
+            }
+            struct wfs_extent_block *eb = (struct wfs_extent_block *)DISK_MAP_PTR(0, next);
+            if (eb->magic != EXT_MAGIC || eb->count > EXT_BLOCK_ENTRIES) {
+                report(BAD_BLOCK, "inode %d: extent block %ld is damaged", num, block_index(next));
+                return;
+            }
+            use_extent_slots(num, eb->ext, eb->count);
+            next = eb->next;
+        }
+        return;
+    }
+
+    for (int i = 0; i < IND_BLOCK; i++) {
+        if (inode->blocks[i] != 0) {
+            use_block(num, file_block_disk(i), inode->blocks[i], "data");
+        }
+    }
+    off_t roots[MAX_IND_LEVEL] = {inode->blocks[IND_BLOCK], inode->dind_block, inode->tind_block};
+    size_t first = IND_BLOCK;
+    size_t span = PTRS_PER_BLOCK;
+    for (int level = 1; level <= MAX_IND_LEVEL; level++) {
+        if (roots[level - 1] != 0) {
+            use_indirect(num, roots[level - 1], level, first);
+        }
+        first += span;
+        span *= PTRS_PER_BLOCK;
+    }
+}
+
+static void use_blocks(size_t first, size_t end) {
+    for (size_t num = first; num < end; num++) {
+        if (!bit_test(inode_bitmap(0), num)) {
+            continue;
+        }
+        struct wfs_inode *inode = get_inode(num);
+        if (inode->num != (int)num) {
+            report(BAD_INODE, "inode %zu: has number %d", num, inode->num);
+        }
+        if (!S_ISDIR(inode->mode) && !S_ISREG(inode->mode)) {
+            report(BAD_INODE, "inode %zu: mode %o is neither a directory nor a file", num, inode->mode);
+            continue;
+        }
+        if (num == 0 && !S_ISDIR(inode->mode)) {
+            report(BAD_INODE, "inode 0: the root is not a directory");
+            continue;
+        }
+
+        // Blocks of an orphan that is freed are left unused, so pass 4 frees them too
+        if (num != 0 && (links[num] == 0 || inode->nlinks == 0)) {
+            report(ORPHAN, "inode %zu: %s with %d links named by %u entries%s", num,
+                   S_ISDIR(inode->mode) ? "directory" : "file", inode->nlinks, links[num],
+                   repair ? ", freed" : "");
+            if (repair) {
+                __atomic_fetch_or(&orphans[num / 64], (uint64_t)1 << (num % 64), __ATOMIC_RELAXED);
+                continue;
+            }
+        }
+
+        if (S_ISDIR(inode->mode)) {
+            __atomic_add_fetch(&dirs_seen, 1, __ATOMIC_RELAXED);
+            if (num != 0 && links[num] > 1) {
+                report(LINK_COUNT, "directory %zu: named by %u entries", num, links[num]);
+            }
+            use_dir_blocks(inode);
+        } else {
+            __atomic_add_fetch(&files_seen, 1, __ATOMIC_RELAXED);
+            if (links[num] != 0 && inode->nlinks != 0 && (uint32_t)inode->nlinks != links[num]) {
+                report(LINK_COUNT, "inode %zu: %d links, named by %u entries", num, inode->nlinks, links[num]);
+            }
+            use_file_blocks(inode);
+        }
+    }
+}
+
+// --------------------------------------Pass 3: mirror copies--------------------------------------
+
+// What the replicated byte at offset holds, for reports
+static void describe(off_t offset, char *buf, size_t len) {
+    if (offset < sb->d_bitmap_ptr) {
+        snprintf(buf, len, "inode bitmap byte %ld", (long)(offset - sb->i_bitmap_ptr));
+    } else if (offset < sb->i_blocks_ptr) {
+        snprintf(buf, len, "data bitmap byte %ld", (long)(offset - sb->d_bitmap_ptr));
+    } else if (offset < sb->d_blocks_ptr) {
+        size_t block = (offset - sb->i_blocks_ptr) / BLOCK_SIZE;
+        if (features & WFS_FEATURE_DENSE_INODES) {
+            snprintf(buf, len, "inode table block %zu (inodes %zu to %zu)", block,
+                     block * INODES_PER_BLOCK, (block + 1) * INODES_PER_BLOCK - 1);
+        } else {
+            snprintf(buf, len, "inode %zu", block);
+        }
+    } else {
+        snprintf(buf, len, "metadata block %ld", block_index(offset));
+    }
+}
+
+// Compares [start, end) of every disk with disk 0, reporting each block-sized piece that differs
+static void compare_range(off_t start, off_t end) {
+    for (int disk = 1; disk < num_disks; disk++) {
+        if (memcmp(DISK_MAP_PTR(0, start), DISK_MAP_PTR(disk, start), end - start) == 0) {
+            continue;
+        }
+        for (off_t piece = start; piece < end; piece = (piece / BLOCK_SIZE + 1) * BLOCK_SIZE) {
+            off_t piece_end = MIN((off_t)((piece / BLOCK_SIZE + 1) * BLOCK_SIZE), end);
+            if (memcmp(DISK_MAP_PTR(0, piece), DISK_MAP_PTR(disk, piece), piece_end - piece) != 0) {
+                char what[80];
+                describe(piece, what, sizeof(what));
+                report(MIRROR, "%s differs between %s and %s", what, disk_names[0], disk_names[disk]);
+            }
+        }
+    }
+}
+
+// The replicated regions before the data blocks, in chunks: everything after the superblock
+// for the mirrored modes, the inode bitmap and the inode table for RAID 0
+static off_t compare_start, compare_end;
+
+static void compare_chunks(size_t first, size_t end) {
+    for (size_t chunk = first; chunk < end; chunk++) {
+        off_t start = compare_start + (off_t)chunk * COMPARE_CHUNK;
+        off_t stop = MIN(start + COMPARE_CHUNK, compare_end);
+        if (raid_mode == 0) {
+            // The data bitmaps belong to their disk
+            if (start < sb->d_bitmap_ptr) {
+                compare_range(start, MIN(stop, sb->d_bitmap_ptr));
+            }
+            if (stop > sb->i_blocks_ptr) {
+                compare_range(start > sb->i_blocks_ptr ? start : sb->i_blocks_ptr, stop);
+            }
+        } else {
+            compare_range(start, stop);
+        }
+    }
+}
+
+static void compare_meta(size_t first, size_t end) {
+    for (size_t w = first; w < end; w++) {
+        for (uint64_t bits = meta[w]; bits != 0; bits &= bits - 1) {
+            off_t addr = sb->d_blocks_ptr + (off_t)(w * 64 + __builtin_ctzll(bits)) * BLOCK_SIZE;
+            compare_range(addr, addr + BLOCK_SIZE);
+        }
+    }
+}
+
+// --------------------------------------Pass 4: data bitmaps--------------------------------------
+
+// Disk whose data bitmap pass 4 is checking. The mirrored modes check disk 0 and repair all.
+static int bitmap_disk;
+
+static void set_data_bit(size_t i, int value) {
+    for (int disk = 0; disk < num_disks; disk++) {
+        if (disk == bitmap_disk || mirrored()) {
+            bit_set(data_bitmap(disk), i, value);
+        }
+    }
+}
+
+// Batches are whole words, so no two threads touch the same bitmap byte
+static void check_bitmap(size_t first, size_t end) {
+    unsigned char *bits = data_bitmap(bitmap_disk);
+    for (size_t w = first; w < end; w++) {
+        size_t nbits = MIN(64, sb->num_data_blocks - w * 64);
+        uint64_t on_disk = 0;
+        memcpy(&on_disk, bits + w * 8, (nbits + 7) / 8);
+        if (nbits < 64) {
+            on_disk &= ((uint64_t)1 << nbits) - 1;
+        }
+        uint64_t in_use = used[bitmap_disk][w];
+
+        for (uint64_t leaked = on_disk & ~in_use; leaked != 0; leaked &= leaked - 1) {
+            size_t i = w * 64 + __builtin_ctzll(leaked);
+            report(LEAKED_BLOCK, "block %zu on disk %d is allocated but not used%s", i, bitmap_disk,
+                   repair ? ", freed" : "");
+            if (repair) {
+                set_data_bit(i, 0);
+                __atomic_add_fetch(&repaired[LEAKED_BLOCK], 1, __ATOMIC_RELAXED);
+            }
+        }
+        for (uint64_t missing = in_use & ~on_disk; missing != 0; missing &= missing - 1) {
+            size_t i = w * 64 + __builtin_ctzll(missing);
+            report(USED_FREE_BLOCK, "block %zu on disk %d is used but free in the bitmap%s", i, bitmap_disk,
+                   repair ? ", marked used" : "");
+            if (repair) {
+                set_data_bit(i, 1);
+                __atomic_add_fetch(&repaired[USED_FREE_BLOCK], 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+}
+
+// ------------------------------------------Setup------------------------------------------------
+
+// Number of committed transactions waiting in disk's journal to be replayed, -1 if its header
+// is damaged. Mirrors the first step of journal_replay() in journal.c.
+static int journal_pending(int disk) {
+    off_t end = data_end();
+    if (features & WFS_FEATURE_CHECKSUMS) {
+        end += sb->num_data_blocks * CSUM_SIZE;
+    }
+    off_t offset = (end + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+    if (offset + BLOCK_SIZE > disk_sizes[disk]) {
+        return -1;
+    }
+    struct wfs_journal_header *hdr = (struct wfs_journal_header *)DISK_MAP_PTR(disk, offset);
+    if (hdr->magic != JOURNAL_MAGIC || hdr->size <= BLOCK_SIZE || offset + hdr->size > disk_sizes[disk]) {
+        return -1;
+    }
+
+    struct wfs_journal_txn *txn = (struct wfs_journal_txn *)((char *)hdr + BLOCK_SIZE);
+    size_t covered = sizeof(*txn) - offsetof(struct wfs_journal_txn, sequence);
+    if (BLOCK_SIZE + sizeof(*txn) > hdr->size || txn->magic != JOURNAL_TXN_MAGIC ||
+        txn->sequence != hdr->sequence || txn->len > hdr->size - BLOCK_SIZE - sizeof(*txn) ||
+        crc32c(&txn->sequence, covered + txn->len) != txn->crc) {
+        return 0;
+    }
+    return 1;
+}
+
+// Maps every disk and puts RAID 0 disks in disk_id order
+static int open_disks() {
+    for (int i = 0; i < num_disks; i++) {
+        int fd = open(disk_names[i], repair ? O_RDWR : O_RDONLY);
+        if (fd == -1) {
+            printf("Failed to open %s\n", disk_names[i]);
+            return FAIL;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(struct wfs_sb)) {
+            printf("%s is too small to hold a superblock\n", disk_names[i]);
+            close(fd);
+            return FAIL;
+        }
+        disk_sizes[i] = st.st_size;
+        disk_region[i] = mmap(NULL, st.st_size, repair ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (disk_region[i] == MAP_FAILED) {
+            printf("Failed to mmap %s\n", disk_names[i]);
+            return FAIL;
+        }
+    }
+
+    struct wfs_sb *first = (struct wfs_sb *)disk_region[0];
+    raid_mode = first->raid_mode;
+    if (raid_mode < 0 || raid_mode > 2) {
+        printf("%s has no wfs superblock\n", disk_names[0]);
+        return FAIL;
+    }
+
+    // The superblocks only differ in disk_id
+    for (int i = 1; i < num_disks; i++) {
+        struct wfs_sb a = *first, b = *(struct wfs_sb *)disk_region[i];
+        a.disk_id = b.disk_id = 0;
+        if (memcmp(&a, &b, sizeof(a)) != 0) {
+            printf("%s and %s are not disks of the same filesystem\n", disk_names[0], disk_names[i]);
+            return FAIL;
+        }
+    }
+
+    if (raid_mode == 0) {
+        void *regions[MAX_DISKS] = {0};
+        char *names[MAX_DISKS];
+        size_t sizes[MAX_DISKS];
+        for (int i = 0; i < num_disks; i++) {
+            int id = ((struct wfs_sb *)disk_region[i])->disk_id;
+            if (id < 0 || id >= num_disks || regions[id]) {
+                printf("RAID 0 needs every disk once, %s has disk id %d\n", disk_names[i], id);
+                return FAIL;
+            }
+            regions[id] = disk_region[i];
+            names[id] = disk_names[i];
+            sizes[id] = disk_sizes[i];
+        }
+        memcpy(disk_region, regions, sizeof(regions));
+        memcpy(disk_names, names, num_disks * sizeof(char *));
+        memcpy(disk_sizes, sizes, num_disks * sizeof(size_t));
+    }
+
+    sb = (struct wfs_sb *)disk_region[0];
+    if (sb->i_bitmap_ptr >= sizeof(struct wfs_sb)) {
+        features = sb->features;
+        block_size = sb->block_bits ? (size_t)1 << sb->block_bits : DEFAULT_BLOCK_SIZE;
+        stripe_blocks = (size_t)1 << sb->stripe_bits;
+    }
+    if (block_size < MIN_BLOCK_SIZE || block_size > MAX_BLOCK_SIZE) {
+        printf("Unsupported block size %zu\n", block_size);
+        return FAIL;
+    }
+    num_dentries = BLOCK_SIZE / sizeof(struct wfs_dentry);
+
+    if (sb->num_inodes == 0 || sb->i_bitmap_ptr >= sb->d_bitmap_ptr || sb->d_bitmap_ptr > sb->i_blocks_ptr ||
+        inode_offset(sb->num_inodes) > sb->d_blocks_ptr) {
+        printf("The superblock of %s is damaged\n", disk_names[0]);
+        return FAIL;
+    }
+    for (int i = 0; i < num_disks; i++) {
+        if (disk_sizes[i] < (size_t)data_end()) {
+            printf("%s is smaller than the filesystem on it\n", disk_names[i]);
+            return FAIL;
+        }
+    }
+    return SUCCESS;
+}
+
+static double elapsed(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-y") == 0) {
+            repair = 1;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+            if (num_threads <= 0) {
+                printf("Thread count must be a positive number\n");
+                return FSCK_FAILED;
+            }
+        } else if (argv[i][0] == '-') {
+            printf("Unknown option %s\n", argv[i]);
+            return FSCK_FAILED;
+        } else if (num_disks == MAX_DISKS) {
+            printf("Too many disks provided. Max supported: %d\n", MAX_DISKS);
+            return FSCK_FAILED;
+        } else {
+            disk_names[num_disks++] = argv[i];
+        }
+    }
+    if (num_disks == 0) {
+        printf("Usage: %s [-y] [-j threads] <disk> [<disk> ...]\n", argv[0]);
+        return FSCK_FAILED;
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    if (num_threads > MAX_THREADS) {
+        num_threads = MAX_THREADS;
+    }
+
+    if (open_disks() != SUCCESS) {
+        return FSCK_FAILED;
+    }
+    crc32c_init();
+
+    // Committed transactions not replayed yet are newer than the metadata in place, repairs
+    // made under them would be undone by the next mount
+    if (mirrored() && (features & WFS_FEATURE_JOURNAL)) {
+        for (int disk = 0; disk < num_disks; disk++) {
+            int pending = journal_pending(disk);
+            if (pending < 0) {
+                report(JOURNAL, "%s: the journal header is damaged", disk_names[disk]);
+            } else if (pending > 0) {
+                printf("%s: the journal has transactions to replay, mount and unmount first%s\n",
+                       disk_names[disk], repair ? "" : ", problems below may be gone after that");
+                if (repair) {
+                    return FSCK_FAILED;
+                }
+                break;
+            }
+        }
+    }
+
+    if (!bit_test(inode_bitmap(0), 0) || !S_ISDIR(get_inode(0)->mode)) {
+        printf("The root directory is gone\n");
+        return FSCK_ERRORS;
+    }
+
+    bitmap_words = (sb->num_data_blocks + 63) / 64;
+    links = calloc(sb->num_inodes, sizeof(uint32_t));
+    meta = calloc(bitmap_words, sizeof(uint64_t));
+    orphans = calloc((sb->num_inodes + 63) / 64, sizeof(uint64_t));
+    if (!links || !meta || !orphans) {
+        printf("Out of memory\n");
+        return FSCK_FAILED;
+    }
+    for (int disk = 0; disk < num_disks; disk++) {
+        used[disk] = calloc(bitmap_words, sizeof(uint64_t));
+        if (!used[disk]) {
+            printf("Out of memory\n");
+            return FSCK_FAILED;
+        }
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    run_pass(count_entries, sb->num_inodes, INODE_BATCH);
+    run_pass(use_blocks, sb->num_inodes, INODE_BATCH);
+    for (size_t num = 0; num < sb->num_inodes; num++) {
+        if (orphans[num / 64] & ((uint64_t)1 << (num % 64))) {
+            for (int disk = 0; disk < num_disks; disk++) {
+                bit_set(inode_bitmap(disk), num, 0);
+            }
+            repaired[ORPHAN]++;
+        }
+    }
+
+    if (num_disks > 1) {
+        compare_start = sb->i_bitmap_ptr;
+        compare_end = sb->d_blocks_ptr;
+        run_pass(compare_chunks, (compare_end - compare_start + COMPARE_CHUNK - 1) / COMPARE_CHUNK, 1);
+        if (mirrored()) {
+            run_pass(compare_meta, bitmap_words, WORD_BATCH);
+        }
+    }
+
+    for (bitmap_disk = 0; bitmap_disk < (mirrored() ? 1 : num_disks); bitmap_disk++) {
+        run_pass(check_bitmap, bitmap_words, WORD_BATCH);
+    }
+
+    if (repair) {
+        for (int disk = 0; disk < num_disks; disk++) {
+            if (msync(disk_region[disk], disk_sizes[disk], MS_SYNC) != 0) {
+                printf("Failed to write back %s\n", disk_names[disk]);
+                return FSCK_FAILED;
+            }
+        }
+    }
+
+    unsigned long blocks_in_use = 0;
+    for (int disk = 0; disk < num_disks; disk++) {
+        for (size_t w = 0; w < bitmap_words; w++) {
+            blocks_in_use += __builtin_popcountll(used[disk][w]);
+        }
+    }
+    printf("%lu directories, %lu files, %lu blocks in use on %d disks, checked in %.3f s with %d threads\n",
+           dirs_seen, files_seen, blocks_in_use, num_disks, elapsed(&start), num_threads);
+
+    int status = FSCK_OK;
+    for (int kind = 0; kind < NUM_PROBLEMS; kind++) {
+        if (problems[kind] == 0) {
+            continue;
+        }
+        printf("%lu %s", problems[kind], problem_names[kind]);
+        if (repaired[kind] > 0) {
+            printf(", %lu repaired", repaired[kind]);
+        }
+        printf("\n");
+        status |= repaired[kind] < problems[kind] ? FSCK_ERRORS : FSCK_CORRECTED;
+    }
+    if (status == FSCK_OK) {
+        printf("No problems found\n");
+    }
+    return status & FSCK_ERRORS ? FSCK_ERRORS : status;
+}
@@ -0,0 +1,236 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "wfs.h"
+#include "trace.h"
+#include "writeback.h"
+
+#define BITS_PER_WORD (8 * sizeof(unsigned long))
+
+struct wb_disk {
+    char *region;
+    size_t size;
+    unsigned long *dirty;       // Bit c set when chunk c changed since it was last synced
+    size_t nwords;
+};
+
+int writeback_init(struct writeback *wb, int num_disks, void *const *regions, const size_t *sizes) {
+    memset(wb, 0, sizeof(struct writeback));
+    pthread_mutex_init(&wb->lock, NULL);
+    pthread_cond_init(&wb->done, NULL);
+    pthread_mutex_init(&wb->stop_lock, NULL);
+    pthread_cond_init(&wb->stop_cond, NULL);
+    wb->disks = calloc(num_disks, sizeof(struct wb_disk));
+    if (!wb->disks) {
+        writeback_destroy(wb);
+        return FAIL;
+    }
+    for (int i = 0; i < num_disks; i++) {
+        size_t nchunks = (sizes[i] + WRITEBACK_CHUNK - 1) / WRITEBACK_CHUNK;
+        wb->disks[i].region = regions[i];
+        wb->disks[i].size = sizes[i];
+        wb->disks[i].nwords = (nchunks + BITS_PER_WORD - 1) / BITS_PER_WORD;
+        wb->disks[i].dirty = calloc(wb->disks[i].nwords, sizeof(unsigned long));
+        if (!wb->disks[i].dirty) {
+            wb->num_disks = i + 1;
+            writeback_destroy(wb);
+            return FAIL;
+        }
+    }
+    wb->num_disks = num_disks;
+    return SUCCESS;
+}
+
+void writeback_destroy(struct writeback *wb) {
+    for (int i = 0; i < wb->num_disks; i++) {
+        free(wb->disks[i].dirty);
+    }
+    free(wb->disks);
+    wb->disks = NULL;
+    wb->num_disks = 0;
+    pthread_mutex_destroy(&wb->lock);
+    pthread_cond_destroy(&wb->done);
+    pthread_mutex_destroy(&wb->stop_lock);
+    pthread_cond_destroy(&wb->stop_cond);
+}
+
+void writeback_mark(struct writeback *wb, int disk, off_t offset, size_t len) {
+    if (disk >= wb->num_disks || len == 0) {
+        return;
+    }
+    struct wb_disk *d = &wb->disks[disk];
+
+    size_t last = (offset + len - 1) / WRITEBACK_CHUNK;
+    for (size_t c = offset / WRITEBACK_CHUNK; c <= last; c++) {
+        unsigned long bit = 1UL << (c % BITS_PER_WORD);
+        unsigned long *word = &d->dirty[c / BITS_PER_WORD];
+
+        // Hot chunks (inodes, bitmaps) are marked over and over, only write the word once
+        if (!(__atomic_load_n(word, __ATOMIC_RELAXED) & bit)) {
+            __atomic_fetch_or(word, bit, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+void writeback_mark_all(struct writeback *wb, off_t offset, size_t len) {
+    for (int i = 0; i < wb->num_disks; i++) {
+        writeback_mark(wb, i, offset, len);
+    }
+}
+
+// Syncs chunks [first, end) of disk, marking them dirty again if that fails
+static int sync_chunks(struct writeback *wb, struct wb_disk *d, size_t first, size_t end, size_t *bytes) {
+    off_t start = (off_t)first * WRITEBACK_CHUNK;
+    size_t len = MIN(end * WRITEBACK_CHUNK, d->size) - start;
+    *bytes += len;
+    if (msync(d->region + start, len, MS_SYNC) != 0) {
+        writeback_mark(wb, d - wb->disks, start, len);
+        return -EIO;
+    }
+    return 0;
+}
+
+// Takes the dirty bits of every disk and syncs those chunks, a run of neighbouring ones at a time
+static int sync_dirty(struct writeback *wb) {
+    int err = 0;
+    size_t ranges = 0, bytes = 0;
+
+    for (int i = 0; i < wb->num_disks; i++) {
+        struct wb_disk *d = &wb->disks[i];
+        size_t run_start = 0, run_end = 0;   // Chunks of the run so far, empty when equal
+
+        for (size_t w = 0; w < d->nwords; w++) {
+            if (__atomic_load_n(&d->dirty[w], __ATOMIC_RELAXED) == 0) {
+                continue;
+            }
+            unsigned long bits = __atomic_exchange_n(&d->dirty[w], 0, __ATOMIC_ACQ_REL);
+            while (bits) {
+                size_t c = w * BITS_PER_WORD + __builtin_ctzl(bits);
+                bits &= bits - 1;
+                if (c == run_end && run_end > run_start) {
+                    run_end++;
+                    continue;
+                }
+                if (run_end > run_start && sync_chunks(wb, d, run_start, run_end, &bytes) != 0) {
+                    err = -EIO;
+                }
+                ranges += run_end > run_start;
+                run_start = c;
+                run_end = c + 1;
+            }
+        }
+        if (run_end > run_start && sync_chunks(wb, d, run_start, run_end, &bytes) != 0) {
+            err = -EIO;
+        }
+        ranges += run_end > run_start;
+    }
+
+    TRACE(WB_SYNC, NULL, ranges, bytes);
+    return err;
+}
+
+int writeback_sync(struct writeback *wb) {
+    pthread_mutex_lock(&wb->lock);
+
+    // A sync already running may have taken the dirty bits before the caller's changes were
+    // marked, so the caller needs the one after it
+    unsigned long target = wb->started + 1;
+    while (wb->finished < target) {
+        if (wb->running) {
+            TRACE(WB_JOIN, NULL, target);
+            pthread_cond_wait(&wb->done, &wb->lock);
+            continue;
+        }
+
+        wb->running = 1;
+        unsigned long n = ++wb->started;
+        pthread_mutex_unlock(&wb->lock);
+        if (wb->commit) {
+            wb->commit(wb->commit_arg);
+        }
+        int err = sync_dirty(wb);
+        if (err == 0 && wb->synced) {
+            wb->synced(wb->commit_arg);
+        }
+        pthread_mutex_lock(&wb->lock);
+
+        wb->running = 0;
+        wb->finished = n;
+        if (err) {
+            TRACE(WB_SYNC_FAIL, NULL, n);
+            wb->failed = n;
+            wb->errors++;
+        }
+        pthread_cond_broadcast(&wb->done);
+    }
+
+    int ret = wb->failed >= target ? -EIO : 0;
+    pthread_mutex_unlock(&wb->lock);
+    return ret;
+}
+
+void writeback_set_commit(struct writeback *wb, void (*commit)(void *), void (*synced)(void *), void *arg) {
+    wb->commit = commit;
+    wb->synced = synced;
+    wb->commit_arg = arg;
+}
+
+unsigned long writeback_errors(struct writeback *wb) {
+    pthread_mutex_lock(&wb->lock);
+    unsigned long errors = wb->errors;
+    pthread_mutex_unlock(&wb->lock);
+    return errors;
+}
+
+// Waits until `until` or until writeback_stop(), returns 1 for the latter
+static int wb_sleep(struct writeback *wb, const struct timespec *until) {
+    pthread_mutex_lock(&wb->stop_lock);
+    while (!wb->stop && pthread_cond_timedwait(&wb->stop_cond, &wb->stop_lock, until) != ETIMEDOUT) {
+    }
+    int stop = wb->stop;
+    pthread_mutex_unlock(&wb->stop_lock);
+    return stop;
+}
+
+static void *wb_thread(void *arg) {
+    struct writeback *wb = arg;
+    for (;;) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += (time_t)wb->interval;
+        until.tv_nsec += (long)((wb->interval - (time_t)wb->interval) * 1e9);
+        if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+        if (wb_sleep(wb, &until)) {
+            return NULL;
+        }
+        writeback_sync(wb);
+    }
+}
+
+int writeback_start(struct writeback *wb, double interval) {
+    wb->interval = interval;
+    wb->stop = 0;
+    if (pthread_create(&wb->tid, NULL, wb_thread, wb) != 0) {
+        return FAIL;
+    }
+    wb->thread_started = 1;
+    return SUCCESS;
+}
+
+void writeback_stop(struct writeback *wb) {
+    if (!wb->thread_started) {
+        return;
+    }
+    pthread_mutex_lock(&wb->stop_lock);
+    wb->stop = 1;
+    pthread_cond_broadcast(&wb->stop_cond);
+    pthread_mutex_unlock(&wb->stop_lock);
+    pthread_join(wb->tid, NULL);
+    wb->thread_started = 0;
+}
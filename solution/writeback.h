@@ -0,0 +1,78 @@
+#ifndef WFS_WRITEBACK_H
+#define WFS_WRITEBACK_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+  Writeback of the disk images to stable storage.
+
+  wfs changes the images through MAP_SHARED mappings, which the kernel
+  writes back whenever it likes. Every change is also recorded here, as a
+  bit per WRITEBACK_CHUNK bytes of each disk, so a sync only has to
+  msync(MS_SYNC) the chunks that changed rather than whole images.
+  Neighbouring dirty chunks go out as one range.
+
+  writeback_sync() is a group commit: a caller waits for a sync that started
+  after it called, and callers that arrive while one is running share the
+  next one. A failed sync marks its chunks dirty again and counts an error,
+  see writeback_errors().
+
+  Hooks let the journal seal its running transaction as part of every sync
+  and write what it committed in place once the sync got it to disk.
+
+  writeback_start() runs a thread that syncs every `interval` seconds.
+
+  Every mounted filesystem has its own struct writeback covering its disks.
+*/
+
+#define WRITEBACK_CHUNK (64 * 1024)   // Bytes per dirty bit, a multiple of the page size
+
+struct writeback {
+    struct wb_disk *disks;
+    int num_disks;
+
+    // Group commit, see writeback_sync()
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    unsigned long started;      // Syncs started so far, the running one included
+    unsigned long finished;     // Number of the last sync that finished
+    unsigned long failed;       // Number of the last sync that failed
+    unsigned long errors;
+    int running;
+    void (*commit)(void *);
+    void (*synced)(void *);
+    void *commit_arg;
+
+    // Background thread
+    pthread_t tid;
+    int thread_started;
+    double interval;
+    int stop;
+    pthread_mutex_t stop_lock;
+    pthread_cond_t stop_cond;
+};
+
+int writeback_init(struct writeback *wb, int num_disks, void *const *regions, const size_t *sizes);
+void writeback_destroy(struct writeback *wb);
+
+// Records [offset, offset + len) of disk, or of every disk, as changed
+void writeback_mark(struct writeback *wb, int disk, off_t offset, size_t len);
+void writeback_mark_all(struct writeback *wb, off_t offset, size_t len);
+
+// Returns 0 once everything marked before the call is on stable storage, -EIO if that failed
+int writeback_sync(struct writeback *wb);
+
+// Has commit(arg) called by the thread that runs each sync before it looks for dirty chunks,
+// so what it writes goes out with the sync, and synced(arg) after a sync that didn't fail,
+// before its callers return. What synced() marks goes out with the next one.
+void writeback_set_commit(struct writeback *wb, void (*commit)(void *), void (*synced)(void *), void *arg);
+
+// Number of syncs that have failed so far
+unsigned long writeback_errors(struct writeback *wb);
+
+int writeback_start(struct writeback *wb, double interval);
+void writeback_stop(struct writeback *wb);
+
+#endif
@@ -0,0 +1,101 @@
+#!/usr/bin/python3
+
+# time concurrent writers that fsync after every write on raid1. fsyncs that
+# arrive while one is running share the next sync, so the rate across all
+# writers should grow with the number of writers instead of staying flat.
+# checks every file reads back and that the mirrors match after unmount.
+#
+# usage: ./bench-fsync.py [writers] [seconds]
+
+import os
+import sys
+import threading
+import time
+from wfstest import *
+
+writers = int(sys.argv[1]) if len(sys.argv) > 1 else 8
+seconds = float(sys.argv[2]) if len(sys.argv) > 2 else 3
+
+disks = disk_paths("bench")
+disksize = "16M"
+inodes = 256
+blocks = 8192
+chunk = 4096
+file_chunks = 64
+
+mounts = [
+    ("default", []),
+    ("interval 1s", ["--writeback-interval=1"]),
+]
+
+def writer(path, n, deadline, counts, errors):
+    """Writes chunk n of the file round and round, fsyncing after each."""
+    fd = os.open(path, os.O_CREAT | os.O_RDWR, 0o644)
+    syncs = 0
+    try:
+        while time.perf_counter() < deadline:
+            i = syncs % file_chunks
+            os.pwrite(fd, bytes([(n + i) % 256]) * chunk, i * chunk)
+            os.fsync(fd)
+            syncs += 1
+    except OSError as e:
+        errors.append(f"{path}: {e}")
+    finally:
+        os.close(fd)
+    counts[n] = syncs
+
+def check(path, n, syncs, errors):
+    written = min(syncs, file_chunks)
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) != written * chunk:
+        errors.append(f"{path}: size {len(data)}, expected {written * chunk}")
+        return
+    for i in range(written):
+        if data[i * chunk:(i + 1) * chunk] != bytes([(n + i) % 256]) * chunk:
+            errors.append(f"{path}: chunk {i} differs")
+            return
+
+def run(label, wfs_args, threads):
+    mkfs(disks, disksize, ["-r", "1", "-i", str(inodes), "-b", str(blocks)])
+    mount(disks, wfs_args, label)
+
+    errors = []
+    counts = [0] * threads
+    paths = [f"{mnt}/w{n}" for n in range(threads)]
+    deadline = time.perf_counter() + seconds
+    start = time.perf_counter()
+    workers = [threading.Thread(target=writer, args=(paths[n], n, deadline, counts, errors))
+               for n in range(threads)]
+    for w in workers:
+        w.start()
+    for w in workers:
+        w.join()
+    rate = sum(counts) / (time.perf_counter() - start)
+
+    for n, path in enumerate(paths):
+        check(path, n, counts[n], errors)
+
+    unmount()
+
+    # Everything after the superblock is mirrored
+    with open(disks[0], "rb") as a, open(disks[1], "rb") as b:
+        a.seek(64)
+        b.seek(64)
+        if a.read() != b.read():
+            errors.append("mirrors differ after unmount")
+
+    print(f"{label:<14} {threads:>8} {rate:10.0f} {'ok' if not errors else 'BAD':>8}")
+    for err in errors[:5]:
+        print(f"{'':<14} {err}")
+    return not errors
+
+print(f"{'mount':<14} {'writers':>8} {'fsyncs/s':>10} {'result':>8}")
+ok = True
+try:
+    for label, wfs_args in mounts:
+        for threads in sorted({1, 2, writers}):
+            ok = run(label, wfs_args, threads) and ok
+finally:
+    cleanup(disks)
+exit(0 if ok else 1)
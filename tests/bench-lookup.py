@@ -0,0 +1,102 @@
+#!/usr/bin/python3
+
+# time stat and open/read/close of files deep in a directory tree on raid1,
+# mounted with the path API and with --lowlevel. also checks that a file
+# unlinked while open can still be read and written through the open
+# descriptor, and that its name can be reused afterwards. the path API only
+# lets that happen with -o hard_remove, otherwise FUSE renames the file, which
+# wfs doesn't support.
+#
+# usage: ./bench-lookup.py [depth] [passes]
+
+import os
+import sys
+import time
+from wfstest import *
+
+depth = int(sys.argv[1]) if len(sys.argv) > 1 else 8
+passes = int(sys.argv[2]) if len(sys.argv) > 2 else 2000
+
+disks = disk_paths("bench")
+disksize = "16M"
+inodes = 256
+blocks = 8192
+files = 16
+
+mounts = [
+    ("path API", ["-o", "hard_remove"]),
+    ("lowlevel", ["--lowlevel"]),
+    ("lowlevel, 10s cache", ["--lowlevel", "--entry-timeout=10", "--attr-timeout=10"]),
+]
+
+def open_unlinked(errors):
+    """An unlinked file stays usable through a descriptor opened before."""
+    path = f"{mnt}/open-unlinked"
+    fd = os.open(path, os.O_CREAT | os.O_RDWR, 0o644)
+    os.write(fd, b"a" * 3000)
+    os.unlink(path)
+    if os.path.exists(path):
+        errors.append("unlinked file still has its name")
+    os.pwrite(fd, b"b" * 100, 3000)
+    if os.pread(fd, 3100, 0) != b"a" * 3000 + b"b" * 100:
+        errors.append("unlinked file read back different data")
+    if os.fstat(fd).st_nlink != 0:
+        errors.append("unlinked file still has links")
+    os.close(fd)
+
+    # The name can be taken again once the orphan is closed
+    fd = os.open(path, os.O_CREAT | os.O_RDWR, 0o644)
+    os.close(fd)
+    os.unlink(path)
+
+def run(label, wfs_args):
+    mkfs(disks, disksize, ["-r", "1", "-i", str(inodes), "-b", str(blocks)])
+    mount(disks, wfs_args, label)
+
+    errors = []
+    deep = mnt
+    for level in range(depth):
+        deep = f"{deep}/d{level}"
+        os.mkdir(deep)
+    paths = [f"{deep}/f{i}" for i in range(files)]
+    for i, path in enumerate(paths):
+        with open(path, "wb") as f:
+            f.write(bytes([i]) * 1000)
+
+    start = time.perf_counter()
+    for n in range(passes):
+        if os.stat(paths[n % files]).st_size != 1000:
+            errors.append(f"{paths[n % files]}: wrong size")
+    stat_rate = passes / (time.perf_counter() - start)
+
+    start = time.perf_counter()
+    for n in range(passes):
+        with open(paths[n % files], "rb") as f:
+            if f.read(1) != bytes([n % files]):
+                errors.append(f"{paths[n % files]}: wrong data")
+    open_rate = passes / (time.perf_counter() - start)
+
+    open_unlinked(errors)
+
+    unmount()
+
+    # Everything after the superblock is mirrored
+    with open(disks[0], "rb") as a, open(disks[1], "rb") as b:
+        a.seek(64)
+        b.seek(64)
+        if a.read() != b.read():
+            errors.append("mirrors differ after unmount")
+
+    print(f"{label:<22} {stat_rate:10.0f} {open_rate:12.0f} {'ok' if not errors else 'BAD':>8}")
+    for err in errors[:5]:
+        print(f"{'':<22} {err}")
+    return not errors
+
+print(f"{'mount':<22} {'stat/s':>10} {'open+read/s':>12} {'result':>8}")
+ok = True
+try:
+    for label, wfs_args in mounts:
+        ok = run(label, wfs_args) and ok
+finally:
+    cleanup(disks)
+exit(0 if ok else 1)
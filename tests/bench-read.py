@@ -0,0 +1,80 @@
+#!/usr/bin/python3
+
+# time sequential reads of one large file on raid1, raid1v and raid1v with
+# -O checksums, each with two mirrors. raid1 is also read with splicing turned
+# off, which makes fuse copy the data through user space. the checksum image
+# is read a second time after every 7th data block of the second mirror has a
+# byte flipped, which must not change what is read back.
+#
+# usage: ./bench-read.py [file size in MB] [passes]
+
+import os
+import struct
+import sys
+import time
+from wfstest import *
+
+size_mb = int(sys.argv[1]) if len(sys.argv) > 1 else 32
+passes = int(sys.argv[2]) if len(sys.argv) > 2 else 5
+
+disks = disk_paths("bench")
+disksize = f"{size_mb + 16}M"
+blocks = (size_mb + 8) * 2048
+chunk = 1 << 20
+
+configs = [
+    ("raid1", ["-r", "1"], False, []),
+    ("raid1, no splice", ["-r", "1"], False, ["-o", "no_splice_read,no_splice_write"]),
+    ("raid1v", ["-r", "1v"], False, []),
+    ("raid1v checksums", ["-r", "1v", "-O", "checksums"], False, []),
+    ("raid1v checksums, bad mirror", ["-r", "1v", "-O", "checksums"], True, []),
+]
+
+def corrupt_data_blocks(disk):
+    """Flip one byte in every 7th data block of disk."""
+    with open(disk, "r+b") as f:
+        _, datablocks, _, _, _, dblocks_ptr = struct.unpack("<QQqqqq", f.read(48))
+        for block in range(1, datablocks, 7):
+            f.seek(dblocks_ptr + block * 512 + 100)
+            byte = f.read(1)[0]
+            f.seek(-1, os.SEEK_CUR)
+            f.write(bytes([byte ^ 0xff]))
+
+def run(name, mkfs_args, corrupt, wfs_args, data):
+    mkfs(disks, disksize, ["-i", "32", "-b", str(blocks)] + mkfs_args)
+    mount(disks, ["-s"], name)
+    with open(f"{mnt}/file", "wb") as f:
+        f.write(data)
+    unmount()
+
+    if corrupt:
+        corrupt_data_blocks(disks[1])
+    mount(disks, ["-s"] + wfs_args, name)
+
+    ok = True
+    start = time.perf_counter()
+    for _ in range(passes):
+        with open(f"{mnt}/file", "rb", buffering=0) as f:
+            read_back = bytearray()
+            while True:
+                part = f.read(chunk)
+                if not part:
+                    break
+                read_back += part
+        ok = ok and read_back == data
+    elapsed = time.perf_counter() - start
+    unmount()
+
+    print(f"{name:<30} {size_mb * passes / elapsed:10.1f} {'ok' if ok else 'BAD DATA':>10}")
+    return ok
+
+data = bytes((i * 7 + i // 511) % 256 for i in range(size_mb << 20))
+
+print(f"{'image':<30} {'MB/s':>10} {'data':>10}")
+ok = True
+try:
+    for name, mkfs_args, corrupt, wfs_args in configs:
+        ok = run(name, mkfs_args, corrupt, wfs_args, data) and ok
+finally:
+    cleanup(disks)
+exit(0 if ok else 1)
@@ -0,0 +1,72 @@
+#!/usr/bin/python3
+
+# time listing a large directory on raid1 with -O dir_index: names only
+# (os.listdir), names and types (os.scandir, which uses the type stored in
+# the dentry), and names with a stat of every entry, as `ls -l` does.
+# every listing must return each entry exactly once with the right type.
+#
+# usage: ./bench-readdir.py [entries] [passes]
+
+import os
+import stat
+import sys
+import time
+from wfstest import *
+
+entries = int(sys.argv[1]) if len(sys.argv) > 1 else 5000
+passes = int(sys.argv[2]) if len(sys.argv) > 2 else 5
+
+disks = disk_paths("bench")
+disksize = "16M"
+inodes = entries + 64
+blocks = 16384
+
+def name(i):
+    """Every 7th name is as long as a name can be, which leaves no room for the type."""
+    return f"{i:027d}" if i % 7 == 3 else f"entry-{i}"
+
+def names_only(path):
+    return {n: None for n in os.listdir(path)}
+
+def with_types(path):
+    with os.scandir(path) as it:
+        return {e.name: e.is_dir(follow_symlinks=False) for e in it}
+
+def with_stat(path):
+    return {n: stat.S_ISDIR(os.lstat(f"{path}/{n}").st_mode) for n in os.listdir(path)}
+
+listings = [
+    ("names", names_only, False),
+    ("names and types", with_types, True),
+    ("names and stat", with_stat, True),
+]
+
+ok = True
+try:
+    mkfs(disks, disksize, ["-r", "1", "-i", str(inodes), "-b", str(blocks), "-O", "dir_index"])
+    mount(disks, ["-s"], "readdir")
+
+    os.mkdir(f"{mnt}/big")
+    for i in range(entries):
+        if i % 5 == 0:
+            os.mkdir(f"{mnt}/big/{name(i)}")
+        else:
+            open(f"{mnt}/big/{name(i)}", "wb").close()
+    expected = {name(i): i % 5 == 0 for i in range(entries)}
+
+    print(f"{'listing':<20} {'entries/s':>12} {'result':>10}")
+    for label, listing, check_types in listings:
+        good = True
+        start = time.perf_counter()
+        for _ in range(passes):
+            found = listing(f"{mnt}/big")
+            if check_types:
+                good = good and found == expected
+            else:
+                good = good and found.keys() == expected.keys()
+        elapsed = time.perf_counter() - start
+        print(f"{label:<20} {entries * passes / elapsed:12.0f} {'ok' if good else 'BAD':>10}")
+        ok = ok and good
+finally:
+    cleanup(disks)
+exit(0 if ok else 1)
@@ -0,0 +1,65 @@
+#!/usr/bin/python3
+
+# time small writes on raid1 images of increasing size
+# with dirty-range replication the latency should stay flat as the image grows
+#
+# usage: ./bench-small-write.py [numwrites] [size ...]
+#   sizes accept a K/M/G suffix, e.g. ./bench-small-write.py 2000 1M 64M 512M
+
+import os
+import random
+import sys
+import time
+from wfstest import *
+
+numwrites = int(sys.argv[1]) if len(sys.argv) > 1 else 1000
+sizes = sys.argv[2:] if len(sys.argv) > 2 else ["1M", "16M", "128M", "512M"]
+
+disks = disk_paths("bench")
+inodes = 64
+filesize = 4096
+
+def parse_size(size):
+    """Convert a size such as 16M into bytes."""
+    units = {"K": 1 << 10, "M": 1 << 20, "G": 1 << 30}
+    if size[-1].upper() in units:
+        return int(size[:-1]) * units[size[-1].upper()]
+    return int(size)
+
+def num_blocks(size):
+    """Largest number of data blocks mkfs will fit on a disk of this size."""
+    # superblock, bitmaps and one block per inode come before the data region,
+    # mkfs also reserves sizeof(struct wfs_inode) per inode after it
+    overhead = 1024 + (size // 512) // 8 + inodes * 1024
+    return ((size - overhead) // 512) // 32 * 32
+
+def bench(size):
+    """Mount a fresh raid1 image of the given size and time 1-byte writes."""
+    nbytes = parse_size(size)
+    mkfs(disks, str(nbytes), ["-r", "1", "-i", str(inodes), "-b", str(num_blocks(nbytes))])
+    mount(disks, ["-s"], size)
+
+    latencies = []
+    fd = os.open(f"{mnt}/file1", os.O_CREAT | os.O_WRONLY)
+    os.pwrite(fd, b'\0' * filesize, 0)
+    for _ in range(numwrites):
+        offset = random.randrange(filesize)
+        start = time.perf_counter()
+        os.pwrite(fd, b'x', offset)
+        latencies.append(time.perf_counter() - start)
+    os.close(fd)
+
+    unmount()
+
+    latencies.sort()
+    mean = sum(latencies) / len(latencies)
+    p50 = latencies[len(latencies) // 2]
+    p99 = latencies[min(len(latencies) - 1, int(len(latencies) * 0.99))]
+    print(f"{size:>8} {mean * 1e6:10.1f} {p50 * 1e6:10.1f} {p99 * 1e6:10.1f}")
+
+print(f"{'image':>8} {'mean_us':>10} {'p50_us':>10} {'p99_us':>10}")
+try:
+    for size in sizes:
+        bench(size)
+finally:
+    cleanup(disks)
@@ -0,0 +1,101 @@
+#!/usr/bin/python3
+
+# stress wfs under the multi-threaded fuse loop (no -s) and time it
+# every thread creates, writes, reads back and unlinks files in its own
+# directory and in one shared directory, while also reading a shared file.
+# contents are checked after every read, and the raid1 mirrors must match
+# once the filesystem is unmounted.
+#
+# usage: ./bench-threads.py [ops per thread] [threads ...]
+#   e.g. ./bench-threads.py 500 1 2 4 8 16
+
+import os
+import sys
+import threading
+import time
+from wfstest import *
+
+numops = int(sys.argv[1]) if len(sys.argv) > 1 else 300
+thread_counts = [int(n) for n in sys.argv[2:]] if len(sys.argv) > 2 else [1, 2, 4, 8]
+
+disks = disk_paths("bench")
+disksize = "16M"
+inodes = 1024
+blocks = 16384
+files_per_dir = 8
+
+def payload(tid, i):
+    """Data unique to a thread and iteration, a few blocks long."""
+    size = 100 + (tid * 131 + i * 37) % 3000
+    return bytes([(tid * 7 + i + j) % 251 for j in range(size)])
+
+def worker(tid, errors):
+    mydir = f"{mnt}/t{tid}"
+    os.mkdir(mydir)
+    for i in range(numops):
+        try:
+            data = payload(tid, i)
+            path = f"{mydir}/f{i % files_per_dir}"
+            with open(path, "wb") as f:
+                f.write(data)
+            with open(path, "rb") as f:
+                if f.read() != data:
+                    errors.append(f"{path}: read back different data")
+
+            shared = f"{mnt}/shared/t{tid}-{i % files_per_dir}"
+            with open(shared, "wb") as f:
+                f.write(data[:64])
+            with open(f"{mnt}/shared/common", "rb") as f:
+                if f.read() != b"c" * 4096:
+                    errors.append("shared/common changed")
+            if i % 3 == 0:
+                os.unlink(shared)
+            if i % 5 == 0:
+                os.listdir(f"{mnt}/shared")
+            if i % 7 == 0:
+                os.mkdir(f"{mydir}/sub")
+                os.rmdir(f"{mydir}/sub")
+        except OSError as e:
+            errors.append(f"thread {tid} op {i}: {e}")
+
+def run(nthreads):
+    """Mount a fresh raid1 filesystem and run nthreads workers against it."""
+    mkfs(disks, disksize, ["-r", "1", "-i", str(inodes), "-b", str(blocks)])
+    mount(disks, label=str(nthreads))
+
+    os.mkdir(f"{mnt}/shared")
+    with open(f"{mnt}/shared/common", "wb") as f:
+        f.write(b"c" * 4096)
+
+    errors = []
+    threads = [threading.Thread(target=worker, args=(tid, errors)) for tid in range(nthreads)]
+    start = time.perf_counter()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.perf_counter() - start
+
+    unmount()
+
+    # Everything after the superblock is mirrored
+    with open(disks[0], "rb") as a, open(disks[1], "rb") as b:
+        a.seek(64)
+        b.seek(64)
+        if a.read() != b.read():
+            errors.append("mirrors differ after unmount")
+
+    ops = nthreads * numops
+    print(f"{nthreads:>8} {ops:>8} {elapsed:10.2f} {ops / elapsed:10.1f} {len(errors):>8}")
+    for err in errors[:5]:
+        print(f"         {err}")
+    return not errors
+
+print(f"{'threads':>8} {'ops':>8} {'secs':>10} {'ops/s':>10} {'errors':>8}")
+ok = True
+try:
+    for n in thread_counts:
+        ok = run(n) and ok
+finally:
+    cleanup(disks)
+exit(0 if ok else 1)
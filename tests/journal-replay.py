@@ -0,0 +1,187 @@
+#!/usr/bin/python3
+
+# crash test for the metadata journal. creates files on a raid1 image made
+# with -J, fsyncs, kills wfs without unmounting and then puts back the
+# bitmaps and inode table from before the files were made, as if none of the
+# in-place metadata writes had reached the disk. mounting again has to replay
+# the journal and bring every file back. the same is done with the second
+# mirror's journal lost too. prints how long each mount took for a small and
+# a large image: replay time depends on the journal, not on the image size.
+#
+# then a power loss: after the fsync, files are removed and made without
+# one, wfs is killed and every page of each image is put back to how the
+# fsync left it or not, at random. whatever pages made it, the next mount
+# has to find the files exactly as they were at the fsync and wfsck has to
+# find nothing wrong.
+#
+# usage: ./journal-replay.py [files]
+
+import os
+import random
+import signal
+import struct
+import subprocess
+import sys
+import time
+from wfstest import *
+
+files = int(sys.argv[1]) if len(sys.argv) > 1 else 60
+
+disks = disk_paths("journal")
+journal = "1M"
+images = [("16M", 8192), ("256M", 400000)]
+
+def layout(path):
+    """Returns the inode bitmap offset, data region offset and journal offset"""
+    with open(path, "rb") as f:
+        sb = f.read(64)
+    _, num_data_blocks, i_bitmap_ptr, _, _, d_blocks_ptr = struct.unpack("<QQqqqq", sb[:48])
+    block_bits = sb[60]
+    block = 1 << block_bits if block_bits else 512
+    end = d_blocks_ptr + num_data_blocks * block
+    return i_bitmap_ptr, d_blocks_ptr, (end + block - 1) // block * block
+
+def wfs_pid():
+    out = subprocess.run(["pgrep", "-f", f"wfs {disks[0]}"], capture_output=True, text=True).stdout
+    return int(out.split()[0])
+
+def contents(n):
+    return bytes([ord("a") + n % 26]) * (500 + n * 97 % 3000)
+
+def make_files(first, last):
+    for n in range(first, last):
+        with open(f"{mnt}/a/b/f{n}", "wb") as f:
+            f.write(contents(n))
+
+def fsync_dir():
+    fd = os.open(f"{mnt}/a/b", os.O_RDONLY)
+    os.fsync(fd)
+    os.close(fd)
+
+def crash():
+    os.kill(wfs_pid(), signal.SIGKILL)
+    time.sleep(0.2)
+    subprocess.run(["fusermount", "-uq", mnt])
+
+def check_files(errors, expected):
+    """Checks file n exists with its contents exactly when expected(n), for every n made"""
+    for n in range(files * 2):
+        path = f"{mnt}/a/b/f{n}"
+        if not expected(n):
+            if os.path.exists(path):
+                errors.append(f"{path} is there")
+            continue
+        try:
+            with open(path, "rb") as f:
+                if f.read() != contents(n):
+                    errors.append(f"{path}: wrong data")
+        except OSError as e:
+            errors.append(f"{path}: {e}")
+
+def run(label, disksize, blocks, lose_mirror_journal):
+    mkfs(disks, disksize, ["-r", "1", "-i", "256", "-b", str(blocks), "-O", "dir_index", "-J", journal])
+    i_bitmap_ptr, d_blocks_ptr, journal_ptr = layout(disks[0])
+    before = []
+    for disk in disks:
+        with open(disk, "rb") as f:
+            f.seek(i_bitmap_ptr)
+            metadata = f.read(d_blocks_ptr - i_bitmap_ptr)
+            f.seek(journal_ptr)
+            before.append((metadata, f.read()))
+
+    mount(disks, label=label)
+    os.makedirs(f"{mnt}/a/b")
+    make_files(0, files)
+    for n in range(0, files, 4):
+        os.unlink(f"{mnt}/a/b/f{n}")
+    fsync_dir()
+    crash()
+
+    for i, disk in enumerate(disks):
+        with open(disk, "r+b") as f:
+            f.seek(i_bitmap_ptr)
+            f.write(before[i][0])
+            if lose_mirror_journal and i == 1:
+                f.seek(journal_ptr)
+                f.write(before[i][1])
+
+    start = time.perf_counter()
+    out = mount(disks, label=f"{label} after crash", capture_output=True, text=True).stdout
+    mount_time = time.perf_counter() - start
+
+    errors = []
+    check_files(errors, lambda n: n < files and n % 4 != 0)
+    unmount()
+
+    # Everything after the superblock is mirrored, the journal included
+    with open(disks[0], "rb") as a, open(disks[1], "rb") as b:
+        a.seek(64)
+        b.seek(64)
+        while True:
+            chunk = a.read(1 << 20)
+            if chunk != b.read(1 << 20):
+                errors.append("mirrors differ after unmount")
+                break
+            if not chunk:
+                break
+
+    replayed = out.strip().splitlines()[-1] if out.strip() else "nothing replayed"
+    print(f"{label:<26} {mount_time * 1000:9.1f} ms  {'ok' if not errors else 'BAD':>4}  {replayed}")
+    for err in errors[:5]:
+        print(f"{'':<26} {err}")
+    return not errors
+
+def run_power_loss(label, disksize, blocks, seed):
+    mkfs(disks, disksize, ["-r", "1", "-i", "256", "-b", str(blocks), "-O", "dir_index", "-J", journal])
+
+    # Nothing but the fsync syncs, so the images at the fsync are what a power loss leaves
+    # of every page the changes after it touched
+    mount(disks, ["--writeback-interval=3600"], label=label)
+    os.makedirs(f"{mnt}/a/b")
+    make_files(0, files)
+    for n in range(0, files, 4):
+        os.unlink(f"{mnt}/a/b/f{n}")
+    fsync_dir()
+    synced = []
+    for disk in disks:
+        with open(disk, "rb") as f:
+            synced.append(f.read())
+
+    for n in range(1, files, 4):
+        os.unlink(f"{mnt}/a/b/f{n}")
+    make_files(files, files * 2)
+    crash()
+
+    rng = random.Random(seed)
+    page = 4096
+    for i, disk in enumerate(disks):
+        with open(disk, "r+b") as f:
+            for at in range(0, len(synced[i]), page):
+                if rng.random() < 0.5:
+                    f.seek(at)
+                    f.write(synced[i][at:at + page])
+
+    out = mount(disks, label=f"{label} after power loss", capture_output=True, text=True).stdout
+    errors = []
+    check_files(errors, lambda n: n < files and n % 4 != 0)
+    unmount()
+    result = subprocess.run(["../solution/wfsck", *disks], capture_output=True, text=True)
+    if result.returncode != 0:
+        errors += ["wfsck: " + line for line in result.stdout.splitlines()[-3:]]
+
+    replayed = out.strip().splitlines()[-1] if out.strip() else "nothing replayed"
+    print(f"{label:<26} {'':>12}  {'ok' if not errors else 'BAD':>4}  {replayed}")
+    for err in errors[:5]:
+        print(f"{'':<26} {err}")
+    return not errors
+
+ok = True
+try:
+    for disksize, blocks in images:
+        ok = run(f"{disksize}", disksize, blocks, False) and ok
+        ok = run(f"{disksize}, one journal lost", disksize, blocks, True) and ok
+    for seed in range(3):
+        ok = run_power_loss(f"16M, power loss {seed + 1}", "16M", 8192, seed) and ok
+finally:
+    cleanup(disks)
+exit(0 if ok else 1)
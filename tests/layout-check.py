@@ -0,0 +1,91 @@
+#!/usr/bin/python3
+
+# checks files keep the block layout images have always had: blocks[0..6] of
+# the inode map file blocks 0 to 6, blocks[7] points at the indirect block
+# for the next 64 and the double indirect block comes after those. writes a
+# file through wfs and finds its data where that layout says, then rewrites
+# every block there behind wfs's back, as a wfs from before double indirect
+# blocks would have put it, and checks wfs reads back the new data.
+#
+# usage: ./layout-check.py [blocks]
+
+import os
+import struct
+import sys
+from wfstest import *
+
+nblocks = int(sys.argv[1]) if len(sys.argv) > 1 else 150
+
+disks = disk_paths("layout")
+direct = 7
+block = 512
+ptrs = block // 8
+
+def block_data(n, tag):
+    return bytes([tag]) + n.to_bytes(4, "little") + bytes([(n * 7 + tag) % 256]) * (block - 5)
+
+def file_blocks(f, img, num):
+    """Image offsets of the data blocks of inode num, in file order"""
+    f.seek(img.inode_offset(num))
+    inode = f.read(136)
+    (mode,) = struct.unpack("<I", inode[4:8])
+    (size,) = struct.unpack("<q", inode[16:24])
+    assert mode & 0o170000 == 0o100000, f"inode {num} isn't a regular file"
+    blocks = struct.unpack(f"<{direct + 1}q", inode[56:56 + 8 * (direct + 1)])
+    (dind,) = struct.unpack("<q", inode[120:128])
+
+    def pointers(at):
+        f.seek(at)
+        return struct.unpack(f"<{ptrs}q", f.read(block))
+
+    out = list(blocks[:direct])
+    if blocks[direct]:
+        out += pointers(blocks[direct])
+    if dind:
+        for ind in pointers(dind):
+            out += pointers(ind) if ind else [0] * ptrs
+    return out[:(size + block - 1) // block]
+
+def run():
+    mkfs(disks, "4M", ["-r", "1", "-i", "32", "-b", "4096"])
+    mount(disks, ["-s"], "layout")
+    with open(f"{mnt}/file", "wb") as f:
+        for n in range(nblocks):
+            f.write(block_data(n, 1))
+    unmount()
+
+    errors = []
+    img = Image(disks[0])
+    with open(disks[0], "rb") as f:
+        offsets = file_blocks(f, img, 1)
+        for n, at in enumerate(offsets):
+            f.seek(at)
+            if not at or f.read(block) != block_data(n, 1):
+                errors.append(f"written: file block {n} isn't at the offset the layout gives")
+                break
+
+    if not errors:
+        for disk in disks:
+            with open(disk, "r+b") as f:
+                for n, at in enumerate(offsets):
+                    f.seek(at)
+                    f.write(block_data(n, 2))
+
+        mount(disks, ["-s"], "layout")
+        with open(f"{mnt}/file", "rb") as f:
+            for n in range(nblocks):
+                if f.read(block) != block_data(n, 2):
+                    errors.append(f"read back: file block {n} isn't from the offset the layout gives")
+                    break
+        unmount()
+
+    print(f"{nblocks} blocks {'ok' if not errors else 'BAD'}")
+    for err in errors:
+        print(f"  {err}")
+    return not errors
+
+try:
+    ok = run()
+finally:
+    cleanup(disks)
+exit(0 if ok else 1)
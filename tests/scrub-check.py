@@ -0,0 +1,87 @@
+#!/usr/bin/python3
+
+# check that the background scrubber repairs a damaged mirror.
+# writes a few files to a two-disk image, flips a byte in every allocated
+# data block of the second disk, mounts with --scrub-rate and waits for the
+# mirrors to match again. done for raid1, raid1v and raid1v -O checksums.
+# also reports how long the pass took against what the rate allows.
+#
+# usage: ./scrub-check.py [scrub rate in MB/s]
+
+import os
+import struct
+import sys
+import time
+from wfstest import *
+
+rate = int(sys.argv[1]) if len(sys.argv) > 1 else 2
+
+disks = disk_paths("scrub")
+files = {f"file{i}": bytes((i * 13 + j) % 256 for j in range(200000 + i * 50000)) for i in range(4)}
+
+configs = [
+    ("raid1", ["-r", "1"]),
+    ("raid1v", ["-r", "1v"]),
+    ("raid1v checksums", ["-r", "1v", "-O", "checksums"]),
+]
+
+def allocated_blocks(disk):
+    """Offsets of the allocated data blocks of disk."""
+    with open(disk, "rb") as f:
+        _, datablocks, _, dbitmap_ptr, _, dblocks_ptr = struct.unpack("<QQqqqq", f.read(48))
+        f.seek(dbitmap_ptr)
+        bitmap = f.read(datablocks // 8)
+    return [dblocks_ptr + b * 512 for b in range(datablocks) if bitmap[b // 8] & (1 << (b % 8))]
+
+def data_blocks(disk, offsets):
+    with open(disk, "rb") as f:
+        blocks = []
+        for offset in offsets:
+            f.seek(offset)
+            blocks.append(f.read(512))
+    return blocks
+
+def run(name, mkfs_args):
+    mkfs(disks, "8M", ["-i", "32", "-b", "8192"] + mkfs_args)
+    mount(disks, ["-s"], name)
+    for fname, data in files.items():
+        with open(f"{mnt}/{fname}", "wb") as f:
+            f.write(data)
+    unmount()
+
+    offsets = allocated_blocks(disks[0])
+    with open(disks[1], "r+b") as f:
+        for offset in offsets:
+            f.seek(offset + 100)
+            byte = f.read(1)[0]
+            f.seek(-1, os.SEEK_CUR)
+            f.write(bytes([byte ^ 0xff]))
+
+    start = time.perf_counter()
+    mount(disks, ["-s", f"--scrub-rate={rate}"], name)
+
+    # The scrubber reads every copy of every allocated block once per pass
+    expected = len(offsets) * 512 * len(disks) / (rate * 1024 * 1024)
+    repaired = False
+    while time.perf_counter() - start < expected * 2 + 10:
+        if data_blocks(disks[0], offsets) == data_blocks(disks[1], offsets):
+            repaired = True
+            break
+        time.sleep(0.1)
+    elapsed = time.perf_counter() - start
+
+    intact = all(open(f"{mnt}/{fname}", "rb").read() == data for fname, data in files.items())
+    unmount()
+
+    ok = repaired and intact
+    print(f"{name:<20} {len(offsets):>8} {elapsed:8.1f} {expected:9.1f} {'ok' if ok else 'FAILED':>8}")
+    return ok
+
+print(f"{'image':<20} {'blocks':>8} {'secs':>8} {'at rate':>9} {'result':>8}")
+ok = True
+try:
+    for name, mkfs_args in configs:
+        ok = run(name, mkfs_args) and ok
+finally:
+    cleanup(disks)
+exit(0 if ok else 1)
@@ -0,0 +1,103 @@
+#!/usr/bin/python3
+
+# check mnt/.wfs/stats and the SIGUSR1 dump. on a raid1 image, mounted with
+# the path API and with --lowlevel, makes a directory of files, writes,
+# syncs and removes them, and checks the counts in the statistics went up
+# by as many. also checks .wfs isn't listed and can't be written to or
+# removed, and that SIGUSR1 prints the statistics on stdout.
+#
+# usage: ./stats-check.py [files]
+
+import os
+import signal
+import subprocess
+import sys
+import time
+from wfstest import *
+
+numfiles = int(sys.argv[1]) if len(sys.argv) > 1 else 20
+
+disks = disk_paths("stats")
+stats_path = f"{mnt}/.wfs/stats"
+
+def read_stats():
+    """Ops as name -> (count, errors), and the counters as name -> value."""
+    with open(stats_path) as f:
+        text = f.read()
+    ops = {}
+    counters = {}
+    for line in text.split("\n"):
+        fields = line.split()
+        if len(fields) == 6 and fields[0] != "op":
+            ops[fields[0]] = (int(fields[1]), int(fields[2]))
+        elif len(fields) == 2 and fields[1].isdigit():
+            counters[fields[0]] = int(fields[1])
+    return ops, counters
+
+def check(name, cond, what):
+    if not cond:
+        print(f"{name}: {what}")
+    return cond
+
+def run(name, wfs_args):
+    mkfs(disks, "16M", ["-r", "1", "-i", "256", "-b", "16384"])
+    wfs = subprocess.Popen(["../solution/wfs", *disks, "-f", "-s"] + wfs_args + [mnt],
+                           stdout=subprocess.PIPE, text=True)
+    if not wait_for_mount(mnt):
+        print(f"{name}: mount failed")
+        wfs.kill()
+        exit(1)
+
+    ok = True
+    ops0, counters0 = read_stats()
+    os.mkdir(f"{mnt}/dir")
+    for i in range(numfiles):
+        with open(f"{mnt}/dir/file{i}", "wb") as f:
+            f.write(bytes(i % 256 for _ in range(4096)))
+            os.fsync(f.fileno())
+    ok = check(name, not os.path.exists(f"{mnt}/dir/missing"), "missing file exists") and ok
+    for i in range(numfiles):
+        os.unlink(f"{mnt}/dir/file{i}")
+    os.rmdir(f"{mnt}/dir")
+    ops1, counters1 = read_stats()
+
+    def delta(op):
+        return ops1[op][0] - ops0[op][0]
+    ok = check(name, delta("mkdir") == 1 and delta("rmdir") == 1, "mkdir and rmdir not counted once") and ok
+    ok = check(name, delta("mknod") == numfiles and delta("unlink") == numfiles, "creates and unlinks not counted") and ok
+    ok = check(name, delta("write") >= numfiles, f"{delta('write')} writes counted") and ok
+    missing_op = "lookup" if "--lowlevel" in wfs_args else "getattr"
+    ok = check(name, ops1[missing_op][1] > ops0[missing_op][1], f"{missing_op} of a missing file not counted as an error") and ok
+    blocks = counters1["blocks_allocated"] - counters0["blocks_allocated"]
+    ok = check(name, blocks >= numfiles * 8, f"{blocks} blocks allocated") and ok
+    ok = check(name, counters1["bytes_replicated"] > counters0["bytes_replicated"], "nothing replicated") and ok
+    ok = check(name, counters1["dentries_scanned"] > counters0["dentries_scanned"], "no dentries scanned") and ok
+
+    ok = check(name, ".wfs" not in os.listdir(mnt), ".wfs listed") and ok
+    ok = check(name, os.listdir(f"{mnt}/.wfs") == ["stats"], ".wfs doesn't list stats") and ok
+    for what, call, error in [("write stats", lambda: open(stats_path, "w"), PermissionError),
+                              ("mkdir .wfs", lambda: os.mkdir(f"{mnt}/.wfs"), FileExistsError),
+                              ("unlink stats", lambda: os.unlink(stats_path), PermissionError),
+                              ("create in .wfs", lambda: open(f"{mnt}/.wfs/x", "w"), PermissionError)]:
+        try:
+            call()
+            ok = check(name, False, f"{what} worked") and ok
+        except error:
+            pass
+
+    wfs.send_signal(signal.SIGUSR1)
+    time.sleep(0.5)
+    unmount()
+    out, _ = wfs.communicate(timeout=10)
+    ok = check(name, "uptime" in out and "bytes_replicated" in out, "SIGUSR1 printed nothing") and ok
+
+    print(f"{name:<12} {'ok' if ok else 'FAILED'}")
+    return ok
+
+ok = True
+try:
+    for name, wfs_args in [("path", []), ("lowlevel", ["--lowlevel"])]:
+        ok = run(name, wfs_args) and ok
+finally:
+    cleanup(disks)
+exit(0 if ok else 1)
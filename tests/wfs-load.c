@@ -0,0 +1,663 @@
+// mounts wfs on image files and runs mixed workloads on it with a number of
+// threads: small-file create storms, large sequential streams, random 4K I/O
+// and an ls -lR of everything. prints the rate of each, and with -b compares
+// them to a stored baseline and exits 1 if one fell more than the threshold
+// (10% by default) below it. -w writes the rates as the new baseline.
+//
+// every workload checks what it reads, and the raid1 and raid1v mirrors must
+// match after unmount. -D runs the workloads in an existing directory instead,
+// without mkfs or a mount, to compare with other filesystems.
+//
+// build: make wfs-load in ../solution
+// usage: ./wfs-load [-r modes] [-t threads] [-n files] [-m stream MB] [-k random ops]
+//                   [-R runs] [-O features] [-b baseline] [-w baseline] [-T threshold %]
+//                   [-D dir] [-- wfs options ...]
+//   e.g. ./wfs-load -r 1,1v -t 1,4,8 -R 3 -b wfs-load.baseline
+//
+// modes are raid modes for mkfs (1 by default), threads the thread counts to
+// run each with (1,4 by default). per thread the create storm makes 1000 files
+// of 100 bytes to 4K, the stream is 16 MB and the random I/O is 5000 4K reads
+// and writes. images are made in /tmp/$USER with -O dir_index unless -O says
+// otherwise, and mounted on mnt with the wfs options given after --.
+// with -R every configuration runs that many times and the best rate counts,
+// which steadies the numbers a gate compares.
+//
+// exits 0 when every rate is within the threshold, 1 when one regressed and
+// 2 when a workload or the setup failed.
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NUM_DISKS    2
+#define STREAM_CHUNK (128 * 1024)
+#define RAND_SIZE    4096
+#define MAX_RESULTS  256
+
+static const char *wfs_path = "../solution/wfs";
+static const char *mkfs_path = "../solution/mkfs";
+static const char *mnt = "mnt";
+static const char *features = "dir_index";
+static char *wfs_args[32];
+static int num_wfs_args;
+
+static int files = 1000;      // per thread, for the create storm
+static int stream_mb = 16;    // per thread
+static int rand_ops = 5000;   // per thread
+static double threshold = 10;
+static int repeats = 1;       // runs of everything, the best rate counts
+
+static char disk_names[NUM_DISKS][512];
+static const char *root;      // where the workloads run, mnt or -D
+static int nthreads;
+
+// What one thread did in a workload
+struct worker {
+    pthread_t thread;
+    int id;
+    long ops;
+    size_t bytes;
+    char error[1024];
+};
+
+struct result {
+    char mode[16];
+    int threads;
+    char workload[32];
+    double rate;
+    const char *unit;
+};
+
+static struct result results[MAX_RESULTS];
+static int num_results;
+static struct result baseline[MAX_RESULTS];
+static int num_baseline;
+
+static pthread_barrier_t start_barrier;
+
+static struct result *find_result(struct result *list, int n, const char *mode, int threads, const char *workload) {
+    for (int i = 0; i < n; i++) {
+        if (strcmp(list[i].mode, mode) == 0 && list[i].threads == threads && strcmp(list[i].workload, workload) == 0) {
+            return &list[i];
+        }
+    }
+    return NULL;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fail(struct worker *w, const char *what, const char *path) {
+    if (!w->error[0]) {
+        snprintf(w->error, sizeof(w->error), "thread %d: %s %s: %s", w->id, what, path, strerror(errno));
+    }
+}
+
+// Bytes of file n of thread id in the create storm, 100 to 4K of them
+static size_t small_size(int id, int n) {
+    return 100 + (id * 131 + n * 37) % 4000;
+}
+
+// Contents of file or chunk n of thread id, from byte from on
+static void fill(char *buf, size_t len, int id, long n, size_t from) {
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (char)(id * 7 + n + (from + i) / 512);
+    }
+}
+
+static void create_storm(struct worker *w) {
+    char path[512], buf[4096], back[4096];
+    snprintf(path, sizeof(path), "%s/storm/t%d", root, w->id);
+    if (mkdir(path, 0755) != 0) {
+        fail(w, "mkdir", path);
+    }
+    pthread_barrier_wait(&start_barrier);
+
+    // Every 4th file goes to the directory all threads share
+    for (int n = 0; n < files && !w->error[0]; n++) {
+        if (n % 4 == 3) {
+            snprintf(path, sizeof(path), "%s/storm/shared/t%d-%d", root, w->id, n);
+        } else {
+            snprintf(path, sizeof(path), "%s/storm/t%d/f%d", root, w->id, n);
+        }
+        size_t len = small_size(w->id, n);
+        fill(buf, len, w->id, n, 0);
+        int fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+        if (fd < 0) {
+            fail(w, "create", path);
+            break;
+        }
+        if (write(fd, buf, len) != (ssize_t)len) {
+            fail(w, "write", path);
+        }
+        close(fd);
+
+        // Read back one in 16
+        if (n % 16 == 0) {
+            fd = open(path, O_RDONLY);
+            if (fd < 0 || read(fd, back, sizeof(back)) != (ssize_t)len || memcmp(buf, back, len) != 0) {
+                fail(w, "read back", path);
+            }
+            close(fd);
+        }
+        w->ops++;
+        w->bytes += len;
+    }
+}
+
+static int stream_open(struct worker *w, int flags) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/stream/t%d", root, w->id);
+    int fd = open(path, flags, 0644);
+    if (fd < 0) {
+        fail(w, "open", path);
+    }
+    return fd;
+}
+
+static void seq_write(struct worker *w) {
+    char *buf = malloc(STREAM_CHUNK);
+    int fd = stream_open(w, O_CREAT | O_TRUNC | O_WRONLY);
+    pthread_barrier_wait(&start_barrier);
+    if (fd < 0 || !buf) {
+        free(buf);
+        return;
+    }
+
+    long chunks = (long)stream_mb * 1024 * 1024 / STREAM_CHUNK;
+    for (long n = 0; n < chunks; n++) {
+        fill(buf, STREAM_CHUNK, w->id, n, 0);
+        if (write(fd, buf, STREAM_CHUNK) != STREAM_CHUNK) {
+            fail(w, "write", "stream");
+            break;
+        }
+        w->ops++;
+        w->bytes += STREAM_CHUNK;
+    }
+    if (fsync(fd) != 0) {
+        fail(w, "fsync", "stream");
+    }
+    close(fd);
+    free(buf);
+}
+
+static void seq_read(struct worker *w) {
+    char *buf = malloc(STREAM_CHUNK), *expect = malloc(STREAM_CHUNK);
+    int fd = stream_open(w, O_RDONLY);
+
+    // So the reads get to wfs instead of the page cache
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    pthread_barrier_wait(&start_barrier);
+    if (fd < 0 || !buf || !expect) {
+        free(buf);
+        free(expect);
+        return;
+    }
+
+    long chunks = (long)stream_mb * 1024 * 1024 / STREAM_CHUNK;
+    for (long n = 0; n < chunks; n++) {
+        if (read(fd, buf, STREAM_CHUNK) != STREAM_CHUNK) {
+            fail(w, "read", "stream");
+            break;
+        }
+        fill(expect, STREAM_CHUNK, w->id, n, 0);
+        if (memcmp(buf, expect, STREAM_CHUNK) != 0) {
+            errno = EIO;
+            fail(w, "wrong data in", "stream");
+            break;
+        }
+        w->ops++;
+        w->bytes += STREAM_CHUNK;
+    }
+    close(fd);
+    free(buf);
+    free(expect);
+}
+
+// Reads and writes (one in 4) of 4K at random places in the thread's stream file. Writes
+// put the piece back as seq_write() left it, so every read can be checked.
+static void rand_4k(struct worker *w) {
+    char buf[RAND_SIZE], expect[RAND_SIZE];
+    int fd = stream_open(w, O_RDWR);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    pthread_barrier_wait(&start_barrier);
+    if (fd < 0) {
+        return;
+    }
+
+    unsigned int seed = w->id + 1;
+    long pieces = (long)stream_mb * 1024 * 1024 / RAND_SIZE;
+    for (int n = 0; n < rand_ops; n++) {
+        long piece = rand_r(&seed) % pieces;
+        off_t offset = piece * RAND_SIZE;
+
+        // What seq_write() put there, part of one of its chunks
+        fill(expect, RAND_SIZE, w->id, offset / STREAM_CHUNK, offset % STREAM_CHUNK);
+
+        if (n % 4 == 0) {
+            if (pwrite(fd, expect, RAND_SIZE, offset) != RAND_SIZE) {
+                fail(w, "pwrite", "stream");
+                break;
+            }
+        } else if (pread(fd, buf, RAND_SIZE, offset) != RAND_SIZE || memcmp(buf, expect, RAND_SIZE) != 0) {
+            fail(w, "pread", "stream");
+            break;
+        }
+        w->ops++;
+        w->bytes += RAND_SIZE;
+    }
+    close(fd);
+}
+
+// lstat of every entry under path, as ls -lR does
+static void walk(struct worker *w, const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        fail(w, "opendir", path);
+        return;
+    }
+    struct dirent *ent;
+    char child[512];
+    while ((ent = readdir(dir)) != NULL && !w->error[0]) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+        snprintf(child, sizeof(child), "%s/%s", path, ent->d_name);
+        struct stat st;
+        if (lstat(child, &st) != 0) {
+            fail(w, "lstat", child);
+            break;
+        }
+        w->ops++;
+        if (S_ISDIR(st.st_mode)) {
+            walk(w, child);
+        }
+    }
+    closedir(dir);
+}
+
+static void ls_lr(struct worker *w) {
+    pthread_barrier_wait(&start_barrier);
+    walk(w, root);
+}
+
+// The workload every worker of the running phase calls
+static void (*phase_fn)(struct worker *);
+
+static void *phase_thread(void *arg) {
+    phase_fn(arg);
+    return NULL;
+}
+
+// Runs fn on every thread at once and records the rate. Workers set up their files before
+// the barrier, so only the work after it is timed.
+static int run_phase(const char *mode, const char *name, void (*fn)(struct worker *), int in_mb) {
+    struct worker workers[nthreads];
+    memset(workers, 0, sizeof(workers));
+    pthread_barrier_init(&start_barrier, NULL, nthreads + 1);
+    phase_fn = fn;
+    for (int i = 0; i < nthreads; i++) {
+        workers[i].id = i;
+        pthread_create(&workers[i].thread, NULL, phase_thread, &workers[i]);
+    }
+    pthread_barrier_wait(&start_barrier);
+    double start = now();
+
+    long ops = 0;
+    size_t bytes = 0;
+    int ok = 1;
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        ops += workers[i].ops;
+        bytes += workers[i].bytes;
+        if (workers[i].error[0]) {
+            printf("  %s: %s\n", name, workers[i].error);
+            ok = 0;
+        }
+    }
+    double elapsed = now() - start;
+    pthread_barrier_destroy(&start_barrier);
+
+    // With -R the best run counts
+    double rate = in_mb ? bytes / elapsed / (1024 * 1024) : ops / elapsed;
+    struct result *r = find_result(results, num_results, mode, nthreads, name);
+    if (!r && num_results < MAX_RESULTS) {
+        r = &results[num_results++];
+        snprintf(r->mode, sizeof(r->mode), "%s", mode);
+        snprintf(r->workload, sizeof(r->workload), "%s", name);
+        r->threads = nthreads;
+        r->unit = in_mb ? "MB/s" : "ops/s";
+    }
+    if (r && rate > r->rate) {
+        r->rate = rate;
+    }
+    printf("  %-12s %10.1f %-6s (%ld ops in %.2f s)\n", name, rate, in_mb ? "MB/s" : "ops/s", ops, elapsed);
+    fflush(stdout);
+    return ok;
+}
+
+// Runs a program and waits for it, output to /dev/null unless show is set
+static int run_program(char *const argv[], int show) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (!show) {
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+        }
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+        return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static int is_mounted(const char *path) {
+    struct stat st, parent;
+    char up[512];
+    snprintf(up, sizeof(up), "%s/..", path);
+    return stat(path, &st) == 0 && stat(up, &parent) == 0 && st.st_dev != parent.st_dev;
+}
+
+static int mount_wfs(void) {
+    char *argv[NUM_DISKS + 36];
+    int n = 0;
+    argv[n++] = (char *)wfs_path;
+    for (int i = 0; i < NUM_DISKS; i++) {
+        argv[n++] = disk_names[i];
+    }
+    for (int i = 0; i < num_wfs_args; i++) {
+        argv[n++] = wfs_args[i];
+    }
+    argv[n++] = (char *)mnt;
+    argv[n] = NULL;
+    if (run_program(argv, 1) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < 100; i++) {
+        if (is_mounted(mnt)) {
+            return 0;
+        }
+        usleep(50000);
+    }
+    return -1;
+}
+
+static int unmount_wfs(void) {
+    char *argv[] = {"fusermount", "-u", (char *)mnt, NULL};
+    for (int i = 0; i < 100; i++) {
+        if (run_program(argv, 0) == 0) {
+            return 0;
+        }
+        usleep(50000);  // Busy while the last close is still on its way
+    }
+    return -1;
+}
+
+// Makes fresh images sized for the workloads
+static int make_images(const char *mode) {
+    size_t data = (size_t)nthreads * ((size_t)stream_mb * 1024 * 1024 + (size_t)files * 4096 * 2) * 3 / 2 + (16 << 20);
+    size_t blocks = data / 512;
+    size_t inodes = (size_t)nthreads * (files + 16) + 256;
+    size_t bytes = data + data / 512 * 4 + inodes * 512 + (1 << 20);
+
+    struct passwd *user = getpwuid(getuid());
+    char dir[256];
+    snprintf(dir, sizeof(dir), "/tmp/%s", user ? user->pw_name : "wfs");
+    mkdir(dir, 0755);
+    for (int i = 0; i < NUM_DISKS; i++) {
+        snprintf(disk_names[i], sizeof(disk_names[i]), "%s/load-disk%d", dir, i + 1);
+        int fd = open(disk_names[i], O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ftruncate(fd, bytes) != 0) {
+            printf("%s: %s\n", disk_names[i], strerror(errno));
+            return -1;
+        }
+        close(fd);
+    }
+
+    char inodes_arg[32], blocks_arg[32];
+    snprintf(inodes_arg, sizeof(inodes_arg), "%zu", inodes);
+    snprintf(blocks_arg, sizeof(blocks_arg), "%zu", blocks);
+    char *argv[] = {(char *)mkfs_path, "-r", (char *)mode, "-d", disk_names[0], "-d", disk_names[1],
+                    "-i", inodes_arg, "-b", blocks_arg, *features ? "-O" : NULL, (char *)features, NULL};
+    if (run_program(argv, 1) != 0) {
+        printf("mkfs -r %s failed\n", mode);
+        return -1;
+    }
+    return 0;
+}
+
+// Whether the images match past the superblock, which has the disk's id
+static int mirrors_match(void) {
+    FILE *a = fopen(disk_names[0], "rb"), *b = fopen(disk_names[1], "rb");
+    int same = a && b;
+    if (same) {
+        fseek(a, 64, SEEK_SET);
+        fseek(b, 64, SEEK_SET);
+        char x[65536], y[65536];
+        size_t n;
+        while (same && (n = fread(x, 1, sizeof(x), a)) > 0) {
+            same = fread(y, 1, n, b) == n && memcmp(x, y, n) == 0;
+        }
+    }
+    if (a) {
+        fclose(a);
+    }
+    if (b) {
+        fclose(b);
+    }
+    return same;
+}
+
+static int make_dirs(void) {
+    const char *dirs[] = {"storm", "storm/shared", "stream"};
+    char path[512];
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/%s", root, dirs[i]);
+        if (mkdir(path, 0755) != 0) {
+            printf("mkdir %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Runs every workload on mode with nthreads. Returns 0 if they all went through.
+static int run(const char *mode, const char *dir) {
+    printf("%s, %d threads\n", mode, nthreads);
+    if (dir) {
+        root = dir;
+    } else {
+        root = mnt;
+        if (make_images(mode) != 0) {
+            return -1;
+        }
+        if (mount_wfs() != 0) {
+            printf("  mount failed\n");
+            return -1;
+        }
+    }
+
+    int ok = make_dirs() == 0;
+    ok = ok && run_phase(mode, "create", create_storm, 0);
+    ok = ok && run_phase(mode, "seq_write", seq_write, 1);
+    ok = ok && run_phase(mode, "seq_read", seq_read, 1);
+    ok = ok && run_phase(mode, "rand_4k", rand_4k, 0);
+
+    // A fresh mount, so the listing isn't served from the kernel's caches
+    if (ok && !dir) {
+        if (unmount_wfs() != 0 || mount_wfs() != 0) {
+            printf("  remount failed\n");
+            return -1;
+        }
+    }
+    ok = ok && run_phase(mode, "ls_lR", ls_lr, 0);
+
+    if (dir) {
+        char *argv[] = {"rm", "-rf", NULL, NULL, NULL};
+        char storm[512], stream[512];
+        snprintf(storm, sizeof(storm), "%s/storm", dir);
+        snprintf(stream, sizeof(stream), "%s/stream", dir);
+        argv[2] = storm;
+        argv[3] = stream;
+        run_program(argv, 1);
+        return ok ? 0 : -1;
+    }
+    if (unmount_wfs() != 0) {
+        printf("  unmount failed\n");
+        return -1;
+    }
+    if (strcmp(mode, "0") != 0 && !mirrors_match()) {
+        printf("  mirrors differ after unmount\n");
+        ok = 0;
+    }
+    for (int i = 0; i < NUM_DISKS; i++) {
+        unlink(disk_names[i]);
+    }
+    return ok ? 0 : -1;
+}
+
+// Baseline files have a line "<mode> <threads> <workload> <rate>" per result, # for comments
+static int load_baseline(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        printf("%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), f) && num_baseline < MAX_RESULTS) {
+        struct result *r = &baseline[num_baseline];
+        if (line[0] != '#' && sscanf(line, "%15s %d %31s %lf", r->mode, &r->threads, r->workload, &r->rate) == 4) {
+            num_baseline++;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static int save_baseline(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        printf("%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    fprintf(f, "# wfs-load rates: mode threads workload rate (ops/s, MB/s for seq_*)\n");
+    for (int i = 0; i < num_results; i++) {
+        fprintf(f, "%s %d %s %.1f\n", results[i].mode, results[i].threads, results[i].workload, results[i].rate);
+    }
+    fclose(f);
+    return 0;
+}
+
+// Prints every result next to its baseline. Returns the number that regressed.
+static int compare(void) {
+    int regressed = 0;
+    printf("\n%-6s %7s %-12s %12s %12s %8s\n", "mode", "threads", "workload", "rate", "baseline", "change");
+    for (int i = 0; i < num_results; i++) {
+        struct result *r = &results[i];
+        struct result *b = find_result(baseline, num_baseline, r->mode, r->threads, r->workload);
+        if (!b || b->rate <= 0) {
+            printf("%-6s %7d %-12s %12.1f %12s\n", r->mode, r->threads, r->workload, r->rate, "-");
+            continue;
+        }
+        double change = (r->rate - b->rate) / b->rate * 100;
+        int bad = change < -threshold;
+        regressed += bad;
+        printf("%-6s %7d %-12s %12.1f %12.1f %+7.1f%%%s\n", r->mode, r->threads, r->workload, r->rate, b->rate, change,
+               bad ? "  REGRESSED" : "");
+    }
+    return regressed;
+}
+
+int main(int argc, char *argv[]) {
+    char *modes = "1", *threads = "1,4";
+    const char *baseline_path = NULL, *save_path = NULL, *dir = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:t:n:m:k:R:O:b:w:T:D:")) != -1) {
+        switch (opt) {
+        case 'r': modes = optarg; break;
+        case 't': threads = optarg; break;
+        case 'n': files = atoi(optarg); break;
+        case 'm': stream_mb = atoi(optarg); break;
+        case 'k': rand_ops = atoi(optarg); break;
+        case 'R': repeats = atoi(optarg); break;
+        case 'O': features = optarg; break;
+        case 'b': baseline_path = optarg; break;
+        case 'w': save_path = optarg; break;
+        case 'T': threshold = atof(optarg); break;
+        case 'D': dir = optarg; break;
+        default:
+            printf("usage: %s [-r modes] [-t threads] [-n files] [-m stream MB] [-k random ops] [-R runs]\n"
+                   "       [-O features] [-b baseline] [-w baseline] [-T threshold %%] [-D dir] [-- wfs options ...]\n", argv[0]);
+            return 2;
+        }
+    }
+    for (int i = optind; i < argc && num_wfs_args < 31; i++) {
+        wfs_args[num_wfs_args++] = argv[i];
+    }
+    if (files <= 0 || stream_mb <= 0 || rand_ops <= 0 || repeats <= 0) {
+        printf("files, stream MB, random ops and runs must be positive numbers\n");
+        return 2;
+    }
+    if (baseline_path && load_baseline(baseline_path) != 0) {
+        return 2;
+    }
+    if (dir) {
+        modes = "dir";
+    } else {
+        mkdir(mnt, 0755);
+    }
+
+    int failed = 0;
+    char *mode_list = strdup(modes);
+    for (char *mode = strtok(mode_list, ","); mode; mode = strtok(NULL, ",")) {
+        char *thread_list = strdup(threads), *save;
+        for (char *t = strtok_r(thread_list, ",", &save); t; t = strtok_r(NULL, ",", &save)) {
+            nthreads = atoi(t);
+            for (int i = 0; i < repeats; i++) {
+                if (nthreads <= 0 || run(mode, dir) != 0) {
+                    failed = 1;
+                    if (!dir && is_mounted(mnt)) {
+                        unmount_wfs();
+                    }
+                }
+            }
+        }
+        free(thread_list);
+    }
+    free(mode_list);
+
+    if (save_path && !failed && save_baseline(save_path) != 0) {
+        failed = 1;
+    }
+    int regressed = compare();
+    if (failed) {
+        printf("\nFAILED\n");
+        return 2;
+    }
+    if (regressed) {
+        printf("\n%d rates more than %.0f%% below the baseline\n", regressed, threshold);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+#!/usr/bin/python3
+
+# checks wfsck on raid1 and raid0 images. fills them through wfs, checks
+# wfsck finds nothing, then damages the metadata behind its back: a leaked
+# block, a file no directory names (an orphan) and a used block cleared in
+# the bitmap. wfsck has to find all three and -y has to repair them, after
+# which the image has to check clean and mount with every file intact. a
+# difference between the raid1 mirrors has to be found too. prints how long
+# each check took.
+#
+# usage: ./wfsck-check.py [files]
+
+import os
+import struct
+import subprocess
+import sys
+import time
+from wfstest import *
+
+files = int(sys.argv[1]) if len(sys.argv) > 1 else 200
+
+disks = disk_paths("wfsck")
+images = [
+    ("raid1", ["-r", "1"]),
+    ("raid1 extents", ["-r", "1", "-O", "dir_index,extents,dense_inodes"]),
+    ("raid0", ["-r", "0", "-O", "dir_index"]),
+]
+
+def contents(n):
+    return bytes([ord("a") + n % 26]) * (100 + n * 211 % 5000)
+
+def wfsck(*args):
+    start = time.perf_counter()
+    result = subprocess.run(["../solution/wfsck", *args, *disks], capture_output=True, text=True)
+    return result.returncode, result.stdout, time.perf_counter() - start
+
+def set_bit(f, base, i, value):
+    f.seek(base + i // 8)
+    byte = f.read(1)[0]
+    byte = byte | (1 << (i % 8)) if value else byte & ~(1 << (i % 8))
+    f.seek(base + i // 8)
+    f.write(bytes([byte]))
+
+def test_bit(f, base, i):
+    f.seek(base + i // 8)
+    return (f.read(1)[0] >> (i % 8)) & 1
+
+def damage(img):
+    """Leaks the last data block, clears the bitmap bit of a used block and makes a free inode
+    an orphan. Data bitmaps are only mirrored on raid1, the inode table on both. Returns the
+    number of the used block."""
+    last = img.num_data_blocks - 1
+    with open(disks[0], "rb") as f:
+        orphan = next(n for n in range(img.num_inodes - 1, 0, -1) if not test_bit(f, img.i_bitmap_ptr, n))
+        used = next(i for i in range(img.num_data_blocks) if test_bit(f, img.d_bitmap_ptr, i))
+    for disk in disks:
+        with open(disk, "r+b") as f:
+            if img.raid_mode != 0 or disk == disks[0]:
+                set_bit(f, img.d_bitmap_ptr, last, True)
+                set_bit(f, img.d_bitmap_ptr, used, False)
+            set_bit(f, img.i_bitmap_ptr, orphan, True)
+            f.seek(img.inode_offset(orphan))
+            f.write(struct.pack("<iI", orphan, 0o100644))
+            f.seek(img.inode_offset(orphan) + 24)
+            f.write(struct.pack("<i", 1))
+    return used
+
+def run(label, mkfs_args):
+    mkfs(disks, "16M", [*mkfs_args, "-i", "512", "-b", "8192"])
+
+    mount(disks, label=label)
+    for d in range(4):
+        os.makedirs(f"{mnt}/d{d}/sub")
+    for n in range(files):
+        with open(f"{mnt}/d{n % 4}/f{n}", "wb") as f:
+            f.write(contents(n))
+    for n in range(0, files, 5):
+        os.unlink(f"{mnt}/d{n % 4}/f{n}")
+    unmount()
+
+    errors = []
+    img = Image(disks[0])
+    rc, out, clean_time = wfsck()
+    if rc != 0:
+        errors.append(f"fresh image: exit {rc}\n{out}")
+
+    used = damage(img)
+    rc, out, _ = wfsck()
+    for expect in ("1 leaked blocks", "1 orphan inodes", "1 used blocks marked free", f"block {used} "):
+        if expect not in out:
+            errors.append(f"damaged image: no \"{expect}\" in\n{out}")
+    if rc != 4:
+        errors.append(f"damaged image: exit {rc}, expected 4")
+    rc, out, _ = wfsck("-y")
+    if rc != 1:
+        errors.append(f"repair: exit {rc}, expected 1\n{out}")
+    rc, out, _ = wfsck()
+    if rc != 0:
+        errors.append(f"repaired image: exit {rc}\n{out}")
+
+    mount(disks, label=f"{label} after repair")
+    for n in range(files):
+        path = f"{mnt}/d{n % 4}/f{n}"
+        if n % 5 == 0:
+            continue
+        try:
+            with open(path, "rb") as f:
+                if f.read() != contents(n):
+                    errors.append(f"{path}: wrong data")
+        except OSError as e:
+            errors.append(f"{path}: {e}")
+    unmount()
+
+    if img.raid_mode != 0:
+        with open(disks[1], "r+b") as f:
+            f.seek(img.inode_offset(1) + 40)
+            byte = f.read(1)[0]
+            f.seek(img.inode_offset(1) + 40)
+            f.write(bytes([byte ^ 1]))
+        rc, out, _ = wfsck()
+        if rc != 4 or "1 mirror differences" not in out:
+            errors.append(f"mirror difference: exit {rc}\n{out}")
+
+    print(f"{label:<16} {clean_time * 1000:9.1f} ms  {'ok' if not errors else 'BAD':>4}")
+    for err in errors[:5]:
+        print(f"{'':<16} {err}")
+    return not errors
+
+ok = True
+try:
+    for label, mkfs_args in images:
+        ok = run(label, mkfs_args) and ok
+finally:
+    cleanup(disks)
+exit(0 if ok else 1)
@@ -0,0 +1,73 @@
+# what the scripts in this directory share: disk images made with mkfs in
+# /tmp/$USER, wfs mounted on ./mnt, and the layout from a superblock.
+# run the scripts from this directory, after make in ../solution.
+
+import getpass
+import os
+import struct
+import subprocess
+import time
+
+diskdir = f"/tmp/{getpass.getuser()}"
+mnt = "mnt"
+
+def disk_paths(name, count=2):
+    """Paths of the images a script uses, and makes sure their directory and mnt exist"""
+    os.makedirs(diskdir, exist_ok=True)
+    os.makedirs(mnt, exist_ok=True)
+    return [f"{diskdir}/{name}-disk{i + 1}" for i in range(count)]
+
+def mkfs(disks, size, args):
+    """Makes fresh images of the given size (with a K/M/G suffix or in bytes)"""
+    for disk in disks:
+        if os.path.exists(disk):
+            os.remove(disk)
+        subprocess.run(["truncate", "-s", str(size), disk], check=True)
+    mkfs_args = [arg for disk in disks for arg in ("-d", disk)]
+    subprocess.run(["../solution/mkfs", *mkfs_args, *args], check=True)
+
+def wait_for_mount(path=mnt):
+    for _ in range(100):
+        if os.path.ismount(path):
+            return True
+        time.sleep(0.05)
+    return False
+
+def mount(disks, wfs_args=(), label="", **kwargs):
+    """Mounts the images on mnt, extra keyword arguments go to subprocess.run. Exits when the
+    mount doesn't appear."""
+    result = subprocess.run(["../solution/wfs", *disks, *wfs_args, mnt], check=True, **kwargs)
+    if not wait_for_mount(mnt):
+        print(f"{label}: mount failed")
+        exit(1)
+    return result
+
+def unmount():
+    subprocess.run(["fusermount", "-u", mnt], check=True)
+
+def cleanup(disks):
+    """Unmounts if still mounted and removes the images, for a finally: at the end"""
+    subprocess.run(["fusermount", "-uq", mnt])
+    for disk in disks:
+        if os.path.exists(disk):
+            os.remove(disk)
+
+class Image:
+    """The layout from the superblock of an image"""
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            sb = f.read(64)
+        (self.num_inodes, self.num_data_blocks, self.i_bitmap_ptr, self.d_bitmap_ptr,
+         self.i_blocks_ptr, self.d_blocks_ptr) = struct.unpack("<QQqqqq", sb[:48])
+        self.raid_mode, self.disk_id, self.features = struct.unpack("<iiI", sb[48:60])
+        self.block = 1 << sb[60] if sb[60] else 512
+        if self.i_bitmap_ptr < 64:
+            # From before the features field
+            self.features, self.block = 0, 512
+        self.dense = self.features & (1 << 3)
+
+    def inode_offset(self, num):
+        if self.dense:
+            per_block = self.block // 136
+            return self.i_blocks_ptr + num // per_block * self.block + num % per_block * 136
+        return self.i_blocks_ptr + num * self.block